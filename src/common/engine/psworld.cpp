@@ -44,6 +44,9 @@
 //=============================================================================
 #include "psworld.h"
 
+/// How many portals apart two sectors may be for WarpSpace() and Distance() to reach across.
+#define WARP_CACHE_DEPTH 3
+
 psWorld::psWorld()
 {
     regions.AttachNew(new scfStringArray());
@@ -89,23 +92,39 @@ void psWorld::GetAllRegionNames(csString& str)
     }
 }
 
+/// The warp that applies 'first' and then 'second'.
+static csReversibleTransform CombineWarps(const csReversibleTransform& first, const csReversibleTransform& second)
+{
+    // second * (first * v) = M2 * (M1 * (v - p1) - p2) = M2 * M1 * (v - (p1 + M1^-1 * p2))
+    return csReversibleTransform(second.GetO2T() * first.GetO2T(),
+                                 first.GetO2TTranslation() + first.GetT2O() * second.GetO2TTranslation());
+}
+
 void psWorld::BuildWarpCache()
 {
     int sectorCount = engine->GetSectors()->GetCount();
     Debug2(LOG_STARTUP,0,"Building warp cache for %d sectors...",sectorCount);
 
     /// Clear existing entries
-    transarray.Empty();
+    sectorIndex.DeleteAll();
+    sectors.Empty();
 
-    transarray.SetSize(sectorCount);
+    for(int i=0; i<sectorCount; i++)
+    {
+        iSector* sector = engine->GetSectors()->Get(i);
+        sectors.Push(sector);
+        sectorIndex.Put(sector, i);
+    }
 
-    csReversibleTransform identity;
+    // The warps of the portals leading out of each sector
+    csArray< csArray<DirectWarp> > direct;
+    direct.SetSize(sectorCount);
 
     for(int i=0; i<sectorCount; i++)
     {
-        const csSet<csPtrKey<iMeshWrapper> >& portals = engine->GetSectors()->Get(i)->GetPortalMeshes();
+        const csSet<csPtrKey<iMeshWrapper> >& portals = sectors[i]->GetPortalMeshes();
         Debug3(LOG_STARTUP,0," %zu portal meshes for %s",portals.GetSize(),
-            engine->GetSectors()->Get(i)->QueryObject()->GetName());
+            sectors[i]->QueryObject()->GetName());
 
         csSet<csPtrKey<iMeshWrapper> >::GlobalIterator it = portals.GetIterator ();
         while (it.HasNext ())
@@ -117,14 +136,84 @@ void psWorld::BuildWarpCache()
                 iPortal* portal = pc->GetPortal (j);
                 if (portal->CompleteSector(0))
                 {
-                    if (engine->GetSectors()->Find(portal->GetSector()) != -1)
+                    size_t* to = sectorIndex.GetElementPointer(portal->GetSector());
+                    if (to)
                     {
-                        transarray[i].Set(portal->GetSector(), portal->GetWarp());
+                        DirectWarp d;
+                        d.to = *to;
+                        d.warp = portal->GetWarp();
+                        direct[i].Push(d);
                     }
                 }
             }
         }
     }
+
+    BuildWarpCache(direct);
+}
+
+void psWorld::BuildWarpCache(const csArray< csArray<DirectWarp> >& direct)
+{
+    size_t sectorCount = sectors.GetSize();
+
+    transarray.Empty();
+    warpSources.Empty();
+    transarray.SetSize(sectorCount);
+    warpSources.SetSize(sectorCount);
+
+    // Mirrors lead back into their own sector, where positions need no warp
+    // and where a warp source would have the sector searched twice.
+    for(size_t i=0; i<sectorCount; i++)
+    {
+        for (size_t d = 0; d < direct[i].GetSize(); d++)
+        {
+            if (direct[i][d].to != i)
+                transarray[i].Set(sectors[direct[i][d].to], direct[i][d].warp);
+        }
+    }
+
+    // Sectors further away, through the sectors in between. Breadth first,
+    // so the warp through the fewest portals is kept.
+    for(size_t i=0; i<sectorCount; i++)
+    {
+        csArray<size_t> frontier;
+        for (size_t d = 0; d < direct[i].GetSize(); d++)
+        {
+            if (direct[i][d].to != i)
+                frontier.Push(direct[i][d].to);
+        }
+
+        for (int depth = 2; depth <= WARP_CACHE_DEPTH && frontier.GetSize(); depth++)
+        {
+            csArray<size_t> next;
+            for (size_t f = 0; f < frontier.GetSize(); f++)
+            {
+                size_t via = frontier[f];
+                csReversibleTransform toVia = *transarray[i].Get(sectors[via]);
+                for (size_t d = 0; d < direct[via].GetSize(); d++)
+                {
+                    size_t to = direct[via][d].to;
+                    if (to == i || transarray[i].Get(sectors[to]))
+                        continue;
+
+                    transarray[i].Set(sectors[to], CombineWarps(toVia, direct[via][d].warp));
+                    next.Push(to);
+                }
+            }
+            frontier = next;
+        }
+    }
+
+    for(size_t i=0; i<sectorCount; i++)
+    {
+        csHash<csReversibleTransform*, csPtrKey<iSector> >::GlobalIterator it = transarray[i].GetIterator();
+        while (it.HasNext())
+        {
+            csPtrKey<iSector> to;
+            it.Next(to);
+            warpSources[*sectorIndex.GetElementPointer(to)].Push(sectors[i]);
+        }
+    }
 }
 
 void psWorld::DumpWarpCache()
@@ -132,7 +221,7 @@ void psWorld::DumpWarpCache()
     for(size_t i=0; i<transarray.GetSize(); i++)
     {
         csHash<csReversibleTransform*, csPtrKey<iSector> >::GlobalIterator it =  transarray[i].GetIterator();
-        iSector * fromSector = engine->GetSectors()->Get((int)i);
+        iSector * fromSector = sectors[i];
         CPrintf(CON_CMDOUTPUT,"%s\n",fromSector->QueryObject()->GetName());
         while (it.HasNext())
         {
@@ -150,13 +239,7 @@ bool psWorld::WarpSpace(const iSector* from, const iSector* to, csVector3& pos)
     if(from == to)
         return true; // No need to transform, pos ok.
 
-    int i = engine->GetSectors()->Find((iSector*)from);
-    if (i == -1)
-    {
-        return false; // Didn't find transformation, pos not ok. 
-    }
-
-    csReversibleTransform* transform = transarray[i].Get((iSector*)to);
+    const csReversibleTransform* transform = GetWarp(from, to);
     if(transform)
     {
         pos = *transform * pos;
@@ -166,6 +249,28 @@ bool psWorld::WarpSpace(const iSector* from, const iSector* to, csVector3& pos)
     return false; // Didn't find transformation, pos not ok.
 }
 
+const csReversibleTransform* psWorld::GetWarp(const iSector* from, const iSector* to)
+{
+    const size_t* i = sectorIndex.GetElementPointer((iSector*)from);
+    if (!i)
+    {
+        return NULL;
+    }
+
+    return transarray[*i].Get((iSector*)to);
+}
+
+const csArray<iSector*>* psWorld::GetWarpSources(const iSector* to)
+{
+    const size_t* i = sectorIndex.GetElementPointer((iSector*)to);
+    if (!i || warpSources[*i].IsEmpty())
+    {
+        return NULL;
+    }
+
+    return &warpSources[*i];
+}
+
 float psWorld::Distance(const csVector3& from_pos, const iSector* from_sector, csVector3 to_pos, const iSector* to_sector)
 {
     if (from_sector == to_sector)
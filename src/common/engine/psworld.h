@@ -24,6 +24,7 @@
 // Crystal Space Includes
 //=============================================================================
 #include <csgeom/transfrm.h>
+#include <csutil/hash.h>
 #include <csutil/parray.h>
 #include <csutil/weakref.h>
 
@@ -95,9 +96,30 @@ protected:
 
     };
 
+    /// Warps from each sector, by sector index, to the sectors within WARP_CACHE_DEPTH portals.
     csArray<sectorTransformation> transarray;
+    /// Index of each sector in transarray.
+    csHash<size_t, csPtrKey<iSector> > sectorIndex;
+    /// The sector of each index.
+    csArray<iSector*> sectors;
+    /// By sector index, the sectors with a warp into that sector.
+    csArray< csArray<iSector*> > warpSources;
+
+    /// The warp of a portal and the index of the sector it leads to.
+    struct DirectWarp
+    {
+        size_t to;
+        csReversibleTransform warp;
+    };
 
+    /// Fill the cache for all sectors of the engine, from their portals.
     void BuildWarpCache();
+
+    /**
+     * Fill the cache for the sectors in 'sectors', given the warps of the
+     * portals leading out of each, by sector index.
+     */
+    void BuildWarpCache(const csArray< csArray<DirectWarp> >& direct);
 public:
     psWorld();
     ~psWorld();
@@ -111,9 +133,15 @@ public:
     /// This makes a string out of all region names, separated by | chars.
     void GetAllRegionNames(csString& str);
 
-    /// Changes pos according to the warp portal between adjacent sectors from and to.
+    /// Changes pos according to the warp portals between sectors from and to, a few portals apart at most.
     bool WarpSpace(const iSector* from, const iSector* to, csVector3& pos);
 
+    /// The transformation WarpSpace() applies between sectors from and to, NULL if they are too far apart.
+    const csReversibleTransform* GetWarp(const iSector* from, const iSector* to);
+
+    /// The sectors GetWarp() has a warp for from them into sector 'to', NULL if there are none.
+    const csArray<iSector*>* GetWarpSources(const iSector* to);
+
     /// Calculate the distance between two to points either in same or different sectors.
     float Distance(const csVector3& from_pos, const iSector* from_sector, csVector3 to_pos, const iSector* to_sector);
     
@@ -125,6 +125,7 @@ void psNetConnection::DisConnect()
     }
 
     // with proper refcounting this should kill all members of the hash
+    resendwheel.Clear();
     awaitingack.Empty();
 }
 
@@ -32,6 +32,7 @@
 #include "util/log.h"
 #include "net/packing.h"
 #include "net/pstypes.h"
+#include "net/netbufferpool.h"
 #include "util/genrefqueue.h"
 
 using namespace CS::Threading;
@@ -134,7 +135,7 @@ public:
             Debug3(LOG_NET,0,"Call to MsgEntry construction truncated data.  Requested size %u > max size %u.\n",(unsigned int)datasize,(unsigned int)MAX_MESSAGE_SIZE);
             datasize=MAX_MESSAGE_SIZE;
         }
-        bytes = (psMessageBytes*) cs_malloc(sizeof(psMessageBytes) + datasize);
+        bytes = (psMessageBytes*) psNetBufferPool::Alloc(sizeof(psMessageBytes) + datasize);
         CS_ASSERT(bytes != NULL);
 
         current = 0;
@@ -153,7 +154,7 @@ public:
 
         current = 0;
 
-        bytes = (psMessageBytes*) cs_malloc(msgsize);
+        bytes = (psMessageBytes*) psNetBufferPool::Alloc(msgsize);
         CS_ASSERT(bytes != NULL);
 
         memcpy (bytes, msg, msgsize);
@@ -169,7 +170,7 @@ public:
             Bug2("Call to MsgEntry copy constructor truncated data.  Source data > %u length.\n",MAX_MESSAGE_SIZE);
             msgsize = MAX_MESSAGE_SIZE;
         }
-        bytes = (psMessageBytes*) cs_malloc(msgsize);
+        bytes = (psMessageBytes*) psNetBufferPool::Alloc(msgsize);
         CS_ASSERT(bytes != NULL);
         memcpy (bytes, me->bytes, msgsize);
 
@@ -185,7 +186,7 @@ public:
 
     virtual ~MsgEntry()
     {
-        cs_free ((void*) bytes);
+        psNetBufferPool::Free ((void*) bytes);
     }
 
     void ClipToCurrentSize()
@@ -163,7 +163,7 @@ psAuthenticationMessage::psAuthenticationMessage(uint32_t clientnum,
     }
 
 
-    msg.AttachNew(new MsgEntry(strlen(userid)+1+strlen(password)+1+strlen(os)+1+strlen(gfxcard)+1+strlen(gfxversion)+1+sizeof(uint32_t),PRIORITY_LOW));
+    msg.AttachNew(new MsgEntry(strlen(userid)+1+strlen(password)+1+strlen(os)+1+strlen(gfxcard)+1+strlen(gfxversion)+1+sizeof(uint32_t)+sizeof(uint8_t),PRIORITY_LOW));
 
     msg->SetType(MSGTYPE_AUTHENTICATE);
     msg->clientnum      = clientnum;
@@ -174,6 +174,9 @@ psAuthenticationMessage::psAuthenticationMessage(uint32_t clientnum,
     msg->Add(os);
     msg->Add(gfxcard);
     msg->Add(gfxversion);
+    // Added at the end, so servers that don't know it just ignore it.
+    compression = true;
+    msg->Add(compression);
 
     // Sets valid flag based on message overrun state
     valid=!(msg->overrun);
@@ -190,6 +193,7 @@ psAuthenticationMessage::psAuthenticationMessage(MsgEntry *message)
     os_ = message->GetStr();
     gfxcard_ = message->GetStr();
     gfxversion_ = message->GetStr();
+    compression = !message->IsEmpty() && message->GetBool();
 
     // Sets valid flag based on message overrun state
     valid=!(message->overrun);
@@ -260,7 +260,10 @@ enum MSG_TYPES
     MSGTYPE_CACHEFILE,
     MSGTYPE_DIALOG_MENU,
     MSGTYPE_SIMPLE_STRING,
-    MSGTYPE_ORDEREDTEST
+    MSGTYPE_ORDEREDTEST,
+
+    // Wraps another message compressed by psNetCompression
+    MSGTYPE_COMPRESSED
 };
 
 class psMessageCracker;
@@ -600,6 +603,8 @@ public:
     csString  sAddr;
     csString  sUser,sPassword;
     csString  os_, gfxcard_, gfxversion_;
+    /// The sender can inflate MSGTYPE_COMPRESSED messages. False for old clients.
+    bool      compression;
 
     /**
      * This function creates a PS Message struct given a userid and
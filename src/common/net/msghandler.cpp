@@ -54,58 +54,51 @@ bool MsgHandler::Initialize(NetBase* nb, int queuelen)
 
 void MsgHandler::Publish(MsgEntry* me)
 {
-    CS::Threading::RecursiveMutexScopedLock lock(mutex);
-
     netbase->LogMessages('R',me);
 
-    bool handled = false;
-
     int mtype = me->GetType();
 
-    for ( size_t x = 0; x < subscribers[mtype].GetSize(); x++ )
+    // Take a reference to the current subscribers, the list itself is never
+    // changed so the lock doesn't have to be held across the callbacks.
+    csRef<SubscriberList> list;
+    {
+        CS::Threading::RecursiveMutexScopedLock lock(mutex);
+        list = subscribers[mtype];
+    }
+
+    if (!list || list->subscriptions.IsEmpty())
+    {
+        Debug4(LOG_ANY,me->clientnum,"Unhandled message received 0x%04X(%d) from %d",
+               me->GetType(), me->GetType(), me->clientnum);
+        return;
+    }
+
+    for ( size_t x = 0; x < list->subscriptions.GetSize(); x++ )
     {
+        Subscription *sub = list->subscriptions[x];
         Client *client;
         me->Reset();
 		// Copy the reference so we can modify it in the loop
 		MsgEntry *message = me;
-        if (subscribers[mtype][x]->subscriber->Verify(message,subscribers[mtype][x]->flags,client))
+        if (sub->subscriber->Verify(message,sub->flags,client))
         {
-            if (subscribers[mtype][x]->callback)
-	            subscribers[mtype][x]->callback->Call(message,client);
+            if (sub->callback)
+	            sub->callback->Call(message,client);
 		    else
-			    subscribers[mtype][x]->subscriber->HandleMessage(message,client);
+			    sub->subscriber->HandleMessage(message,client);
         }
-        handled = true;
-    }
-
-    if (!handled)
-    {
-        Debug4(LOG_ANY,me->clientnum,"Unhandled message received 0x%04X(%d) from %d",
-               me->GetType(), me->GetType(), me->clientnum);
     }
 }
 
 bool MsgHandler::Subscribe(iNetSubscriber *subscriber, msgtype type,uint32_t flags)
 {
-    Subscription* p = new Subscription;
-
-    p->subscriber = subscriber;
-    p->callback   = NULL; 
-    p->type       = type;
-    p->flags      = flags;
-
-    CS::Threading::RecursiveMutexScopedLock lock(mutex);
-    if ( IsSubscribed(p) )
-        delete p;
-    else
-        subscribers[type].Push(p);
-
-    return true;
+    return Subscribe(subscriber, NULL, type, flags);
 }
 
 bool MsgHandler::Subscribe(iNetSubscriber *subscriber, MsgtypeCallback *callback, msgtype type,uint32_t flags)
 {
-    Subscription* p = new Subscription;
+    csRef<Subscription> p;
+    p.AttachNew(new Subscription);
 
     p->subscriber = subscriber;
     p->callback   = callback;
@@ -113,14 +106,9 @@ bool MsgHandler::Subscribe(iNetSubscriber *subscriber, MsgtypeCallback *callback
     p->flags      = flags;
 
     CS::Threading::RecursiveMutexScopedLock lock(mutex);
-    if ( IsSubscribed(p) )
-    {
-        if (p->callback)
-            delete p->callback;
-        delete p;
-    }
-    else
-        subscribers[type].Push(p);
+    // A duplicate is dropped with its functor
+    if ( !IsSubscribed(p) )
+        ChangeSubscribers(type, p, NULL);
 
     return true;
 }
@@ -129,12 +117,14 @@ bool MsgHandler::Unsubscribe(iNetSubscriber *subscriber, msgtype type)
 {
     CS::Threading::RecursiveMutexScopedLock lock(mutex);
 
-    for ( size_t x = 0; x < subscribers[type].GetSize(); x++ )
+    if (!subscribers[type])
+        return false;
+
+    for ( size_t x = 0; x < subscribers[type]->subscriptions.GetSize(); x++ )
     {
-        if (subscribers[type][x]->subscriber == subscriber)
+        if (subscribers[type]->subscriptions[x]->subscriber == subscriber)
         {
-            delete subscribers[type][x]->callback; // delete functor if present
-            subscribers[type].DeleteIndex(x);
+            ChangeSubscribers(type, NULL, subscriber);
             return true;
         }        
     }
@@ -142,12 +132,36 @@ bool MsgHandler::Unsubscribe(iNetSubscriber *subscriber, msgtype type)
     return false;
 }
 
+void MsgHandler::ChangeSubscribers(msgtype type, Subscription* add, iNetSubscriber* remove)
+{
+    csRef<SubscriberList> list;
+    list.AttachNew(new SubscriberList);
+
+    if (subscribers[type])
+    {
+        for ( size_t x = 0; x < subscribers[type]->subscriptions.GetSize(); x++ )
+        {
+            Subscription* sub = subscribers[type]->subscriptions[x];
+            if (sub->subscriber != remove)
+                list->subscriptions.Push(sub);
+        }
+    }
+    if (add)
+        list->subscriptions.Push(add);
+
+    subscribers[type] = list;
+}
+
 
 bool MsgHandler::IsSubscribed( Subscription* sub )
 {
-    for ( size_t x = 0; x < subscribers[sub->type].GetSize(); x++ )
+    SubscriberList* list = subscribers[sub->type];
+    if (!list)
+        return false;
+
+    for ( size_t x = 0; x < list->subscriptions.GetSize(); x++ )
     {
-        if (subscribers[sub->type][x]->subscriber == sub->subscriber)
+        if (list->subscriptions[x]->subscriber == sub->subscriber)
         {
             return true;
         }        
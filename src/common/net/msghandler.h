@@ -20,6 +20,7 @@
 #define __MSGHANDLER_H__
 
 #include <csutil/parray.h>
+#include <csutil/refarr.h>
 #include <csutil/refcount.h>
 #include <csutil/threading/thread.h>
 
@@ -77,7 +78,7 @@ class NetMessageCallback : public MsgtypeCallback
 
 
 /// This little struct tracks who is interested in what.
-struct Subscription
+struct Subscription : public csSyncRefCount
 {
     /// type of the messages this listener listens to
     msgtype type;
@@ -90,6 +91,18 @@ struct Subscription
 
     /// pointer to functor class callback as alternative to iNetSubscriber
     MsgtypeCallback *callback;
+
+    ~Subscription() { delete callback; }
+};
+
+/**
+ * The subscribers of one message type. A list is never changed once
+ * in use, Subscribe() and Unsubscribe() replace it, so Publish() can
+ * call the subscribers without holding the lock.
+ */
+struct SubscriberList : public csSyncRefCount
+{
+    csRefArray<Subscription> subscriptions;
 };
 
 
@@ -172,11 +185,15 @@ protected:
     NetBase                       *netbase;
     MsgQueue                      *queue;
 
+    /// Replace the subscribers of a type with a copy that has 'add' added and 'remove' removed.
+    void ChangeSubscribers(msgtype type, Subscription* add, iNetSubscriber* remove);
+
     /** 
      * Each message type now has an array of subscribers so we can publish 
      * to them directly instead of searching the entire list of all subscribers.
      */
-    csPDelArray<Subscription>      subscribers[MAX_MESSAGE_TYPES];
+    csRef<SubscriberList>          subscribers[MAX_MESSAGE_TYPES];
+    /// Guards swapping the subscriber lists, not held while publishing.
     CS::Threading::RecursiveMutex  mutex;
 };
 
@@ -39,6 +39,8 @@
 #include "util/pserror.h"
 #include "net/netbase.h"
 #include "net/netpacket.h"
+#include "net/netbufferpool.h"
+#include "net/netcompress.h"
 #include "net/message.h"
 #include "net/messages.h"
 #include "util/psscf.h"
@@ -55,7 +57,7 @@ int NetBase::socklibrefcount=0;
 const float TEST_PACKETLOSS = 0.0f;
 
 NetBase::NetBase(int outqueuesize)
-: senders(outqueuesize)
+: senders(outqueuesize), resendwheel(RESENDWHEELRESOLUTION, csGetTicks())
 {
     randomgen = new csRandomGen;
     
@@ -91,6 +93,20 @@ NetBase::NetBase(int outqueuesize)
     logmsgfiltersetting.send = false;
 
     input_buffer = NULL;
+
+    compressthreshold = 0;
+    memset(compresstypes, 0, sizeof(compresstypes));
+
+#ifdef USE_BATCHED_IO
+    batchedio = true;
+    epollfd = -1;
+    rxcount = rxpos = txcount = 0;
+    for (int i = 0; i < NETBATCHSIZE; i++)
+        rxbuf[i] = NULL;
+#else
+    batchedio = false;
+#endif
+
     for(int i=0;i < NETAVGCOUNT;i++)
     {
         sendStats[i].senders = sendStats[i].messages = sendStats[i].time = 0;
@@ -119,8 +135,12 @@ NetBase::~NetBase()
     
     delete profs;
 
-    if (input_buffer)
-        cs_free(input_buffer);
+    psNetBufferPool::Free(input_buffer);
+
+#ifdef USE_BATCHED_IO
+    for (int i = 0; i < NETBATCHSIZE; i++)
+        psNetBufferPool::Free(rxbuf[i]);
+#endif
 }
 
 /* add a Message Queue */
@@ -144,6 +164,11 @@ void NetBase::ProcessNetwork (csTicks timeout)
         // Outgoing packets from a queue go on the wire.
         ) && csGetTicks() <= timeout
         );
+
+#ifdef USE_BATCHED_IO
+    // Acks queued while receiving must not wait for the next round.
+    FlushBatchedSend();
+#endif
 }
 
 bool NetBase::CheckIn()
@@ -156,11 +181,11 @@ bool NetBase::CheckIn()
 
     if (!input_buffer)
     {
-        input_buffer = (char*) cs_malloc(MAXPACKETSIZE);
+        input_buffer = (char*) psNetBufferPool::Alloc(MAXPACKETSIZE);
 
         if (!input_buffer)
         {
-            Error2("Failed to cs_malloc %d bytes for packet buffer!\n",MAXPACKETSIZE);
+            Error2("Failed to allocate %d bytes for packet buffer!\n",MAXPACKETSIZE);
             return false;
         }
     }
@@ -168,7 +193,13 @@ bool NetBase::CheckIn()
     // Connection must be initialized!
     CS_ASSERT(ready);
     
+#ifdef USE_BATCHED_IO
+    // Without an epoll instance (see Init) the select path is used.
+    int packetlen = (batchedio && epollfd >= 0) ? RecvBatched (&addr, input_buffer) :
+        RecvFrom (&addr, &len, (void*) input_buffer, MAXPACKETSIZE);
+#else
     int packetlen = RecvFrom (&addr, &len, (void*) input_buffer, MAXPACKETSIZE);
+#endif
 
     if (packetlen <= 0)
     {
@@ -299,11 +330,12 @@ bool NetBase::CheckIn()
 
 bool NetBase::Flush(MsgQueue * queue)
 {
-    //@@@ Dirty, hack, this might be in a diffrent thread
-    //@@@ need to syncronize this in some way. But at least
-    //@@@ by moving this here the client code dosn't call
-    //@@@ SendOut anymore.
+    // Usually not the network thread, SendOut() takes the send mutex
+    CS::Threading::RecursiveMutexScopedLock lock(sendmutex);
     SendOut();
+#ifdef USE_BATCHED_IO
+    FlushBatchedSend();
+#endif
 
     return true;
 }
@@ -378,7 +410,7 @@ bool NetBase::HandleAck(csRef<psNetPacketEntry> pkt, Connection* connection,
 
 
 
-            if (!awaitingack.Delete(PacketKey(pkt->clientnum, pkt->packet->pktid), ack))
+            if (!RemoveAwaitingAck(ack))
             {
 #ifdef PACKETDEBUG
                 Debug2(LOG_NET,0,"No packet in ack queue :%d\n", ack->packet->pktid);
@@ -446,8 +478,6 @@ bool NetBase::CheckDoublePackets(Connection* connection, csRef<psNetPacketEntry>
 
 void NetBase::CheckResendPkts()
 {
-	// NOTE: Globaliterators on csHash do not retrieve keys contiguously.
-    csHash<csRef<psNetPacketEntry> , PacketKey>::GlobalIterator it(awaitingack.GetIterator());
     csRef<psNetPacketEntry> pkt;
     csArray<csRef<psNetPacketEntry> > pkts;
     csArray<Connection*> resentConnections;
@@ -455,13 +485,9 @@ void NetBase::CheckResendPkts()
     csTicks currenttime = csGetTicks();
     unsigned int resentCount = 0;
 
-    while(it.HasNext())
-    {
-        pkt = it.Next();
-        // Check the connection packet timeout
-        if (pkt->timestamp + MIN(PKTMAXRTO, pkt->RTO) < currenttime)
-            pkts.Push(pkt);
-    }
+    // Only the packets whose RTO expired are returned, no need to scan the pool.
+    GetExpiredPkts(currenttime, pkts);
+
     for (size_t i = 0; i < pkts.GetSize(); i++)
     {
         pkt = pkts.Get(i);
@@ -493,7 +519,7 @@ void NetBase::CheckResendPkts()
             //printf("pkt=%p, pkt->packet=%p\n",pkt,pkt->packet);
             // take out of awaiting ack pool.
             // This does NOT delete the pkt mem block itself.
-            if (!awaitingack.Delete(PacketKey(pkt->clientnum, pkt->packet->pktid), pkt))
+            if (!RemoveAwaitingAck(pkt))
             {
 #ifdef PACKETDEBUG
                 Debug2(LOG_NET,0,"No packet in ack queue :%d\n", pkt->packet->pktid);
@@ -502,6 +528,11 @@ void NetBase::CheckResendPkts()
             else if(connection)
             	connection->RemoveFromWindow(pkt->packet->GetPacketSize());
         }
+        else
+        {
+            // Still awaiting ack, try again when the new RTO expires.
+            ScheduleResend(pkt, pkt->timestamp + MIN(PKTMAXRTO, pkt->RTO));
+        }
     }
 
     if(resentCount > 0)
@@ -537,6 +568,34 @@ void NetBase::CheckResendPkts()
 }
     
 
+void NetBase::AddAwaitingAck(csRef<psNetPacketEntry> pkt)
+{
+    awaitingack.Put(PacketKey(pkt->clientnum, pkt->packet->pktid), pkt);
+    ScheduleResend(pkt, pkt->timestamp + MIN(PKTMAXRTO, pkt->RTO));
+}
+
+bool NetBase::RemoveAwaitingAck(csRef<psNetPacketEntry> pkt)
+{
+    resendwheel.Remove(pkt);
+    return awaitingack.Delete(PacketKey(pkt->clientnum, pkt->packet->pktid), pkt);
+}
+
+void NetBase::ScheduleResend(psNetPacketEntry* pkt, csTicks when)
+{
+    // A packet is resent once the current time is past its deadline.
+    resendwheel.Schedule(pkt, when + 1);
+}
+
+void NetBase::GetExpiredPkts(csTicks now, csArray<csRef<psNetPacketEntry> > &pkts)
+{
+    csArray<psNetPacketEntry*> expired;
+    resendwheel.Advance(now, expired);
+
+    // The wheel does not hold references, the awaiting ack pool does.
+    for (size_t i = 0; i < expired.GetSize(); i++)
+        pkts.Push(expired[i]);
+}
+
 bool NetBase::SendMergedPackets(NetPacketQueue *q)
 {
     csRef<psNetPacketEntry> queueget;
@@ -616,7 +675,7 @@ bool NetBase::SendSinglePacket(csRef<psNetPacketEntry> pkt)
         	connection->sends++;
         	// Set timeout for resending.
         	pkt->RTO = connection->RTO;
-        	awaitingack.Put(PacketKey(pkt->clientnum, pkt->packet->pktid), pkt);
+        	AddAwaitingAck(pkt);
         }
     }
 
@@ -653,6 +712,43 @@ bool NetBase::SendFinalPacket(csRef<psNetPacketEntry> pkt, LPSOCKADDR_IN addr)
 
 	// printf("Sending packet sequence %d, length %d on the wire.\n", pkt->packet->GetSequence(),pkt->packet->GetPacketSize() );
 
+#ifdef USE_BATCHED_IO
+    if (batchedio)
+        return QueueBatchedSend(pkt, addr);
+#endif
+
+    return SendPacketTo(pkt, addr);
+}
+
+bool NetBase::SendFinalPacketNow(csRef<psNetPacketEntry> pkt)
+{
+    Connection* connection = GetConnByNum(pkt->clientnum);
+    if (!connection)
+        return false;
+
+    if(pkt->packet->pktid == 0)
+    {
+        pkt->packet->pktid = connection->GetNextPacketID();
+    }
+    return SendPacketTo(pkt,&(connection->addr));
+}
+
+bool NetBase::SendPacketTo(csRef<psNetPacketEntry> pkt, LPSOCKADDR_IN addr)
+{
+    if (pkt->IsShared())
+    {
+        // Put the header and the shared data together for the wire.
+        char buf[MAXPACKETSIZE];
+        uint16_t size = (uint16_t)pkt->CopyPacketTo(buf);
+        int err = SendTo (addr, buf, size);
+        if (err != (int)size )
+        {
+            Error4("Send error %d: %d bytes sent and %d bytes expected to be sent.\n", errno,err,size);
+            return false;
+        }
+        return true;
+    }
+
     uint16_t size = (uint16_t)pkt->packet->GetPacketSize();
     void *data = pkt->GetData();
 
@@ -672,6 +768,7 @@ bool NetBase::SendFinalPacket(csRef<psNetPacketEntry> pkt, LPSOCKADDR_IN addr)
 
 bool NetBase::SendOut()
 {
+    CS::Threading::RecursiveMutexScopedLock lock(sendmutex);
     bool sent_anything = false;
     csTicks begin = csGetTicks();
 
@@ -746,6 +843,10 @@ bool NetBase::SendOut()
     if(senderCount > 0)
         avgIndex = (avgIndex + 1) % NETAVGCOUNT;
 
+#ifdef USE_BATCHED_IO
+    FlushBatchedSend();
+#endif
+
     return sent_anything;
 }
 
@@ -775,6 +876,27 @@ bool NetBase::Init(bool autobind)
         return false;
     }
 
+#ifdef USE_BATCHED_IO
+    epollfd = epoll_create(2);
+    if (epollfd < 0)
+    {
+        Error2("epoll_create failed with errno=%d, falling back to select",errno);
+    }
+    else
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = mysocket;
+        epoll_ctl(epollfd, EPOLL_CTL_ADD, mysocket, &ev);
+        if (pipe_fd[0] > 0)
+        {
+            ev.data.fd = pipe_fd[0];
+            epoll_ctl(epollfd, EPOLL_CTL_ADD, pipe_fd[0], &ev);
+        }
+    }
+#endif
+
     if (autobind)
     {
         if (!Bind ((int) INADDR_ANY, 0))
@@ -820,12 +942,185 @@ bool NetBase::Bind (int addr, int port)
 
 void NetBase::Close(bool force)
 {
+#ifdef USE_BATCHED_IO
+    if (ready)
+        FlushBatchedSend();
+    if (epollfd >= 0)
+    {
+        close(epollfd);
+        epollfd = -1;
+    }
+    rxcount = rxpos = 0;
+#endif
+
     if (ready || force)
         SOCK_CLOSE(mysocket); 
 
     ready = false;
 }
 
+void NetBase::SetBatchedIO(bool enable)
+{
+#ifdef USE_BATCHED_IO
+    FlushBatchedSend();
+    batchedio = enable;
+#else
+    (void) enable;
+#endif
+}
+
+#ifdef USE_BATCHED_IO
+int NetBase::RecvBatched(LPSOCKADDR_IN addr, char* &buf)
+{
+    if (rxpos == rxcount)
+    {
+        rxpos = rxcount = 0;
+
+        struct epoll_event events[2];
+        int timeoutms = timeout.tv_sec * 1000 + timeout.tv_usec / 1000;
+        int n = epoll_wait(epollfd, events, 2, timeoutms);
+
+        bool readable = false;
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.fd == pipe_fd[0])
+            {
+                char throwaway[32];
+                if(read(pipe_fd[0], throwaway, 32) == -1)
+                {
+                   Error1("Read failed!");
+                }
+            }
+            else
+                readable = true;
+        }
+        if (!readable)
+            return 0;
+
+        for (int i = 0; i < NETBATCHSIZE; i++)
+        {
+            if (!rxbuf[i])
+                rxbuf[i] = (char*) psNetBufferPool::Alloc(MAXPACKETSIZE);
+
+            rxiov[i].iov_base = rxbuf[i];
+            rxiov[i].iov_len = MAXPACKETSIZE;
+            memset(&rxmsgs[i].msg_hdr, 0, sizeof(rxmsgs[i].msg_hdr));
+            rxmsgs[i].msg_hdr.msg_name = &rxaddr[i];
+            rxmsgs[i].msg_hdr.msg_namelen = sizeof(SOCKADDR_IN);
+            rxmsgs[i].msg_hdr.msg_iov = &rxiov[i];
+            rxmsgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int received = recvmmsg(mysocket, rxmsgs, NETBATCHSIZE, MSG_DONTWAIT, NULL);
+        if (received <= 0)
+            return 0;
+        rxcount = received;
+    }
+
+    int i = rxpos++;
+    int len = (int) rxmsgs[i].msg_len;
+    *addr = rxaddr[i];
+
+    // Hand the datagram over and keep the caller's buffer for the next batch.
+    char* tmp = buf;
+    buf = rxbuf[i];
+    rxbuf[i] = tmp;
+
+    totaltransferin += len;
+    totalcountin++;
+    return len;
+}
+
+bool NetBase::QueueBatchedSend(csRef<psNetPacketEntry> pkt, LPSOCKADDR_IN addr)
+{
+    CS::Threading::RecursiveMutexScopedLock lock(sendmutex);
+    if (txcount == NETBATCHSIZE)
+        FlushBatchedSend();
+
+    txpkts[txcount] = pkt;
+    txaddr[txcount] = *addr;
+    txcount++;
+    return true;
+}
+
+void NetBase::FlushBatchedSend()
+{
+    CS::Threading::RecursiveMutexScopedLock lock(sendmutex);
+    if (!txcount)
+        return;
+
+    for (int i = 0; i < txcount; i++)
+    {
+        psNetPacketEntry* pkt = txpkts[i];
+        struct iovec* iov = &txiov[2 * i];
+        size_t iovlen = 1;
+        size_t size = pkt->packet->GetPacketSize();
+        if (pkt->IsShared() && size > sizeof(psNetPacket))
+        {
+            // Header from the packet, data straight from the shared payload.
+            iov[0].iov_base = pkt->GetData();
+            iov[0].iov_len = sizeof(psNetPacket);
+            iov[1].iov_base = (void*) pkt->GetPacketData();
+            iov[1].iov_len = size - sizeof(psNetPacket);
+            iovlen = 2;
+        }
+        else
+        {
+            iov[0].iov_base = pkt->GetData();
+            iov[0].iov_len = size;
+        }
+        pkt->packet->MarshallEndian();
+
+        memset(&txmsgs[i].msg_hdr, 0, sizeof(txmsgs[i].msg_hdr));
+        txmsgs[i].msg_hdr.msg_name = &txaddr[i];
+        txmsgs[i].msg_hdr.msg_namelen = sizeof(SOCKADDR_IN);
+        txmsgs[i].msg_hdr.msg_iov = iov;
+        txmsgs[i].msg_hdr.msg_iovlen = iovlen;
+    }
+
+    int sent = 0;
+    int retries = 0;
+    while (sent < txcount)
+    {
+        int n = sendmmsg(mysocket, txmsgs + sent, txcount - sent, 0);
+        if (n > 0)
+        {
+            for (int i = sent; i < sent + n; i++)
+            {
+                totaltransferout += txmsgs[i].msg_len;
+                totalcountout++;
+            }
+            sent += n;
+        }
+        else if ((errno == EAGAIN || errno == EWOULDBLOCK) && retries++ < SENDTO_MAX_RETRIES)
+        {
+            // Wait for the socket buffer to drain, as SendTo does.
+            fd_set wfds;
+            struct timeval wait;
+            FD_ZERO(&wfds);
+            FD_SET(mysocket,&wfds);
+            wait.tv_sec=SENDTO_SELECT_TIMEOUT_SEC;
+            wait.tv_usec=SENDTO_SELECT_TIMEOUT_USEC;
+            SOCK_SELECT(mysocket+1,NULL,&wfds,NULL,&wait);
+        }
+        else
+        {
+            // Only the first packet failed, skip it and carry on.
+            Error3("NetBase::FlushBatchedSend() gave up sending a packet with errno=%d, %d more queued.",
+                errno, txcount - sent - 1);
+            sent++;
+        }
+    }
+
+    for (int i = 0; i < txcount; i++)
+    {
+        txpkts[i]->packet->UnmarshallEndian();
+        txpkts[i] = NULL;
+    }
+    txcount = 0;
+}
+#endif
+
 int NetBase::GetIPByName(LPSOCKADDR_IN addr, const char *name)
 {
     struct hostent *hentry;
@@ -923,6 +1218,7 @@ csString NetBase::LogMessageFilter(char *arg)
 
 void NetBase::AddFilterLogMessage(int type)
 {
+    CS::Threading::MutexScopedLock lock(logmsgfiltermutex);
     size_t n;
     for (n = 0; n < logmessagefilter.GetSize(); n++)
     {
@@ -937,6 +1233,7 @@ void NetBase::AddFilterLogMessage(int type)
 
 void NetBase::RemoveFilterLogMessage(int type)
 {
+    CS::Threading::MutexScopedLock lock(logmsgfiltermutex);
     size_t n;
     for (n = 0; n < logmessagefilter.GetSize(); n++)
     {
@@ -947,6 +1244,7 @@ void NetBase::RemoveFilterLogMessage(int type)
 
 void NetBase::LogMessageFilterClear()
 {
+    CS::Threading::MutexScopedLock lock(logmsgfiltermutex);
     logmessagefilter.DeleteAll();
 }
 
@@ -965,6 +1263,7 @@ bool NetBase::FilterLogMessage(int type, char dir)
         return true;
     }
     
+    CS::Threading::MutexScopedLock lock(logmsgfiltermutex);
     for (n = 0; n < logmessagefilter.GetSize(); n++)
     {
         if (logmessagefilter[n] == type) result = true;
@@ -987,6 +1286,7 @@ void NetBase::LogMessageFilterDump()
     CPrintf(CON_CMDOUTPUT,"Filter receive : %s\n",(logmsgfiltersetting.receive?"true":"false"));
     CPrintf(CON_CMDOUTPUT,"Filter send    : %s\n",(logmsgfiltersetting.send?"true":"false"));
     CPrintf(CON_CMDOUTPUT,"Filter msgs    :\n");
+    CS::Threading::MutexScopedLock lock(logmsgfiltermutex);
     for (n = 0; n < logmessagefilter.GetSize(); n++)
     {
         CPrintf(CON_CMDOUTPUT,"%s(%d)\n",GetMsgTypeName(logmessagefilter[n]).GetDataSafe(),logmessagefilter[n]);
@@ -1005,6 +1305,11 @@ bool NetBase::SendMessage(MsgEntry* me)
 }
 
 bool NetBase::SendMessage(MsgEntry* me,NetPacketQueueRefCount *queue)
+{
+    return SendMessage(me,queue,NULL);
+}
+
+bool NetBase::SendMessage(MsgEntry* me,NetPacketQueueRefCount *queue,psNetSharedPayload *payload)
 {
     profs->AddSentMsg(me);
 
@@ -1029,8 +1334,12 @@ bool NetBase::SendMessage(MsgEntry* me,NetPacketQueueRefCount *queue)
         char notify = '!';
 
         csRef<psNetPacketEntry> pNewPkt;
-        pNewPkt.AttachNew(new psNetPacketEntry(me->priority, me->clientnum, id, (uint16_t)offset,
-          (uint16_t)me->bytes->GetTotalSize(), (uint16_t)pktlen, me->bytes));
+        if (payload)
+            pNewPkt.AttachNew(new psNetPacketEntry(me->priority, me->clientnum, id, (uint16_t)offset,
+              (uint16_t)me->bytes->GetTotalSize(), (uint16_t)pktlen, payload));
+        else
+            pNewPkt.AttachNew(new psNetPacketEntry(me->priority, me->clientnum, id, (uint16_t)offset,
+              (uint16_t)me->bytes->GetTotalSize(), (uint16_t)pktlen, me->bytes));
 
 		//if (me->GetSequenceNumber())
 		//	printf("Just created packet with sequence number %d.\n", me->GetSequenceNumber());
@@ -1320,6 +1629,19 @@ bool NetBase::QueueMessage(MsgEntry *me)
 void NetBase::HandleCompletedMessage(MsgEntry *me, Connection* &connection,
                                      LPSOCKADDR_IN addr,csRef<psNetPacketEntry> pkt)
 {
+    // Nothing above the network layer gets to see compressed messages.
+    csRef<MsgEntry> inflated;
+    if (me->bytes->type == MSGTYPE_COMPRESSED)
+    {
+        inflated = psNetCompression::Decompress(me);
+        if (!inflated)
+        {
+            Debug1(LOG_NET,connection ? connection->clientnum : 0,"Dropping compressed message that could not be inflated.\n");
+            return;
+        }
+        me = inflated;
+    }
+
     profs->AddReceivedMsg(me);
     
     if (!connection)
@@ -1381,6 +1703,7 @@ NetBase::Connection::Connection(uint32_t num): sequence(1), packethistoryhash(MA
     devRTT = 0;
     sends = 0;
     resends = 0;
+    compression = false;
 
     RTO = PKTINITRTO;
 
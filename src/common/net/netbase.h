@@ -26,6 +26,7 @@
 #include "net/netinfos.h"
 #include "net/netpacket.h"
 #include "util/genrefqueue.h"
+#include "util/timerwheel.h"
 #include <csutil/ref.h>
 #include <csutil/weakref.h>
 #include <csutil/weakreferenced.h>
@@ -42,6 +43,8 @@
                                  // of the input queue
 #define NETAVGCOUNT 400
 #define RESENDAVGCOUNT 200
+#define RESENDWHEELRESOLUTION 10 // Granularity in ticks of the resend timer wheel
+#define NETBATCHSIZE 32 // Datagrams moved per system call with batched I/O
 
 const unsigned int WINDOW_MAX_SIZE = 65536; // The size of the maximum reliable window in bytes.
 
@@ -129,6 +132,13 @@ public:
     virtual bool SendMessage (MsgEntry* me);
     virtual bool SendMessage (MsgEntry* me,NetPacketQueueRefCount *queue);
 
+    /**
+     * Put a message into the given queue using an already built payload.
+     * The packets only get a header of their own and share the payload
+     * data, so a message going to many clients is copied only once.
+     */
+    bool SendMessage (MsgEntry* me,NetPacketQueueRefCount *queue,psNetSharedPayload *payload);
+
     /**
      * Broadcast a message, DON'T USE this function, it's only for MsgHandler!
      */
@@ -158,7 +168,10 @@ public:
      */
     void ProcessNetwork (csTicks timeout);
 
-    /** sendOut sends the next packet in the outgoing message queue */
+    /**
+     * sendOut sends the next packet in the outgoing message queue.
+     * Called by the network thread and through Flush() by others.
+     */
     bool SendOut(void);
 
     /** this receives an Incoming Packet and analyses it */
@@ -172,6 +185,30 @@ public:
      */
     bool Flush(MsgQueue * queue);
 
+    /**
+     * Use recvmmsg/sendmmsg and epoll to move many datagrams per system
+     * call. Only has an effect where USE_BATCHED_IO is available, elsewhere
+     * the one datagram per call path is always used. Call before Bind().
+     */
+    void SetBatchedIO(bool enable);
+    bool IsBatchedIO() { return batchedio; }
+
+    /**
+     * Compress outgoing messages of the types marked with SetCompressedType()
+     * once their payload is at least 'threshold' bytes. 0 turns compression
+     * off. Only connections that asked for compression get compressed
+     * messages, see Connection::compression.
+     */
+    void SetCompressionThreshold(size_t threshold) { compressthreshold = threshold; }
+    void SetCompressedType(msgtype type, bool compress) { compresstypes[type] = compress; }
+
+    /// Should this message be compressed for connections that support it?
+    bool ShouldCompress(MsgEntry* me)
+    {
+        return compressthreshold && compresstypes[me->bytes->type] &&
+            me->bytes->GetSize() >= compressthreshold;
+    }
+
     /** Binds the socket to the specified address (only needed on server */
     bool Bind(const char* addr, int port);
     bool Bind(int addr, int port);
@@ -434,6 +471,26 @@ protected:
     }
 
 
+#ifdef USE_BATCHED_IO
+    /**
+     * Batched version of RecvFrom. Receives up to NETBATCHSIZE datagrams
+     * with one recvmmsg call and hands them out one by one. The datagram is
+     * returned by swapping 'buf' (a MAXPACKETSIZE psNetBufferPool buffer)
+     * with the receive buffer, so no data is copied.
+     */
+    int RecvBatched(LPSOCKADDR_IN addr, char* &buf);
+
+    /**
+     * Batched version of SendTo. The packet is sent with the next
+     * FlushBatchedSend(), which happens when the batch is full or at the
+     * end of each SendOut().
+     */
+    bool QueueBatchedSend(csRef<psNetPacketEntry> pkt, LPSOCKADDR_IN addr);
+
+    /** Send all packets queued by QueueBatchedSend with sendmmsg. */
+    void FlushBatchedSend();
+#endif
+
     /**
      * some helper functions... the getConnBy functions should be reimplemented
      * in the client/server classes.
@@ -469,6 +526,31 @@ protected:
      */
     void CheckResendPkts(void);
 
+    /**
+     * Add a sent packet to the pool of packets awaiting ack and schedule
+     * its resend for when its RTO expires.
+     */
+    void AddAwaitingAck(csRef<psNetPacketEntry> pkt);
+
+    /**
+     * Take a packet out of the awaiting ack pool and cancel its resend.
+     * @return False if the packet was not in the pool.
+     */
+    bool RemoveAwaitingAck(csRef<psNetPacketEntry> pkt);
+
+    /**
+     * Reschedule the resend of a packet still awaiting ack after its
+     * timestamp or RTO has been changed.
+     */
+    void ScheduleResend(psNetPacketEntry* pkt, csTicks when);
+
+    /**
+     * Collect the packets awaiting ack whose RTO has expired. Only the
+     * expired packets are touched, not the whole pool.  The packets stay
+     * in the awaiting ack pool but are no longer scheduled for resend.
+     */
+    void GetExpiredPkts(csTicks now, csArray<csRef<psNetPacketEntry> > &pkts);
+
     /**
      * This takes incoming packets and rebuilds psMessages from them. If/when a
      * complete message is reassembled, it calls HandleCompletedMessage().
@@ -527,18 +609,39 @@ protected:
      */
     bool SendFinalPacket(csRef<psNetPacketEntry> pkt, LPSOCKADDR_IN addr);
 
+    /**
+     * Send packet to the clientnum given by clientnum in psNetPacketEntry
+     * right away, even with batched I/O. For use outside the network thread.
+     */
+    bool SendFinalPacketNow(csRef<psNetPacketEntry> pkt);
+
+    /**
+     * Put the packet on the wire with SendTo
+     */
+    bool SendPacketTo(csRef<psNetPacketEntry> pkt, LPSOCKADDR_IN addr);
+
     /** Outgoing message queue */
     csRef<NetPacketQueueRefCount> NetworkQueue;
 
     /** weak referenced list of outbound queues with waiting data so disconnected clients won't receive packets*/
     GenericRefQueue<NetPacketQueueRefCount, csWeakRef > senders;
 
+    /** The outbound queues allow only one consumer at a time. Held by
+     *  SendOut() and around the batched send buffer.
+     */
+    CS::Threading::RecursiveMutex sendmutex;
+
     /** Incoming message queue vector */
     csArray<MsgQueue*> inqueues;
 
     /** Packets Awaiting Ack pool */
     csHash<csRef<psNetPacketEntry>, PacketKey> awaitingack;
 
+    /** Resend deadlines of the packets in awaitingack, ordered by expiry.
+     *  Must be declared after awaitingack so it is emptied before the pool.
+     */
+    TimerWheel<psNetPacketEntry> resendwheel;
+
     /** System Socket lib initialized? */
     static int socklibrefcount;
 
@@ -573,6 +676,32 @@ private:
     /** a pipe to wake up from the select call when data is ready to be written */
     SOCKET pipe_fd[2];
 
+    /** use the batched socket calls */
+    bool batchedio;
+
+    /** message compression policy, see SetCompressionThreshold() */
+    size_t compressthreshold;
+    bool compresstypes[256];
+
+#ifdef USE_BATCHED_IO
+    /** epoll instance waiting on mysocket and the pipe */
+    int epollfd;
+
+    /** datagrams received by the last recvmmsg, rxpos is the next to hand out */
+    struct mmsghdr rxmsgs[NETBATCHSIZE];
+    struct iovec rxiov[NETBATCHSIZE];
+    SOCKADDR_IN rxaddr[NETBATCHSIZE];
+    char* rxbuf[NETBATCHSIZE];
+    int rxcount, rxpos;
+
+    /** packets waiting for the next sendmmsg */
+    struct mmsghdr txmsgs[NETBATCHSIZE];
+    struct iovec txiov[2 * NETBATCHSIZE];   // header and shared data per packet
+    SOCKADDR_IN txaddr[NETBATCHSIZE];
+    csRef<psNetPacketEntry> txpkts[NETBATCHSIZE];
+    int txcount;
+#endif
+
     /** tree holding the outgoing packets */
     csHash<csRef<psNetPacketEntry> , PacketKey> packets;
 
@@ -599,6 +728,9 @@ private:
     /** LogMessage filter setting */
     csArray<int> logmessagefilter;
 
+    /** Messages are logged from the game and network threads while the console changes the filter */
+    CS::Threading::Mutex logmsgfiltermutex;
+
 
 
     typedef struct {
@@ -645,6 +777,8 @@ public:
     uint32_t sends;
     /** Number of resends */
     uint32_t resends;
+    /** Did the other side ask for compressed messages when authenticating? */
+    bool compression;
     
     // Reliable transmission window size
     uint32_t window;
@@ -672,24 +806,25 @@ public:
 class NetPacketQueueRefCount : public NetPacketQueue, public csSyncRefCount, public CS::Utility::WeakReferenced
 {
 private:
-    bool pending;
+    int32 pending;
 
 public:
     NetPacketQueueRefCount(int qlen)
     : NetPacketQueue(qlen)
-    { pending=false; }
+    { pending=0; }
     virtual ~NetPacketQueueRefCount()
     {}
 
     /// This flag ensures the same object is not queued twice.
-    /// Doesn't have to mutexed here because these are already called from within a queue mutex.
+    /// The senders queue is lock free, so two threads adding at once may
+    /// still queue it twice. That only costs an extra empty SendMergedPackets().
     void SetPending(bool flag)
     {
-        pending = flag;
+        CS::Threading::AtomicOperations::Set(&pending, flag ? 1 : 0);
     }
     bool GetPending()
     {
-        return pending;
+        return CS::Threading::AtomicOperations::Read(&pending) != 0;
     }
 };
 
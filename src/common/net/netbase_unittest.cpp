@@ -0,0 +1,328 @@
+/*
+ * netbase_unittest.cpp
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "net/netbase.h"
+#include "net/netpacket.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/**
+ * A NetBase without a socket that owns a set of synthetic connections.
+ * Packets are put straight into the awaiting ack pool as if they had been
+ * sent, and resent packets are drained from the outgoing queue.
+ */
+class SyntheticNetBase : public NetBase
+{
+public:
+    SyntheticNetBase(size_t numConnections)
+    {
+        for (size_t i = 0; i < numConnections; i++)
+        {
+            Connection* conn = new Connection((uint32_t)i + 1);
+            conn->valid = true;
+            connections.Push(conn);
+        }
+    }
+
+    ~SyntheticNetBase()
+    {
+        resendwheel.Clear();
+        awaitingack.Empty();
+        for (size_t i = 0; i < connections.GetSize(); i++)
+            delete connections[i];
+    }
+
+    virtual void Broadcast(MsgEntry*, int, int) {}
+    virtual void Multicast(MsgEntry*, const csArray<PublishDestination>&, int, float) {}
+    virtual Connection* GetConnByIP(LPSOCKADDR_IN) { return NULL; }
+    virtual Connection* GetConnByNum(uint32_t clientnum)
+    {
+        if (clientnum == 0 || clientnum > connections.GetSize())
+            return NULL;
+        return connections[clientnum - 1];
+    }
+    virtual bool HandleUnknownClient(LPSOCKADDR_IN, MsgEntry*) { return false; }
+
+    /// Put a HIGH priority packet in flight that expires after 'rto' ticks.
+    csRef<psNetPacketEntry> InFlight(uint32_t clientnum, csTicks rto)
+    {
+        Connection* conn = GetConnByNum(clientnum);
+        csRef<psNetPacketEntry> pkt;
+        pkt.AttachNew(new psNetPacketEntry(PRIORITY_HIGH, clientnum,
+            conn->GetNextPacketID(), 0, 100, 100, (const char*)NULL));
+        pkt->RTO = rto;
+        conn->AddToWindow(pkt->packet->GetPacketSize());
+        AddAwaitingAck(pkt);
+        return pkt;
+    }
+
+    void Ack(csRef<psNetPacketEntry> pkt)
+    {
+        if (RemoveAwaitingAck(pkt))
+            GetConnByNum(pkt->clientnum)->RemoveFromWindow(pkt->packet->GetPacketSize());
+    }
+
+    /// Run a resend check and return the number of packets that were resent.
+    size_t ResendCheck()
+    {
+        CheckResendPkts();
+
+        size_t count = 0;
+        csRef<psNetPacketEntry> pkt;
+        while ((pkt = NetworkQueue->Get()))
+            count++;
+        return count;
+    }
+
+    size_t AwaitingAck() { return awaitingack.GetSize(); }
+
+    /// Open a socket on the loopback interface.
+    bool Open(int port)
+    {
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 0;
+        return Init(false) && Bind("127.0.0.1", port);
+    }
+
+    /// Receive everything waiting on the socket, returns the datagram count.
+    long Drain()
+    {
+        long before = totalcountin;
+        while (CheckIn())
+            ;
+        return totalcountin - before;
+    }
+
+    /// Send an ack-sized packet to the given address.
+    void SendAck(LPSOCKADDR_IN addr)
+    {
+        csRef<psNetPacketEntry> pkt;
+        pkt.AttachNew(new psNetPacketEntry(PRIORITY_LOW, 0, 1, 0, 0, PKTSIZE_ACK, (const char*)NULL));
+        SendFinalPacket(pkt, addr);
+    }
+
+    void Flush()
+    {
+        SendOut();
+    }
+
+private:
+    csArray<Connection*> connections;
+};
+
+TEST(NetBaseTest, ResendOnlyExpired)
+{
+    SyntheticNetBase net(4);
+
+    // Nothing of these expires during the test.
+    for (uint32_t i = 0; i < 100; i++)
+        net.InFlight(i % 4 + 1, PKTMAXRTO);
+
+    // These expire right away, unless acked.
+    net.InFlight(1, 1);
+    net.InFlight(2, 1);
+    net.Ack(net.InFlight(3, 1));
+
+    csSleep(2 * RESENDWHEELRESOLUTION);
+    EXPECT_EQ(2u, net.ResendCheck());
+    EXPECT_EQ(100u, net.AwaitingAck());
+    EXPECT_EQ(0u, net.ResendCheck());
+}
+
+TEST(NetBaseTest, AckCancelsResend)
+{
+    SyntheticNetBase net(1);
+    csRef<psNetPacketEntry> pkt = net.InFlight(1, 1);
+    net.Ack(pkt);
+    EXPECT_FALSE(pkt->IsScheduled());
+
+    csSleep(2 * RESENDWHEELRESOLUTION);
+    EXPECT_EQ(0u, net.ResendCheck());
+    EXPECT_EQ(0u, net.AwaitingAck());
+}
+
+// Reports the cost of a resend check against the number of packets in flight.
+// Disabled in normal runs, see util/benchmark.h.
+TEST(NetBaseTest, DISABLED_ResendCheckBenchmark)
+{
+    const size_t connections = 300;
+    const size_t inflight[] = { 1000, 10000, 50000 };
+    const int ticks = 100;
+
+    for (size_t n = 0; n < sizeof(inflight) / sizeof(inflight[0]); n++)
+    {
+        SyntheticNetBase net(connections);
+        for (size_t i = 0; i < inflight[n]; i++)
+        {
+            // About 1% of the packets expire during the run.
+            csTicks rto = (i % 100 == 0) ? PKTMINRTO / 5 : PKTMAXRTO;
+            net.InFlight((uint32_t)(i % connections) + 1, rto);
+        }
+
+        csMicroTicks total = 0;
+        size_t resent = 0;
+        for (int t = 0; t < ticks; t++)
+        {
+            csSleep(1);
+            csMicroTicks start = csGetMicroTicks();
+            resent += net.ResendCheck();
+            total += csGetMicroTicks() - start;
+        }
+
+        printf("%zu packets in flight: %.2f usec per resend check, %zu resent\n",
+            inflight[n], (double)total / ticks, resent);
+        EXPECT_EQ(inflight[n] - resent, net.AwaitingAck());
+    }
+}
+
+// A packet built on a shared payload must look the same on the wire as a copy.
+TEST(NetBaseTest, SharedPayloadPackets)
+{
+    const size_t datasize = 2000;
+    csRef<MsgEntry> me;
+    me.AttachNew(new MsgEntry(datasize));
+    for (size_t i = 0; i < datasize; i++)
+        me->bytes->payload[i] = (char)i;
+
+    csRef<psNetSharedPayload> payload;
+    payload.AttachNew(new psNetSharedPayload(me->bytes));
+    ASSERT_EQ(me->bytes->GetTotalSize(), payload->GetSize());
+
+    uint32_t total = (uint32_t)payload->GetSize();
+    uint32_t offset = 1000;
+    uint16_t size = (uint16_t)(total - offset);
+
+    csRef<psNetPacketEntry> copy, shared;
+    copy.AttachNew(new psNetPacketEntry(PRIORITY_HIGH, 1, 7, offset, total, size, me->bytes));
+    shared.AttachNew(new psNetPacketEntry(PRIORITY_HIGH, 1, 7, offset, total, size, payload));
+    EXPECT_TRUE(shared->IsShared());
+    EXPECT_EQ(0, memcmp(copy->GetPacketData(), shared->GetPacketData(), size));
+
+    char a[MAXPACKETSIZE], b[MAXPACKETSIZE];
+    ASSERT_EQ(copy->CopyPacketTo(a), shared->CopyPacketTo(b));
+    EXPECT_EQ(0, memcmp(a, b, copy->packet->GetPacketSize()));
+
+    // Small shared packets are copied out when merged into a multipacket.
+    csRef<MsgEntry> small;
+    small.AttachNew(new MsgEntry(10));
+    csRef<psNetSharedPayload> smallpayload;
+    smallpayload.AttachNew(new psNetSharedPayload(small->bytes));
+    uint16_t smallsize = (uint16_t)smallpayload->GetSize();
+
+    csRef<psNetPacketEntry> first, second;
+    first.AttachNew(new psNetPacketEntry(PRIORITY_LOW, 1, 0, 0, smallsize, smallsize, smallpayload));
+    second.AttachNew(new psNetPacketEntry(PRIORITY_LOW, 1, 0, 0, smallsize, smallsize, smallpayload));
+    ASSERT_TRUE(first->Append(second));
+    EXPECT_FALSE(first->IsShared());
+
+    psNetPacket* inner = NULL;
+    int count = 0;
+    while (csRef<psNetPacketEntry> pkt = first->GetNextPacket(inner))
+    {
+        EXPECT_EQ(smallsize, pkt->packet->pktsize);
+        EXPECT_EQ(0, memcmp(small->bytes, pkt->packet->data, smallsize));
+        count++;
+    }
+    EXPECT_EQ(2, count);
+}
+
+/**
+ * Loopback load generator. Blasts ack-sized datagrams at a NetBase and
+ * reports the packets per second it receives and sends, with and without
+ * batched I/O. Disabled in normal runs, see util/benchmark.h.
+ */
+TEST(NetBaseTest, DISABLED_LoopbackThroughputBenchmark)
+{
+    const int port = 13399;
+    const int burst = 256;
+    const int bursts = 400;
+
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ASSERT_NE(INVALID_SOCKET, sock);
+    SOCKADDR_IN sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.sin_family = AF_INET;
+    sink.sin_addr.s_addr = inet_addr("127.0.0.1");
+    sink.sin_port = htons(port + 1);
+    ASSERT_EQ(0, bind(sock, (LPSOCKADDR) &sink, sizeof(sink)));
+    unsigned long nonblock = 1;
+    SOCK_IOCTL(sock, FIONBIO, &nonblock);
+
+    SOCKADDR_IN server = sink;
+    server.sin_port = htons(port);
+
+    psNetPacket ack;
+    memset(&ack, 0, sizeof(ack));
+    ack.MarshallEndian();
+
+    for (int batched = 0; batched < 2; batched++)
+    {
+        SyntheticNetBase net(1);
+        net.SetBatchedIO(batched != 0);
+        ASSERT_TRUE(net.Open(port));
+
+        // Receiving
+        long received = 0;
+        csMicroTicks recvtime = 0;
+        for (int b = 0; b < bursts; b++)
+        {
+            for (int i = 0; i < burst; i++)
+                SOCK_SENDTO(sock, &ack, sizeof(ack), 0, (LPSOCKADDR) &server, sizeof(server));
+
+            csMicroTicks start = csGetMicroTicks();
+            received += net.Drain();
+            recvtime += csGetMicroTicks() - start;
+        }
+
+        // Sending
+        char buf[MAXPACKETSIZE];
+        csMicroTicks sendtime = 0;
+        for (int b = 0; b < bursts; b++)
+        {
+            csMicroTicks start = csGetMicroTicks();
+            for (int i = 0; i < burst; i++)
+                net.SendAck(&sink);
+            net.Flush();
+            sendtime += csGetMicroTicks() - start;
+
+            while (SOCK_RECVFROM(sock, buf, sizeof(buf), 0, NULL, NULL) > 0)
+                ;
+        }
+
+        printf("%s I/O: received %ld packets at %.0f pps, sent %d packets at %.0f pps\n",
+            batched ? "batched" : "single", received, received * 1000000.0 / MAX(recvtime, 1),
+            burst * bursts, burst * bursts * 1000000.0 / MAX(sendtime, 1));
+        EXPECT_GT(received, 0);
+    }
+
+    SOCK_CLOSE(sock);
+}
@@ -0,0 +1,251 @@
+/*
+ * netbufferpool.cpp
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+#include <psconfig.h>
+
+#include <csutil/threading/atomicops.h>
+#include <csutil/threading/mutex.h>
+#include <csutil/threading/tls.h>
+
+#include "net/netbufferpool.h"
+#include "net/netpacket.h"
+
+using namespace CS::Threading;
+
+// Number of buffers moved between a thread and the depot at once.
+#define POOL_BATCH          64
+// A thread returns a batch to the depot when it holds more than this.
+#define POOL_THREAD_MAX     (4 * POOL_BATCH)
+// Number of buffers allocated per slab.
+#define POOL_SLAB_BUFFERS   (2 * POOL_BATCH)
+
+enum
+{
+    POOL_CLASSES = 3,
+    POOL_OVERSIZE = 0xff   // Marks a buffer that came from cs_malloc
+};
+
+/** Header in front of every buffer handed out. Also the freelist link. */
+union BufferHeader
+{
+    struct
+    {
+        BufferHeader* next;
+        uint8 sizeclass;
+    } info;
+    double align[2]; ///< Keep the payload aligned
+};
+
+static const size_t classSizes[POOL_CLASSES] = { 128, 512, MAXPACKETSIZE + sizeof(BufferHeader) };
+
+/** A chain of free buffers of one size class. */
+struct BufferList
+{
+    BufferHeader* head;
+    size_t count;
+
+    BufferList() : head(NULL), count(0) {}
+
+    void Push(BufferHeader* buf)
+    {
+        buf->info.next = head;
+        head = buf;
+        count++;
+    }
+
+    BufferHeader* Pop()
+    {
+        BufferHeader* buf = head;
+        head = buf->info.next;
+        count--;
+        return buf;
+    }
+
+    /// Move up to 'num' buffers from this list to 'to'.
+    void Move(BufferList &to, size_t num)
+    {
+        while (head && num--)
+            to.Push(Pop());
+    }
+};
+
+struct PoolStats
+{
+    int32 allocs;     ///< Buffers handed out from a size class
+    int32 hits;       ///< ...of which came straight from the thread's freelist
+    int32 refills;    ///< Batches taken from the depot
+    int32 slabs;      ///< Slabs allocated from the heap
+    int32 oversize;   ///< Requests too large for any class
+};
+
+class psNetBufferPoolImpl
+{
+public:
+    /** The freelists of one thread. Returned to the depot when the thread ends. */
+    struct ThreadCache
+    {
+        BufferList lists[POOL_CLASSES];
+
+        ~ThreadCache();
+    };
+
+    psNetBufferPoolImpl()
+    {
+        memset(stats, 0, sizeof(stats));
+    }
+
+    void* Alloc(size_t size)
+    {
+        size_t total = size + sizeof(BufferHeader);
+        int c = 0;
+        while (c < POOL_CLASSES && classSizes[c] < total)
+            c++;
+
+        BufferHeader* buf;
+        if (c == POOL_CLASSES)
+        {
+            AtomicOperations::Increment(&stats[0].oversize);
+            buf = (BufferHeader*) cs_malloc(total);
+            CS_ASSERT(buf != NULL);
+            buf->info.sizeclass = POOL_OVERSIZE;
+            return buf + 1;
+        }
+
+        AtomicOperations::Increment(&stats[c].allocs);
+        BufferList &list = cache.Get().lists[c];
+        if (list.head)
+            AtomicOperations::Increment(&stats[c].hits);
+        else
+            Refill(c, list);
+
+        buf = list.Pop();
+        buf->info.sizeclass = (uint8) c;
+        return buf + 1;
+    }
+
+    void Free(void* ptr)
+    {
+        if (!ptr)
+            return;
+
+        BufferHeader* buf = ((BufferHeader*) ptr) - 1;
+        int c = buf->info.sizeclass;
+        if (c == POOL_OVERSIZE)
+        {
+            cs_free(buf);
+            return;
+        }
+        CS_ASSERT(c < POOL_CLASSES);
+
+        BufferList &list = cache.Get().lists[c];
+        list.Push(buf);
+        if (list.count > POOL_THREAD_MAX)
+        {
+            MutexScopedLock lock(depotmutex[c]);
+            list.Move(depot[c], POOL_BATCH);
+        }
+    }
+
+    /// Give a thread's buffers back to the depot.
+    void Release(ThreadCache* tc)
+    {
+        for (int c = 0; c < POOL_CLASSES; c++)
+        {
+            MutexScopedLock lock(depotmutex[c]);
+            tc->lists[c].Move(depot[c], tc->lists[c].count);
+        }
+    }
+
+    csString Dump()
+    {
+        csString str("==================\nPacket buffer pool\n==================\n");
+        for (int c = 0; c < POOL_CLASSES; c++)
+        {
+            int32 allocs = AtomicOperations::Read(&stats[c].allocs);
+            int32 hits = AtomicOperations::Read(&stats[c].hits);
+            str.AppendFmt("%5u bytes: %d allocs, %.1f%% thread hits, %d depot refills, %d slabs\n",
+                (unsigned int) classSizes[c], allocs, allocs ? 100.0 * hits / allocs : 0.0,
+                AtomicOperations::Read(&stats[c].refills), AtomicOperations::Read(&stats[c].slabs));
+        }
+        str.AppendFmt("oversize: %d allocs\n", AtomicOperations::Read(&stats[0].oversize));
+        return str;
+    }
+
+    void ResetStats()
+    {
+        for (int c = 0; c < POOL_CLASSES; c++)
+        {
+            AtomicOperations::Set(&stats[c].allocs, 0);
+            AtomicOperations::Set(&stats[c].hits, 0);
+            AtomicOperations::Set(&stats[c].refills, 0);
+        }
+        AtomicOperations::Set(&stats[0].oversize, 0);
+    }
+
+private:
+    /// Fill an empty thread freelist from the depot, allocating a slab if needed.
+    void Refill(int c, BufferList &list)
+    {
+        AtomicOperations::Increment(&stats[c].refills);
+
+        MutexScopedLock lock(depotmutex[c]);
+        if (!depot[c].head)
+        {
+            AtomicOperations::Increment(&stats[c].slabs);
+            char* slab = (char*) cs_malloc(classSizes[c] * POOL_SLAB_BUFFERS);
+            CS_ASSERT(slab != NULL);
+            for (size_t i = 0; i < POOL_SLAB_BUFFERS; i++)
+                depot[c].Push((BufferHeader*) (slab + i * classSizes[c]));
+        }
+        depot[c].Move(list, POOL_BATCH);
+    }
+
+    ThreadLocal<ThreadCache> cache;
+
+    BufferList depot[POOL_CLASSES];
+    Mutex depotmutex[POOL_CLASSES];
+
+    PoolStats stats[POOL_CLASSES];
+};
+
+static psNetBufferPoolImpl pool;
+
+psNetBufferPoolImpl::ThreadCache::~ThreadCache()
+{
+    pool.Release(this);
+}
+
+void* psNetBufferPool::Alloc(size_t size)
+{
+    return pool.Alloc(size);
+}
+
+void psNetBufferPool::Free(void* ptr)
+{
+    pool.Free(ptr);
+}
+
+csString psNetBufferPool::Dump()
+{
+    return pool.Dump();
+}
+
+void psNetBufferPool::ResetStats()
+{
+    pool.ResetStats();
+}
@@ -0,0 +1,60 @@
+/*
+ * netbufferpool.h
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ *
+ * Size-classed buffer pool for network packets and messages.
+ *
+ */
+
+/*   Design notes:
+ *
+ *  Packets and messages are created on one thread and very often freed on
+ *  another (the game thread queues a message, the network thread frees the
+ *  packets once they are acked), so a plain PoolAllocator can't be used.
+ *
+ *  Buffers come in a few size classes up to MAXPACKETSIZE.  Each thread keeps
+ *  its own freelist per class which needs no locking at all.  When a thread's
+ *  freelist runs dry it grabs a batch from a shared depot, and when it grows
+ *  too long it hands a batch back, so the depot mutex is only taken once per
+ *  batch.  The depot is refilled by allocating whole slabs of buffers.
+ *
+ *  Requests larger than the biggest class go straight to cs_malloc.
+ *
+ *  Like PoolAllocator, slab memory is never returned to the heap.
+ */
+#ifndef __NETBUFFERPOOL_H__
+#define __NETBUFFERPOOL_H__
+
+#include <csutil/csstring.h>
+
+class psNetBufferPool
+{
+public:
+    /// Get a buffer of at least 'size' bytes.
+    static void* Alloc(size_t size);
+
+    /// Return a buffer obtained from Alloc(). NULL is fine.
+    static void Free(void* ptr);
+
+    /// Textual statistics of the pool, used by psNetMsgProfiles.
+    static csString Dump();
+
+    /// Reset the hit/miss counters.
+    static void ResetStats();
+};
+
+#endif
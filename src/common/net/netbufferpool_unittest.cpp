@@ -0,0 +1,231 @@
+/*
+ * netbufferpool_unittest.cpp
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/set.h>
+#include <csutil/threading/condition.h>
+#include <csutil/threading/thread.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "net/netbufferpool.h"
+#include "net/netpacket.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+using namespace CS::Threading;
+
+// More than a thread may keep on its own freelist, so some must reach the depot.
+#define MANY_BUFFERS    400
+// Size of one batch moved to and from the depot.
+#define BATCH           64
+
+/// Allocates 'count' buffers of 'size' bytes on its own thread.
+class Allocator : public Runnable
+{
+public:
+    Allocator(size_t size, size_t count) : size(size), count(count) {}
+
+    void Run()
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            void* buf = psNetBufferPool::Alloc(size);
+            memset(buf, 0xAB, size);
+            buffers.Push(buf);
+        }
+    }
+
+    csArray<void*> buffers;
+
+private:
+    size_t size;
+    size_t count;
+};
+
+/**
+ * Frees the given buffers on its own thread. If 'hold' is set the thread
+ * stays alive until Release() is called, so its freelist isn't handed back.
+ */
+class Freer : public Runnable
+{
+public:
+    Freer(const csArray<void*> &buffers, bool hold)
+        : buffers(buffers), hold(hold), done(false), released(false) {}
+
+    void Run()
+    {
+        for (size_t i = 0; i < buffers.GetSize(); i++)
+            psNetBufferPool::Free(buffers[i]);
+
+        MutexScopedLock lock(mutex);
+        done = true;
+        condition.NotifyAll();
+        while (hold && !released)
+            condition.Wait(mutex);
+    }
+
+    void WaitDone()
+    {
+        MutexScopedLock lock(mutex);
+        while (!done)
+            condition.Wait(mutex);
+    }
+
+    void Release()
+    {
+        MutexScopedLock lock(mutex);
+        released = true;
+        condition.NotifyAll();
+    }
+
+private:
+    csArray<void*> buffers;
+    bool hold;
+    bool done;
+    bool released;
+    Mutex mutex;
+    Condition condition;
+};
+
+static void RunThread(Runnable* runnable)
+{
+    csRef<Thread> thread;
+    thread.AttachNew(new Thread(runnable));
+    thread->Start();
+    thread->Wait();
+}
+
+static csSet<csPtrKey<void> > ToSet(const csArray<void*> &buffers)
+{
+    csSet<csPtrKey<void> > set;
+    for (size_t i = 0; i < buffers.GetSize(); i++)
+        set.Add(buffers[i]);
+    return set;
+}
+
+TEST(NetBufferPoolTest, SameThreadReuse)
+{
+    void* a = psNetBufferPool::Alloc(100);
+    psNetBufferPool::Free(a);
+    void* b = psNetBufferPool::Alloc(100);
+    EXPECT_EQ(a, b);
+    psNetBufferPool::Free(b);
+
+    psNetBufferPool::Free(NULL);
+}
+
+TEST(NetBufferPoolTest, DistinctAndAligned)
+{
+    csArray<void*> buffers;
+    for (int i = 0; i < 200; i++)
+    {
+        void* buf = psNetBufferPool::Alloc(MAXPACKETSIZE);
+        EXPECT_EQ(0u, ((uintptr_t) buf) % sizeof(double));
+        memset(buf, i, MAXPACKETSIZE);
+        buffers.Push(buf);
+    }
+    EXPECT_EQ(buffers.GetSize(), ToSet(buffers).GetSize());
+
+    for (size_t i = 0; i < buffers.GetSize(); i++)
+        EXPECT_EQ((char) i, ((char*) buffers[i])[MAXPACKETSIZE - 1]);
+    for (size_t i = 0; i < buffers.GetSize(); i++)
+        psNetBufferPool::Free(buffers[i]);
+}
+
+TEST(NetBufferPoolTest, Oversize)
+{
+    size_t size = MAXPACKETSIZE * 4;
+    char* buf = (char*) psNetBufferPool::Alloc(size);
+    ASSERT_TRUE(buf != NULL);
+    memset(buf, 0x5A, size);
+    EXPECT_EQ(0x5A, buf[size - 1]);
+    psNetBufferPool::Free(buf);
+
+    // Oversize buffers don't go through the freelists, so the thread's
+    // regular buffers are unaffected.
+    void* a = psNetBufferPool::Alloc(100);
+    psNetBufferPool::Free(a);
+    psNetBufferPool::Free(psNetBufferPool::Alloc(size));
+    EXPECT_EQ(a, psNetBufferPool::Alloc(100));
+    psNetBufferPool::Free(a);
+}
+
+TEST(NetBufferPoolTest, FreeOnOtherThread)
+{
+    // Buffers allocated on one thread and freed on another that then exits
+    // go back to the depot, and a third thread gets those back first.
+    csRef<Allocator> first;
+    first.AttachNew(new Allocator(300, MANY_BUFFERS));
+    RunThread(first);
+
+    csRef<Freer> freer;
+    freer.AttachNew(new Freer(first->buffers, false));
+    RunThread(freer);
+
+    csRef<Allocator> second;
+    second.AttachNew(new Allocator(300, MANY_BUFFERS / 2));
+    RunThread(second);
+
+    csSet<csPtrKey<void> > freed = ToSet(first->buffers);
+    for (size_t i = 0; i < second->buffers.GetSize(); i++)
+        EXPECT_TRUE(freed.Contains(second->buffers[i]));
+
+    freer.AttachNew(new Freer(second->buffers, false));
+    RunThread(freer);
+}
+
+TEST(NetBufferPoolTest, DepotWhileThreadAlive)
+{
+    // A thread freeing more than it may keep hands batches to the depot
+    // right away, without waiting to exit.
+    csRef<Allocator> first;
+    first.AttachNew(new Allocator(300, MANY_BUFFERS));
+    RunThread(first);
+
+    csRef<Freer> freer;
+    freer.AttachNew(new Freer(first->buffers, true));
+    csRef<Thread> thread;
+    thread.AttachNew(new Thread(freer));
+    thread->Start();
+    freer->WaitDone();
+
+    csRef<Allocator> second;
+    second.AttachNew(new Allocator(300, BATCH));
+    RunThread(second);
+
+    csSet<csPtrKey<void> > freed = ToSet(first->buffers);
+    for (size_t i = 0; i < second->buffers.GetSize(); i++)
+        EXPECT_TRUE(freed.Contains(second->buffers[i]));
+
+    freer->Release();
+    thread->Wait();
+
+    csRef<Freer> cleanup;
+    cleanup.AttachNew(new Freer(second->buffers, false));
+    RunThread(cleanup);
+}
@@ -0,0 +1,128 @@
+/*
+ * netcompress.cpp
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+#include <psconfig.h>
+
+#include <csutil/zip.h>
+#include <csutil/threading/tls.h>
+
+#include "net/netcompress.h"
+#include "net/message.h"
+#include "net/messages.h"
+
+using namespace CS::Threading;
+
+/// Original type and payload size in front of the deflated data.
+#define COMPRESSED_HEADER (sizeof(uint8_t) + sizeof(uint16_t))
+
+/** zlib state of one thread, reset for every message. */
+struct CompressionStreams
+{
+    z_stream deflater;
+    z_stream inflater;
+    bool deflateok;
+    bool inflateok;
+
+    CompressionStreams()
+    {
+        memset(&deflater, 0, sizeof(deflater));
+        memset(&inflater, 0, sizeof(inflater));
+        deflateok = deflateInit(&deflater, Z_BEST_SPEED) == Z_OK;
+        inflateok = inflateInit(&inflater) == Z_OK;
+    }
+
+    ~CompressionStreams()
+    {
+        if (deflateok)
+            deflateEnd(&deflater);
+        if (inflateok)
+            inflateEnd(&inflater);
+    }
+};
+
+static ThreadLocal<CompressionStreams> streams;
+
+csPtr<MsgEntry> psNetCompression::Compress(const MsgEntry* me)
+{
+    CompressionStreams &s = streams.Get();
+    if (!s.deflateok)
+        return NULL;
+
+    // Anything that doesn't end up smaller than the original isn't worth sending.
+    size_t size = me->bytes->GetSize();
+    if (size <= COMPRESSED_HEADER + 1)
+        return NULL;
+    size_t room = size - COMPRESSED_HEADER - 1;
+
+    csRef<MsgEntry> out;
+    out.AttachNew(new MsgEntry(size));
+    out->bytes->type = MSGTYPE_COMPRESSED;
+    out->Add((uint8_t) me->bytes->type);
+    out->Add((uint16_t) size);
+
+    z_stream &z = s.deflater;
+    deflateReset(&z);
+    z.next_in = (Bytef*) me->bytes->payload;
+    z.avail_in = (uInt) size;
+    z.next_out = (Bytef*) out->bytes->payload + COMPRESSED_HEADER;
+    z.avail_out = (uInt) room;
+
+    if (deflate(&z, Z_FINISH) != Z_STREAM_END)
+        return NULL;
+
+    out->bytes->SetSize(COMPRESSED_HEADER + z.total_out);
+    out->clientnum = me->clientnum;
+    out->priority = me->priority;
+    out->msgid = me->msgid;
+    return csPtr<MsgEntry>(out);
+}
+
+csPtr<MsgEntry> psNetCompression::Decompress(const MsgEntry* me)
+{
+    CompressionStreams &s = streams.Get();
+    if (!s.inflateok)
+        return NULL;
+
+    size_t size = me->bytes->GetSize();
+    if (me->bytes->type != MSGTYPE_COMPRESSED || size <= COMPRESSED_HEADER)
+        return NULL;
+
+    const char* payload = me->bytes->payload;
+    msgtype type = (msgtype) payload[0];
+    uint16_t origsize = csLittleEndian::UInt16(*(uint16_t*) (payload + sizeof(uint8_t)));
+
+    csRef<MsgEntry> out;
+    out.AttachNew(new MsgEntry(origsize));
+    out->bytes->type = type;
+
+    z_stream &z = s.inflater;
+    inflateReset(&z);
+    z.next_in = (Bytef*) payload + COMPRESSED_HEADER;
+    z.avail_in = (uInt) (size - COMPRESSED_HEADER);
+    z.next_out = (Bytef*) out->bytes->payload;
+    z.avail_out = origsize;
+
+    // The data must inflate to exactly the announced size.
+    if (inflate(&z, Z_FINISH) != Z_STREAM_END || z.total_out != origsize)
+        return NULL;
+
+    out->clientnum = me->clientnum;
+    out->priority = me->priority;
+    out->msgid = me->msgid;
+    return csPtr<MsgEntry>(out);
+}
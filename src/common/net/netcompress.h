@@ -0,0 +1,63 @@
+/*
+ * netcompress.h
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ *
+ * Compression of whole messages before they are split into packets.
+ *
+ */
+
+/*   Design notes:
+ *
+ *  A compressed message is sent as a MSGTYPE_COMPRESSED message, so the
+ *  psMessageBytes header itself is unchanged.  Its payload is:
+ *
+ *      uint8   type of the original message
+ *      uint16  payload size of the original message
+ *      ...     the original payload, deflated
+ *
+ *  NetBase inflates these as soon as a message is complete, so nothing
+ *  above the network layer ever sees them.  A client only gets compressed
+ *  messages when it announced it can handle them at authentication.
+ *
+ *  zlib is used at its fastest level since it is already linked for the
+ *  strings cache.  Each thread keeps its own deflate and inflate state so
+ *  they are only allocated once.
+ */
+#ifndef __NETCOMPRESS_H__
+#define __NETCOMPRESS_H__
+
+#include <csutil/ref.h>
+
+class MsgEntry;
+
+class psNetCompression
+{
+public:
+    /**
+     * Returns a MSGTYPE_COMPRESSED copy of the message, with the same
+     * client, priority and id, or NULL if it does not get any smaller.
+     */
+    static csPtr<MsgEntry> Compress(const MsgEntry* me);
+
+    /**
+     * Returns the original message of a MSGTYPE_COMPRESSED message, or NULL
+     * if it is malformed.
+     */
+    static csPtr<MsgEntry> Decompress(const MsgEntry* me);
+};
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * netcompress_unittest.cpp
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "net/message.h"
+#include "net/messages.h"
+#include "net/netcompress.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+TEST(NetCompressionTest, RoundTrip)
+{
+    // Something that looks like an item list.
+    csRef<MsgEntry> me;
+    me.AttachNew(new MsgEntry(4000, PRIORITY_HIGH));
+    me->SetType(MSGTYPE_GUIINVENTORY);
+    me->clientnum = 42;
+    me->msgid = 7;
+    while (me->current + 20 <= me->bytes->GetSize())
+        me->Add("Small Iron Dagger");
+
+    csRef<MsgEntry> compressed = psNetCompression::Compress(me);
+    ASSERT_TRUE(compressed.IsValid());
+    EXPECT_EQ(MSGTYPE_COMPRESSED, compressed->bytes->type);
+    EXPECT_LT(compressed->bytes->GetTotalSize(), me->bytes->GetTotalSize() / 4);
+    EXPECT_EQ(me->clientnum, compressed->clientnum);
+    EXPECT_EQ(me->priority, compressed->priority);
+
+    csRef<MsgEntry> inflated = psNetCompression::Decompress(compressed);
+    ASSERT_TRUE(inflated.IsValid());
+    EXPECT_EQ(MSGTYPE_GUIINVENTORY, inflated->bytes->type);
+    ASSERT_EQ(me->bytes->GetTotalSize(), inflated->bytes->GetTotalSize());
+    EXPECT_EQ(0, memcmp(me->bytes, inflated->bytes, me->bytes->GetTotalSize()));
+    EXPECT_EQ(me->clientnum, inflated->clientnum);
+}
+
+TEST(NetCompressionTest, IncompressibleIsNotCompressed)
+{
+    csRef<MsgEntry> me;
+    me.AttachNew(new MsgEntry(1000));
+    me->SetType(MSGTYPE_GUIINVENTORY);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < me->bytes->GetSize(); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        me->bytes->payload[i] = (char)(seed >> 16);
+    }
+
+    csRef<MsgEntry> compressed = psNetCompression::Compress(me);
+    EXPECT_FALSE(compressed.IsValid());
+}
+
+TEST(NetCompressionTest, MalformedIsDropped)
+{
+    csRef<MsgEntry> me;
+    me.AttachNew(new MsgEntry(2000));
+    me->SetType(MSGTYPE_GUIINVENTORY);
+    memset(me->bytes->payload, 'x', me->bytes->GetSize());
+
+    csRef<MsgEntry> compressed = psNetCompression::Compress(me);
+    ASSERT_TRUE(compressed.IsValid());
+
+    // Announce a different size than the data inflates to.
+    uint16_t* size = (uint16_t*)(compressed->bytes->payload + 1);
+    *size = csLittleEndian::Convert((uint16)1000);
+    csRef<MsgEntry> inflated = psNetCompression::Decompress(compressed);
+    EXPECT_FALSE(inflated.IsValid());
+
+    // Cut the data short.
+    *size = csLittleEndian::Convert((uint16)2000);
+    compressed->bytes->SetSize(compressed->bytes->GetSize() / 2);
+    inflated = psNetCompression::Decompress(compressed);
+    EXPECT_FALSE(inflated.IsValid());
+}
@@ -22,6 +22,7 @@
 
 #include "util/log.h"
 #include "net/netpacket.h"
+#include "net/netbufferpool.h"
 
 // #define PACKETDEBUG
 
@@ -41,7 +42,7 @@ psNetPacketEntry::psNetPacketEntry (uint8_t pri, uint32_t cnum,
                     uint32_t totalsize, uint16_t sz,
                     psMessageBytes *msg)
 {
-    packet = (psNetPacket*) cs_malloc (sizeof(psNetPacket) + sz);
+    packet = (psNetPacket*) psNetBufferPool::Alloc (sizeof(psNetPacket) + sz);
     CS_ASSERT(packet != NULL);
     clientnum = cnum;
     packet->flags = pri;
@@ -60,7 +61,7 @@ psNetPacketEntry::psNetPacketEntry (uint8_t pri, uint32_t cnum,
     uint32_t id, uint32_t off, uint32_t totalsize, uint16_t sz,
     const char *bytes)
 {
-    packet = (psNetPacket*) cs_malloc (sizeof(psNetPacket) + sz);
+    packet = (psNetPacket*) psNetBufferPool::Alloc (sizeof(psNetPacket) + sz);
     CS_ASSERT(packet != NULL);
     clientnum = cnum;
     packet->flags = pri;
@@ -75,10 +76,53 @@ psNetPacketEntry::psNetPacketEntry (uint8_t pri, uint32_t cnum,
     memcpy(packet->data, bytes, sz);
 }
 
+/** construct a new PacketEntry for a part of a shared message */
+psNetPacketEntry::psNetPacketEntry (uint8_t pri, uint32_t cnum,
+    uint32_t id, uint32_t off, uint32_t totalsize, uint16_t sz,
+    psNetSharedPayload *payload)
+    : payload(payload)
+{
+    CS_ASSERT(off + sz <= payload->GetSize());
+    packet = (psNetPacket*) psNetBufferPool::Alloc (sizeof(psNetPacket));
+    CS_ASSERT(packet != NULL);
+    clientnum = cnum;
+    packet->flags = pri;
+    packet->pktid = id;
+    packet->offset = off;
+    packet->pktsize = sz;
+    packet->msgsize = totalsize;
+    timestamp = csGetTicks();
+    retransmitted = false;
+    RTO = 0;
+}
+
+void* psNetPacketEntry::operator new(size_t size)
+{
+    return psNetBufferPool::Alloc(size);
+}
+
+void psNetPacketEntry::operator delete(void* ptr)
+{
+    psNetBufferPool::Free(ptr);
+}
+
 psNetPacketEntry::~psNetPacketEntry()
 {
-    if (packet)
-        cs_free(packet);
+    psNetBufferPool::Free(packet);
+}
+
+size_t psNetPacketEntry::CopyPacketTo(char* dest)
+{
+    size_t size = packet->GetPacketSize();
+    const char* data = GetPacketData();
+
+    packet->MarshallEndian();
+    memcpy(dest, packet, sizeof(psNetPacket));
+    packet->UnmarshallEndian();
+
+    if (size > sizeof(psNetPacket))
+        memcpy(dest + sizeof(psNetPacket), data, size - sizeof(psNetPacket));
+    return size;
 }
 
 bool psNetPacketEntry::Append(csRef<psNetPacketEntry> next)
@@ -117,7 +161,7 @@ bool psNetPacketEntry::Append(csRef<psNetPacketEntry> next)
         * or copy data more than once.  Only exact number of bytes will be
         * sent on the wire.
         */
-        merge = (psNetPacket*) cs_malloc (MAXPACKETSIZE);
+        merge = (psNetPacket*) psNetBufferPool::Alloc (MAXPACKETSIZE);
         CS_ASSERT(merge != NULL);
 
         /**
@@ -134,13 +178,11 @@ bool psNetPacketEntry::Append(csRef<psNetPacketEntry> next)
         * After marshalling for network, copy entire first packet, with header, into data section
         * of new packet.
         */
-        uint16_t size = (uint16_t)packet->GetPacketSize();
-        packet->MarshallEndian();
-        memcpy(merge->data, packet, size);
-        packet->UnmarshallEndian();
+        CopyPacketTo(merge->data);
 
-        cs_free(packet);   // done with old packet
+        psNetBufferPool::Free(packet);   // done with old packet
         packet = merge;
+        payload = NULL;
     }
     else
     {
@@ -155,14 +197,10 @@ bool psNetPacketEntry::Append(csRef<psNetPacketEntry> next)
     if (next->packet->GetPriority() == PRIORITY_HIGH)
         packet->flags = PRIORITY_HIGH | FLAG_MULTIPACKET; // HIGH overrides LOW but not vice versa
 
-    /* Copy size information temporarily, and pack the next packet for transmission.
-    * Do not reference the next->packet after MarshallEndian() has been called.
-    * copy the entire 2nd packet into 1st packet after existing data
+    /* copy the entire 2nd packet, packed for transmission, into 1st packet
+    * after existing data
     */
-    uint16_t nextSize = (uint16_t)next->packet->GetPacketSize();
-    next->packet->MarshallEndian();
-    memcpy(packet->data+packet->pktsize, next->packet, nextSize);
-    next->packet->UnmarshallEndian();
+    uint16_t nextSize = (uint16_t)next->CopyPacketTo(packet->data+packet->pktsize);
 
     /**
     * now update length of outer packet
@@ -272,3 +310,26 @@ csRef<psNetPacketEntry> psNetPacketEntry::GetNextPacket(psNetPacket * &packetdat
     }
 }
 
+
+psNetSharedPayload::psNetSharedPayload(const psMessageBytes* msg)
+{
+    size = msg->GetTotalSize();
+    data = (char*) psNetBufferPool::Alloc(size);
+    CS_ASSERT(data != NULL);
+    memcpy(data, msg, size);
+}
+
+psNetSharedPayload::~psNetSharedPayload()
+{
+    psNetBufferPool::Free(data);
+}
+
+void* psNetSharedPayload::operator new(size_t size)
+{
+    return psNetBufferPool::Alloc(size);
+}
+
+void psNetSharedPayload::operator delete(void* ptr)
+{
+    psNetBufferPool::Free(ptr);
+}
@@ -25,6 +25,7 @@
 
 #include "net/packing.h"
 #include "net/message.h"
+#include "util/timerwheel.h"
 
 enum
 {
@@ -159,7 +160,31 @@ public:
 template<> class csHashComputer<PacketKey> :
 public csHashComputerStruct<PacketKey> {};
 
-class psNetPacketEntry : public csSyncRefCount
+/**
+ * A message serialized once and shared, read only, by the packets going to
+ * every recipient of a broadcast or multicast.  Packets built on it only
+ * allocate their own psNetPacket header, the data stays here.
+ */
+class psNetSharedPayload : public csSyncRefCount
+{
+public:
+    /** Copies the message bytes, the message may be changed or freed afterwards. */
+    psNetSharedPayload(const psMessageBytes* msg);
+    ~psNetSharedPayload();
+
+    /// Payloads are allocated from psNetBufferPool.
+    void* operator new(size_t size);
+    void operator delete(void* ptr);
+
+    const char* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+
+private:
+    char* data;
+    size_t size;
+};
+
+class psNetPacketEntry : public csSyncRefCount, public TimerWheelNode
 {
 public:
     /** clientnum this packet comes from/goes to */
@@ -178,8 +203,13 @@ public:
      */
     psNetPacket* packet;
 
+    /** The shared data of this packet, if any. When set, 'packet' only holds
+     * the header and the data is found at payload->GetData() + packet->offset.
+     */
+    csRef<psNetSharedPayload> payload;
+
     /** construct a new PacketEntry from a packet, not that this classe calls
-     * free on the packet pointer later!
+     * free on the packet pointer later! The packet must come from psNetBufferPool.
      */
     psNetPacketEntry (psNetPacket* packet, uint32_t cnum, uint16_t sz);
     
@@ -193,12 +223,23 @@ public:
                       uint32_t id, uint32_t off, uint32_t totalsize, uint16_t sz,
                       const char *bytes);
 
+    /** construct a new PacketEntry for a part of a shared message. Only the
+     * header is allocated, the data is referenced from 'payload'.
+     */
+    psNetPacketEntry (uint8_t pri, uint32_t cnum, uint32_t id,
+                      uint32_t off, uint32_t totalsize, uint16_t sz,
+                      psNetSharedPayload *payload);
+
     psNetPacketEntry (csRef<psNetPacketEntry> )
     {
         CS_ASSERT(false);
     }
 
     ~psNetPacketEntry();
+
+    /// Entries and their packets are allocated from psNetBufferPool.
+    void* operator new(size_t size);
+    void operator delete(void* ptr);
     
     bool Append(csRef<psNetPacketEntry> next);
     csRef <psNetPacketEntry> GetNextPacket(psNetPacket* &packetdata);
@@ -209,6 +250,23 @@ public:
         return packet;
     }
 
+    /// True if the data of this packet lives in a shared payload.
+    bool IsShared() const
+    {
+        return payload.IsValid();
+    }
+
+    /// The data following the header, wherever it is stored.
+    const char* GetPacketData() const
+    {
+        return payload ? payload->GetData() + packet->offset : packet->data;
+    }
+
+    /** Copy the whole packet, marshalled for the network, into 'dest' which
+     * must hold at least GetPacketSize() bytes. Returns the bytes copied.
+     */
+    size_t CopyPacketTo(char* dest);
+
     bool operator < (const psNetPacketEntry& other) const
     {
         if (clientnum < other.clientnum)
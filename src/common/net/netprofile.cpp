@@ -20,6 +20,7 @@
 #include <psconfig.h>
 #include "netprofile.h"
 #include "messages.h"
+#include "netbufferpool.h"
 
 
 void psNetMsgProfiles::AddEnoughRecords(csArray<psOperProfile*> & arr, int neededIndex, const char * desc)
@@ -35,12 +36,14 @@ void psNetMsgProfiles::AddEnoughRecords(csArray<psOperProfile*> & arr, int neede
 
 void psNetMsgProfiles::AddSentMsg(MsgEntry * me)
 {
+    CS::Threading::MutexScopedLock lock(mutex);
     AddEnoughRecords(sentProfs, me->bytes->type, "sent");
     sentProfs[me->bytes->type]->AddConsumption(me->bytes->size);
 }
 
 void psNetMsgProfiles::AddReceivedMsg(MsgEntry * me)
 {
+    CS::Threading::MutexScopedLock lock(mutex);
     AddEnoughRecords(recvProfs, me->bytes->type, "recv");
     recvProfs[me->bytes->type]->AddConsumption(me->bytes->size);
 }
@@ -49,14 +52,18 @@ csString psNetMsgProfiles::Dump()
 {
     csStringFast<50> header, list;
     
+    CS::Threading::MutexScopedLock lock(mutex);
     psOperProfileSet::Dump("byte", header, list);
-    return "=================\nBandwidth profile\n=================\n" + header + list;
+    return "=================\nBandwidth profile\n=================\n" + header + list
+        + "\n" + psNetBufferPool::Dump();
 }
 
 void psNetMsgProfiles::Reset()
 {
+    CS::Threading::MutexScopedLock lock(mutex);
     recvProfs.DeleteAll();
     sentProfs.DeleteAll();
+    psNetBufferPool::ResetStats();
     
     psOperProfileSet::Reset();
 }
@@ -21,11 +21,15 @@
 #define __NETPROFILE_H__
 
 #include <csutil/parray.h>
+#include <csutil/threading/mutex.h>
 
 #include "message.h"
 #include "util/psprofile.h"
 
-/**  Statistics of receiving or sending of network messages */
+/**
+ * Statistics of receiving or sending of network messages. Messages are
+ * sent from the game thread and the network thread, so this is locked.
+ */
 class psNetMsgProfiles : public psOperProfileSet
 {
 public:
@@ -38,6 +42,8 @@ protected:
     
     /** Statistics for receiving and sending of different message types */
     csArray<psOperProfile*> recvProfs, sentProfs;
+
+    CS::Threading::Mutex mutex;
 };
 
 #endif
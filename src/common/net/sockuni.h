@@ -32,6 +32,12 @@
 #include <netdb.h>
 #include <unistd.h>
 
+/* Linux can drain and flush many datagrams with one system call */
+#if defined(__linux__) && !defined(PS_NO_BATCHED_IO)
+#define USE_BATCHED_IO
+#include <sys/epoll.h>
+#endif
+
 /* define some types */
 #ifndef SOCKET
 #define SOCKET    int
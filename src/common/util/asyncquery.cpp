@@ -0,0 +1,178 @@
+/*
+ * asyncquery.cpp
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+#include <psconfig.h>
+
+#include <csutil/sysfunc.h>
+
+#include "util/asyncquery.h"
+
+AsyncQueryPool::AsyncQueryPool()
+{
+    queued = 0;
+    stopping = false;
+}
+
+AsyncQueryPool::~AsyncQueryPool()
+{
+    Stop();
+}
+
+void AsyncQueryPool::Start(const csArray<Connection*>& connections)
+{
+    stopping = false;
+    for (size_t i = 0; i < connections.GetSize(); i++)
+    {
+        csRef<Worker> worker;
+        worker.AttachNew(new Worker(this, connections[i]));
+        csRef<CS::Threading::Thread> thread;
+        thread.AttachNew(new CS::Threading::Thread(worker));
+        thread->Start();
+
+        workers.Push(worker);
+        threads.Push(thread);
+    }
+}
+
+void AsyncQueryPool::Select(iQueryCallback* callback, const char* sql)
+{
+    Push(callback, sql, true);
+}
+
+void AsyncQueryPool::Command(iQueryCallback* callback, const char* sql)
+{
+    Push(callback, sql, false);
+}
+
+void AsyncQueryPool::Push(iQueryCallback* callback, const char* sql, bool select)
+{
+    Job job;
+    job.sql = sql;
+    job.select = select;
+    job.callback = callback;
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    jobs.PushBack(job);
+    queued++;
+    condition.NotifyOne();
+}
+
+bool AsyncQueryPool::Take(Job& job)
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    while (jobs.IsEmpty() && !stopping)
+        condition.Wait(mutex);
+
+    if (jobs.IsEmpty())
+        return false;
+
+    job = jobs.Front();
+    jobs.PopFront();
+    queued--;
+    return true;
+}
+
+void AsyncQueryPool::Stop()
+{
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+        stopping = true;
+        condition.NotifyAll();
+    }
+
+    for (size_t i = 0; i < threads.GetSize(); i++)
+        threads[i]->Wait();
+
+    threads.Empty();
+    workers.Empty();
+}
+
+size_t AsyncQueryPool::GetQueueDepth()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    return queued;
+}
+
+void AsyncQueryPool::Worker::Run()
+{
+    conn->ThreadInit();
+
+    Job job;
+    while (pool->Take(job))
+    {
+        if (job.select)
+        {
+            iResultSet* rs = conn->Select(job.sql);
+            if (!job.callback)
+            {
+                if (rs)
+                    rs->Release();
+            }
+            else if (rs)
+                job.callback->QueryDone(rs, rs->Count(), NULL);
+            else
+                job.callback->QueryDone(NULL, QUERY_FAILED, conn->GetLastError());
+        }
+        else
+        {
+            unsigned long affected = conn->Command(job.sql);
+            if (job.callback)
+                job.callback->QueryDone(NULL, affected, (affected == QUERY_FAILED) ? conn->GetLastError() : NULL);
+        }
+    }
+
+    conn->ThreadEnd();
+}
+
+psDBQueryEvent::psDBQueryEvent(const char* type) : psGameEvent(0, 0, type)
+{
+    result = NULL;
+    affected = 0;
+    failed = false;
+}
+
+psDBQueryEvent::~psDBQueryEvent()
+{
+    if (result)
+        result->Release();
+}
+
+void psDBQueryEvent::QueryDone(iResultSet* result, unsigned long affected, const char* error)
+{
+    this->result = result;
+    this->affected = affected;
+    failed = (error != NULL);
+    if (error)
+        this->error = error;
+
+    if (!eventmanager)
+    {
+        // Shutting down, nobody is left to handle it
+        delete this;
+        return;
+    }
+
+    // Due now, not when the query was sent
+    triggerticks = csGetTicks();
+    QueueEvent();
+}
+
+void psDBQueryEvent::Trigger()
+{
+    Done(result, affected, failed ? error.GetData() : NULL);
+}
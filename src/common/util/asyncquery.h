@@ -0,0 +1,139 @@
+/*
+ * asyncquery.h
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#ifndef __ASYNCQUERY_H__
+#define __ASYNCQUERY_H__
+
+#include <csutil/csstring.h>
+#include <csutil/list.h>
+#include <csutil/refarr.h>
+#include <csutil/threading/thread.h>
+#include <csutil/threading/condition.h>
+
+#include "iserver/idal.h"
+#include "util/gameevent.h"
+
+/**
+ * Worker threads that run queries for iDataConnection::SelectAsync() and
+ * CommandAsync(). Each worker owns one connection and takes the next
+ * query from a shared queue. The pool knows nothing of the database
+ * behind the connections, so it can be run against a fake one.
+ */
+class AsyncQueryPool
+{
+public:
+    /// A connection of the pool, only ever used by the thread of one worker.
+    class Connection
+    {
+    public:
+        virtual ~Connection() {}
+
+        /// Called on the worker thread before the first and after the last query.
+        virtual void ThreadInit() {}
+        virtual void ThreadEnd() {}
+
+        /// Returns NULL if the query failed.
+        virtual iResultSet* Select(const char* sql)=0;
+        /// Returns QUERY_FAILED if the command failed.
+        virtual unsigned long Command(const char* sql)=0;
+        virtual const char* GetLastError()=0;
+    };
+
+    AsyncQueryPool();
+    ~AsyncQueryPool();
+
+    /// Start a worker for each connection. The pool deletes them when stopped.
+    void Start(const csArray<Connection*>& connections);
+
+    bool IsRunning() { return !workers.IsEmpty(); }
+
+    void Select(iQueryCallback* callback, const char* sql);
+    void Command(iQueryCallback* callback, const char* sql);
+
+    /// Run the queries still queued and join the workers.
+    void Stop();
+
+    /// Queries waiting for a worker.
+    size_t GetQueueDepth();
+
+private:
+    struct Job
+    {
+        csString sql;
+        bool select;
+        iQueryCallback* callback;
+    };
+
+    class Worker : public CS::Threading::Runnable
+    {
+    public:
+        Worker(AsyncQueryPool* pool, Connection* conn) : pool(pool), conn(conn) {}
+        virtual ~Worker() { delete conn; }
+        virtual void Run();
+    private:
+        AsyncQueryPool* pool;
+        Connection* conn;
+    };
+
+    void Push(iQueryCallback* callback, const char* sql, bool select);
+
+    /// Wait for the next job, false once the pool stops and the queue is empty.
+    bool Take(Job& job);
+
+    CS::Threading::Mutex mutex;
+    CS::Threading::Condition condition;
+    csList<Job> jobs;
+    size_t queued;
+    bool stopping;
+
+    csRefArray<Worker> workers;
+    csRefArray<CS::Threading::Thread> threads;
+};
+
+/**
+ * A query callback that finishes on the game thread. QueryDone() keeps the
+ * outcome and queues the event, the EventManager then calls Done() and
+ * deletes the event. Derive from it to keep what the handler needs, and
+ * look up clients again in Done() since they may be gone by then.
+ */
+class psDBQueryEvent : public psGameEvent, public iQueryCallback
+{
+public:
+    psDBQueryEvent(const char* type);
+    virtual ~psDBQueryEvent();
+
+    virtual void QueryDone(iResultSet* result, unsigned long affected, const char* error);
+
+    virtual void Trigger();
+
+protected:
+    /**
+     * Called on the game thread. 'result' is NULL for commands and failed
+     * selects, it is released after Done() returns.
+     */
+    virtual void Done(iResultSet* result, unsigned long affected, const char* error)=0;
+
+private:
+    iResultSet* result;
+    unsigned long affected;
+    csString error;
+    bool failed;
+};
+
+#endif
@@ -0,0 +1,264 @@
+/*
+ * asyncquery_unittest.cpp
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/asyncquery.h"
+#include "util/eventmanager.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// A single row holding the text of the query that selected it.
+class FakeRow : public iResultRow
+{
+public:
+    FakeRow(const char* value) : value(value) {}
+
+    virtual void SetMaxFields(int fields) {}
+    virtual void SetResultSet(void* resultsettoken) {}
+    virtual int Fetch(int row) { return 0; }
+    virtual const char* operator[](int whichfield) { return value; }
+    virtual const char* operator[](const char* fieldname) { return value; }
+    virtual int GetFieldIndex(const char* fieldname) { return 0; }
+    virtual int GetFieldCount() { return 1; }
+    virtual const char* GetFieldName(int whichfield) { return whichfield ? NULL : "value"; }
+    virtual int GetInt(int whichfield) { return atoi(value); }
+    virtual int GetInt(const char* fieldname) { return atoi(value); }
+    virtual unsigned long GetUInt32(int whichfield) { return strtoul(value, NULL, 10); }
+    virtual unsigned long GetUInt32(const char* fieldname) { return strtoul(value, NULL, 10); }
+    virtual float GetFloat(int whichfield) { return atof(value); }
+    virtual float GetFloat(const char* fieldname) { return atof(value); }
+    virtual uint64 GetUInt64(int whichfield) { return stringtouint64(value); }
+    virtual uint64 GetUInt64(const char* fieldname) { return stringtouint64(value); }
+    virtual uint64 stringtouint64(const char* stringbuf) { return strtoul(stringbuf, NULL, 10); }
+
+private:
+    csString value;
+};
+
+class FakeResultSet : public iResultSet
+{
+public:
+    FakeResultSet(const char* value) : row(value), fetched(false) {}
+
+    virtual iResultRow& operator[](unsigned long whichrow) { return row; }
+    virtual unsigned long Count(void) { return 1; }
+    virtual iResultRow* Next()
+    {
+        if (fetched)
+            return NULL;
+        fetched = true;
+        return &row;
+    }
+    virtual void Release(void) { delete this; }
+
+private:
+    FakeRow row;
+    bool fetched;
+};
+
+/**
+ * Stands in for a database connection: selects echo the query back as
+ * one row, queries starting with "FAIL" fail. Every query takes 'latency'
+ * milliseconds, as a round trip to the server would.
+ */
+class FakeConnection : public AsyncQueryPool::Connection
+{
+public:
+    FakeConnection(int latency) : latency(latency) {}
+
+    virtual iResultSet* Select(const char* sql)
+    {
+        Wait();
+        if (!strncmp(sql, "FAIL", 4))
+            return NULL;
+        return new FakeResultSet(sql);
+    }
+
+    virtual unsigned long Command(const char* sql)
+    {
+        Wait();
+        if (!strncmp(sql, "FAIL", 4))
+            return QUERY_FAILED;
+        return 1;
+    }
+
+    virtual const char* GetLastError() { return "fake error"; }
+
+private:
+    void Wait()
+    {
+        if (latency)
+            csSleep(latency);
+    }
+
+    int latency;
+};
+
+/// Records what the game thread got back.
+struct QueryOutcome
+{
+    csString value;
+    unsigned long affected;
+    csString error;
+};
+
+class TestQueryEvent : public psDBQueryEvent
+{
+public:
+    TestQueryEvent(csArray<QueryOutcome>* outcomes)
+        : psDBQueryEvent("TestQueryEvent"), outcomes(outcomes)
+    {
+    }
+
+protected:
+    virtual void Done(iResultSet* result, unsigned long affected, const char* error)
+    {
+        QueryOutcome outcome;
+        if (result)
+            outcome.value = (*result)[0][0];
+        outcome.affected = affected;
+        if (error)
+            outcome.error = error;
+        outcomes->Push(outcome);
+    }
+
+private:
+    csArray<QueryOutcome>* outcomes;
+};
+
+static void StartPool(AsyncQueryPool& pool, int connections, int latency)
+{
+    csArray<AsyncQueryPool::Connection*> conns;
+    for (int i = 0; i < connections; i++)
+        conns.Push(new FakeConnection(latency));
+    pool.Start(conns);
+}
+
+TEST(AsyncQueryTest, CompletesOnGameThread)
+{
+    EventManager manager;
+    csArray<QueryOutcome> outcomes;
+
+    AsyncQueryPool pool;
+    StartPool(pool, 3, 0);
+    EXPECT_TRUE(pool.IsRunning());
+
+    for (int i = 0; i < 30; i++)
+        pool.Select(new TestQueryEvent(&outcomes), csString().Format("%d", i));
+    pool.Command(new TestQueryEvent(&outcomes), "UPDATE");
+    pool.Command(NULL, "UPDATE");
+
+    // Stopping runs what is queued, but nothing completes before the game thread asks
+    pool.Stop();
+    EXPECT_FALSE(pool.IsRunning());
+    EXPECT_EQ(0u, pool.GetQueueDepth());
+    EXPECT_EQ(0u, outcomes.GetSize());
+
+    manager.ProcessEventQueue();
+    ASSERT_EQ(31u, outcomes.GetSize());
+
+    csArray<bool> seen;
+    seen.SetSize(30, false);
+    for (size_t i = 0; i < outcomes.GetSize(); i++)
+    {
+        EXPECT_TRUE(outcomes[i].error.IsEmpty());
+        EXPECT_EQ(1u, outcomes[i].affected);
+        if (!outcomes[i].value.IsEmpty())
+            seen[atoi(outcomes[i].value)] = true;
+    }
+    for (size_t i = 0; i < seen.GetSize(); i++)
+        EXPECT_TRUE(seen[i]);
+}
+
+TEST(AsyncQueryTest, ReportsFailures)
+{
+    EventManager manager;
+    csArray<QueryOutcome> outcomes;
+
+    AsyncQueryPool pool;
+    StartPool(pool, 1, 0);
+    pool.Select(new TestQueryEvent(&outcomes), "FAIL SELECT");
+    pool.Command(new TestQueryEvent(&outcomes), "FAIL UPDATE");
+    pool.Stop();
+
+    manager.ProcessEventQueue();
+    ASSERT_EQ(2u, outcomes.GetSize());
+    for (size_t i = 0; i < outcomes.GetSize(); i++)
+    {
+        EXPECT_TRUE(outcomes[i].value.IsEmpty());
+        EXPECT_EQ(QUERY_FAILED, outcomes[i].affected);
+        EXPECT_STREQ("fake error", outcomes[i].error);
+    }
+}
+
+/**
+ * Reports how long the game thread is held up by queries that take a few
+ * milliseconds each, run at once against handing them to pools of
+ * growing size, and how long until all of them completed. Disabled in
+ * normal runs, see util/benchmark.h.
+ */
+TEST(AsyncQueryTest, DISABLED_LatencyBenchmark)
+{
+    const int queries = 100;
+    const int latency = 2;
+    const int sizes[] = { 1, 2, 4, 8 };
+
+    FakeConnection direct(latency);
+    csMicroTicks start = csGetMicroTicks();
+    for (int i = 0; i < queries; i++)
+        direct.Select("SELECT")->Release();
+    csMicroTicks directtime = csGetMicroTicks() - start;
+    printf("direct:         game thread blocked %8.0f usec\n", (double)directtime);
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        EventManager manager;
+        csArray<QueryOutcome> outcomes;
+        AsyncQueryPool pool;
+        StartPool(pool, sizes[s], latency);
+
+        start = csGetMicroTicks();
+        for (int i = 0; i < queries; i++)
+            pool.Select(new TestQueryEvent(&outcomes), "SELECT");
+        csMicroTicks blocked = csGetMicroTicks() - start;
+
+        while (outcomes.GetSize() < (size_t)queries)
+        {
+            csSleep(1);
+            manager.ProcessEventQueue();
+        }
+        csMicroTicks total = csGetMicroTicks() - start;
+        pool.Stop();
+
+        printf("%d connections:  game thread blocked %8.0f usec, all done after %8.0f usec\n",
+            sizes[s], (double)blocked, (double)total);
+    }
+}
@@ -0,0 +1,59 @@
+/*
+ * benchmark.h
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ *
+ * Helpers for the benchmarks in the unit tests.
+ *
+ */
+
+/*   Design notes:
+ *
+ *  Benchmarks are gtest tests named DISABLED_<Something>Benchmark, so the
+ *  normal run of a test program skips them and prints no timings.  Run
+ *  them on demand with
+ *
+ *    psutil_test --gtest_also_run_disabled_tests --gtest_filter=*Benchmark
+ */
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <csutil/array.h>
+
+/// qsort() order for floats.
+inline int CompareFloat(const void* a, const void* b)
+{
+    float fa = *(const float*)a;
+    float fb = *(const float*)b;
+    return (fa < fb) ? -1 : (fa > fb) ? 1 : 0;
+}
+
+/// Sort 'samples' and print their percentiles on one line.
+inline void PrintPercentiles(const char* what, csArray<float>& samples, const char* unit)
+{
+    if (samples.IsEmpty())
+        return;
+
+    qsort(samples.GetArray(), samples.GetSize(), sizeof(float), CompareFloat);
+    size_t n = samples.GetSize();
+    printf("%-32s p50 %9.2f  p90 %9.2f  p99 %9.2f  max %9.2f %s (%zu samples)\n", what,
+        samples[n / 2], samples[n * 9 / 10], samples[n * 99 / 100], samples[n - 1], unit, n);
+}
+
+#endif
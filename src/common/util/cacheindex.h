@@ -0,0 +1,154 @@
+/*
+ * cacheindex.h
+ *
+ * Copyright (C) 2005 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ *
+ * Indexes over caches that keep their objects in arrays, so lookups by id
+ * or name need no scan. Both find the object a scan of the array in the
+ * order of adding would find: the first one added for a key.
+ *
+ */
+#ifndef __CACHEINDEX_H__
+#define __CACHEINDEX_H__
+
+#include <ctype.h>
+#include <csutil/array.h>
+#include <csutil/csstring.h>
+#include <csutil/hash.h>
+
+/**
+ * Objects by a key such as an id, or several ids packed in one.
+ */
+template <class T, class K = uint32>
+class CacheIndex
+{
+public:
+    /// Index 'obj' under 'key', unless an earlier object has that key.
+    void Add(const K& key, T* obj)
+    {
+        if (!index.Contains(key))
+            index.Put(key, obj);
+    }
+
+    /// The first object added with 'key', NULL if none.
+    T* Get(const K& key) const
+    {
+        return index.Get(key, NULL);
+    }
+
+    size_t GetSize() const
+    {
+        return index.GetSize();
+    }
+
+    void Clear()
+    {
+        index.DeleteAll();
+    }
+
+private:
+    csHash<T*, K> index;
+};
+
+/**
+ * Objects by case insensitive name. Lookups neither copy the name nor
+ * allocate. All objects sharing a name are kept, in the order they were
+ * added, for lookups that choose among them by more than the name.
+ */
+template <class T>
+class NameIndex
+{
+public:
+    /// Index 'obj' under 'name'. Objects without a name are left out.
+    void Add(const char* name, T* obj)
+    {
+        if (!name)
+            return;
+
+        uint32 hash = Hash(name);
+        csArray<Entry>* bucket = index.GetElementPointer(hash);
+        if (!bucket)
+        {
+            index.Put(hash, csArray<Entry>());
+            bucket = index.GetElementPointer(hash);
+        }
+
+        for (size_t i = 0; i < bucket->GetSize(); i++)
+        {
+            if (!strcasecmp(bucket->Get(i).name, name))
+            {
+                bucket->Get(i).objs.Push(obj);
+                return;
+            }
+        }
+
+        Entry entry;
+        entry.name = name;
+        entry.objs.Push(obj);
+        bucket->Push(entry);
+    }
+
+    /// The objects named 'name' in the order they were added, NULL if none.
+    const csArray<T*>* GetAll(const char* name) const
+    {
+        if (!name)
+            return NULL;
+
+        const csArray<Entry>* bucket = index.GetElementPointer(Hash(name));
+        if (!bucket)
+            return NULL;
+
+        for (size_t i = 0; i < bucket->GetSize(); i++)
+        {
+            if (!strcasecmp(bucket->Get(i).name, name))
+                return &bucket->Get(i).objs;
+        }
+        return NULL;
+    }
+
+    /// The first object added with 'name', NULL if none.
+    T* Get(const char* name) const
+    {
+        const csArray<T*>* objs = GetAll(name);
+        return objs ? objs->Get(0) : NULL;
+    }
+
+    void Clear()
+    {
+        index.DeleteAll();
+    }
+
+    /// djb2 over the lower case characters.
+    static uint32 Hash(const char* name)
+    {
+        uint32 hash = 5381;
+        for (; *name; name++)
+            hash = hash * 33 + (uint32) tolower((unsigned char) *name);
+        return hash;
+    }
+
+private:
+    struct Entry
+    {
+        csString name;
+        csArray<T*> objs;
+    };
+
+    /// Names by hash, more than one only when the hashes collide
+    csHash<csArray<Entry>, uint32> index;
+};
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ * cacheindex_unittest.cpp
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/parray.h>
+#include <csutil/sysfunc.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/cacheindex.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// Stands in for the cached objects, a race or a spell.
+struct Cached
+{
+    Cached(unsigned int id, const char* name, int gender = 0)
+        : id(id), name(name), gender(gender) {}
+
+    unsigned int id;
+    csString name;
+    int gender;
+};
+
+TEST(CacheIndexTest, FirstAddedWins)
+{
+    Cached a(1, "a"), b(1, "b"), c(2, "c");
+    CacheIndex<Cached> index;
+    index.Add(a.id, &a);
+    index.Add(b.id, &b);
+    index.Add(c.id, &c);
+
+    EXPECT_EQ(2u, index.GetSize());
+    EXPECT_EQ(&a, index.Get(1));
+    EXPECT_EQ(&c, index.Get(2));
+    EXPECT_TRUE(index.Get(3) == NULL);
+
+    index.Clear();
+    EXPECT_EQ(0u, index.GetSize());
+    EXPECT_TRUE(index.Get(1) == NULL);
+}
+
+TEST(CacheIndexTest, StringKeysAreExact)
+{
+    Cached a(1, "Weapons"), b(2, "weapons");
+    CacheIndex<Cached, csString> index;
+    index.Add(a.name, &a);
+    index.Add(b.name, &b);
+
+    EXPECT_EQ(&a, index.Get("Weapons"));
+    EXPECT_EQ(&b, index.Get("weapons"));
+    EXPECT_TRUE(index.Get("WEAPONS") == NULL);
+}
+
+TEST(CacheIndexTest, NamesIgnoreCase)
+{
+    Cached female(1, "Ylian", 1), male(2, "ylian", 2), klyros(3, "Klyros");
+    NameIndex<Cached> index;
+    index.Add(female.name, &female);
+    index.Add(male.name, &male);
+    index.Add(klyros.name, &klyros);
+    index.Add(NULL, &klyros);
+
+    EXPECT_EQ(&female, index.Get("YLIAN"));
+    EXPECT_EQ(&klyros, index.Get("klyros"));
+    EXPECT_TRUE(index.Get("Ylia") == NULL);
+    EXPECT_TRUE(index.Get(NULL) == NULL);
+
+    const csArray<Cached*>* all = index.GetAll("yLiAn");
+    ASSERT_TRUE(all != NULL);
+    ASSERT_EQ(2u, all->GetSize());
+    EXPECT_EQ(&female, all->Get(0));
+    EXPECT_EQ(&male, all->Get(1));
+
+    index.Clear();
+    EXPECT_TRUE(index.Get("Ylian") == NULL);
+}
+
+TEST(CacheIndexTest, HashCollisions)
+{
+    // Different names with the same hash still find their own objects
+    Cached a(1, "Aa"), b(2, "B@");
+    ASSERT_EQ(NameIndex<Cached>::Hash("Aa"), NameIndex<Cached>::Hash("b@"));
+
+    NameIndex<Cached> index;
+    index.Add(a.name, &a);
+    index.Add(b.name, &b);
+    EXPECT_EQ(&a, index.Get("aA"));
+    EXPECT_EQ(&b, index.Get("b@"));
+}
+
+/**
+ * Reports the time per lookup by id and by name of the indexes against
+ * scanning the array the way CacheManager did before, for caches of
+ * growing size. Disabled in normal runs, see util/benchmark.h.
+ */
+TEST(CacheIndexTest, DISABLED_LookupBenchmark)
+{
+    const int lookups = 200000;
+    const size_t sizes[] = { 25, 500, 5000 };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        csPDelArray<Cached> list;
+        CacheIndex<Cached> byid;
+        NameIndex<Cached> byname;
+        for (size_t i = 0; i < sizes[s]; i++)
+        {
+            Cached* obj = new Cached((unsigned int) i * 7, csString().Format("Object Number %zu", i));
+            list.Push(obj);
+            byid.Add(obj->id, obj);
+            byname.Add(obj->name, obj);
+        }
+
+        csArray<csString> names;
+        for (int i = 0; i < 64; i++)
+            names.Push(csString().Format("object number %zu", (i * 7919) % sizes[s]));
+
+        size_t found = 0;
+        csMicroTicks start = csGetMicroTicks();
+        for (int i = 0; i < lookups; i++)
+        {
+            unsigned int id = (unsigned int) ((i * 7919) % sizes[s]) * 7;
+            for (size_t j = 0; j < list.GetSize(); j++)
+            {
+                if (list[j]->id == id)
+                {
+                    found++;
+                    break;
+                }
+            }
+        }
+        csMicroTicks scanid = csGetMicroTicks() - start;
+
+        start = csGetMicroTicks();
+        for (int i = 0; i < lookups; i++)
+        {
+            if (byid.Get((unsigned int) ((i * 7919) % sizes[s]) * 7))
+                found++;
+        }
+        csMicroTicks indexid = csGetMicroTicks() - start;
+
+        start = csGetMicroTicks();
+        for (int i = 0; i < lookups; i++)
+        {
+            const csString& name = names[i % names.GetSize()];
+            for (size_t j = 0; j < list.GetSize(); j++)
+            {
+                if (name.CompareNoCase(list[j]->name))
+                {
+                    found++;
+                    break;
+                }
+            }
+        }
+        csMicroTicks scanname = csGetMicroTicks() - start;
+
+        start = csGetMicroTicks();
+        for (int i = 0; i < lookups; i++)
+        {
+            if (byname.Get(names[i % names.GetSize()]))
+                found++;
+        }
+        csMicroTicks indexname = csGetMicroTicks() - start;
+
+        EXPECT_EQ((size_t) lookups * 4, found);
+        printf("%5zu objects: by id %8.4f usec scanned, %8.4f indexed;"
+            " by name %8.4f usec scanned, %8.4f indexed\n", sizes[s],
+            (double) scanid / lookups, (double) indexid / lookups,
+            (double) scanname / lookups, (double) indexname / lookups);
+    }
+}
@@ -0,0 +1,359 @@
+/*
+ * delayedwrite.cpp
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+#include <psconfig.h>
+
+#include "util/delayedwrite.h"
+#include "util/psprofile.h"
+
+/// Start a new statement after this many bytes, well below max_allowed_packet
+#define DELAYED_WRITE_MAX_LENGTH 256000
+
+bool DelayedWriteManager::PendingRow::Sets(const char* table, const char* field, const char* value) const
+{
+    if (this->table != table)
+        return false;
+
+    size_t f = fields.Find(field);
+    return f != csArrayItemNotFound && values[f] == value;
+}
+
+DelayedWriteManager::DelayedWriteManager(AsyncQueryPool::Connection* conn, csTicks interval, size_t batchsize)
+{
+    this->conn = conn;
+    this->interval = interval;
+    this->batchsize = batchsize;
+    queuedCount = writtenCount = 0;
+    flushRequested = false;
+    stopping = false;
+    running = true;
+    memset(&stats, 0, sizeof(stats));
+}
+
+DelayedWriteManager::~DelayedWriteManager()
+{
+    for (size_t i = 0; i < order.GetSize(); i++)
+        delete order[i];
+    delete conn;
+}
+
+bool DelayedWriteManager::Queue(const char* table, const char* idfield, uint32 id,
+                                const csArray<csString>& fields, const csArray<csString>& values, size_t count)
+{
+    csString key;
+    key.Format("%s/%u", table, id);
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    if (stopping)
+        return false;
+
+    queuedCount++;
+    stats.rowsQueued++;
+
+    PendingRow* row = pending.Get(key, NULL);
+    if (!row)
+    {
+        row = new PendingRow;
+        row->table = table;
+        row->idfield = idfield;
+        row->id = id;
+        for (size_t i = 0; i < count; i++)
+        {
+            row->fields.Push(fields[i]);
+            row->values.Push(values[i]);
+        }
+        pending.Put(key, row);
+        order.Push(row);
+        return true;
+    }
+
+    // Still waiting, the newest value of each field wins
+    stats.rowsCoalesced++;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t f = (i < row->fields.GetSize() && row->fields[i] == fields[i]) ? i : row->fields.Find(fields[i]);
+        if (f == csArrayItemNotFound)
+        {
+            row->fields.Push(fields[i]);
+            row->values.Push(values[i]);
+        }
+        else
+        {
+            row->values[f] = values[i];
+        }
+    }
+    return true;
+}
+
+void DelayedWriteManager::Flush()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    size_t target = queuedCount;
+    while (running && writtenCount < target)
+    {
+        flushRequested = true;
+        datacondition.NotifyOne();
+        flushcondition.Wait(mutex);
+    }
+}
+
+bool DelayedWriteManager::Flush(const char* table, uint32 id)
+{
+    csString key;
+    key.Format("%s/%u", table, id);
+
+    // Usually the row is not queued and this returns at once
+    bool queued = false;
+    CS::Threading::MutexScopedLock lock(mutex);
+    while (running && (pending.Contains(key) || writingKeys.Contains(key)))
+    {
+        queued = true;
+        flushRequested = true;
+        datacondition.NotifyOne();
+        flushcondition.Wait(mutex);
+    }
+    return queued;
+}
+
+void DelayedWriteManager::Flush(const char* table, const char* field, uint32 value)
+{
+    // The literal dbDelayedUpdate::AddField() makes of an unsigned int
+    csString literal;
+    literal.Format("%u", value);
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    while (running && IsQueued(table, field, literal))
+    {
+        flushRequested = true;
+        datacondition.NotifyOne();
+        flushcondition.Wait(mutex);
+    }
+}
+
+bool DelayedWriteManager::IsQueued(const char* table, const char* field, const char* value)
+{
+    for (size_t i = 0; i < order.GetSize(); i++)
+    {
+        if (order[i]->Sets(table, field, value))
+            return true;
+    }
+    for (size_t i = 0; i < writingRows.GetSize(); i++)
+    {
+        if (writingRows[i]->Sets(table, field, value))
+            return true;
+    }
+    return false;
+}
+
+void DelayedWriteManager::Stop()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    stopping = true;
+    datacondition.NotifyOne();
+}
+
+void DelayedWriteManager::GetStats(psDelayedWriteStats& stats)
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    stats = this->stats;
+    stats.queueDepth = order.GetSize() + writingRows.GetSize();
+}
+
+void DelayedWriteManager::Run()
+{
+    conn->ThreadInit();
+
+    bool done = false;
+    while (!done)
+    {
+        size_t count;
+        {
+            CS::Threading::MutexScopedLock lock(mutex);
+            if (!stopping && !flushRequested)
+                datacondition.Wait(mutex, interval);
+
+            // The rows stay readable by Flush() until they are written
+            writingRows = order;
+            order.Empty();
+            csHash<PendingRow*, csString>::GlobalIterator it = pending.GetIterator();
+            while (it.HasNext())
+            {
+                csString key;
+                it.Next(key);
+                writingKeys.Add(key);
+            }
+            pending.DeleteAll();
+            count = queuedCount;
+            done = stopping;
+        }
+
+        if (!writingRows.IsEmpty())
+            WriteRows(writingRows);
+
+        CS::Threading::MutexScopedLock lock(mutex);
+        for (size_t i = 0; i < writingRows.GetSize(); i++)
+            delete writingRows[i];
+        writingRows.Empty();
+        writingKeys.DeleteAll();
+        writtenCount = count;
+        flushRequested = false;
+        if (done)
+            running = false;
+        flushcondition.NotifyAll();
+    }
+
+    conn->ThreadEnd();
+}
+
+void DelayedWriteManager::WriteRows(csArray<PendingRow*>& rows)
+{
+    psStopWatch timer;
+    timer.Start();
+
+    // Group the rows that set the same fields of the same table
+    csHash<size_t, csString> groupIndex;
+    csArray<csArray<PendingRow*> > groups;
+    for (size_t i = 0; i < rows.GetSize(); i++)
+    {
+        PendingRow* row = rows[i];
+        csString signature(row->table);
+        signature.Append('/');
+        signature.Append(row->idfield);
+        for (size_t f = 0; f < row->fields.GetSize(); f++)
+        {
+            signature.Append(',');
+            signature.Append(row->fields[f]);
+        }
+
+        size_t group = groupIndex.Get(signature, csArrayItemNotFound);
+        if (group == csArrayItemNotFound)
+        {
+            group = groups.Push(csArray<PendingRow*>());
+            groupIndex.Put(signature, group);
+        }
+        groups[group].Push(row);
+    }
+
+    // MyISAM has no transactions, each statement is written on its own
+    for (size_t g = 0; g < groups.GetSize(); g++)
+        WriteGroup(groups[g]);
+
+    csTicks elapsed = timer.Stop();
+    CS::Threading::MutexScopedLock lock(mutex);
+    stats.flushes++;
+    stats.lastFlushTime = elapsed;
+    stats.maxFlushTime = MAX(stats.maxFlushTime, elapsed);
+    stats.totalFlushTime += elapsed;
+}
+
+void DelayedWriteManager::WriteGroup(csArray<PendingRow*>& rows)
+{
+    size_t written = 0, failed = 0;
+    size_t first = 0;
+    while (first < rows.GetSize())
+    {
+        // Take rows while the statement stays short enough
+        size_t last = first;
+        size_t length = 0;
+        while (last < rows.GetSize() && last - first < batchsize && length < DELAYED_WRITE_MAX_LENGTH)
+        {
+            PendingRow* row = rows[last++];
+            for (size_t f = 0; f < row->values.GetSize(); f++)
+                length += row->fields[f].Length() + row->values[f].Length() + 16;
+        }
+
+        csString sql;
+        BuildUpdate(sql, rows, first, last);
+        if (conn->Command(sql) != QUERY_FAILED)
+        {
+            written += last - first;
+        }
+        else if (last - first == 1)
+        {
+            printf("Delayed update of %s %u failed: %s\n", rows[first]->table.GetData(),
+                rows[first]->id, conn->GetLastError());
+            failed++;
+        }
+        else
+        {
+            // One bad row fails the statement, write them one by one
+            for (size_t i = first; i < last; i++)
+            {
+                BuildUpdate(sql, rows, i, i + 1);
+                if (conn->Command(sql) != QUERY_FAILED)
+                {
+                    written++;
+                }
+                else
+                {
+                    printf("Delayed update of %s %u failed: %s\n", rows[i]->table.GetData(),
+                        rows[i]->id, conn->GetLastError());
+                    failed++;
+                }
+            }
+        }
+        first = last;
+    }
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    stats.rowsWritten += written;
+    stats.rowsFailed += failed;
+}
+
+void DelayedWriteManager::BuildUpdate(csString& sql, csArray<PendingRow*>& rows, size_t first, size_t last)
+{
+    PendingRow* head = rows[first];
+    sql.Format("UPDATE %s SET ", head->table.GetData());
+
+    if (last - first == 1)
+    {
+        for (size_t f = 0; f < head->fields.GetSize(); f++)
+        {
+            if (f > 0)
+                sql.Append(", ");
+            sql.Append(head->fields[f]);
+            sql.Append(" = ");
+            sql.Append(head->values[f]);
+        }
+        sql.AppendFmt(" WHERE %s = %u", head->idfield.GetData(), head->id);
+        return;
+    }
+
+    // field = CASE id WHEN 1 THEN value WHEN 2 THEN value END, ...
+    for (size_t f = 0; f < head->fields.GetSize(); f++)
+    {
+        if (f > 0)
+            sql.Append(", ");
+        sql.AppendFmt("%s = CASE %s", head->fields[f].GetData(), head->idfield.GetData());
+        for (size_t i = first; i < last; i++)
+        {
+            sql.AppendFmt(" WHEN %u THEN ", rows[i]->id);
+            sql.Append(rows[i]->values[f]);
+        }
+        sql.Append(" END");
+    }
+
+    sql.AppendFmt(" WHERE %s IN (", head->idfield.GetData());
+    for (size_t i = first; i < last; i++)
+    {
+        if (i > first)
+            sql.Append(",");
+        sql.AppendFmt("%u", rows[i]->id);
+    }
+    sql.Append(")");
+}
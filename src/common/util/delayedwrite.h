@@ -0,0 +1,123 @@
+/*
+ * delayedwrite.h
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+#ifndef __DELAYEDWRITE_H__
+#define __DELAYEDWRITE_H__
+
+#include <csutil/csstring.h>
+#include <csutil/hash.h>
+#include <csutil/set.h>
+#include <csutil/threading/thread.h>
+#include <csutil/threading/condition.h>
+
+#include "iserver/idal.h"
+#include "util/asyncquery.h"
+
+/**
+ * Writes the rows queued by iDataConnection::NewDelayedUpdateStatement()
+ * from a thread of its own, on a connection of its own. Like the
+ * AsyncQueryPool it knows nothing of the database behind the connection.
+ *
+ * A row is identified by table and id. Queuing a row that is still waiting
+ * merges the fields into it, so a row changed many times between flushes
+ * is written once. Every 'interval' milliseconds, or when asked to flush,
+ * the waiting rows are written. Rows of a table that set the same fields
+ * are combined into multi-row UPDATE statements of up to 'batchsize' rows.
+ * The tables are MyISAM, so each statement stands on its own, a flush is
+ * not one transaction. These are UPDATEs and not upserts, so rows deleted
+ * in the meantime stay deleted.
+ *
+ * A queued row sets its fields when it is written, so a direct update of
+ * those fields made in the meantime would be lost, and a select may see
+ * the old values. Code that reads or updates such rows directly flushes
+ * them first, by id or by the value of a field such as the owner.
+ */
+class DelayedWriteManager : public CS::Threading::Runnable
+{
+public:
+    /// The manager deletes 'conn' when it is destroyed.
+    DelayedWriteManager(AsyncQueryPool::Connection* conn, csTicks interval, size_t batchsize);
+    virtual ~DelayedWriteManager();
+
+    virtual void Run();
+
+    /// Queue a row, 'values' are SQL literals matching 'fields'. False once stopped.
+    bool Queue(const char* table, const char* idfield, uint32 id,
+               const csArray<csString>& fields, const csArray<csString>& values, size_t count);
+
+    /// Wait until all rows queued so far are written.
+    void Flush();
+
+    /**
+     * Wait until the row of 'table' and 'id' is written, if it is queued or
+     * being written. Returns true if it was.
+     */
+    bool Flush(const char* table, uint32 id);
+
+    /// Wait until the rows of 'table' queued with 'field' set to 'value' are written.
+    void Flush(const char* table, const char* field, uint32 value);
+
+    /// Write all rows and end the thread.
+    void Stop();
+
+    void GetStats(psDelayedWriteStats& stats);
+
+private:
+    struct PendingRow
+    {
+        csString table;
+        csString idfield;
+        uint32 id;
+        csArray<csString> fields;
+        csArray<csString> values;
+
+        /// True if the row sets 'field' of 'table' to the literal 'value'.
+        bool Sets(const char* table, const char* field, const char* value) const;
+    };
+
+    /// True if a row waiting or being written sets 'field' of 'table' to 'value'.
+    bool IsQueued(const char* table, const char* field, const char* value);
+
+    void WriteRows(csArray<PendingRow*>& rows);
+    void WriteGroup(csArray<PendingRow*>& rows);
+    void BuildUpdate(csString& sql, csArray<PendingRow*>& rows, size_t first, size_t last);
+
+    AsyncQueryPool::Connection* conn;
+    csTicks interval;
+    size_t batchsize;
+
+    CS::Threading::Mutex mutex;
+    CS::Threading::Condition datacondition;
+    CS::Threading::Condition flushcondition;
+
+    /// Waiting rows by "table/id", and in the order they were first queued
+    csHash<PendingRow*, csString> pending;
+    csArray<PendingRow*> order;
+    /// The rows the writer thread is writing now, and their keys
+    csArray<PendingRow*> writingRows;
+    csSet<csString> writingKeys;
+
+    size_t queuedCount;
+    size_t writtenCount;
+    bool flushRequested;
+    bool stopping;
+    bool running;
+    psDelayedWriteStats stats;
+};
+
+#endif
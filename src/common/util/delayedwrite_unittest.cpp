@@ -0,0 +1,227 @@
+/*
+ * delayedwrite_unittest.cpp
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/delayedwrite.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+using namespace CS::Threading;
+
+/// Keeps the statements it is given, those containing "bad" fail.
+class RecordingConnection : public AsyncQueryPool::Connection
+{
+public:
+    RecordingConnection(csArray<csString>& statements) : statements(statements) {}
+
+    virtual iResultSet* Select(const char* sql) { return NULL; }
+
+    virtual unsigned long Command(const char* sql)
+    {
+        statements.Push(sql);
+        return strstr(sql, "bad") ? QUERY_FAILED : 1;
+    }
+
+    virtual const char* GetLastError() { return "bad value"; }
+
+private:
+    csArray<csString>& statements;
+};
+
+/**
+ * A writer on its own thread with a RecordingConnection. The interval is
+ * long enough that rows are only written when the test flushes.
+ */
+class DelayedWriteTest : public ::testing::Test
+{
+protected:
+    void Start(size_t batchsize)
+    {
+        writer.AttachNew(new DelayedWriteManager(new RecordingConnection(statements), 1000000, batchsize));
+        thread.AttachNew(new Thread(writer));
+        thread->Start();
+    }
+
+    virtual void TearDown()
+    {
+        if (thread)
+        {
+            writer->Stop();
+            thread->Wait();
+        }
+    }
+
+    /// Queue a row of "items" setting one or two fields.
+    bool QueueItem(uint32 id, const char* field, const char* value,
+                   const char* field2 = NULL, const char* value2 = NULL)
+    {
+        csArray<csString> fields, values;
+        fields.Push(field);
+        values.Push(value);
+        if (field2)
+        {
+            fields.Push(field2);
+            values.Push(value2);
+        }
+        return writer->Queue("items", "id", id, fields, values, fields.GetSize());
+    }
+
+    csArray<csString> statements;
+    csRef<DelayedWriteManager> writer;
+    csRef<Thread> thread;
+};
+
+TEST_F(DelayedWriteTest, SingleRow)
+{
+    Start(100);
+    EXPECT_TRUE(QueueItem(7, "owner", "3", "name", "'Sword'"));
+    writer->Flush();
+
+    ASSERT_EQ(1u, statements.GetSize());
+    EXPECT_STREQ("UPDATE items SET owner = 3, name = 'Sword' WHERE id = 7", statements[0].GetData());
+}
+
+TEST_F(DelayedWriteTest, Coalescing)
+{
+    // Queued again before written, the newest value of each field wins and
+    // fields only set the second time are added
+    Start(100);
+    QueueItem(7, "owner", "3", "name", "'Sword'");
+    QueueItem(7, "owner", "4");
+    QueueItem(7, "quality", "50", "owner", "5");
+    writer->Flush();
+
+    ASSERT_EQ(1u, statements.GetSize());
+    EXPECT_STREQ("UPDATE items SET owner = 5, name = 'Sword', quality = 50 WHERE id = 7", statements[0].GetData());
+
+    psDelayedWriteStats stats;
+    writer->GetStats(stats);
+    EXPECT_EQ(3u, stats.rowsQueued);
+    EXPECT_EQ(2u, stats.rowsCoalesced);
+    EXPECT_EQ(1u, stats.rowsWritten);
+    EXPECT_EQ(0u, stats.queueDepth);
+
+    // Once written, the row is queued anew
+    QueueItem(7, "owner", "6");
+    writer->Flush();
+    ASSERT_EQ(2u, statements.GetSize());
+    EXPECT_STREQ("UPDATE items SET owner = 6 WHERE id = 7", statements[1].GetData());
+}
+
+TEST_F(DelayedWriteTest, CaseBatch)
+{
+    Start(100);
+    QueueItem(1, "owner", "10", "name", "'a'");
+    QueueItem(2, "owner", "20", "name", "'b'");
+    QueueItem(3, "owner", "30", "name", "'c'");
+    writer->Flush();
+
+    ASSERT_EQ(1u, statements.GetSize());
+    EXPECT_STREQ("UPDATE items SET "
+                 "owner = CASE id WHEN 1 THEN 10 WHEN 2 THEN 20 WHEN 3 THEN 30 END, "
+                 "name = CASE id WHEN 1 THEN 'a' WHEN 2 THEN 'b' WHEN 3 THEN 'c' END "
+                 "WHERE id IN (1,2,3)", statements[0].GetData());
+}
+
+TEST_F(DelayedWriteTest, GroupsAndBatchSize)
+{
+    // Rows setting other fields go into statements of their own, and no
+    // statement holds more than 'batchsize' rows
+    Start(2);
+    QueueItem(1, "owner", "10");
+    QueueItem(2, "quality", "5");
+    QueueItem(3, "owner", "30");
+    QueueItem(4, "owner", "40");
+    writer->Flush();
+
+    ASSERT_EQ(3u, statements.GetSize());
+    EXPECT_STREQ("UPDATE items SET owner = CASE id WHEN 1 THEN 10 WHEN 3 THEN 30 END WHERE id IN (1,3)",
+                 statements[0].GetData());
+    EXPECT_STREQ("UPDATE items SET owner = 40 WHERE id = 4", statements[1].GetData());
+    EXPECT_STREQ("UPDATE items SET quality = 5 WHERE id = 2", statements[2].GetData());
+}
+
+TEST_F(DelayedWriteTest, FailedRow)
+{
+    // One bad row fails the statement, then the rows are written one by one
+    Start(100);
+    QueueItem(1, "name", "'a'");
+    QueueItem(2, "name", "'bad'");
+    QueueItem(3, "name", "'c'");
+    writer->Flush();
+
+    ASSERT_EQ(4u, statements.GetSize());
+    EXPECT_STREQ("UPDATE items SET name = 'a' WHERE id = 1", statements[1].GetData());
+    EXPECT_STREQ("UPDATE items SET name = 'c' WHERE id = 3", statements[3].GetData());
+
+    psDelayedWriteStats stats;
+    writer->GetStats(stats);
+    EXPECT_EQ(2u, stats.rowsWritten);
+    EXPECT_EQ(1u, stats.rowsFailed);
+}
+
+TEST_F(DelayedWriteTest, FlushRow)
+{
+    Start(100);
+    QueueItem(1, "owner", "10");
+    EXPECT_FALSE(writer->Flush("items", 2));
+    EXPECT_FALSE(writer->Flush("other", 1));
+    EXPECT_TRUE(statements.IsEmpty());
+
+    EXPECT_TRUE(writer->Flush("items", 1));
+    ASSERT_EQ(1u, statements.GetSize());
+    EXPECT_FALSE(writer->Flush("items", 1));
+}
+
+TEST_F(DelayedWriteTest, FlushByValue)
+{
+    Start(100);
+    QueueItem(1, "owner", "10");
+    writer->Flush("items", "owner", 11);
+    writer->Flush("items", "name", 10);
+    EXPECT_TRUE(statements.IsEmpty());
+
+    writer->Flush("items", "owner", 10);
+    ASSERT_EQ(1u, statements.GetSize());
+    EXPECT_STREQ("UPDATE items SET owner = 10 WHERE id = 1", statements[0].GetData());
+}
+
+TEST_F(DelayedWriteTest, Stop)
+{
+    // Stopping writes what is queued and refuses more
+    Start(100);
+    QueueItem(1, "owner", "10");
+    writer->Stop();
+    thread->Wait();
+    thread.Invalidate();
+
+    ASSERT_EQ(1u, statements.GetSize());
+    EXPECT_FALSE(QueueItem(2, "owner", "20"));
+
+    // Nothing left to wait for
+    writer->Flush();
+    EXPECT_FALSE(writer->Flush("items", 1));
+}
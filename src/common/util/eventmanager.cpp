@@ -30,6 +30,7 @@
 /*---------------------------------------------------------------------------*/
 
 EventManager::EventManager()
+    : eventqueue(1, csGetTicks())
 {
     // Setting up the static pointer in psGameEvent. Used so
     // that an event can be fired without needing to look up 
@@ -42,9 +43,17 @@ EventManager::EventManager()
 EventManager::~EventManager()
 {
     // Clean up the event queue
-    while (eventqueue.Length())
+    csArray<psGameEvent*> events;
+    eventqueue.RemoveAll(events);
+    events.Merge(cancelled);
+    cancelled.Empty();
+
+    if (psGameEvent::eventmanager == this)
+        psGameEvent::eventmanager = NULL;
+
+    for (size_t i = 0; i < events.GetSize(); i++)
     {
-        delete eventqueue.DeleteMin();
+        delete events[i];
     }
 }
 
@@ -52,8 +61,8 @@ void EventManager::Push(psGameEvent *event)
 {
     CS::Threading::MutexScopedLock lock(mutex);
 
-    // This inserts the event into the priority queue, sorted by timestamp
-    eventqueue.Insert(event);
+    // This inserts the event into the timer wheel at its trigger time
+    eventqueue.Schedule(event, event->triggerticks);
 
     /*check if events are inserted late*/
     if (event->triggerticks < lastTick)
@@ -67,6 +76,23 @@ void EventManager::Push(psGameEvent *event)
     }
 }
 
+bool EventManager::Cancel(psGameEvent *event)
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    if (!eventqueue.Remove(event))
+        return false;
+
+    cancelled.Push(event);
+    return true;
+}
+
+size_t EventManager::GetQueuedEvents()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    return eventqueue.GetSize();
+}
+
 // Process events at least every 250 tick
 #define PROCESS_EVENT   250
 
@@ -76,7 +102,8 @@ csTicks EventManager::ProcessEventQueue()
 
     static int lastid;
 
-    psGameEvent *event = NULL;
+    csArray<psGameEvent*> due;
+    csArray<psGameEvent*> dead;
     int events = 0;
     int count = 0;
 
@@ -86,80 +113,78 @@ csTicks EventManager::ProcessEventQueue()
         {
             CS::Threading::MutexScopedLock lock(mutex);
 
-            event = eventqueue.FindMin();
+            // Events cancelled since the last run, or by the last batch
+            dead.Merge(cancelled);
+            cancelled.Empty();
 
-            if (!event || event->triggerticks > now)
+            // Takes out every event due, in trigger order
+            eventqueue.Advance(now, due);
+            if (due.IsEmpty())
             {
                 // Empty event queue or not time for event yet
                 break;
             }
-            eventqueue.DeleteMin();
 
-            /*check if events arrive in order*/
-            if (event->triggerticks < lastTick)
-            {
-                /* this should not happen at all */
-                CPrintf(
-                        CON_DEBUG,
-                        "Event %s:%s (%d) scheduled at %d is being processed out of order at time %d! Last processed event was scheduled for %d.\n",
-                        event->GetType(), 
-                        event->ToString().GetDataSafe(),
-                        event->id, event->triggerticks, now, lastTick);
-                CS_ASSERT_MSG("Event trigger time is inconsistent", false);
-            }
-            else
+            // Events queued late are due at once and may come after later
+            // ones, just keep track of the latest.
+            for (size_t i = 0; i < due.GetSize(); i++)
             {
-                lastTick = event->triggerticks;
+                if ((int32)(due[i]->triggerticks - lastTick) > 0)
+                    lastTick = due[i]->triggerticks;
             }
-
         }
-        
 
-        events++;
-        csTicks start = csGetTicks();
-
-        if (event->CheckTrigger())
+        for (size_t i = 0; i < dead.GetSize(); i++)
         {
-            event->Trigger();
+            delete dead[i];
         }
+        dead.Empty();
 
-        csTicks timeTaken = csGetTicks() - start;
-
-        if(timeTaken > 1000)
+        for (size_t i = 0; i < due.GetSize(); i++)
         {
-            csString status;
-            status.Format("Event type %s:%s has taken %u time to process\n", event->GetType(), 
-                          event->ToString().GetDataSafe(),timeTaken);
-            CPrintf(CON_WARNING, "%s\n", status.GetData());
-            if(LogCSV::GetSingletonPtr())
-                LogCSV::GetSingleton().Write(CSV_STATUS, status);
-        }
+            psGameEvent *event = due[i];
 
-        if (lastid == event->id)
-        {
-            CPrintf(CON_DEBUG, "Event %d is being processed more than once at time %d!\n",event->id,event->triggerticks);
-        }
-        lastid    = event->id;
+            events++;
+            csTicks start = csGetTicks();
 
-        count++;
-//        if (count % 100 == 0)
-//        {
-//            CPrintf(CON_DEBUG, "Went through event loop 100 times in one timeslice for %d events.  This means we either have duplicate events, "
-//                "bugs in event generation or bugs in deleting events from the event tree. "
-//                "Last event: %s:%s took %u time\n", events, event->GetType(), event->ToString().GetDataSafe(), timeTaken);
-//        }
+            if (event->CheckTrigger())
+            {
+                event->Trigger();
+            }
+
+            csTicks timeTaken = csGetTicks() - start;
 
-        delete event;
+            if(timeTaken > 1000)
+            {
+                csString status;
+                status.Format("Event type %s:%s has taken %u time to process\n", event->GetType(), 
+                              event->ToString().GetDataSafe(),timeTaken);
+                CPrintf(CON_WARNING, "%s\n", status.GetData());
+                if(LogCSV::GetSingletonPtr())
+                    LogCSV::GetSingleton().Write(CSV_STATUS, status);
+            }
+
+            if (lastid == event->id)
+            {
+                CPrintf(CON_DEBUG, "Event %d is being processed more than once at time %d!\n",event->id,event->triggerticks);
+            }
+            lastid    = event->id;
+
+            count++;
+
+            delete event;
+        }
+        due.Empty();
     }
 
-    if (event)
+    for (size_t i = 0; i < dead.GetSize(); i++)
     {
-        // We have a event so report when we would like to be
-        // called again
-        return MIN(event->triggerticks, PROCESS_EVENT + now);
+        delete dead[i];
     }
 
-    return PROCESS_EVENT; // Process events at least every PROCESS_EVENT ticks
+    // Report when we would like to be called again
+    CS::Threading::MutexScopedLock lock(mutex);
+    return eventqueue.NextExpire(now + PROCESS_EVENT);
 }
 
 void EventManager::TrackEventTimes(csTicks timeTaken,MsgEntry *msg)
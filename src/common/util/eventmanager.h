@@ -20,7 +20,7 @@
 #ifndef __EVENTMANAGER_H__
 #define __EVENTMANAGER_H__
 
-#include "util/heap.h"
+#include "util/timerwheel.h"
 #include "net/msghandler.h"
 
 class psGameEvent;
@@ -32,12 +32,18 @@ class MsgHandler;
  * It maintains a queue ordered by trigger time and is polled by the engine
  * periodically to clear any queued events with trigger times less than the
  * current ticks time.
+ *
+ * The queue is a timer wheel with a resolution of one tick, so queueing,
+ * cancelling and firing an event are O(1). Events due in the same tick
+ * fire in the order they were queued.
  */
 class EventManager : public MsgHandler, public Singleton<EventManager>
 {
 protected:
     CS::Threading::Mutex mutex;
-    Heap<psGameEvent> eventqueue;
+    TimerWheel<psGameEvent> eventqueue;
+    /// Events taken out by Cancel(), deleted by the next ProcessEventQueue().
+    csArray<psGameEvent*> cancelled;
 
     csTicks lastTick;
 
@@ -64,6 +70,16 @@ public:
     /// Add new event to scheduler queue.
     void Push(psGameEvent *event);
 
+    /**
+     * Take an event out of the scheduler queue. Returns false if it wasn't
+     * queued. A removed event is deleted on the next ProcessEventQueue(),
+     * so it is safe to cancel an event from within its own callbacks.
+     */
+    bool Cancel(psGameEvent *event);
+
+    /// Number of events in the scheduler queue.
+    size_t GetQueuedEvents();
+
     /// Check Event Queue for scheduled events which are due
     csTicks ProcessEventQueue();
 
@@ -0,0 +1,261 @@
+/*
+ * eventmanager_unittest.cpp
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+#include <csutil/randomgen.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/eventmanager.h"
+#include "util/gameevent.h"
+#include "util/heap.h"
+#include "util/benchmark.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// An event that records when it fired.
+class TestEvent : public psGameEvent
+{
+public:
+    TestEvent(int offset, csArray<int>* fired, int tag)
+        : psGameEvent(0, offset, "TestEvent"), fired(fired), tag(tag)
+    {
+        alive++;
+    }
+    ~TestEvent() { alive--; }
+
+    virtual void Trigger() { fired->Push(tag); }
+
+    static int alive;
+
+private:
+    csArray<int>* fired;
+    int tag;
+};
+
+int TestEvent::alive = 0;
+
+TEST(EventManagerTest, FiresInOrderAndCancels)
+{
+    csArray<int> fired;
+    {
+        EventManager manager;
+
+        TestEvent* events[10];
+        for (int i = 0; i < 10; i++)
+        {
+            // 0, 10, 20, ... ticks from now, queued in reverse
+            events[9 - i] = new TestEvent((9 - i) * 10, &fired, 9 - i);
+            manager.Push(events[9 - i]);
+        }
+        EXPECT_EQ(10u, manager.GetQueuedEvents());
+
+        events[3]->CancelEvent();
+        events[7]->CancelEvent();
+        EXPECT_EQ(8u, manager.GetQueuedEvents());
+        // A second cancel finds nothing queued
+        EXPECT_FALSE(manager.Cancel(events[3]));
+
+        csSleep(120);
+        manager.ProcessEventQueue();
+        EXPECT_EQ(0u, manager.GetQueuedEvents());
+        EXPECT_EQ(0, TestEvent::alive);
+
+        ASSERT_EQ(8u, fired.GetSize());
+        const int expected[] = { 0, 1, 2, 4, 5, 6, 8, 9 };
+        for (size_t i = 0; i < fired.GetSize(); i++)
+            EXPECT_EQ(expected[i], fired[i]);
+
+        // The manager deletes whatever is still queued
+        manager.Push(new TestEvent(100000, &fired, 10));
+        csTicks next = manager.ProcessEventQueue();
+        EXPECT_LE(next - csGetTicks(), 250u);
+    }
+    EXPECT_EQ(0, TestEvent::alive);
+}
+
+/**
+ * The mix of pending events on a busy server: most events are short
+ * timers (NPC and combat ticks, delayed messages), a steady share are
+ * regeneration and spell durations, and a long tail are save and cache
+ * timers that sit in the queue for minutes and are often cancelled.
+ */
+struct EventMix
+{
+    const char* type;
+    csTicks mindelay;
+    csTicks maxdelay;
+    int share;          ///< Percentage of the events
+    int cancelled;      ///< Percentage of these that are cancelled before firing
+};
+
+static const EventMix eventMix[] =
+{
+    { "DelayedMessage",   0,      500,     20, 0  },
+    { "CombatTick",       500,    3000,    25, 0  },
+    { "NPCTick",          250,    1000,    20, 0  },
+    { "Regen",            1000,   1000,    10, 0  },
+    { "SpellDuration",    10000,  120000,  10, 30 },
+    { "CacheExpire",      60000,  300000,  10, 50 },
+    { "SaveCharacter",    600000, 600000,  5,  50 }
+};
+
+class MixEvent : public psGameEvent
+{
+public:
+    MixEvent(const EventMix& mix, csTicks delay, csArray<float>* lateness)
+        : psGameEvent(0, delay, mix.type), lateness(lateness) {}
+
+    virtual void Trigger()
+    {
+        lateness->Push((float)(csGetTicks() - triggerticks));
+    }
+
+private:
+    csArray<float>* lateness;
+};
+
+/// Pick an event type and delay from the mix.
+static const EventMix& PickMix(csRandomGen& rng, csTicks& delay)
+{
+    int roll = (int)rng.Get(100);
+    size_t i = 0;
+    while (i < sizeof(eventMix) / sizeof(eventMix[0]) - 1 && roll >= eventMix[i].share)
+    {
+        roll -= eventMix[i].share;
+        i++;
+    }
+    delay = eventMix[i].mindelay + rng.Get(eventMix[i].maxdelay - eventMix[i].mindelay + 1);
+    return eventMix[i];
+}
+
+/**
+ * Replays the event mix: fills the queue, then keeps it at a steady size
+ * for a few seconds while dispatching. Reports the cost of a Push, the
+ * dispatch cost per event and how late events fire, and the cost of
+ * inserting the same sequence into the old binary heap.
+ */
+TEST(EventManagerTest, DISABLED_EventMixBenchmark)
+{
+    const size_t pending = 50000;
+    const size_t batch = 100;
+    const csTicks runtime = 3000;
+
+    csArray<float> pushcost, dispatchcost, lateness;
+    csArray<psGameEvent*> cancellable;
+    csRandomGen rng(1234);
+
+    EventManager manager;
+
+    // Fill the queue
+    for (size_t i = 0; i < pending; i += batch)
+    {
+        csMicroTicks start = csGetMicroTicks();
+        for (size_t j = 0; j < batch; j++)
+        {
+            csTicks delay;
+            const EventMix& mix = PickMix(rng, delay);
+            MixEvent* event = new MixEvent(mix, delay, &lateness);
+            manager.Push(event);
+            // Only long timers, these can't have fired and been deleted yet
+            if (mix.mindelay > 2 * runtime && (int)rng.Get(100) < mix.cancelled)
+                cancellable.Push(event);
+        }
+        pushcost.Push((csGetMicroTicks() - start) * 1000.0f / batch);
+    }
+
+    // Run, topping the queue up with new events as they fire
+    csTicks end = csGetTicks() + runtime;
+    csTicks next = csGetTicks();
+    size_t dispatched = 0;
+    while ((int32)(csGetTicks() - end) < 0)
+    {
+        if ((int32)(csGetTicks() - next) < 0)
+        {
+            csSleep(1);
+            continue;
+        }
+
+        size_t before = lateness.GetSize();
+        csMicroTicks start = csGetMicroTicks();
+        next = manager.ProcessEventQueue();
+        size_t count = lateness.GetSize() - before;
+        if (count)
+            dispatchcost.Push((csGetMicroTicks() - start) * 1000.0f / count);
+        dispatched += count;
+
+        // Cancel a few of the long timers, like logouts and cache hits do
+        for (size_t i = 0; i < count / 10 && cancellable.GetSize(); i++)
+            cancellable.Pop()->CancelEvent();
+
+        while (manager.GetQueuedEvents() < pending)
+        {
+            csTicks delay;
+            const EventMix& mix = PickMix(rng, delay);
+            manager.Push(new MixEvent(mix, delay, &lateness));
+        }
+    }
+
+    printf("Event mix: %zu events pending, %zu dispatched in %u ms\n", pending, dispatched, runtime);
+    PrintPercentiles("timer wheel push", pushcost, "ns");
+    PrintPercentiles("timer wheel dispatch per event", dispatchcost, "ns");
+    PrintPercentiles("timer wheel lateness", lateness, "ms");
+    EXPECT_GT(dispatched, 0u);
+
+    // The same fill and drain on a binary heap
+    csArray<float> heapinsert, heapdelete;
+    csArray<psGameEvent*> events;
+    csRandomGen heaprng(1234);
+    for (size_t i = 0; i < pending; i++)
+    {
+        csTicks delay;
+        const EventMix& mix = PickMix(heaprng, delay);
+        events.Push(new MixEvent(mix, delay, &lateness));
+    }
+
+    Heap<psGameEvent> heap;
+    for (size_t i = 0; i < pending; i += batch)
+    {
+        csMicroTicks start = csGetMicroTicks();
+        for (size_t j = 0; j < batch; j++)
+            heap.Insert(events[i + j]);
+        heapinsert.Push((csGetMicroTicks() - start) * 1000.0f / batch);
+    }
+    for (size_t i = 0; i < pending; i += batch)
+    {
+        csMicroTicks start = csGetMicroTicks();
+        for (size_t j = 0; j < batch; j++)
+            heap.DeleteMin();
+        heapdelete.Push((csGetMicroTicks() - start) * 1000.0f / batch);
+    }
+    PrintPercentiles("binary heap insert", heapinsert, "ns");
+    PrintPercentiles("binary heap delete-min", heapdelete, "ns");
+
+    for (size_t i = 0; i < events.GetSize(); i++)
+        delete events[i];
+}
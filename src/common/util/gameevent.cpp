@@ -55,3 +55,10 @@ void psGameEvent::QueueEvent()
 {
     eventmanager->Push(this);
 }
+
+void psGameEvent::CancelEvent()
+{
+    valid = false;
+    if (eventmanager)
+        eventmanager->Cancel(this);
+}
@@ -22,6 +22,8 @@
 
 #include <csutil/csstring.h>
 
+#include "util/timerwheel.h"
+
 class EventManager;
 
 
@@ -30,7 +32,7 @@ class EventManager;
  * queued by the EventManager and are passed to the various subscribed 
  * handlers at the appropriate time.
  */
-class psGameEvent
+class psGameEvent : public TimerWheelNode
 {
     char type[32];          ///< The type of this GameEvent, used for debugging
 public:
@@ -54,6 +56,14 @@ public:
      */
     void QueueEvent();
 
+    /**
+     * Take the event out of the EventManager queue, it will be deleted
+     * by the EventManager without being triggered. If the event is not
+     * queued (never queued, or being triggered right now) it is only
+     * invalidated and the owner is still responsible for it.
+     */
+    void CancelEvent();
+
     /**
      * Called right before a Trigger is called.
      *
@@ -1,7 +1,7 @@
 /*
 * genqueue.h by Matze Braun <MatzeBraun@gmx.de>
 *
-* Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org) 
+* Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
 *
 *
 * This program is free software; you can redistribute it and/or
@@ -17,10 +17,35 @@
 *
 */
 
+/*   Design notes:
+ *
+ *  The queue is a bounded ring that many threads may Add() to but only ONE
+ *  thread at a time may Get() or Peek() from (SendOut() under the NetBase
+ *  send mutex for outgoing packets, the game thread for the message queue).
+ *
+ *  Every slot carries a sequence number.  A producer claims a position by
+ *  advancing 'tail' with a compare and swap, fills the slot and then
+ *  publishes it by setting the slot sequence to position + 1.  The consumer
+ *  takes a slot once its sequence says it was published and hands it back
+ *  to the producers by setting it to position + size.  Neither side takes a
+ *  lock.
+ *
+ *  Positions are unsigned and wrap around, they are only ever compared
+ *  through their difference cast to signed.
+ *
+ *  The mutex and conditions are only used to sleep: GetWait() on an empty
+ *  queue and AddWait() on a full one.  A sleeper announces itself before its
+ *  final check, the consumer's flag or the count of waiting producers, and
+ *  the other side only locks to notify when someone is waiting.
+ *
+ *  The size is rounded up to a power of two.
+ */
+
 #ifndef __GENQUEUE_H__
 #define __GENQUEUE_H__
 
 #include <csutil/ref.h>
+#include <csutil/threading/atomicops.h>
 #include <csutil/threading/mutex.h>
 #include <csutil/threading/condition.h>
 
@@ -37,94 +62,121 @@ class GenericRefQueue
 public:
     GenericRefQueue(unsigned int maxsize = 500)
     {
-        /* we make the buffer 1 typ bigger, so we can avoid one check and one
-         variable when testing if buffer is full */
-        qsize = maxsize;
-        qbuffer = new refType<queuetype>[qsize + 1]();
+        qsize = 1;
+        while (qsize < maxsize)
+            qsize <<= 1;
+
+        qbuffer = new Slot[qsize];
+        for (unsigned int i = 0; i < qsize; i++)
+            qbuffer[i].sequence = i;
+
         qstart = qend = 0;
+        getwaiting = addwaiters = 0;
     }
 
     ~GenericRefQueue()
     {
         delete[] qbuffer;
     }
-    
+
     /** like above, but waits to add the next message, if the queue is full
      *  be careful with this. It's easy to deadlock! */
     bool AddWait(queuetype* msg, csTicks timeout = 0)
     {
         // is there's a space in the queue left just add it
+        if (Add(msg))
+            return true;
+
+        Error1("Queue full! Waiting.\n");
+
         CS::Threading::RecursiveMutexScopedLock lock(mutex);
+        // Counted, so the consumer keeps waking producers until the last one got in.
+        CS::Threading::AtomicOperations::Increment(&addwaiters);
         while(true)
         {
-            bool added = Add(msg);
-            if (added)
+            if (Add(msg))
             {
+                CS::Threading::AtomicOperations::Decrement(&addwaiters);
                 return true;
             }
-            Error1("Queue full! Waiting.\n");
-            
+
             // Wait release mutex before waiting so that it is possible to
-            // add new messages.
-            if (!datacondition.Wait(mutex, timeout))
+            // get messages.
+            if (!spacecondition.Wait(mutex, timeout))
             {
-                // Timed out waiting for new message
+                // Timed out waiting for space
+                CS::Threading::AtomicOperations::Decrement(&addwaiters);
                 return false;
             }
         }
     }
-        
-    /** This adds a message to the queue and waits if it is full */
+
+    /** This adds a message to the queue, returns false if it is full */
     bool Add(queuetype* msg)
     {
-        unsigned int tqend;
+        if (msg->GetPending())
+            return true;
 
-        CS::Threading::RecursiveMutexScopedLock lock(mutex);
+        // check are we having a refcount race (in which msg would already be destroyed)
+        CS_ASSERT(msg->GetRefCount() > 0);
 
-        if (!msg->GetPending())
+        // Claim a position
+        uint32 pos = AtomicRead(&qend);
+        Slot* slot;
+        while (true)
         {
-            tqend = (qend + 1) % qsize;
-            // check if queue is full
-            if (tqend == qstart)
+            slot = &qbuffer[pos & (qsize - 1)];
+            uint32 seq = AtomicRead(&slot->sequence);
+            int32 dif = (int32)(seq - pos);
+            if (dif == 0)
+            {
+                uint32 prev = AtomicCompareAndSet(&qend, pos + 1, pos);
+                if (prev == pos)
+                    break;
+                pos = prev;
+            }
+            else if (dif < 0)
             {
+                // The consumer didn't free this slot yet, the queue is full
                 Interrupt();
                 return false;
             }
-            // check are we having a refcount race (in which msg would already be destroyed)
-			CS_ASSERT(msg->GetRefCount() > 0);
-            // add Message to queue
-            qbuffer[qend]=msg;
-            qend=tqend;
+            else
+            {
+                pos = AtomicRead(&qend);
+            }
+        }
 
-            msg->SetPending(true);
+        // Mark it before publishing, the consumer clears the flag on Get().
+        msg->SetPending(true);
+        slot->item = msg;
+        AtomicSet(&slot->sequence, pos + 1);
 
+        if (CS::Threading::AtomicOperations::Read(&getwaiting))
             Interrupt();
-        }
         return true;
     }
-    
+
     // Peeks at the next message from the queue but does not remove it.
+    // Only the consumer thread may call this.
     csPtr<queuetype> Peek()
 	{
-        CS::Threading::RecursiveMutexScopedLock lock(mutex);
-
         csRef<queuetype> ptr;
-        
-        unsigned int qpointer = qstart;
-        
+
+        uint32 pos = qstart;
+
         // if this is a weakref queue we should skip over null entries
         while(!ptr.IsValid())
         {
             // check if queue is empty
-            if (qpointer == qend)
+            Slot* slot = &qbuffer[pos & (qsize - 1)];
+            if (AtomicRead(&slot->sequence) != pos + 1)
             {
                 return 0;
             }
 
-            // removes Message from queue
-            ptr = qbuffer[qpointer];
-            
-            qpointer = (qpointer + 1) % qsize;
+            ptr = slot->item;
+            pos++;
         }
 
         return csPtr<queuetype>(ptr);
@@ -133,33 +185,37 @@ public:
     /**
     * This gets the next message from the queue, it is then removed from
     * the queue. Note: It returns a pointer to the message, so a null
-    * pointer indicates an error
+    * pointer indicates an error. Only the consumer thread may call this.
     */
     csPtr<queuetype> Get()
     {
-        CS::Threading::RecursiveMutexScopedLock lock(mutex);
-
         csRef<queuetype> ptr;
-        
+
         // if this is a weakref queue we should skip over null entries
         while(!ptr.IsValid())
         {
             // check if queue is empty
-            if (qstart == qend)
+            uint32 pos = qstart;
+            Slot* slot = &qbuffer[pos & (qsize - 1)];
+            if (AtomicRead(&slot->sequence) != pos + 1)
             {
-                Interrupt();
                 return 0;
             }
 
-            // removes Message from queue
-            ptr = qbuffer[qstart];
-            qbuffer[qstart] = 0;
-            
-            qstart = (qstart + 1) % qsize;
+            // removes Message from queue and hands the slot back
+            ptr = slot->item;
+            slot->item = 0;
+            AtomicSet(&slot->sequence, pos + qsize);
+            AtomicSet(&qstart, pos + 1);
         }
 
         ptr->SetPending(false);
-        Interrupt();
+
+        if (CS::Threading::AtomicOperations::Read(&addwaiters))
+        {
+            CS::Threading::RecursiveMutexScopedLock lock(mutex);
+            spacecondition.NotifyAll();
+        }
 
         return csPtr<queuetype>(ptr);
     }
@@ -168,12 +224,22 @@ public:
     csPtr<queuetype> GetWait(csTicks timeout)
     {
         // is there's a message in the queue left just return it
+        csRef<queuetype> temp = Get();
+        if (temp)
+        {
+            return csPtr<queuetype> (temp);
+        }
+
         CS::Threading::RecursiveMutexScopedLock lock(mutex);
         while(true)
         {
-            csRef<queuetype> temp = Get();
+            // Producers only notify once they see the flag, so check again
+            // after raising it.
+            CS::Threading::AtomicOperations::Set(&getwaiting, 1);
+            temp = Get();
             if (temp)
             {
+                CS::Threading::AtomicOperations::Set(&getwaiting, 0);
                 return csPtr<queuetype> (temp);
             }
 
@@ -182,6 +248,7 @@ public:
             if (!datacondition.Wait(mutex, timeout))
             {
                 // Timed out waiting for new message
+                CS::Threading::AtomicOperations::Set(&getwaiting, 0);
                 return 0;
             }
         }
@@ -194,32 +261,57 @@ public:
     */
     void Interrupt()
     {
+        CS::Threading::RecursiveMutexScopedLock lock(mutex);
         datacondition.NotifyOne();
     }
 
     /**
-     * Number of items in the queue.
+     * Number of items in the queue. Only exact when no other thread uses it.
      */
     unsigned int Count()
     {
-        CS::Threading::RecursiveMutexScopedLock lock(mutex);
-        if(qend < qstart)
-            return qend + qsize - qstart;
-        else
-            return qend - qstart;
+        uint32 start = AtomicRead(&qstart);
+        uint32 end = AtomicRead(&qend);
+        return (unsigned int)(end - start);
     }
-    
+
     bool IsFull()
     {
-    	CS::Threading::RecursiveMutexScopedLock lock(mutex);
-    	return ((qend + 1) % qsize == qstart);
+        return Count() >= qsize;
     }
 protected:
+    struct Slot
+    {
+        uint32 sequence;
+        refType<queuetype> item;
+    };
+
+    // The atomic operations only come for int32, positions go through these.
+    static uint32 AtomicRead(uint32* target)
+    {
+        return (uint32)CS::Threading::AtomicOperations::Read((int32*)target);
+    }
+    static void AtomicSet(uint32* target, uint32 value)
+    {
+        CS::Threading::AtomicOperations::Set((int32*)target, (int32)value);
+    }
+    static uint32 AtomicCompareAndSet(uint32* target, uint32 value, uint32 comparand)
+    {
+        return (uint32)CS::Threading::AtomicOperations::CompareAndSet((int32*)target,
+                                                                     (int32)value, (int32)comparand);
+    }
 
-    refType<queuetype>* qbuffer;
-    unsigned int qstart, qend, qsize;
+    Slot* qbuffer;
+    unsigned int qsize;
+    /// Position the consumer reads next, and the next position a producer claims.
+    uint32 qstart, qend;
+    /// Set while the consumer sleeps in GetWait().
+    int32 getwaiting;
+    /// Number of producers sleeping in AddWait().
+    int32 addwaiters;
     CS::Threading::RecursiveMutex mutex;
     CS::Threading::Condition datacondition;
+    CS::Threading::Condition spacecondition;
 };
 
 #endif
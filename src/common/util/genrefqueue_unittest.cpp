@@ -0,0 +1,456 @@
+/*
+ * genrefqueue_unittest.cpp
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+#include <csutil/threading/thread.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "net/message.h"
+#include "net/netbase.h"
+#include "util/genrefqueue.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+using namespace CS::Threading;
+
+typedef GenericRefQueue<NetPacketQueueRefCount, csWeakRef> SenderQueue;
+
+/// A queue entry with a thread safe reference count, like MsgEntry.
+class QueueItem
+{
+public:
+    QueueItem(int producer, int seq) : producer(producer), seq(seq), refcount(1) {}
+
+    void IncRef() { AtomicOperations::Increment(&refcount); }
+    void DecRef()
+    {
+        if (AtomicOperations::Decrement(&refcount) == 0)
+            delete this;
+    }
+    int32 GetRefCount() { return AtomicOperations::Read(&refcount); }
+
+    void SetPending(bool) {}
+    bool GetPending() { return false; }
+
+    int producer;
+    int seq;
+
+private:
+    int32 refcount;
+};
+
+typedef GenericRefQueue<QueueItem> ItemQueue;
+
+/// Lets a test start the positions anywhere.
+class PositionedItemQueue : public ItemQueue
+{
+public:
+    PositionedItemQueue(unsigned int size) : ItemQueue(size) {}
+
+    /// Only while empty.
+    void SetPosition(uint32 pos)
+    {
+        qstart = qend = pos;
+        for (unsigned int i = 0; i < qsize; i++)
+            qbuffer[(pos + i) & (qsize - 1)].sequence = pos + i;
+    }
+};
+
+/// The old queue, a ring guarded by a single mutex, for comparison.
+class LockedItemQueue
+{
+public:
+    LockedItemQueue(unsigned int size) : items(size + 1), start(0), end(0)
+    {
+        for (unsigned int i = 0; i <= size; i++)
+            items.Push(csRef<QueueItem>());
+    }
+
+    bool AddWait(QueueItem* item)
+    {
+        RecursiveMutexScopedLock lock(mutex);
+        while ((end + 1) % items.GetSize() == start)
+            condition.Wait(mutex, 0);
+        items[end] = item;
+        end = (end + 1) % items.GetSize();
+        condition.NotifyAll();
+        return true;
+    }
+
+    csPtr<QueueItem> GetWait(csTicks timeout)
+    {
+        RecursiveMutexScopedLock lock(mutex);
+        while (start == end)
+        {
+            if (!condition.Wait(mutex, timeout))
+                return 0;
+        }
+        csRef<QueueItem> item = items[start];
+        items[start] = 0;
+        start = (start + 1) % items.GetSize();
+        condition.NotifyAll();
+        return csPtr<QueueItem>(item);
+    }
+
+private:
+    csArray<csRef<QueueItem> > items;
+    size_t start, end;
+    RecursiveMutex mutex;
+    Condition condition;
+};
+
+template <class Queue>
+class Producer : public Runnable
+{
+public:
+    Producer(Queue* queue, int id, int count) : queue(queue), id(id), count(count) {}
+
+    void Run()
+    {
+        for (int i = 0; i < count; i++)
+        {
+            csRef<QueueItem> item;
+            item.AttachNew(new QueueItem(id, i));
+            queue->AddWait(item);
+        }
+    }
+
+private:
+    Queue* queue;
+    int id;
+    int count;
+};
+
+/**
+ * Runs 'producers' threads adding 'count' items each while this thread
+ * takes them out. Returns the items per second and checks that every item
+ * arrived once and in order per producer.
+ */
+template <class Queue>
+double RunProducers(int producers, int count, unsigned int size = 500)
+{
+    Queue queue(size);
+    csArray<csRef<Thread> > threads;
+    csArray<int> next;
+    for (int p = 0; p < producers; p++)
+        next.Push(0);
+
+    csMicroTicks start = csGetMicroTicks();
+    for (int p = 0; p < producers; p++)
+    {
+        csRef<Runnable> producer;
+        producer.AttachNew(new Producer<Queue>(&queue, p, count));
+        csRef<Thread> thread;
+        thread.AttachNew(new Thread(producer));
+        thread->Start();
+        threads.Push(thread);
+    }
+
+    int total = producers * count;
+    int received = 0;
+    while (received < total)
+    {
+        csRef<QueueItem> item = queue.GetWait(1000);
+        if (!item)
+        {
+            ADD_FAILURE() << "Timed out with " << received << " of " << total << " items";
+            break;
+        }
+        EXPECT_EQ(next[item->producer], item->seq);
+        next[item->producer] = item->seq + 1;
+        received++;
+    }
+    csMicroTicks elapsed = csGetMicroTicks() - start;
+
+    for (size_t t = 0; t < threads.GetSize(); t++)
+        threads[t]->Wait();
+
+    return received * 1000000.0 / MAX(elapsed, 1);
+}
+
+TEST(GenericRefQueueTest, SingleThread)
+{
+    ItemQueue queue(4);
+    csRef<QueueItem> items[4];
+    for (int i = 0; i < 4; i++)
+    {
+        items[i].AttachNew(new QueueItem(0, i));
+        EXPECT_TRUE(queue.Add(items[i]));
+    }
+    EXPECT_TRUE(queue.IsFull());
+    EXPECT_EQ(4u, queue.Count());
+
+    csRef<QueueItem> extra;
+    extra.AttachNew(new QueueItem(0, 4));
+    EXPECT_FALSE(queue.Add(extra));
+
+    csRef<QueueItem> item = queue.Peek();
+    EXPECT_EQ(0, item->seq);
+    for (int i = 0; i < 4; i++)
+    {
+        item = queue.Get();
+        ASSERT_TRUE(item.IsValid());
+        EXPECT_EQ(i, item->seq);
+    }
+    item = queue.Get();
+    EXPECT_FALSE(item.IsValid());
+    item = queue.GetWait(10);
+    EXPECT_FALSE(item.IsValid());
+
+    // Wraps around the ring.
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_TRUE(queue.Add(extra));
+        item = queue.Get();
+        EXPECT_EQ((QueueItem*)extra, (QueueItem*)item);
+    }
+    EXPECT_EQ(0u, queue.Count());
+}
+
+TEST(GenericRefQueueTest, PositionsWrap)
+{
+    // Across the sign bit and back to zero
+    const uint32 starts[] = { 0x7ffffffa, 0xfffffffa };
+    for (size_t s = 0; s < sizeof(starts) / sizeof(starts[0]); s++)
+    {
+        PositionedItemQueue queue(4);
+        queue.SetPosition(starts[s]);
+
+        csRef<QueueItem> items[4];
+        for (int round = 0; round < 4; round++)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                items[i].AttachNew(new QueueItem(0, round * 4 + i));
+                EXPECT_TRUE(queue.Add(items[i]));
+            }
+            EXPECT_TRUE(queue.IsFull());
+            EXPECT_FALSE(queue.Add(items[0]));
+
+            for (int i = 0; i < 4; i++)
+            {
+                csRef<QueueItem> item = queue.Get();
+                ASSERT_TRUE(item.IsValid());
+                EXPECT_EQ(round * 4 + i, item->seq);
+            }
+            EXPECT_EQ(0u, queue.Count());
+        }
+    }
+}
+
+TEST(GenericRefQueueTest, ManyBlockedProducers)
+{
+    // More producers than slots, most of them wait in AddWait() without a timeout
+    RunProducers<ItemQueue>(8, 2000, 2);
+}
+
+TEST(GenericRefQueueTest, Messages)
+{
+    MsgQueue queue(4);
+    csRef<MsgEntry> msgs[3];
+    for (int i = 0; i < 3; i++)
+    {
+        msgs[i].AttachNew(new MsgEntry(10));
+        msgs[i]->clientnum = i + 1;
+        EXPECT_TRUE(queue.Add(msgs[i]));
+    }
+
+    // Messages have no pending flag, the same one may be queued twice
+    EXPECT_TRUE(queue.Add(msgs[0]));
+    EXPECT_EQ(4u, queue.Count());
+
+    csRef<MsgEntry> msg = queue.Peek();
+    EXPECT_EQ(1u, msg->clientnum);
+    const uint32_t expected[] = { 1, 2, 3, 1 };
+    for (int i = 0; i < 4; i++)
+    {
+        msg = queue.Get();
+        ASSERT_TRUE(msg.IsValid());
+        EXPECT_EQ(expected[i], msg->clientnum);
+    }
+    msg = queue.Get();
+    EXPECT_FALSE(msg.IsValid());
+}
+
+TEST(GenericRefQueueTest, PendingSenders)
+{
+    SenderQueue senders(4);
+    csRef<NetPacketQueueRefCount> a, b;
+    a.AttachNew(new NetPacketQueueRefCount(10));
+    b.AttachNew(new NetPacketQueueRefCount(10));
+
+    // A sender is only queued once until it is taken out
+    EXPECT_TRUE(senders.Add(a));
+    EXPECT_TRUE(a->GetPending());
+    EXPECT_TRUE(senders.Add(a));
+    EXPECT_EQ(1u, senders.Count());
+    EXPECT_TRUE(senders.Add(b));
+
+    csRef<NetPacketQueueRefCount> q = senders.Get();
+    EXPECT_EQ((NetPacketQueueRefCount*)a, (NetPacketQueueRefCount*)q);
+    EXPECT_FALSE(a->GetPending());
+    EXPECT_TRUE(senders.Add(a));
+    EXPECT_EQ(2u, senders.Count());
+
+    // A sender destroyed while queued is skipped
+    b.Invalidate();
+    q = senders.Get();
+    EXPECT_EQ((NetPacketQueueRefCount*)a, (NetPacketQueueRefCount*)q);
+    q = senders.Get();
+    EXPECT_FALSE(q.IsValid());
+}
+
+/// Adds numbered packets for one client to its queue and queues it as a sender.
+class PacketProducer : public Runnable
+{
+public:
+    PacketProducer(SenderQueue* senders, NetPacketQueueRefCount* queue, uint32_t clientnum, int count)
+        : senders(senders), queue(queue), clientnum(clientnum), count(count) {}
+
+    void Run()
+    {
+        for (int i = 0; i < count; i++)
+        {
+            csRef<psNetPacketEntry> pkt;
+            pkt.AttachNew(new psNetPacketEntry(PRIORITY_LOW, clientnum, i, 0, 10, 10, (const char*)NULL));
+            queue->AddWait(pkt);
+            senders->Add(queue);
+        }
+    }
+
+private:
+    SenderQueue* senders;
+    NetPacketQueueRefCount* queue;
+    uint32_t clientnum;
+    int count;
+};
+
+/**
+ * Takes senders and their packets out under a shared mutex, the way
+ * NetBase::SendOut() does on the network thread and through Flush().
+ */
+class SendOutConsumer : public Runnable
+{
+public:
+    SendOutConsumer(SenderQueue* senders, Mutex* mutex, csArray<int>* next, int total)
+        : senders(senders), mutex(mutex), next(next), total(total) {}
+
+    void Run()
+    {
+        csTicks end = csGetTicks() + 10000;
+        while (csGetTicks() < end)
+        {
+            {
+                MutexScopedLock lock(*mutex);
+                csRef<NetPacketQueueRefCount> q;
+                while ((q = senders->Get()))
+                {
+                    csRef<psNetPacketEntry> pkt;
+                    while ((pkt = q->Get()))
+                    {
+                        EXPECT_EQ((*next)[pkt->clientnum], (int)pkt->packet->pktid);
+                        (*next)[pkt->clientnum] = pkt->packet->pktid + 1;
+                        (*next)[0]++;
+                    }
+                }
+                if ((*next)[0] == total)
+                    return;
+            }
+            csSleep(1);
+        }
+        ADD_FAILURE() << "Timed out with " << (*next)[0] << " of " << total << " packets";
+    }
+
+private:
+    SenderQueue* senders;
+    Mutex* mutex;
+    /// Next packet id per client, [0] counts all packets.
+    csArray<int>* next;
+    int total;
+};
+
+TEST(GenericRefQueueTest, SerializedSendOut)
+{
+    // Two consumers share the senders, every packet arrives once and in order
+    const int clients = 4;
+    const int count = 500;
+    SenderQueue senders(8);
+    Mutex mutex;
+    csArray<int> next;
+    for (int c = 0; c <= clients; c++)
+        next.Push(0);
+
+    csArray<csRef<NetPacketQueueRefCount> > queues;
+    csArray<csRef<Thread> > threads;
+    for (int c = 1; c <= clients; c++)
+    {
+        csRef<NetPacketQueueRefCount> queue;
+        queue.AttachNew(new NetPacketQueueRefCount(1024));
+        queues.Push(queue);
+
+        csRef<Runnable> producer;
+        producer.AttachNew(new PacketProducer(&senders, queue, c, count));
+        csRef<Thread> thread;
+        thread.AttachNew(new Thread(producer));
+        threads.Push(thread);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        csRef<Runnable> consumer;
+        consumer.AttachNew(new SendOutConsumer(&senders, &mutex, &next, clients * count));
+        csRef<Thread> thread;
+        thread.AttachNew(new Thread(consumer));
+        threads.Push(thread);
+    }
+
+    for (size_t t = 0; t < threads.GetSize(); t++)
+        threads[t]->Start();
+    for (size_t t = 0; t < threads.GetSize(); t++)
+        threads[t]->Wait();
+
+    EXPECT_EQ(clients * count, next[0]);
+    for (int c = 1; c <= clients; c++)
+        EXPECT_EQ(count, next[c]);
+}
+
+// Reports the throughput of the lock free queue and the old locked queue.
+// Run with --gtest_also_run_disabled_tests.
+TEST(GenericRefQueueTest, DISABLED_ContentionBenchmark)
+{
+    const int items = 200000;
+    const int producers[] = { 1, 2, 4 };
+
+    for (size_t i = 0; i < sizeof(producers) / sizeof(producers[0]); i++)
+    {
+        double lockfree = RunProducers<ItemQueue>(producers[i], items);
+        double locked = RunProducers<LockedItemQueue>(producers[i], items);
+        printf("%d producer(s): lock free %.0f items/s, mutex %.0f items/s\n",
+            producers[i], lockfree, locked);
+    }
+}
@@ -101,5 +101,179 @@ public:
     }
 };
 
-#endif
+/**
+ * Link information for an object kept in an IndexedHeap.
+ */
+class IndexedHeapNode
+{
+public:
+    IndexedHeapNode() : heapindex(NOT_IN_HEAP) {}
+
+    /// True if this node is currently in a heap.
+    bool IsInHeap() const { return heapindex != NOT_IN_HEAP; }
+
+protected:
+    template <class T, size_t Arity> friend class IndexedHeap;
+
+    static const size_t NOT_IN_HEAP = (size_t)-1;
+    size_t heapindex;
+};
+
+/**
+ * A min heap of objects with a float key that supports changing the key of
+ * an object already in the heap, as needed for Dijkstra and A* searches.
+ * Objects derive from IndexedHeapNode, which remembers their position, so
+ * Update() is O(log n) without searching.  An object can only be in one
+ * heap at a time and must be taken out before it is destroyed.
+ *
+ * Each entry has 'Arity' children.  A wider heap is shallower, so keys
+ * that drop (frequent in searches) sift up in fewer steps, at the price of
+ * more compares in DeleteMin().
+ */
+template <class T, size_t Arity = 2>
+class IndexedHeap
+{
+public:
+    IndexedHeap(size_t ilimit = 0) : entries(ilimit)
+    {
+    }
+
+    ~IndexedHeap()
+    {
+        Clear();
+    }
+
+    size_t Length() const
+    {
+        return entries.GetSize();
+    }
+
+    bool IsEmpty() const
+    {
+        return entries.IsEmpty();
+    }
+
+    /// Insert an object, or move it if it is already in the heap.
+    void Update(T* what, float key)
+    {
+        IndexedHeapNode* node = what;
+        if (!node->IsInHeap())
+        {
+            Entry entry;
+            entry.key = key;
+            entry.item = what;
+            node->heapindex = entries.Push(entry);
+            SiftUp(node->heapindex);
+        }
+        else if (key < entries[node->heapindex].key)
+        {
+            entries[node->heapindex].key = key;
+            SiftUp(node->heapindex);
+        }
+        else
+        {
+            entries[node->heapindex].key = key;
+            SiftDown(node->heapindex);
+        }
+    }
+
+    T* FindMin() const
+    {
+        return entries.GetSize() ? entries[0].item : NULL;
+    }
+
+    float GetMinKey() const
+    {
+        CS_ASSERT(Length());
+        return entries[0].key;
+    }
+
+    T* DeleteMin()
+    {
+        CS_ASSERT(Length());
+        T* minElement = entries[0].item;
+        Delete(minElement);
+        return minElement;
+    }
+
+    /// Take an object out of the heap.
+    void Delete(T* what)
+    {
+        IndexedHeapNode* node = what;
+        CS_ASSERT(node->IsInHeap() && entries[node->heapindex].item == what);
+
+        size_t i = node->heapindex;
+        size_t last = entries.GetSize() - 1;
+        node->heapindex = IndexedHeapNode::NOT_IN_HEAP;
+        if (i != last)
+        {
+            Move(i, entries[last]);
+            entries.Truncate(last);
+            SiftDown(i);
+            SiftUp(i);
+        }
+        else
+        {
+            entries.Truncate(last);
+        }
+    }
+
+    /// Take all objects out of the heap.
+    void Clear()
+    {
+        for (size_t i = 0; i < entries.GetSize(); i++)
+            static_cast<IndexedHeapNode*>(entries[i].item)->heapindex = IndexedHeapNode::NOT_IN_HEAP;
+        entries.Empty();
+    }
+
+private:
+    struct Entry
+    {
+        float key;
+        T* item;
+    };
+
+    void Move(size_t i, const Entry& entry)
+    {
+        entries[i] = entry;
+        static_cast<IndexedHeapNode*>(entry.item)->heapindex = i;
+    }
+
+    void SiftUp(size_t i)
+    {
+        Entry entry = entries[i];
+        while (i != 0 && entries[(i-1)/Arity].key > entry.key)
+        {
+            Move(i, entries[(i-1)/Arity]);
+            i = (i-1)/Arity;
+        }
+        Move(i, entry);
+    }
+
+    void SiftDown(size_t i)
+    {
+        Entry entry = entries[i];
+        size_t child;
+        for (; i * Arity + 1 < entries.GetSize(); i = child)
+        {
+            // Find the smallest child
+            child = i * Arity + 1;
+            size_t end = MIN(child + Arity, entries.GetSize());
+            for (size_t c = child + 1; c < end; c++)
+            {
+                if (entries[c].key < entries[child].key)
+                    child = c;
+            }
+
+            if (entries[child].key < entry.key)
+                Move(i, entries[child]);
+            else
+                break;
+        }
+        Move(i, entry);
+    }
 
+    csArray<Entry> entries;
+};
+
+#endif
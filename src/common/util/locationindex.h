@@ -0,0 +1,316 @@
+/*
+ * locationindex.h
+ *
+ * Copyright (C) 2004 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ *
+ * Nearest and range queries over fixed points such as waypoints and
+ * locations, measured the way psWorld::Distance() measures.
+ *
+ */
+
+/*   Design notes:
+ *
+ *  The points are kept in a SpatialGrid per sector.  psWorld::Distance()
+ *  measures between points in the same sector, or in sectors joined by a
+ *  portal, and calls everything else out of reach.  So a query searches the
+ *  grid of its own sector, and the grids of the adjacent sectors with the
+ *  query position warped into them.  The adjacent sectors of each query
+ *  sector are looked up once and cached.
+ *
+ *  FindNearest() searches a growing radius, starting at the cell size and
+ *  doubling, until it holds enough points or covers every point that can
+ *  be reached.  The bounding box of each sector tells when that is.
+ *
+ *  The index does not own the points.  Build it once the sectors are loaded
+ *  and Clear() it when points move, are added or deleted.
+ */
+#ifndef __LOCATIONINDEX_H__
+#define __LOCATIONINDEX_H__
+
+#include <csutil/array.h>
+#include <csutil/hash.h>
+#include <csgeom/box.h>
+#include <csgeom/transfrm.h>
+
+#include "engine/psworld.h"
+#include "util/spatialgrid.h"
+
+/**
+ * Append to 'found' the objects of 'grid' closer than 'radius' to 'pos' in
+ * 'sector', as psWorld::Distance() measures: those in 'sector' itself and
+ * those in the sectors with a warp into it, each once. 'world' may be NULL,
+ * then only 'sector' is searched.
+ */
+template <class T>
+void QueryInReach(const SpatialGrid<T>& grid, psWorld* world, iSector* sector, const csVector3& pos,
+                  float radius, csArray<T*>& found)
+{
+    if (!sector)
+        return;
+
+    grid.Query(sector, pos, radius, found);
+
+    const csArray<iSector*>* sources = world ? world->GetWarpSources(sector) : NULL;
+    if (!sources)
+        return;
+
+    for (size_t i = 0; i < sources->GetSize(); i++)
+    {
+        // A mirror leads back into 'sector', which was searched already
+        iSector* other = sources->Get(i);
+        if (other == sector)
+            continue;
+
+        // psWorld::Distance() warps the object into our sector, warp back to look around us there
+        const csReversibleTransform* warp = world->GetWarp(other, sector);
+        grid.Query(other, warp->This2Other(pos), radius, found);
+    }
+}
+
+/**
+ * Points of type T indexed by sector and position.
+ */
+template <class T>
+class LocationIndex
+{
+public:
+    /// A point found by a query and its distance from the query position.
+    struct Found
+    {
+        T* obj;
+        float range;
+    };
+
+    /**
+     * @param cellsize The width of a grid cell, in world units.
+     */
+    LocationIndex(float cellsize = 32.0f) : cellsize(cellsize), grid(cellsize)
+    {
+    }
+
+    ~LocationIndex()
+    {
+        Clear();
+    }
+
+    /// Add a point. Points without a sector can't be reached and are skipped.
+    void Add(T* obj, iSector* sector, const csVector3& pos)
+    {
+        if (!sector)
+            return;
+
+        csBox3* box = bounds.GetElementPointer(sector);
+        if (!box)
+        {
+            // A new sector may be adjacent to any query sector
+            ClearLinks();
+            bounds.Put(sector, csBox3(pos));
+        }
+        else
+        {
+            box->AddBoundingVertex(pos);
+        }
+        grid.Update(obj, sector, pos);
+    }
+
+    /// Number of points in the index.
+    size_t GetSize() const
+    {
+        return grid.GetSize();
+    }
+
+    /// Drop all points.
+    void Clear()
+    {
+        grid.Clear();
+        bounds.DeleteAll();
+        ClearLinks();
+    }
+
+    /**
+     * Append all points closer than 'range' to 'found', in no particular
+     * order. 'world' may be NULL, then only 'sector' is searched.
+     */
+    void FindInRange(psWorld* world, iSector* sector, const csVector3& pos, float range,
+                     csArray<Found>& found)
+    {
+        const csArray<Link>& sectors = GetLinks(world, sector);
+        for (size_t i = 0; i < sectors.GetSize(); i++)
+        {
+            const csBox3* box = bounds.GetElementPointer(sectors[i].sector);
+            csVector3 p = sectors[i].identity ? pos : sectors[i].warp.This2Other(pos);
+            if (!box || box->SquaredPosDist(p) >= range * range)
+                continue;
+
+            objs.Empty();
+            ranges.Empty();
+            grid.Query(sectors[i].sector, p, range, objs, &ranges);
+            for (size_t j = 0; j < objs.GetSize(); j++)
+            {
+                if (ranges[j] < range)
+                {
+                    Found f;
+                    f.obj = objs[j];
+                    f.range = ranges[j];
+                    found.Push(f);
+                }
+            }
+        }
+    }
+
+    /**
+     * Put the 'count' points nearest to 'pos' and closer than 'range' into
+     * 'found', nearest first. A negative range finds points at any distance
+     * within reach.
+     */
+    void FindNearest(psWorld* world, iSector* sector, const csVector3& pos, size_t count, float range,
+                     csArray<Found>& found)
+    {
+        found.Empty();
+        if (!count)
+            return;
+
+        float limit = range;
+        if (limit < 0)
+        {
+            // Just beyond the farthest point in reach
+            limit = GetReach(world, sector, pos);
+            if (limit < 0)
+                return;
+            limit += 1.0f;
+        }
+
+        for (float radius = cellsize; ; radius *= 2)
+        {
+            float r = MIN(radius, limit);
+            found.Empty();
+            FindInRange(world, sector, pos, r, found);
+            if (found.GetSize() >= count || r >= limit)
+                break;
+        }
+
+        found.Sort(CompareRange);
+        if (found.GetSize() > count)
+            found.Truncate(count);
+    }
+
+    /**
+     * The point nearest to 'pos' and closer than 'range', NULL if there is
+     * none. A negative range finds points at any distance within reach.
+     */
+    T* FindNearest(psWorld* world, iSector* sector, const csVector3& pos, float range,
+                   float* found_range = NULL)
+    {
+        csArray<Found> found;
+        FindNearest(world, sector, pos, 1, range, found);
+        if (found.IsEmpty())
+            return NULL;
+
+        if (found_range)
+            *found_range = found[0].range;
+        return found[0].obj;
+    }
+
+private:
+    /// A sector searched for queries from another, and how to get there.
+    struct Link
+    {
+        iSector* sector;
+        bool identity;
+        csReversibleTransform warp;
+    };
+
+    /// The sectors within reach of 'sector' that hold points, itself first.
+    const csArray<Link>& GetLinks(psWorld* world, iSector* sector)
+    {
+        csArray<Link>* sectorLinks = links.Get(sector, NULL);
+        if (sectorLinks)
+            return *sectorLinks;
+
+        sectorLinks = new csArray<Link>;
+        Link self;
+        self.sector = sector;
+        self.identity = true;
+        sectorLinks->Push(self);
+
+        if (world)
+        {
+            typename csHash<csBox3, csPtrKey<iSector> >::GlobalIterator it(bounds.GetIterator());
+            while (it.HasNext())
+            {
+                csPtrKey<iSector> other;
+                it.Next(other);
+                if (other == sector)
+                    continue;
+
+                // psWorld::Distance() warps the point into the query sector
+                const csReversibleTransform* warp = world->GetWarp(other, sector);
+                if (warp)
+                {
+                    Link link;
+                    link.sector = other;
+                    link.identity = false;
+                    link.warp = *warp;
+                    sectorLinks->Push(link);
+                }
+            }
+        }
+
+        links.Put(sector, sectorLinks);
+        return *sectorLinks;
+    }
+
+    /// Distance to the farthest corner of any sector in reach, -1 if none holds points.
+    float GetReach(psWorld* world, iSector* sector, const csVector3& pos)
+    {
+        float reach2 = -1.0f;
+        const csArray<Link>& sectors = GetLinks(world, sector);
+        for (size_t i = 0; i < sectors.GetSize(); i++)
+        {
+            const csBox3* box = bounds.GetElementPointer(sectors[i].sector);
+            if (box)
+            {
+                csVector3 p = sectors[i].identity ? pos : sectors[i].warp.This2Other(pos);
+                reach2 = MAX(reach2, box->SquaredPosMaxDist(p));
+            }
+        }
+        return (reach2 < 0) ? -1.0f : sqrtf(reach2);
+    }
+
+    void ClearLinks()
+    {
+        typename csHash<csArray<Link>*, csPtrKey<iSector> >::GlobalIterator it(links.GetIterator());
+        while (it.HasNext())
+            delete it.Next();
+        links.DeleteAll();
+    }
+
+    static int CompareRange(const Found& a, const Found& b)
+    {
+        return (a.range < b.range) ? -1 : (a.range > b.range) ? 1 : 0;
+    }
+
+    float cellsize;
+    SpatialGrid<T> grid;
+    csHash<csBox3, csPtrKey<iSector> > bounds;
+    csHash<csArray<Link>*, csPtrKey<iSector> > links;
+
+    /// Scratch space for grid queries
+    csArray<T*> objs;
+    csArray<float> ranges;
+};
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ * locationindex_unittest.cpp
+ *
+ * Copyright (C) 2004 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csgeom/matrix3.h>
+#include <csutil/randomgen.h>
+#include <csutil/scf.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/locationindex.h"
+#include "util/testsectors.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// Stands in for a waypoint or location.
+struct TestPoint
+{
+    iSector* sector;
+    csVector3 pos;
+};
+
+typedef LocationIndex<TestPoint> TestIndex;
+
+// Without a psWorld no other sector is in reach.
+static iSector* const sectorA = TestSector(0);
+static iSector* const sectorB = TestSector(1);
+static iSector* const sectorC = TestSector(2);
+
+/// A psWorld with warps set by hand, instead of from the portals of an engine.
+class WarpWorld : public psWorld
+{
+public:
+    WarpWorld(iSector* const* list, size_t count)
+    {
+        transarray.SetSize(count);
+        warpSources.SetSize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            sectors.Push(list[i]);
+            sectorIndex.Put(list[i], i);
+        }
+    }
+
+    /// WarpSpace() from 'from' to 'to' will apply 'warp'.
+    void AddWarp(iSector* from, iSector* to, const csReversibleTransform& warp)
+    {
+        transarray[*sectorIndex.GetElementPointer(from)].Set(to, warp);
+        warpSources[*sectorIndex.GetElementPointer(to)].Push(from);
+    }
+};
+
+/// Distances to all points of 'sector' closer than 'range', nearest first.
+static void BruteForce(csArray<TestPoint>& points, iSector* sector, const csVector3& pos,
+                       float range, csArray<float>& dists)
+{
+    for (size_t i = 0; i < points.GetSize(); i++)
+    {
+        float dist = (points[i].pos - pos).Norm();
+        if (points[i].sector == sector && (range < 0 || dist < range))
+            dists.Push(dist);
+    }
+    dists.Sort();
+}
+
+static void MakePoints(csArray<TestPoint>& points, size_t count, float size, csRandomGen& rng)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        TestPoint p;
+        p.sector = rng.Get(4) ? sectorA : sectorB;
+        p.pos = csVector3(rng.Get() * size, rng.Get() * 10, rng.Get() * size);
+        points.Push(p);
+    }
+}
+
+TEST(LocationIndexTest, MatchesBruteForce)
+{
+    csRandomGen rng(17);
+    csArray<TestPoint> points;
+    MakePoints(points, 1500, 1000.0f, rng);
+
+    TestIndex index(50.0f);
+    for (size_t i = 0; i < points.GetSize(); i++)
+        index.Add(&points[i], points[i].sector, points[i].pos);
+    index.Add(NULL, NULL, csVector3(0, 0, 0)); // No sector, skipped
+    EXPECT_EQ(points.GetSize(), index.GetSize());
+
+    for (int q = 0; q < 300; q++)
+    {
+        csVector3 pos(rng.Get() * 1400 - 200, 5, rng.Get() * 1400 - 200);
+        float range = (q % 4 == 0) ? -1.0f : rng.Get() * 200;
+        size_t count = 1 + rng.Get(8);
+
+        csArray<float> expected;
+        BruteForce(points, sectorA, pos, range, expected);
+
+        csArray<TestIndex::Found> found;
+        index.FindNearest(NULL, sectorA, pos, count, range, found);
+        ASSERT_EQ(MIN(count, expected.GetSize()), found.GetSize());
+        for (size_t i = 0; i < found.GetSize(); i++)
+        {
+            EXPECT_EQ(sectorA, found[i].obj->sector);
+            EXPECT_NEAR(expected[i], found[i].range, 0.001f);
+        }
+
+        if (range >= 0)
+        {
+            found.Empty();
+            index.FindInRange(NULL, sectorA, pos, range, found);
+            EXPECT_EQ(expected.GetSize(), found.GetSize());
+        }
+    }
+
+    index.Clear();
+    EXPECT_TRUE(index.FindNearest(NULL, sectorA, csVector3(0, 0, 0), -1.0f) == NULL);
+}
+
+TEST(LocationIndexTest, AcrossWarps)
+{
+    if (iSCF::SCF == 0)
+        scfInitialize(0);
+
+    // B lies east of A behind a portal, and is turned a quarter around.
+    // C is not connected.
+    iSector* const list[] = { sectorA, sectorB, sectorC };
+    WarpWorld world(list, 3);
+    csReversibleTransform warp(csYRotMatrix3(HALF_PI), csVector3(-300, 0, 20));
+    world.AddWarp(sectorB, sectorA, warp);
+    world.AddWarp(sectorA, sectorB, warp.GetInverse());
+
+    csRandomGen rng(31);
+    csArray<TestPoint> points;
+    for (size_t i = 0; i < 900; i++)
+    {
+        TestPoint p;
+        p.sector = list[i % 3];
+        p.pos = csVector3(rng.Get() * 600 - 300, rng.Get() * 10, rng.Get() * 600 - 300);
+        points.Push(p);
+    }
+
+    TestIndex index(50.0f);
+    for (size_t i = 0; i < points.GetSize(); i++)
+        index.Add(&points[i], points[i].sector, points[i].pos);
+
+    size_t warped = 0;
+    for (int q = 0; q < 200; q++)
+    {
+        csVector3 pos(rng.Get() * 600 - 300, 5, rng.Get() * 600 - 300);
+        float range = (q % 4 == 0) ? -1.0f : rng.Get() * 150;
+
+        // What psWorld::Distance() says, C is never in reach
+        csArray<float> expected;
+        for (size_t i = 0; i < points.GetSize(); i++)
+        {
+            if (points[i].sector == sectorC)
+                continue;
+            float dist = world.Distance(pos, sectorA, points[i].pos, points[i].sector);
+            if (range < 0 || dist < range)
+                expected.Push(dist);
+        }
+        expected.Sort();
+
+        csArray<TestIndex::Found> found;
+        index.FindNearest(&world, sectorA, pos, 5, range, found);
+        ASSERT_EQ(MIN((size_t)5, expected.GetSize()), found.GetSize());
+        for (size_t i = 0; i < found.GetSize(); i++)
+        {
+            EXPECT_NEAR(expected[i], found[i].range, 0.01f);
+            EXPECT_TRUE(found[i].obj->sector != sectorC);
+        }
+
+        if (range >= 0)
+        {
+            found.Empty();
+            index.FindInRange(&world, sectorA, pos, range, found);
+            EXPECT_EQ(expected.GetSize(), found.GetSize());
+            for (size_t i = 0; i < found.GetSize(); i++)
+            {
+                if (found[i].obj->sector == sectorB)
+                    warped++;
+                float dist = world.Distance(pos, sectorA, found[i].obj->pos, found[i].obj->sector);
+                EXPECT_NEAR(dist, found[i].range, 0.01f);
+            }
+        }
+    }
+
+    // The queries did reach through the portal
+    EXPECT_GT(warped, 0u);
+}
+
+TEST(LocationIndexTest, QueryInReach)
+{
+    iSector* const list[] = { sectorA, sectorB };
+    WarpWorld world(list, 2);
+    csReversibleTransform warp(csYRotMatrix3(HALF_PI), csVector3(-300, 0, 20));
+    world.AddWarp(sectorB, sectorA, warp);
+    world.AddWarp(sectorA, sectorB, warp.GetInverse());
+
+    // Where (10, 0, 10) in B shows up in A
+    csVector3 pos = warp * csVector3(10, 0, 10);
+
+    TestPoint points[] =
+    {
+        { sectorB, csVector3(11, 0, 10) },        // 1 away through the portal
+        { sectorA, pos + csVector3(0, 0, 2) },    // 2 away in A
+        { sectorB, pos },                         // Same numbers in B, but far away
+        { sectorB, csVector3(10, 0, 20) }         // 10 away through the portal
+    };
+    SpatialGrid<TestPoint> grid(8.0f);
+    for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); i++)
+        grid.Update(&points[i], points[i].sector, points[i].pos);
+
+    csArray<TestPoint*> found;
+    QueryInReach(grid, &world, sectorA, pos, 5.0f, found);
+    ASSERT_EQ(2u, found.GetSize());
+    EXPECT_TRUE(found.Find(&points[0]) != csArrayItemNotFound);
+    EXPECT_TRUE(found.Find(&points[1]) != csArrayItemNotFound);
+
+    // A mirror in A makes it a warp source of itself. Nothing may be found twice.
+    world.AddWarp(sectorA, sectorA, csReversibleTransform(csYRotMatrix3(HALF_PI), csVector3(0, 0, 2)));
+    found.Empty();
+    QueryInReach(grid, &world, sectorA, pos, 5.0f, found);
+    ASSERT_EQ(2u, found.GetSize());
+    EXPECT_TRUE(found.Find(&points[0]) != csArrayItemNotFound);
+    EXPECT_TRUE(found.Find(&points[1]) != csArrayItemNotFound);
+
+    // Without a world only A is searched
+    found.Empty();
+    QueryInReach(grid, NULL, sectorA, pos, 5.0f, found);
+    ASSERT_EQ(1u, found.GetSize());
+    EXPECT_EQ(&points[1], found[0]);
+}
@@ -34,6 +34,7 @@
 
 #include "util/log.h"
 #include <csutil/randomgen.h>
+#include <csutil/stringarray.h>
 #include <csutil/xmltiny.h>
 
 #include "../server/globals.h"
@@ -82,60 +83,102 @@ csString MathVar::Dump() const
 
 //----------------------------------------------------------------------------
 
+/// Slots by variable name, and the names by slot.
+struct MathSlotTable
+{
+    csHash<size_t, csString> slots;
+    csStringArray names;
+};
+
+static MathSlotTable& GetSlotTable()
+{
+    static MathSlotTable table;
+    return table;
+}
+
+size_t MathEnvironment::GetSlot(const char *name)
+{
+    MathSlotTable& table = GetSlotTable();
+    size_t slot = table.slots.Get(name, SIZET_NOT_FOUND);
+    if (slot == SIZET_NOT_FOUND)
+    {
+        slot = table.names.Push(name);
+        table.slots.Put(name, slot);
+    }
+    return slot;
+}
+
+const char* MathEnvironment::GetSlotName(size_t slot)
+{
+    return GetSlotTable().names[slot];
+}
+
 MathEnvironment::~MathEnvironment()
 {
-    csHash<MathVar*, csString>::GlobalIterator it(variables.GetIterator());
-    while (it.HasNext())
+    for (size_t i = 0; i < moreVars.GetSize(); i++)
     {
-        delete it.Next();
+        delete moreVars[i];
     }
 }
 
 MathVar* MathEnvironment::Lookup(const char *name) const
 {
-    MathVar *var = variables.Get(name, NULL);
-    if (!var && parent)
-        var = parent->Lookup(name);
+    size_t slot = GetSlotTable().slots.Get(name, SIZET_NOT_FOUND);
+    if (slot == SIZET_NOT_FOUND)
+        return NULL;
 
-    return var;
+    return LookupSlot(slot);
 }
 
-void MathEnvironment::Define(const char *name, double value)
+MathVar* MathEnvironment::FindSlot(size_t slot) const
 {
-    MathVar *var = variables.Get(name, NULL);
-    if (var)
+    for (size_t i = 0; i < count; i++)
     {
-        var->SetValue(value);
-        return;
+        const Entry & entry = GetEntry(i);
+        if (entry.slot == slot)
+            return const_cast<MathVar*>(&entry.var);
     }
-
-    var = new MathVar;
-    var->SetValue(value);
-    variables.Put(name, var);
+    return NULL;
 }
 
-void MathEnvironment::Define(const char *name, iScriptableVar *obj)
+MathVar* MathEnvironment::DefineSlot(size_t slot)
 {
-    MathVar *var = variables.Get(name, NULL);
+    MathVar *var = FindSlot(slot);
     if (var)
+        return var;
+
+    Entry *entry;
+    if (count < MATHENV_INLINE_VARS)
     {
-        var->SetObject(obj);
-        return;
+        entry = &inlineVars[count];
     }
+    else
+    {
+        entry = new Entry;
+        moreVars.Push(entry);
+    }
+    count++;
+
+    entry->slot = slot;
+    return &entry->var;
+}
 
-    var = new MathVar;
-    var->SetObject(obj);
-    variables.Put(name, var);
+void MathEnvironment::Define(const char *name, double value)
+{
+    DefineSlot(GetSlot(name))->SetValue(value);
+}
+
+void MathEnvironment::Define(const char *name, iScriptableVar *obj)
+{
+    DefineSlot(GetSlot(name))->SetObject(obj);
 }
 
 void MathEnvironment::DumpAllVars() const
 {
-    csString name;
-    csHash<MathVar*, csString>::ConstGlobalIterator it(variables.GetIterator());
-    while (it.HasNext())
+    for (size_t i = 0; i < count; i++)
     {
-        MathVar *var = it.Next(name);
-        CPrintf(CON_DEBUG, "%25s = %s\n", name.GetData(), var->Dump().GetData());
+        const Entry & entry = GetEntry(i);
+        CPrintf(CON_DEBUG, "%25s = %s\n", GetSlotName(entry.slot), entry.var.Dump().GetData());
     }
 }
 
@@ -173,6 +216,7 @@ MathStatement* MathStatement::Create(const csString & line, const char *name)
     csString & assignee = stmt->assignee;
     line.SubString(assignee, 0, assignAt);
     assignee.Trim();
+    stmt->assigneeSlot = MathEnvironment::GetSlot(assignee);
 
     bool validAssignee = isupper(assignee.GetAt(0)) != 0;
     for (size_t i = 1; validAssignee && i < assignee.Length(); i++)
@@ -216,12 +260,11 @@ MathStatement::~MathStatement()
 
 void MathStatement::Evaluate(MathEnvironment *env)
 {
-    env->Define(assignee, expression->Evaluate(env));
+    double value = expression->Evaluate(env);
+    MathVar *var = env->DefineSlot(assigneeSlot);
+    var->SetValue(value);
     if (assigneeType != VARTYPE_VALUE)
-    {
-        MathVar *var = env->Lookup(assignee);
         var->type = assigneeType;
-    }
 }
 
 //----------------------------------------------------------------------------
@@ -284,7 +327,7 @@ MathScript::~MathScript()
 
 void MathScript::Evaluate(MathEnvironment *env)
 {
-    MathVar *exitsignal = env->Lookup("exit");
+    MathVar *exitsignal = env->LookupSlot(exitSlot);
     if (exitsignal)
         exitsignal->SetValue(0); // clear exit condition before running
 
@@ -410,6 +453,23 @@ void MathExpression::AddToFPVarList(const csSet<csString> & set, csString & fpVa
     }
 }
 
+void MathExpression::AddPropertyRef(const csString & object, const csString & property)
+{
+    csString fpVar;
+    fpVar.Format("%s_%s", object.GetData(), property.GetData());
+    for (size_t i = 0; i < propertyRefs.GetSize(); i++)
+    {
+        if (propertyRefs[i].fpVar == fpVar)
+            return;
+    }
+
+    PropertyRef ref;
+    ref.objectSlot = MathEnvironment::GetSlot(object);
+    ref.property = PropertyNames::Request(property);
+    ref.fpVar = fpVar;
+    propertyRefs.Push(ref);
+}
+
 bool MathExpression::Parse(const char *exp)
 {
     CS_ASSERT(exp);
@@ -533,7 +593,7 @@ bool MathExpression::Parse(const char *exp)
             {
                 // Found a property reference, i.e. Actor:HP
                 tokens[i] = "_"; // fparser can't deal with ':', so change it to '_'.
-                propertyRefs.Add(csString().Format("%s:%s", tokens[i-1].GetData(), tokens[i+1].GetData()));
+                AddPropertyRef(tokens[i-1], tokens[i+1]);
                 i++; // skip next token - we already dealt with the property.
             }
         }
@@ -559,15 +619,19 @@ bool MathExpression::Parse(const char *exp)
     csSet<csString>::GlobalIterator it(requiredVars.GetIterator());
     while (it.HasNext())
     {
-        fpVars.Append(it.Next());
+        const csString & var = it.Next();
+        varSlots.Push(MathEnvironment::GetSlot(var));
+        fpVars.Append(var);
         fpVars.Append(',');
     }
-    it = propertyRefs.GetIterator();
+    it = requiredObjs.GetIterator();
     while (it.HasNext())
     {
-        csString ref = it.Next();
-        ref.ReplaceAll(":", "_");
-        fpVars.Append(ref);
+        objSlots.Push(MathEnvironment::GetSlot(it.Next()));
+    }
+    for (size_t j = 0; j < propertyRefs.GetSize(); j++)
+    {
+        fpVars.Append(propertyRefs[j].fpVar);
         fpVars.Append(',');
     }
     if (!fpVars.IsEmpty())
@@ -588,66 +652,57 @@ bool MathExpression::Parse(const char *exp)
     }
 
     fp.Optimize();
+    fp.Compile(); // falls back to the bytecode if it can't
     return true;
 
 }
 
 double MathExpression::Evaluate(const MathEnvironment *env)
 {
-    double *values = new double [requiredVars.GetSize() + propertyRefs.GetSize()];
+    // One more than needed, so expressions without variables get a valid array as well.
+    CS_ALLOC_STACK_ARRAY(double, values, varSlots.GetSize() + propertyRefs.GetSize() + 1);
     size_t i = 0;
 
-    csSet<csString>::GlobalIterator it(requiredVars.GetIterator());
-    while (it.HasNext())
+    for (size_t j = 0; j < varSlots.GetSize(); j++)
     {
-        const csString & varName = it.Next();
-        MathVar *var = env->Lookup(varName);
+        MathVar *var = env->LookupSlot(varSlots[j]);
         if (!var)
         {
-            Error3("Error in >%s<: Required variable >%s< not supplied in environment.", name, varName.GetData());
+            Error3("Error in >%s<: Required variable >%s< not supplied in environment.", name, MathEnvironment::GetSlotName(varSlots[j]));
             CS_ASSERT(false);
             return 0.0;
         }
         values[i++] = var->GetValue();
     }
 
-    it = requiredObjs.GetIterator();
-    while (it.HasNext())
+    for (size_t j = 0; j < objSlots.GetSize(); j++)
     {
-        const csString & objName = it.Next();
-        MathVar *var = env->Lookup(objName);
+        MathVar *var = env->LookupSlot(objSlots[j]);
         CS_ASSERT(var); // checked as part of requiredVars
         if (var->Type() != VARTYPE_OBJ)
         {
-            Error3("Error in >%s<: Type inference requires >%s< to be an iScriptableVar, but it isn't.", name, objName.GetData());
+            Error3("Error in >%s<: Type inference requires >%s< to be an iScriptableVar, but it isn't.", name, MathEnvironment::GetSlotName(objSlots[j]));
             CS_ASSERT(false);
             return 0.0;
         }
         if (!var->GetObject())
         {
-            Error3("Error in >%s<: Given a NULL iScriptableVar* for >%s<.", name, objName.GetData());
+            Error3("Error in >%s<: Given a NULL iScriptableVar* for >%s<.", name, MathEnvironment::GetSlotName(objSlots[j]));
             CS_ASSERT(false);
             return 0.0;
         }
     }
 
-    it = propertyRefs.GetIterator();
-    while (it.HasNext())
+    for (size_t j = 0; j < propertyRefs.GetSize(); j++)
     {
-        const csString & ref = it.Next();
-        size_t colonAt = ref.FindFirst(':');
-        csString objname = ref.Slice(0, colonAt);
-        csString prop    = ref.Slice(colonAt + 1);
-
-        MathVar *var = env->Lookup(objname);
+        const PropertyRef & ref = propertyRefs[j];
+        MathVar *var = env->LookupSlot(ref.objectSlot);
         CS_ASSERT(var); // checked as part of requiredVars
         iScriptableVar *obj = var->GetObject();
         CS_ASSERT(obj); // checked as part of requiredObjs
-        values[i++] = obj->GetProperty(prop);
+        values[i++] = obj->GetPropertyByID(ref.property);
     }
 
-    double ret = fp.Eval(values);
-    delete [] values;
-    return ret;
+    return fp.EvalCompiled(values);
 }
 
@@ -122,25 +122,87 @@ public:
     csString Dump() const;
 };
 
+/// Variables a MathEnvironment holds before it allocates.
+#define MATHENV_INLINE_VARS 32
+
+/**
+ * The variables a script runs with. Every variable name has a slot, the
+ * same in all environments, so scripts can look their variables up by
+ * the slots they found when they were parsed, without hashing names.
+ * Callers that run a script often find the slots of their inputs once and
+ * define them with DefineSlot().
+ *
+ * An environment is a small frame of (slot, variable) pairs in the order
+ * they were defined. The first MATHENV_INLINE_VARS live in the environment
+ * itself, so a local environment costs no allocation.
+ */
 class MathEnvironment
 {
 public:
-    MathEnvironment() : parent(NULL) { }
-    MathEnvironment(const MathEnvironment *parent) : parent(parent) { }
+    MathEnvironment() : parent(NULL), count(0) { }
+    MathEnvironment(const MathEnvironment *parent) : parent(parent), count(0) { }
     ~MathEnvironment();
 
     MathVar* Lookup(const char *name) const;
     void Define(const char *name, double value);
     void Define(const char *name, iScriptableVar *obj);
 
+    /// The variable in 'slot', here or in a parent, NULL if none.
+    MathVar* LookupSlot(size_t slot) const
+    {
+        for (const MathEnvironment *env = this; env; env = env->parent)
+        {
+            MathVar *var = env->FindSlot(slot);
+            if (var)
+                return var;
+        }
+        return NULL;
+    }
+
+    /// The variable in 'slot' of this environment, created if needed.
+    MathVar* DefineSlot(size_t slot);
+
+    void DefineSlot(size_t slot, double value)
+    {
+        DefineSlot(slot)->SetValue(value);
+    }
+
+    void DefineSlot(size_t slot, iScriptableVar *obj)
+    {
+        DefineSlot(slot)->SetObject(obj);
+    }
+
+    /// The slot of variable 'name', a new one if it has none yet.
+    static size_t GetSlot(const char *name);
+
+    /// The name of the variable in 'slot'.
+    static const char* GetSlotName(size_t slot);
+
     void DumpAllVars() const;
 
     /// Perform string interpolation, i.e. replacing ${...} with the appropriate variable.
     void InterpolateString(csString & str) const;
 
 protected:
+    struct Entry
+    {
+        size_t slot;
+        MathVar var;
+    };
+
+    /// The variable in 'slot' of this environment only, NULL if none.
+    MathVar* FindSlot(size_t slot) const;
+
+    /// The i-th variable defined here.
+    const Entry& GetEntry(size_t i) const
+    {
+        return i < MATHENV_INLINE_VARS ? inlineVars[i] : *moreVars[i - MATHENV_INLINE_VARS];
+    }
+
     const MathEnvironment *parent;
-    csHash<MathVar*, csString> variables;
+    Entry inlineVars[MATHENV_INLINE_VARS];
+    csArray<Entry*> moreVars; ///< the variables after the inline ones
+    size_t count;             ///< variables defined here
 };
 
 class MathExpression
@@ -153,11 +215,22 @@ protected:
     MathExpression();
 
     void AddToFPVarList(const csSet<csString> & set, csString & fpVars);
+    void AddPropertyRef(const csString & object, const csString & property);
     bool Parse(const char *expression);
 
     csSet<csString> requiredVars;
     csSet<csString> requiredObjs; ///< a subset of requiredVars which are known to be objects; for type checking
-    csSet<csString> propertyRefs; ///< full names like Target:HP
+    csArray<size_t> varSlots;     ///< slots of requiredVars, in the order fparser takes them
+    csArray<size_t> objSlots;     ///< slots of requiredObjs
+
+    /// A property reference like Target:HP, resolved when the expression is parsed.
+    struct PropertyRef
+    {
+        size_t objectSlot;   ///< the slot of the variable holding the object, Target
+        PropertyID property; ///< the id of HP
+        csString fpVar;      ///< what fparser knows it as, Target_HP
+    };
+    csArray<PropertyRef> propertyRefs;
     FunctionParser fp;
 
     const char *name; // used for debugging
@@ -180,9 +253,10 @@ public:
     void Evaluate(MathEnvironment *env);
 
 protected:
-    MathStatement() : assigneeType(VARTYPE_VALUE), expression(NULL) { }
+    MathStatement() : assigneeSlot(0), assigneeType(VARTYPE_VALUE), expression(NULL) { }
 
     csString assignee;
+    size_t assigneeSlot;
     MathType assigneeType; // we can't know, but at least detect Var = 'Hi' as STR.
     MathExpression *expression;
 };
@@ -206,8 +280,9 @@ public:
     void Evaluate(MathEnvironment *env);
 
 protected:
-    MathScript(const char *name) : name(name) { }
+    MathScript(const char *name) : name(name), exitSlot(MathEnvironment::GetSlot("exit")) { }
     csString name;
+    size_t exitSlot;
     csArray<MathStatement*> scriptLines;
 };
 
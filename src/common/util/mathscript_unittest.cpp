@@ -19,6 +19,11 @@
 
 #include <psconfig.h>
 
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+
 //=============================================================================
 // Project Includes
 //=============================================================================
@@ -120,6 +125,52 @@ TEST(MathScriptTest, BasicProperty)
     EXPECT_EQ(42, exp->Evaluate(&env));
 }
 
+/// Answers properties by id, like the server objects do.
+class Bar : public Foo
+{
+public:
+    enum { BAR_HP, BAR_MANA };
+
+    Bar()
+    {
+        table.Add("HP", BAR_HP);
+        table.Add("Mana", BAR_MANA);
+    }
+    virtual double GetPropertyByID(PropertyID id)
+    {
+        switch (table.Get(id))
+        {
+            case BAR_HP:
+                return 80;
+            case BAR_MANA:
+                return 20;
+        }
+        return Foo::GetPropertyByID(id);
+    }
+
+private:
+    PropertyTable table;
+};
+
+TEST(MathScriptTest, PropertyIDs)
+{
+    PropertyID hp = PropertyNames::Request("HP");
+    EXPECT_EQ(hp, PropertyNames::Request("hp"));
+    EXPECT_EQ(hp, PropertyNames::Find("Hp"));
+    EXPECT_STREQ("HP", PropertyNames::GetName(hp));
+    EXPECT_EQ(PROPERTY_UNKNOWN, PropertyNames::Find("NoSuchPropertyAnywhere"));
+    EXPECT_EQ(NULL, PropertyNames::GetName(PROPERTY_UNKNOWN));
+
+    // Names differing in case are the same property, but distinct fparser variables
+    Bar bar;
+    MathExpression *exp = MathExpression::Create("Quux:HP + Quux:mana * 2 + Quux:Mana + Quux:TheAnswer");
+    MathEnvironment env;
+    ASSERT_NE(exp, NULL);
+    env.Define("Quux", &bar);
+    EXPECT_EQ(80 + 40 + 20 + 42, exp->Evaluate(&env));
+    delete exp;
+}
+
 TEST(MathScriptTest, BasicMethod)
 {
     Foo foo;
@@ -366,3 +417,234 @@ TEST(MathScriptTest, RandomGenTest)
    randomgentest(0);  //should always be 0 :)
    //randomgentest(-1); //this will test rnd(), which should limit at 1, but is NOT IMPLEMENTED
 }
+
+TEST(MathScriptTest, NestedEnvironments)
+{
+    MathScript *script = MathScript::Create("nested", "Sum = Base + Bonus; Base = 1");
+    ASSERT_NE(script, NULL);
+
+    MathEnvironment outer;
+    outer.Define("Base", 10.0);
+    outer.Define("Bonus", 5.0);
+
+    MathEnvironment inner(&outer);
+    inner.Define("Bonus", 7.0);
+    script->Evaluate(&inner);
+
+    // Assignments go to the inner environment, lookups fall through to the outer one.
+    EXPECT_EQ(17.0, inner.Lookup("Sum")->GetValue());
+    EXPECT_EQ(1.0, inner.Lookup("Base")->GetValue());
+    EXPECT_EQ(10.0, outer.Lookup("Base")->GetValue());
+    EXPECT_EQ(NULL, outer.Lookup("Sum"));
+    EXPECT_EQ(NULL, outer.Lookup("NeverDefinedAnywhere"));
+    delete script;
+}
+
+TEST(MathScriptTest, ManyVariables)
+{
+    // More variables than the environment holds inline
+    MathEnvironment env;
+    for (int i = 0; i < 3 * MATHENV_INLINE_VARS; i++)
+    {
+        csString name;
+        name.Format("Var%d", i);
+        env.Define(name, i);
+    }
+    for (int i = 3 * MATHENV_INLINE_VARS - 1; i >= 0; i--)
+    {
+        csString name;
+        name.Format("Var%d", i);
+        MathVar *var = env.Lookup(name);
+        ASSERT_NE(var, NULL);
+        EXPECT_EQ(i, var->GetValue());
+    }
+
+    // Redefining keeps the variable
+    MathVar *last = env.Lookup("Var0");
+    env.Define("Var0", 42.0);
+    EXPECT_EQ(last, env.Lookup("Var0"));
+    EXPECT_EQ(42.0, last->GetValue());
+}
+
+TEST(MathScriptTest, DefineBySlot)
+{
+    MathScript *script = MathScript::Create("slots", "Sum = Base + Bonus");
+    ASSERT_NE(script, NULL);
+
+    size_t base = MathEnvironment::GetSlot("Base");
+    size_t bonus = MathEnvironment::GetSlot("Bonus");
+    size_t sum = MathEnvironment::GetSlot("Sum");
+    EXPECT_EQ(base, MathEnvironment::GetSlot("Base"));
+    EXPECT_STREQ("Bonus", MathEnvironment::GetSlotName(bonus));
+
+    MathEnvironment env;
+    env.DefineSlot(base, 3.0);
+    env.DefineSlot(bonus, 4.0);
+    script->Evaluate(&env);
+    EXPECT_EQ(7.0, env.LookupSlot(sum)->GetValue());
+    EXPECT_EQ(env.Lookup("Sum"), env.LookupSlot(sum));
+    delete script;
+}
+
+/// A script shaped like the combat calculations, variables and properties included.
+static MathScript* CreateCombatScript()
+{
+    return MathScript::Create("combat",
+        "Damage = Weapon * (1 + Attacker:HP / 100) - Armor * Defender:Mana / 50;"
+        "Blocked = Damage < Armor;"
+        "Result = Blocked * 0 + (1 - Blocked) * Damage");
+}
+
+TEST(MathScriptTest, RepeatedEvaluation)
+{
+    MathScript *script = CreateCombatScript();
+    ASSERT_NE(script, NULL);
+
+    Bar attacker, defender;
+    MathEnvironment outer;
+    outer.Define("Attacker", &attacker);
+    outer.Define("Defender", &defender);
+
+    // The second run reuses the slots the first one looked up
+    MathEnvironment env(&outer);
+    env.Define("Weapon", 30.0);
+    env.Define("Armor", 12.0);
+    script->Evaluate(&env);
+    EXPECT_DOUBLE_EQ(30.0 * 1.8 - 12.0 * 20 / 50, env.Lookup("Result")->GetValue());
+    env.Define("Weapon", 5.0);
+    script->Evaluate(&env);
+    EXPECT_DOUBLE_EQ(0.0, env.Lookup("Result")->GetValue());
+    delete script;
+}
+
+/**
+ * Reports how many times a second the combat shaped script can be run.
+ * Disabled in normal runs, see util/benchmark.h.
+ */
+TEST(MathScriptTest, DISABLED_EvaluationBenchmark)
+{
+    const int runs = 200000;
+    MathScript *script = CreateCombatScript();
+    ASSERT_NE(script, NULL);
+
+    Bar attacker, defender;
+    MathEnvironment outer;
+    outer.Define("Attacker", &attacker);
+    outer.Define("Defender", &defender);
+
+    MathEnvironment env(&outer);
+    env.Define("Weapon", 30.0);
+    env.Define("Armor", 12.0);
+
+    csMicroTicks start = csGetMicroTicks();
+    for (int i = 0; i < runs; i++)
+        script->Evaluate(&env);
+    csMicroTicks elapsed = csGetMicroTicks() - start;
+
+    EXPECT_DOUBLE_EQ(30.0 * 1.8 - 12.0 * 20 / 50, env.Lookup("Result")->GetValue());
+    printf("%d script runs in %.0f usec, %.0f runs per second\n",
+        runs, (double) elapsed, elapsed ? runs * 1000000.0 / elapsed : 0.0);
+
+    // As the combat code runs it, a new environment with the inputs defined by slot
+    size_t weapon = MathEnvironment::GetSlot("Weapon");
+    size_t armor = MathEnvironment::GetSlot("Armor");
+    size_t result = MathEnvironment::GetSlot("Result");
+    double last = 0;
+    start = csGetMicroTicks();
+    for (int i = 0; i < runs; i++)
+    {
+        MathEnvironment local(&outer);
+        local.DefineSlot(weapon, 30.0);
+        local.DefineSlot(armor, 12.0);
+        script->Evaluate(&local);
+        last = local.LookupSlot(result)->GetValue();
+    }
+    elapsed = csGetMicroTicks() - start;
+
+    EXPECT_DOUBLE_EQ(30.0 * 1.8 - 12.0 * 20 / 50, last);
+    printf("%d runs in new environments in %.0f usec, %.0f runs per second\n",
+        runs, (double) elapsed, elapsed ? runs * 1000000.0 / elapsed : 0.0);
+    delete script;
+}
+
+/// Formulas from math_scripts.sql, over the variables A to D.
+static const char* const fparserFormulas[] =
+{
+    "A*4*(1+(B*B/10000))",
+    "(50-B) + C/20 + D/20",
+    "1.0 + (C/10)*(1+(1+(200-C)/100)*(B*B/10000))",
+    "floor(10/(1 + D - A))",
+    "if(A=1, (B*2)+(C*0.8), if(A=2, (B*1.5)+(C*0.5), if(A=3, B, if(A=4, B*0.3, 0))))",
+    "if(D>1, pow(D, 1.8) * 0.8, 0)",
+    "((C / 10) * 3)*1000",
+    "min(A, B) + max(C, D) - abs(A - C) + sqrt(D * D)"
+};
+
+TEST(MathScriptTest, CompiledMatchesBytecode)
+{
+    for (size_t f = 0; f < sizeof(fparserFormulas) / sizeof(fparserFormulas[0]); f++)
+    {
+        FunctionParser fp;
+        ASSERT_EQ(-1, fp.Parse(fparserFormulas[f], "A,B,C,D")) << fparserFormulas[f];
+        fp.Optimize();
+        EXPECT_TRUE(fp.Compile()) << fparserFormulas[f];
+
+        for (int i = 0; i < 500; i++)
+        {
+            // Small integers for the if() branches, some giving errors
+            double vars[4] = { double(i % 6), (i * 7) % 97 - 20.5, (i * 13) % 211 / 3.0, (i * 3) % 11 - 2.0 };
+            double expected = fp.Eval(vars);
+            int error = fp.EvalError();
+            EXPECT_EQ(expected, fp.EvalCompiled(vars)) << fparserFormulas[f] << " at " << i;
+            EXPECT_EQ(error, fp.EvalError()) << fparserFormulas[f] << " at " << i;
+        }
+    }
+
+    // Parsing again drops the compiled form
+    FunctionParser fp;
+    fp.Parse("A+1", "A");
+    ASSERT_TRUE(fp.Compile());
+    fp.Parse("A*3", "A");
+    double a = 2;
+    EXPECT_EQ(6.0, fp.EvalCompiled(&a));
+}
+
+/**
+ * Reports how many times a second each formula is evaluated from the
+ * bytecode and from the compiled form. Disabled in normal runs, see
+ * util/benchmark.h.
+ */
+TEST(MathScriptTest, DISABLED_CompiledBenchmark)
+{
+    const int runs = 500000;
+    for (size_t f = 0; f < sizeof(fparserFormulas) / sizeof(fparserFormulas[0]); f++)
+    {
+        FunctionParser fp;
+        fp.Parse(fparserFormulas[f], "A,B,C,D");
+        fp.Optimize();
+        fp.Compile();
+
+        double vars[4] = { 3, 40, 55, 4 };
+        double sum = 0, compiledSum = 0;
+        csMicroTicks start = csGetMicroTicks();
+        for (int i = 0; i < runs; i++)
+        {
+            vars[0] = i & 3;
+            sum += fp.Eval(vars);
+        }
+        csMicroTicks bytecode = csGetMicroTicks() - start;
+
+        start = csGetMicroTicks();
+        for (int i = 0; i < runs; i++)
+        {
+            vars[0] = i & 3;
+            compiledSum += fp.EvalCompiled(vars);
+        }
+        csMicroTicks compiled = csGetMicroTicks() - start;
+
+        EXPECT_EQ(sum, compiledSum);
+        printf("%-40.40s %10.0f runs per second bytecode, %10.0f compiled\n", fparserFormulas[f],
+            bytecode ? runs * 1000000.0 / bytecode : 0.0,
+            compiled ? runs * 1000000.0 / compiled : 0.0);
+    }
+}
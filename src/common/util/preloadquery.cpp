@@ -0,0 +1,585 @@
+/*
+ * preloadquery.cpp
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+#include <psconfig.h>
+
+#include <csutil/memfile.h>
+#include <csutil/stringarray.h>
+
+#include "util/preloadquery.h"
+#include "util/consoleout.h"
+
+/// "PSPS", to tell a snapshot from other files
+#define PRELOAD_SNAPSHOT_MAGIC   0x50535053
+/// Change when the layout changes
+#define PRELOAD_SNAPSHOT_VERSION 1
+/// The length written for NULL values
+#define PRELOAD_SNAPSHOT_NULL    0xFFFFFFFF
+
+class SnapshotResultSet;
+
+/// A row of a query read from a snapshot.
+class SnapshotRow : public iResultRow
+{
+public:
+    SnapshotRow(SnapshotResultSet* set) : set(set), current(0), last_index(0) {}
+
+    void SetMaxFields(int fields) {}
+    void SetResultSet(void* resultsettoken) {}
+
+    int Fetch(int row);
+
+    const char *operator[](int whichfield);
+    const char *operator[](const char *fieldname);
+
+    int GetFieldIndex(const char *fieldname);
+    int GetFieldCount();
+    const char *GetFieldName(int whichfield);
+
+    int GetInt(int whichfield)
+    {
+        const char *ptr = operator[](whichfield);
+        return (ptr) ? atoi(ptr) : 0;
+    }
+    int GetInt(const char *fieldname)
+    {
+        const char *ptr = operator[](fieldname);
+        return (ptr) ? atoi(ptr) : 0;
+    }
+
+    unsigned long GetUInt32(int whichfield)
+    {
+        const char *ptr = operator[](whichfield);
+        return (ptr) ? strtoul(ptr, NULL, 10) : 0;
+    }
+    unsigned long GetUInt32(const char *fieldname)
+    {
+        const char *ptr = operator[](fieldname);
+        return (ptr) ? strtoul(ptr, NULL, 10) : 0;
+    }
+
+    float GetFloat(int whichfield)
+    {
+        const char *ptr = operator[](whichfield);
+        return (ptr) ? atof(ptr) : 0;
+    }
+    float GetFloat(const char *fieldname)
+    {
+        const char *ptr = operator[](fieldname);
+        return (ptr) ? atof(ptr) : 0;
+    }
+
+    uint64 GetUInt64(int whichfield)
+    {
+        const char *ptr = operator[](whichfield);
+        return (ptr) ? stringtouint64(ptr) : 0;
+    }
+    uint64 GetUInt64(const char *fieldname)
+    {
+        const char *ptr = operator[](fieldname);
+        return (ptr) ? stringtouint64(ptr) : 0;
+    }
+
+    uint64 stringtouint64(const char *stringbuf)
+    {
+        uint64 result = 0;
+        for (; *stringbuf >= '0' && *stringbuf <= '9'; stringbuf++)
+            result = result * 10 + (uint64)(*stringbuf - '0');
+        return result;
+    }
+
+private:
+    SnapshotResultSet* set;
+    unsigned long current;
+    int last_index;
+};
+
+/// The rows of a query, pointing into the buffer they were read from.
+class SnapshotResultSet : public iResultSet
+{
+public:
+    SnapshotResultSet(iDataBuffer* data) : data(data), rows(0), fields(0), current((unsigned long)-1), row(this) {}
+
+    void Release(void) { delete this; }
+
+    iResultRow& operator[](unsigned long whichrow)
+    {
+        current = whichrow;
+        row.Fetch(whichrow);
+        return row;
+    }
+
+    unsigned long Count(void) { return rows; }
+
+    iResultRow* Next()
+    {
+        if (current + 1 >= rows)
+            return NULL;
+        return &(*this)[current + 1];
+    }
+
+    csRef<iDataBuffer> data;
+    csArray<const char*> names;
+    /// Row after row, NULL for NULL values
+    csArray<const char*> values;
+    unsigned long rows;
+    int fields;
+
+private:
+    unsigned long current;
+    SnapshotRow row;
+};
+
+int SnapshotRow::Fetch(int row)
+{
+    if (row < 0 || (unsigned long)row >= set->rows)
+        return -1;
+
+    current = row;
+    return 0;
+}
+
+const char *SnapshotRow::operator[](int whichfield)
+{
+    if (whichfield >= 0 && whichfield < set->fields && current < set->rows)
+        return set->values[current * set->fields + whichfield];
+    else
+        return "";
+}
+
+const char *SnapshotRow::operator[](const char *fieldname)
+{
+    int i = GetFieldIndex(fieldname);
+    if (i >= 0)
+        return operator[](i);
+
+    CPrintf(CON_BUG, "Could not find field %s!\n", fieldname);
+    CS_ASSERT(false);
+    return "";
+}
+
+int SnapshotRow::GetFieldIndex(const char *fieldname)
+{
+    // Fields are often read in the order of the columns
+    if (last_index < set->fields && !strcasecmp(set->names[last_index], fieldname))
+        return last_index++;
+
+    for (int i = 0; i < set->fields; i++)
+    {
+        if (!strcasecmp(set->names[i], fieldname))
+        {
+            last_index = i + 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+int SnapshotRow::GetFieldCount()
+{
+    return set->fields;
+}
+
+const char *SnapshotRow::GetFieldName(int whichfield)
+{
+    return (whichfield >= 0 && whichfield < set->fields) ? set->names[whichfield] : NULL;
+}
+
+/// Reads the snapshot layout, failing on anything past the end of the data.
+class SnapshotReader
+{
+public:
+    SnapshotReader(iDataBuffer* data, size_t offset)
+        : data(data->GetData()), size(data->GetSize()), offset(offset), ok(true)
+    {
+    }
+
+    uint32 ReadUInt32()
+    {
+        uint32 value = 0;
+        if (offset + sizeof(value) > size)
+        {
+            ok = false;
+            return 0;
+        }
+        memcpy(&value, data + offset, sizeof(value));
+        offset += sizeof(value);
+        return value;
+    }
+
+    /// NULL for NULL values and on errors.
+    const char* ReadString()
+    {
+        uint32 length = ReadUInt32();
+        if (!ok || length == PRELOAD_SNAPSHOT_NULL)
+            return NULL;
+
+        if (length >= size - offset || data[offset + length] != '\0')
+        {
+            ok = false;
+            return NULL;
+        }
+        const char* str = data + offset;
+        offset += length + 1;
+        return str;
+    }
+
+    const char* data;
+    size_t size;
+    size_t offset;
+    bool ok;
+};
+
+static void WriteUInt32(csMemFile& file, uint32 value)
+{
+    file.Write((const char*) &value, sizeof(value));
+}
+
+static void WriteString(csMemFile& file, const char* str)
+{
+    if (!str)
+    {
+        WriteUInt32(file, PRELOAD_SNAPSHOT_NULL);
+        return;
+    }
+
+    size_t length = strlen(str);
+    WriteUInt32(file, (uint32) length);
+    file.Write(str, length + 1);
+}
+
+csPtr<iDataBuffer> PreloadQuerySet::Serialize(const char* sql, iResultSet* rs)
+{
+    csMemFile file;
+    WriteString(file, sql);
+
+    unsigned long rows = rs->Count();
+    int fields = rows ? (*rs)[0].GetFieldCount() : 0;
+    WriteUInt32(file, fields);
+    for (int i = 0; i < fields; i++)
+        WriteString(file, (*rs)[0].GetFieldName(i));
+
+    WriteUInt32(file, rows);
+    for (unsigned long r = 0; r < rows; r++)
+    {
+        iResultRow& row = (*rs)[r];
+        for (int i = 0; i < fields; i++)
+            WriteString(file, row[i]);
+    }
+
+    return file.GetAllData();
+}
+
+iResultSet* PreloadQuerySet::Parse(iDataBuffer* data, size_t& offset, csString& sql)
+{
+    SnapshotReader reader(data, offset);
+    SnapshotResultSet* set = new SnapshotResultSet(data);
+
+    sql = reader.ReadString();
+    uint32 fields = reader.ReadUInt32();
+    if (fields > (reader.size - MIN(reader.offset, reader.size)) / sizeof(uint32))
+        reader.ok = false;
+    else
+        set->fields = (int) fields;
+    for (int i = 0; i < set->fields && reader.ok; i++)
+    {
+        const char* name = reader.ReadString();
+        set->names.Push(name ? name : "");
+    }
+
+    set->rows = reader.ReadUInt32();
+    if (reader.ok && set->fields > 0)
+    {
+        // Each value takes at least its length, don't trust more than that
+        size_t count = (size_t) set->rows * set->fields;
+        if (count > (reader.size - reader.offset) / sizeof(uint32))
+            reader.ok = false;
+        else
+            set->values.SetCapacity(count);
+
+        for (size_t i = 0; i < count && reader.ok; i++)
+            set->values.Push(reader.ReadString());
+    }
+
+    if (!reader.ok)
+    {
+        delete set;
+        return NULL;
+    }
+
+    offset = reader.offset;
+    return set;
+}
+
+PreloadQuerySet::Query::Query(const char* table, const char* sql) : table(table), sql(sql)
+{
+    started = false;
+    taken = false;
+    snapshotRows = NULL;
+    finished = false;
+    result = NULL;
+}
+
+PreloadQuerySet::Query::~Query()
+{
+    if (snapshotRows)
+        snapshotRows->Release();
+    if (result)
+        result->Release();
+}
+
+void PreloadQuerySet::Query::QueryDone(iResultSet* result, unsigned long affected, const char* error)
+{
+    if (error)
+        CPrintf(CON_ERROR, "Preload query '%s' failed: %s\n", sql.GetData(), error);
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    this->result = result;
+    finished = true;
+    condition.NotifyAll();
+}
+
+iResultSet* PreloadQuerySet::Query::Wait()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    while (!finished)
+        condition.Wait(mutex);
+
+    iResultSet* rs = result;
+    result = NULL;
+    return rs;
+}
+
+PreloadQuerySet::PreloadQuerySet()
+{
+    db = NULL;
+    fromSnapshot = false;
+}
+
+PreloadQuerySet::~PreloadQuerySet()
+{
+    // The async connections still hold the queries not yet done
+    DropUnused(false);
+}
+
+void PreloadQuerySet::Add(const char* table, const char* sql)
+{
+    queries.Push(new Query(table, sql));
+}
+
+PreloadQuerySet::Query* PreloadQuerySet::Find(const char* sql)
+{
+    for (size_t i = 0; i < queries.GetSize(); i++)
+    {
+        if (queries[i]->sql == sql)
+            return queries[i];
+    }
+    return NULL;
+}
+
+void PreloadQuerySet::Start(iDataConnection* db, iVFS* vfs, const char* snapshot)
+{
+    this->db = db;
+    this->vfs = vfs;
+    snapshotPath = snapshot;
+
+    if (vfs && !snapshotPath.IsEmpty())
+    {
+        checksums = ReadChecksums();
+        if (!checksums.IsEmpty() && LoadSnapshot())
+        {
+            fromSnapshot = true;
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < queries.GetSize(); i++)
+    {
+        queries[i]->started = true;
+        db->SelectAsync(queries[i], "%s", queries[i]->sql.GetData());
+    }
+}
+
+iResultSet* PreloadQuerySet::Select(const char* sql)
+{
+    Query* query = Find(sql);
+    if (!query || query->taken || (!query->started && !query->snapshotRows))
+        return db->Select("%s", sql);
+
+    query->taken = true;
+    if (query->snapshotRows)
+    {
+        iResultSet* rs = query->snapshotRows;
+        query->snapshotRows = NULL;
+        return rs;
+    }
+
+    iResultSet* rs = query->Wait();
+    if (rs && !checksums.IsEmpty())
+    {
+        // Keep them for the snapshot, and serve them the way the snapshot will
+        query->serialized = Serialize(sql, rs);
+        rs->Release();
+
+        size_t offset = 0;
+        csString parsedsql;
+        rs = Parse(query->serialized, offset, parsedsql);
+    }
+    return rs;
+}
+
+void PreloadQuerySet::Finish()
+{
+    DropUnused(true);
+
+    if (!fromSnapshot && !checksums.IsEmpty())
+        WriteSnapshot();
+}
+
+void PreloadQuerySet::DropUnused(bool report)
+{
+    for (size_t i = 0; i < queries.GetSize(); i++)
+    {
+        Query* query = queries[i];
+        if (query->taken)
+            continue;
+
+        if (report)
+            CPrintf(CON_WARNING, "Preloaded query '%s' was not used.\n", query->sql.GetData());
+
+        query->taken = true;
+        if (query->started)
+        {
+            iResultSet* rs = query->Wait();
+            if (rs)
+                rs->Release();
+        }
+    }
+}
+
+csString PreloadQuerySet::ReadChecksums()
+{
+    csStringArray tables;
+    for (size_t i = 0; i < queries.GetSize(); i++)
+    {
+        if (tables.Find(queries[i]->table) == csArrayItemNotFound)
+            tables.Push(queries[i]->table);
+    }
+
+    csString list;
+    for (size_t i = 0; i < tables.GetSize(); i++)
+    {
+        if (i)
+            list.Append(", ");
+        list.Append(tables[i]);
+    }
+
+    // Whole table scans on the server, cheap next to sending the rows
+    csString sums;
+    iResultSet* rs = db->Select("CHECKSUM TABLE %s", list.GetData());
+    if (!rs)
+        return sums;
+
+    for (unsigned long i = 0; i < rs->Count(); i++)
+    {
+        const char* sum = (*rs)[i][1];
+        sums.AppendFmt("%s=%s\n", (*rs)[i][0], sum ? sum : "missing");
+    }
+    rs->Release();
+    return sums;
+}
+
+bool PreloadQuerySet::LoadSnapshot()
+{
+    // Disk files are mapped into memory by the VFS where it can
+    csRef<iDataBuffer> data = vfs->ReadFile(snapshotPath, false);
+    if (!data)
+        return false;
+
+    SnapshotReader reader(data, 0);
+    if (reader.ReadUInt32() != PRELOAD_SNAPSHOT_MAGIC || reader.ReadUInt32() != PRELOAD_SNAPSHOT_VERSION)
+    {
+        CPrintf(CON_WARNING, "Ignoring preload snapshot %s of another version.\n", snapshotPath.GetData());
+        return false;
+    }
+
+    const char* sums = reader.ReadString();
+    if (!sums || checksums != sums)
+    {
+        CPrintf(CON_NOTIFY, "Database changed since preload snapshot %s was written.\n", snapshotPath.GetData());
+        return false;
+    }
+
+    uint32 count = reader.ReadUInt32();
+    bool ok = reader.ok && count == queries.GetSize();
+    size_t offset = reader.offset;
+    for (uint32 i = 0; i < count && ok; i++)
+    {
+        csString sql;
+        iResultSet* rs = Parse(data, offset, sql);
+        Query* query = rs ? Find(sql) : NULL;
+        if (!query || query->snapshotRows)
+        {
+            if (rs)
+                rs->Release();
+            ok = false;
+            break;
+        }
+        query->snapshotRows = rs;
+    }
+
+    if (!ok)
+    {
+        CPrintf(CON_WARNING, "Preload snapshot %s does not match the queries, reading the database.\n",
+            snapshotPath.GetData());
+        for (size_t i = 0; i < queries.GetSize(); i++)
+        {
+            if (queries[i]->snapshotRows)
+                queries[i]->snapshotRows->Release();
+            queries[i]->snapshotRows = NULL;
+        }
+    }
+    return ok;
+}
+
+void PreloadQuerySet::WriteSnapshot()
+{
+    // Only complete snapshots, a failed query leaves the old one in place
+    for (size_t i = 0; i < queries.GetSize(); i++)
+    {
+        if (!queries[i]->serialized)
+            return;
+    }
+
+    csMemFile header;
+    WriteUInt32(header, PRELOAD_SNAPSHOT_MAGIC);
+    WriteUInt32(header, PRELOAD_SNAPSHOT_VERSION);
+    WriteString(header, checksums);
+    WriteUInt32(header, (uint32) queries.GetSize());
+
+    csRef<iFile> file = vfs->Open(snapshotPath, VFS_FILE_WRITE);
+    if (!file)
+    {
+        CPrintf(CON_WARNING, "Could not write preload snapshot %s.\n", snapshotPath.GetData());
+        return;
+    }
+
+    file->Write(header.GetData(), header.GetSize());
+    for (size_t i = 0; i < queries.GetSize(); i++)
+        file->Write(queries[i]->serialized->GetData(), queries[i]->serialized->GetSize());
+}
@@ -0,0 +1,143 @@
+/*
+ * preloadquery.h
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+/*   Design notes:
+ *
+ *  The server preloads its caches with a long run of bulk selects, each
+ *  parsed before the next is sent.  The selects don't depend on each other,
+ *  only the parsing does, so they are all sent up front with SelectAsync()
+ *  and run side by side on the connections of the async pool.  The loaders
+ *  still build the caches one after the other on the calling thread, they
+ *  share too much state to do otherwise, but mostly find their rows waiting.
+ *
+ *  With a snapshot file the rows are also kept on disk, together with the
+ *  CHECKSUM TABLE of every table they came from.  On the next start the
+ *  checksums are read first; if none changed the rows are served from the
+ *  snapshot instead of the database.  The file is read as one buffer and
+ *  the rows point into it, nothing is copied per field.
+ *
+ *  Snapshot layout, all integers 32 bit in host byte order:
+ *      magic, version, checksums, number of queries, queries
+ *  where a query is
+ *      sql, columns, column names, rows, columns * rows values
+ *  and a string is its length (or PRELOAD_SNAPSHOT_NULL), the characters
+ *  and a terminating 0.
+ */
+#ifndef __PRELOADQUERY_H__
+#define __PRELOADQUERY_H__
+
+#include <csutil/csstring.h>
+#include <csutil/parray.h>
+#include <csutil/threading/condition.h>
+#include <iutil/databuff.h>
+#include <iutil/vfs.h>
+
+#include "iserver/idal.h"
+
+/**
+ * The bulk selects of a preload, run ahead of the loaders that need them.
+ * Add() all queries, Start() them, then have each loader Select() its rows
+ * in place of iDataConnection::Select(). Finish() when done.
+ */
+class PreloadQuerySet
+{
+public:
+    PreloadQuerySet();
+    ~PreloadQuerySet();
+
+    /// Add a select reading 'table'. Only before Start().
+    void Add(const char* table, const char* sql);
+
+    /**
+     * Send all queries to the database, or read their rows from the
+     * snapshot if the tables did not change since it was written.
+     * @param snapshot VFS path of the snapshot, NULL or empty for none.
+     */
+    void Start(iDataConnection* db, iVFS* vfs, const char* snapshot);
+
+    /**
+     * The rows of a query, waiting for them if needed. The caller releases
+     * them. Queries that were not added, or are asked for twice, are run
+     * directly. Returns NULL if the query failed.
+     */
+    iResultSet* Select(const char* sql);
+
+    /// Wait for queries nobody asked for and write the snapshot if it was outdated.
+    void Finish();
+
+    /// True if the rows come from the snapshot.
+    bool IsFromSnapshot() const { return fromSnapshot; }
+
+    /// Encode the rows of a query the way the snapshot keeps them.
+    static csPtr<iDataBuffer> Serialize(const char* sql, iResultSet* rs);
+
+    /**
+     * Decode a query encoded by Serialize() that starts at 'offset' of
+     * 'data', and move 'offset' past it. The rows keep a reference to
+     * 'data'. Returns NULL if the data is cut short.
+     */
+    static iResultSet* Parse(iDataBuffer* data, size_t& offset, csString& sql);
+
+private:
+    /// A query and its rows, whichever thread they come from.
+    class Query : public iQueryCallback
+    {
+    public:
+        Query(const char* table, const char* sql);
+        virtual ~Query();
+
+        virtual void QueryDone(iResultSet* result, unsigned long affected, const char* error);
+
+        /// Wait for the rows and take them.
+        iResultSet* Wait();
+
+        csString table;
+        csString sql;
+        bool started;
+        bool taken;
+        iResultSet* snapshotRows;
+        csRef<iDataBuffer> serialized;
+
+    private:
+        CS::Threading::Mutex mutex;
+        CS::Threading::Condition condition;
+        bool finished;
+        iResultSet* result;
+    };
+
+    Query* Find(const char* sql);
+
+    /// The CHECKSUM TABLE of all tables, empty if it could not be read.
+    csString ReadChecksums();
+
+    bool LoadSnapshot();
+    void WriteSnapshot();
+
+    /// Wait for the queries not taken and drop their rows.
+    void DropUnused(bool report);
+
+    csPDelArray<Query> queries;
+    iDataConnection* db;
+    csRef<iVFS> vfs;
+    csString snapshotPath;
+    csString checksums;
+    bool fromSnapshot;
+};
+
+#endif
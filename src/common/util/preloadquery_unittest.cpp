@@ -0,0 +1,183 @@
+/*
+ * preloadquery_unittest.cpp
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/memfile.h>
+#include <csutil/sysfunc.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/preloadquery.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// A table held in memory, NULL values included.
+class TableResultSet : public iResultSet, public iResultRow
+{
+public:
+    TableResultSet(int fields) : fields(fields), current(0) {}
+
+    void AddName(const char* name) { names.Push(name); }
+    void AddValue(const char* value) { values.Push(value); }
+
+    // iResultSet
+    virtual iResultRow& operator[](unsigned long whichrow) { current = whichrow; return *this; }
+    virtual unsigned long Count(void) { return values.GetSize() / fields; }
+    virtual iResultRow* Next() { return NULL; }
+    virtual void Release(void) { delete this; }
+
+    // iResultRow
+    virtual void SetMaxFields(int fields) {}
+    virtual void SetResultSet(void* resultsettoken) {}
+    virtual int Fetch(int row) { current = row; return 0; }
+    virtual const char* operator[](int whichfield) { return values[current * fields + whichfield]; }
+    virtual const char* operator[](const char* fieldname) { return operator[](GetFieldIndex(fieldname)); }
+    virtual int GetFieldIndex(const char* fieldname)
+    {
+        for (size_t i = 0; i < names.GetSize(); i++)
+        {
+            if (!strcasecmp(names[i], fieldname))
+                return (int) i;
+        }
+        return -1;
+    }
+    virtual int GetFieldCount() { return fields; }
+    virtual const char* GetFieldName(int whichfield) { return names[whichfield]; }
+    virtual int GetInt(int whichfield) { return atoi(operator[](whichfield)); }
+    virtual int GetInt(const char* fieldname) { return atoi(operator[](fieldname)); }
+    virtual unsigned long GetUInt32(int whichfield) { return strtoul(operator[](whichfield), NULL, 10); }
+    virtual unsigned long GetUInt32(const char* fieldname) { return strtoul(operator[](fieldname), NULL, 10); }
+    virtual float GetFloat(int whichfield) { return atof(operator[](whichfield)); }
+    virtual float GetFloat(const char* fieldname) { return atof(operator[](fieldname)); }
+    virtual uint64 GetUInt64(int whichfield) { return 0; }
+    virtual uint64 GetUInt64(const char* fieldname) { return 0; }
+    virtual uint64 stringtouint64(const char* stringbuf) { return 0; }
+
+private:
+    int fields;
+    unsigned long current;
+    csArray<const char*> names;
+    csArray<const char*> values;
+};
+
+static TableResultSet* MakeSkills()
+{
+    TableResultSet* rs = new TableResultSet(3);
+    rs->AddName("skill_id");
+    rs->AddName("name");
+    rs->AddName("description");
+
+    rs->AddValue("1");
+    rs->AddValue("Sword");
+    rs->AddValue("Swinging \"sharp\" things");
+    rs->AddValue("2");
+    rs->AddValue("Crystal Way");
+    rs->AddValue(NULL);
+    rs->AddValue("-3");
+    rs->AddValue("");
+    rs->AddValue("0.25");
+    return rs;
+}
+
+TEST(PreloadQueryTest, SerializeRoundTrip)
+{
+    TableResultSet* table = MakeSkills();
+    csRef<iDataBuffer> data = PreloadQuerySet::Serialize("SELECT * from skills", table);
+    table->Release();
+
+    size_t offset = 0;
+    csString sql;
+    iResultSet* rs = PreloadQuerySet::Parse(data, offset, sql);
+    ASSERT_TRUE(rs != NULL);
+    EXPECT_EQ(data->GetSize(), offset);
+    EXPECT_STREQ("SELECT * from skills", sql);
+
+    ASSERT_EQ(3u, rs->Count());
+    iResultRow& row = (*rs)[1];
+    EXPECT_EQ(3, row.GetFieldCount());
+    EXPECT_STREQ("description", row.GetFieldName(2));
+    EXPECT_TRUE(row.GetFieldName(3) == NULL);
+    EXPECT_EQ(2, row.GetInt("SKILL_ID"));
+    EXPECT_STREQ("Crystal Way", row["name"]);
+    EXPECT_TRUE(row["description"] == NULL);
+    EXPECT_EQ(-1, row.GetFieldIndex("missing"));
+
+    EXPECT_STREQ("Swinging \"sharp\" things", (*rs)[0]["description"]);
+    EXPECT_EQ(-3, (*rs)[2].GetInt(0));
+    EXPECT_STREQ("", (*rs)[2][1]);
+    EXPECT_FLOAT_EQ(0.25f, (*rs)[2].GetFloat("description"));
+
+    // Next() walks the rows from the start
+    offset = 0;
+    iResultSet* again = PreloadQuerySet::Parse(data, offset, sql);
+    ASSERT_TRUE(again != NULL);
+    const int ids[] = { 1, 2, -3 };
+    int count = 0;
+    iResultRow* next;
+    while ((next = again->Next()) && count < 3)
+        EXPECT_EQ(ids[count++], next->GetInt("skill_id"));
+    EXPECT_EQ(3, count);
+
+    again->Release();
+    rs->Release();
+}
+
+TEST(PreloadQueryTest, RejectsTruncatedData)
+{
+    TableResultSet* table = MakeSkills();
+    csRef<iDataBuffer> data = PreloadQuerySet::Serialize("SELECT * from skills", table);
+    table->Release();
+
+    for (size_t size = 0; size < data->GetSize(); size++)
+    {
+        csMemFile file;
+        file.Write(data->GetData(), size);
+        csRef<iDataBuffer> cut = file.GetAllData();
+
+        size_t offset = 0;
+        csString sql;
+        iResultSet* rs = PreloadQuerySet::Parse(cut, offset, sql);
+        EXPECT_TRUE(rs == NULL) << "cut at " << size;
+        if (rs)
+            rs->Release();
+    }
+}
+
+TEST(PreloadQueryTest, EmptyResult)
+{
+    TableResultSet* table = new TableResultSet(2);
+    csRef<iDataBuffer> data = PreloadQuerySet::Serialize("SELECT * from tips", table);
+    table->Release();
+
+    size_t offset = 0;
+    csString sql;
+    iResultSet* rs = PreloadQuerySet::Parse(data, offset, sql);
+    ASSERT_TRUE(rs != NULL);
+    EXPECT_EQ(0u, rs->Count());
+    EXPECT_TRUE(rs->Next() == NULL);
+    rs->Release();
+}
@@ -147,6 +147,10 @@ struct Result
     }
     
     unsigned long Count(void) { return rs->Count(); }
+
+    iResultRow* Next() { return rs->Next(); }
+
+    const char* GetError() { return rs->GetError(); }
 };
 
 
@@ -41,9 +41,17 @@
 //====================================================================================
 #include "pspathnetwork.h"
 
-#ifndef INFINITY
-#define INFINITY 999999999.0F
-#endif
+/// Cell size of the waypoint index, about the range NPCs locate waypoints in.
+#define WAYPOINT_INDEX_CELL 50.0f
+
+psPathNetwork::psPathNetwork()
+    : world(NULL), searchGeneration(0), estimateScale(-1.0), routeCacheSize(0)
+{
+}
+
+psPathNetwork::~psPathNetwork()
+{
+}
 
 bool psPathNetwork::Load(iEngine *engine, iDataConnection *db,psWorld * world)
 {
@@ -158,6 +166,7 @@ size_t psPathNetwork::AddWaypointToGroup(csString group, Waypoint * wp)
     }
 
     waypointGroups[index].PushBack(wp);
+    ClearWaypointIndex();
     
     return index;
 }
@@ -210,58 +219,41 @@ Waypoint *psPathNetwork::FindWaypoint(const char * name)
 
 Waypoint *psPathNetwork::FindNearestWaypoint(csVector3& v,iSector *sector, float range, float * found_range)
 {
-    csPDelArray<Waypoint>::Iterator iter(waypoints.GetIterator());
-    Waypoint *wp;
+    Waypoint *wp = GetWaypointIndex(-1)->FindNearest(world, sector, v, range, found_range);
 
-    float min_range = range;
-
-    Waypoint *min_wp = NULL;
-
-    while (iter.HasNext())
+    if (!wp && range < 0 && waypoints.GetSize())
     {
-        wp = iter.Next();
-
-        float dist2 = world->Distance(v,sector,wp->loc.pos,wp->GetSector(engine));
-        
-        if (min_range < 0 || dist2 < min_range)
-        {
-            min_range = dist2;
-            min_wp = wp;
-        }
+        // None within reach, they are all equally far away
+        wp = waypoints[0];
+        if (found_range) *found_range = world->Distance(v,sector,wp->loc.pos,wp->GetSector(engine));
     }
-    if (min_wp && found_range) *found_range = min_range;
 
-    return min_wp;
+    return wp;
 }
 
 Waypoint *psPathNetwork::FindRandomWaypoint(csVector3& v,iSector *sector, float range, float * found_range)
 {
-    csPDelArray<Waypoint>::Iterator iter(waypoints.GetIterator());
-    Waypoint *wp;
-
-    csArray<Waypoint*> nearby;
-    csArray<float> dist;
- 
-    while (iter.HasNext())
+    if (range < 0)
     {
-        wp = iter.Next();
+        // Any waypoint will do, no need to measure them all
+        if (waypoints.GetSize() == 0)
+            return NULL;
 
-        float dist2 = world->Distance(v,sector,wp->loc.pos,wp->GetSector(engine));
-        
-        if (range < 0 || dist2 < range)
-        {
-            nearby.Push(wp);
-            dist.Push(dist2);
-        }
+        Waypoint *wp = waypoints[psGetRandom((uint32)waypoints.GetSize())];
+        if (found_range) *found_range = sqrt(world->Distance(v,sector,wp->loc.pos,wp->GetSector(engine)));
+        return wp;
     }
 
+    csArray<LocationIndex<Waypoint>::Found> nearby;
+    GetWaypointIndex(-1)->FindInRange(world, sector, v, range, nearby);
+
     if (nearby.GetSize()>0)  // found one or more closer than range
     {
         size_t pick = psGetRandom((uint32)nearby.GetSize());
         
-        if (found_range) *found_range = sqrt(dist[pick]);
+        if (found_range) *found_range = sqrt(nearby[pick].range);
         
-        return nearby[pick];
+        return nearby[pick].obj;
     }
 
 
@@ -270,64 +262,93 @@ Waypoint *psPathNetwork::FindRandomWaypoint(csVector3& v,iSector *sector, float
 
 Waypoint *psPathNetwork::FindNearestWaypoint(int group, csVector3& v,iSector *sector, float range, float * found_range)
 {
-    csList<Waypoint*>::Iterator iter(waypointGroups[group]);
-    Waypoint *wp;
-
-    float min_range = range;
+    Waypoint *wp = GetWaypointIndex(group)->FindNearest(world, sector, v, range, found_range);
 
-    Waypoint *min_wp = NULL;
-
-    while (iter.HasNext())
+    if (!wp && range < 0 && !waypointGroups[group].IsEmpty())
     {
-        wp = iter.Next();
-
-        float dist2 = world->Distance(v,sector,wp->loc.pos,wp->GetSector(engine));
-        
-        if (min_range < 0 || dist2 < min_range)
-        {
-            min_range = dist2;
-            min_wp = wp;
-        }
+        // None within reach, they are all equally far away
+        wp = waypointGroups[group].Front();
+        if (found_range) *found_range = world->Distance(v,sector,wp->loc.pos,wp->GetSector(engine));
     }
-    if (min_wp && found_range) *found_range = min_range;
 
-    return min_wp;
+    return wp;
 }
 
 Waypoint *psPathNetwork::FindRandomWaypoint(int group, csVector3& v,iSector *sector, float range, float * found_range)
 {
-    csList<Waypoint*>::Iterator iter(waypointGroups[group]);
-    Waypoint *wp;
-
-    csArray<Waypoint*> nearby;
-    csArray<float> dist;
- 
-    while (iter.HasNext())
+    if (range < 0)
     {
-        wp = iter.Next();
-
-        float dist2 = world->Distance(v,sector,wp->loc.pos,wp->GetSector(engine));
-        
-        if (range < 0 || dist2 < range)
+        // Any waypoint of the group will do, no need to measure them all
+        csArray<Waypoint*> all;
+        csList<Waypoint*>::Iterator iter(waypointGroups[group]);
+        while (iter.HasNext())
         {
-            nearby.Push(wp);
-            dist.Push(dist2);
+            all.Push(iter.Next());
         }
+        if (all.GetSize() == 0)
+            return NULL;
+
+        Waypoint *wp = all[psGetRandom((uint32)all.GetSize())];
+        if (found_range) *found_range = sqrt(world->Distance(v,sector,wp->loc.pos,wp->GetSector(engine)));
+        return wp;
     }
 
+    csArray<LocationIndex<Waypoint>::Found> nearby;
+    GetWaypointIndex(group)->FindInRange(world, sector, v, range, nearby);
+
     if (nearby.GetSize()>0)  // found one or more closer than range
     {
         size_t pick = psGetRandom((uint32)nearby.GetSize());
         
-        if (found_range) *found_range = sqrt(dist[pick]);
+        if (found_range) *found_range = sqrt(nearby[pick].range);
         
-        return nearby[pick];
+        return nearby[pick].obj;
     }
 
 
     return NULL;
 }
 
+LocationIndex<Waypoint>* psPathNetwork::GetWaypointIndex(int group)
+{
+    while (waypointIndex.GetSize() <= (size_t)(group+1))
+    {
+        waypointIndex.Push(NULL);
+    }
+
+    LocationIndex<Waypoint>* index = waypointIndex[group+1];
+    if (index)
+    {
+        return index;
+    }
+
+    index = new LocationIndex<Waypoint>(WAYPOINT_INDEX_CELL);
+    if (group < 0)
+    {
+        for (size_t i = 0; i < waypoints.GetSize(); i++)
+        {
+            index->Add(waypoints[i], waypoints[i]->GetSector(engine), waypoints[i]->loc.pos);
+        }
+    }
+    else
+    {
+        csList<Waypoint*>::Iterator iter(waypointGroups[group]);
+        while (iter.HasNext())
+        {
+            Waypoint *wp = iter.Next();
+            index->Add(wp, wp->GetSector(engine), wp->loc.pos);
+        }
+    }
+    waypointIndex[group+1] = index;
+
+    return index;
+}
+
+void psPathNetwork::ClearWaypointIndex()
+{
+    waypointIndex.DeleteAll();
+}
+
 int psPathNetwork::FindWaypointGroup(const char * groupName)
 {
     for (size_t i=0;i< waypointGroupNames.GetSize();i++)
@@ -413,69 +434,128 @@ psPath *psPathNetwork::FindNearestPoint(csVector3& v,iSector *sector, float rang
 csList<Waypoint*> psPathNetwork::FindWaypointRoute(Waypoint * start, Waypoint * end)
 {
     csList<Waypoint*> waypoint_list;
-    csList<Waypoint*> priority; // Should have been a priority queue
-    csPDelArray<Waypoint>::Iterator iter(waypoints.GetIterator());
-    Waypoint *wp;
-    
-    // Using Dijkstra's algorithm to find shortest way
 
-    // Initialize
-    while (iter.HasNext())
+    WaypointRouteKey key;
+    key.start = start;
+    key.end = end;
+
+    const csArray<Waypoint*>* route = routeCache.GetElementPointer(key);
+    csArray<Waypoint*> found;
+    if (!route)
     {
-        wp = iter.Next();
+        SearchRoute(start, end, found);
+        if (routeCacheSize)
+        {
+            if (routeCache.GetSize() >= routeCacheSize)
+            {
+                routeCache.DeleteAll();
+            }
+            routeCache.Put(key, found);
+        }
+        route = &found;
+    }
 
-        wp->distance = INFINITY;
-        wp->pi = NULL;
-        
-        // Insert WP into priority queue
-        priority.PushBack(wp);
+    for (size_t i = 0; i < route->GetSize(); i++)
+    {
+        waypoint_list.PushBack(route->Get(i));
     }
+
+    return waypoint_list;
+}
+
+void psPathNetwork::SearchRoute(Waypoint * start, Waypoint * end, csArray<Waypoint*>& route)
+{
+    // A* search. Waypoints that have not been reached by this search still
+    // carry the generation of an older one, so nothing has to be reset.
+    if (estimateScale < 0.0)
+    {
+        estimateScale = CalculateEstimateScale();
+    }
+    searchGeneration++;
+
     start->distance = 0;
+    start->pi = NULL;
+    start->generation = searchGeneration;
+    open.Update(start, 0);
 
-    while (!priority.IsEmpty())
+    while (!open.IsEmpty())
     {
-        Waypoint *wp_u = NULL, *pri_wp = NULL;
-        // Extract min from priority queue
-        csList<Waypoint*>::Iterator pri(priority);
-        csList<Waypoint*>::Iterator pri_loc;
-        while (pri.HasNext())
+        Waypoint *wp_u = open.DeleteMin();
+        if (wp_u == end)
         {
-            pri_wp = pri.Next();
-
-            if (!wp_u || pri_wp->distance < wp_u->distance)
-            {
-                wp_u = pri_wp;
-                pri_loc = pri;
-            }
+            break;
         }
-        priority.Delete(pri_loc);
-        size_t v;
-        for (v = 0; v < wp_u->links.GetSize(); v++)
+
+        for (size_t v = 0; v < wp_u->links.GetSize(); v++)
         {
             Waypoint * wp_v = wp_u->links[v];
+            float distance = wp_u->distance + wp_u->dists[v];
+
             // Relax
-            if (wp_v->distance > wp_u->distance + wp_u->dists[v])
+            if (wp_v->generation != searchGeneration || distance < wp_v->distance)
             {
-                wp_v->distance = wp_u->distance + wp_u->dists[v];
+                wp_v->generation = searchGeneration;
+                wp_v->distance = distance;
                 wp_v->pi = wp_u;
+
+                float estimate = distance + estimateScale * (wp_v->loc.pos - end->loc.pos).Norm();
+                open.Update(wp_v, estimate);
             }
         }
-        // if wp == end, we should be done!!!!!!
     }
+    open.Clear();
 
-    wp = end;
-
-    if (end->pi)
+    if (end->generation == searchGeneration && end->pi)
     {
-        wp = end;
+        Waypoint * wp = end;
         while (wp)
         {
-            waypoint_list.PushFront(wp);
+            route.Push(wp);
             wp = wp->pi;
         }
+        // Collected from the end, turn it around
+        for (size_t i = 0; i < route.GetSize() / 2; i++)
+        {
+            Waypoint * tmp = route[i];
+            route[i] = route[route.GetSize() - 1 - i];
+            route[route.GetSize() - 1 - i] = tmp;
+        }
+    }
+}
+
+float psPathNetwork::CalculateEstimateScale()
+{
+    // Every link must be at least scale times the straight line between its
+    // waypoints. Then no route is shorter than scale times the straight line
+    // from start to end, and the estimate never misleads the search. Links
+    // through warping portals can be much shorter than the line, which
+    // scales the estimate down, to 0 at worst.
+    float scale = 1.0;
+    for (size_t i = 0; i < waypoints.GetSize(); i++)
+    {
+        Waypoint * wp = waypoints[i];
+        for (size_t j = 0; j < wp->links.GetSize(); j++)
+        {
+            float line = (wp->links[j]->loc.pos - wp->loc.pos).Norm();
+            if (line > 0.0 && wp->dists[j] < scale * line)
+            {
+                scale = MAX(wp->dists[j], 0.0f) / line;
+            }
+        }
     }
+    return scale;
+}
 
-    return waypoint_list;
+void psPathNetwork::SetRouteCacheSize(size_t size)
+{
+    routeCacheSize = size;
+    ClearRouteCache();
+}
+
+void psPathNetwork::ClearRouteCache()
+{
+    routeCache.DeleteAll();
+    estimateScale = -1.0;
 }
 
 
@@ -605,6 +685,7 @@ Waypoint* psPathNetwork::CreateWaypoint(csString& name,
     }
 
     waypoints.Push(wp);
+    ClearWaypointIndex();
 
     return wp;
 }
@@ -626,6 +707,7 @@ psPath* psPathNetwork::CreatePath(psPath * path)
     }
     
     paths.Push(path);
+    ClearRouteCache();
 
     float dist = path->GetLength(world,engine); 
     
@@ -656,6 +738,8 @@ bool psPathNetwork::Delete(psPath * path)
     Waypoint * end = path->end;
 
     delete path;
+    ClearRouteCache();
+    ClearWaypointIndex();
 
     // Now delete any waypoints that dosn't have any links anymore.
     if (start->links.GetSize() == 0)
@@ -20,16 +20,36 @@
 #define __PSPATHNETWORK_H__
 
 #include <csutil/array.h>
+#include <csutil/hash.h>
 #include <csutil/list.h>
 
 #include "iserver/idal.h"
 
 #include "util/pspath.h"
+#include "util/heap.h"
+#include "util/locationindex.h"
 
 class Waypoint;
 class psWorld;
 class psPath;
 
+/// Start and end of a cached waypoint route.
+struct WaypointRouteKey
+{
+    Waypoint* start;
+    Waypoint* end;
+
+    bool operator< (const WaypointRouteKey& other) const
+    {
+        if (start != other.start)
+            return start < other.start;
+        return end < other.end;
+    }
+};
+
+template<> class csHashComputer<WaypointRouteKey> :
+public csHashComputerStruct<WaypointRouteKey> {};
+
 class psPathNetwork
 {
 public:
@@ -43,7 +63,9 @@ public:
     csWeakRef<iDataConnection> db;
     psWorld * world;
     
-    
+    psPathNetwork();
+    ~psPathNetwork();
+
     /**
      * Load all waypoins and paths from db
      */
@@ -107,8 +129,33 @@ public:
     
     /**
      * Find the shortest route between waypoint start and stop.
+     *
+     * Runs an A* search, guided by the straight line distance to the end.
+     * Routes are taken from the route cache when it is enabled.
+     *
+     * @return The waypoints from start to end, empty if there is no route.
      */
     csList<Waypoint*> FindWaypointRoute(Waypoint * start, Waypoint * end);
+
+    /**
+     * Keep up to the given number of routes found by FindWaypointRoute.
+     * 0 disables the cache.
+     */
+    void SetRouteCacheSize(size_t size);
+
+    /**
+     * Forget all cached routes and search estimates. Done by every change
+     * to the network made through this class, call it after changing
+     * waypoints or links directly.
+     */
+    void ClearRouteCache();
+
+    /**
+     * Forget the index used to find waypoints near a position. Done by
+     * every change to the waypoints made through this class, call it after
+     * moving waypoints directly.
+     */
+    void ClearWaypointIndex();
     
     /**
      * List all waypoints matching pattern to console.
@@ -155,6 +202,23 @@ public:
      * Delete the given path from the db.
      */
     bool Delete(psPath * path);
+
+private:
+    /// Run the search, 'route' gets the waypoints from start to end.
+    void SearchRoute(Waypoint * start, Waypoint * end, csArray<Waypoint*>& route);
+
+    /// Find how much of the straight line distance the search may count on.
+    float CalculateEstimateScale();
+
+    /// Index of the waypoints in a group, or of all waypoints for group -1. Built on first use.
+    LocationIndex<Waypoint>* GetWaypointIndex(int group);
+
+    uint32 searchGeneration;                               ///< Stamp of the last search
+    float estimateScale;                                   ///< Weight of the straight line estimate, < 0 if not calculated
+    IndexedHeap<Waypoint> open;                            ///< Waypoints to expand, by estimated route length
+    size_t routeCacheSize;                                 ///< Max routes in the cache, 0 if disabled
+    csHash<csArray<Waypoint*>, WaypointRouteKey> routeCache;
+    csPDelArray<LocationIndex<Waypoint> > waypointIndex;   ///< By group + 1, NULL until used
 };
 
 #endif
@@ -0,0 +1,346 @@
+/*
+ * pspathnetwork_unittest.cpp
+ *
+ * Copyright (C) 2007 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+#include <csutil/randomgen.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/pspathnetwork.h"
+#include "util/waypoint.h"
+#include "util/pspath.h"
+#include "util/psstring.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// A row of an INSERT statement in one of the shipped sql files.
+typedef csArray<csString> SqlRow;
+
+/// Read the rows of the INSERT statements from a file in the database directory.
+static bool ReadShippedTable(const char* file, csArray<SqlRow>& rows)
+{
+    const char* dirs[] = { "src/server/database/mysql/", "../../../src/server/database/mysql/" };
+    FILE* f = NULL;
+    for (size_t d = 0; d < sizeof(dirs) / sizeof(dirs[0]) && !f; d++)
+    {
+        csString path(dirs[d]);
+        path.Append(file);
+        f = fopen(path, "r");
+    }
+    if (!f)
+        return false;
+
+    char line[1024];
+    while (fgets(line, sizeof(line), f))
+    {
+        const char* p = strstr(line, "VALUES (");
+        if (strncmp(line, "INSERT", 6) != 0 || !p)
+            continue;
+
+        SqlRow row;
+        csString value;
+        bool quoted = false;
+        for (p += 8; *p && (quoted || *p != ')'); p++)
+        {
+            if (*p == '\'')
+                quoted = !quoted;
+            else if (*p == ',' && !quoted)
+            {
+                row.Push(value.Trim());
+                value.Empty();
+            }
+            else
+                value.Append(*p);
+        }
+        row.Push(value.Trim());
+        rows.Push(row);
+    }
+    fclose(f);
+    return true;
+}
+
+/**
+ * Link two waypoints the way psPathNetwork::CreatePath does, without
+ * storing the path in the database.
+ */
+static psPath* Link(psPathNetwork& network, Waypoint* wp1, Waypoint* wp2, const char* flags)
+{
+    psPath* path = new psLinearPath("", wp1, wp2, psString(flags));
+    network.paths.Push(path);
+
+    float dist = (wp2->loc.pos - wp1->loc.pos).Norm();
+    wp1->AddLink(path, wp2, psPath::FORWARD, dist);
+    if (!path->oneWay)
+    {
+        wp2->AddLink(path, wp1, psPath::REVERSE, dist);
+    }
+    return path;
+}
+
+/**
+ * Builds a network from the shipped waypoints and links, repeated 'tiles'
+ * by 'tiles' times side by side. Neighbouring copies are joined through
+ * the same few waypoints, so routes across the grid pass many copies.
+ * Links are as long as the straight line between their waypoints.
+ */
+static bool BuildNetwork(psPathNetwork& network, int tiles)
+{
+    csArray<SqlRow> wprows, linkrows;
+    if (!ReadShippedTable("sc_waypoints.sql", wprows) || !ReadShippedTable("sc_waypoint_links.sql", linkrows))
+        return false;
+
+    const float spacing = 400.0f;
+    csArray<csHash<Waypoint*, int> > copies;
+    for (int t = 0; t < tiles * tiles; t++)
+    {
+        csVector3 offset((t % tiles) * spacing, 0, (t / tiles) * spacing);
+        csHash<Waypoint*, int> byid;
+        for (size_t i = 0; i < wprows.GetSize(); i++)
+        {
+            SqlRow& row = wprows[i];
+            csString name;
+            name.Format("%s_%d", row[1].GetData(), t);
+            csVector3 pos((float)atof(row[3]), (float)atof(row[4]), (float)atof(row[5]));
+            pos += offset;
+            csString sector(row[8]);
+            csString flags(row[7]);
+            Waypoint* wp = new Waypoint(name, pos, sector, (float)atof(row[6]), flags);
+            wp->loc.id = (int)network.waypoints.GetSize() + 1;
+            network.waypoints.Push(wp);
+            byid.Put(atoi(row[0]), wp);
+        }
+        copies.Push(byid);
+    }
+
+    for (int t = 0; t < tiles * tiles; t++)
+    {
+        for (size_t i = 0; i < linkrows.GetSize(); i++)
+        {
+            SqlRow& row = linkrows[i];
+            Waypoint* wp1 = copies[t].Get(atoi(row[3]), NULL);
+            Waypoint* wp2 = copies[t].Get(atoi(row[4]), NULL);
+            if (!wp1 || !wp2 || wp1 == wp2)
+                continue;
+            Link(network, wp1, wp2, row[5]);
+        }
+
+        // Join to the copies to the east and the south
+        int neighbours[2] = { (t % tiles < tiles - 1) ? t + 1 : -1, t + tiles };
+        for (int n = 0; n < 2; n++)
+        {
+            if (neighbours[n] < 0 || neighbours[n] >= tiles * tiles)
+                continue;
+            for (int id = 10; id <= 12; id++)
+            {
+                Waypoint* wp1 = copies[t].Get(id, NULL);
+                Waypoint* wp2 = copies[neighbours[n]].Get(id, NULL);
+                if (wp1 && wp2)
+                    Link(network, wp1, wp2, "");
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * The search FindWaypointRoute used before: Dijkstra with a list as
+ * priority queue, scanned for the closest waypoint on every step.
+ * Returns the route length, or -1 if there is no route.
+ */
+static float ListDijkstra(psPathNetwork& network, Waypoint* start, Waypoint* end)
+{
+    size_t count = network.waypoints.GetSize();
+    csHash<size_t, csPtrKey<Waypoint> > index;
+    csArray<float> distance;
+    csArray<bool> done;
+    for (size_t i = 0; i < count; i++)
+    {
+        index.Put(network.waypoints[i], i);
+        distance.Push(1e30f);
+        done.Push(false);
+    }
+    distance[index.Get(start, 0)] = 0;
+
+    for (size_t round = 0; round < count; round++)
+    {
+        size_t u = csArrayItemNotFound;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!done[i] && (u == csArrayItemNotFound || distance[i] < distance[u]))
+                u = i;
+        }
+        done[u] = true;
+
+        Waypoint* wp = network.waypoints[u];
+        for (size_t l = 0; l < wp->links.GetSize(); l++)
+        {
+            size_t v = index.Get(wp->links[l], 0);
+            distance[v] = MIN(distance[v], distance[u] + wp->dists[l]);
+        }
+    }
+
+    float result = distance[index.Get(end, 0)];
+    return (start == end || result >= 1e30f) ? -1.0f : result;
+}
+
+/// Length of a route following the shortest link between each step, -1 if empty.
+static float RouteLength(csList<Waypoint*>& route)
+{
+    if (route.IsEmpty())
+        return -1.0f;
+
+    float length = 0;
+    Waypoint* prev = NULL;
+    csList<Waypoint*>::Iterator it(route);
+    while (it.HasNext())
+    {
+        Waypoint* wp = it.Next();
+        if (prev)
+        {
+            float step = -1.0f;
+            for (size_t l = 0; l < prev->links.GetSize(); l++)
+            {
+                if (prev->links[l] == wp && (step < 0 || prev->dists[l] < step))
+                    step = prev->dists[l];
+            }
+            if (step < 0)
+                return -2.0f; // Not a route at all
+            length += step;
+        }
+        prev = wp;
+    }
+    return length;
+}
+
+TEST(PathNetworkTest, ShortestRoutes)
+{
+    psPathNetwork network;
+    if (!BuildNetwork(network, 3))
+    {
+        printf("Shipped waypoint data not found, skipped.\n");
+        return;
+    }
+
+    csRandomGen rng(11);
+    for (int i = 0; i < 300; i++)
+    {
+        Waypoint* start = network.waypoints[rng.Get((uint32)network.waypoints.GetSize())];
+        Waypoint* end = network.waypoints[rng.Get((uint32)network.waypoints.GetSize())];
+
+        csList<Waypoint*> route = network.FindWaypointRoute(start, end);
+        float expected = ListDijkstra(network, start, end);
+        float length = RouteLength(route);
+        EXPECT_NEAR(expected, length, 0.01f) << start->GetName() << " to " << end->GetName();
+        if (!route.IsEmpty())
+        {
+            EXPECT_EQ(start, route.Front());
+            EXPECT_EQ(end, route.Last());
+        }
+    }
+}
+
+TEST(PathNetworkTest, RouteCache)
+{
+    psPathNetwork network;
+    if (!BuildNetwork(network, 2))
+    {
+        printf("Shipped waypoint data not found, skipped.\n");
+        return;
+    }
+    network.SetRouteCacheSize(100);
+
+    Waypoint* start = network.FindWaypoint("p1_0");
+    Waypoint* end = network.FindWaypoint("p9_3");
+    ASSERT_TRUE(start && end);
+
+    csList<Waypoint*> first = network.FindWaypointRoute(start, end);
+    csList<Waypoint*> second = network.FindWaypointRoute(start, end);
+    ASSERT_FALSE(first.IsEmpty());
+    EXPECT_FLOAT_EQ(RouteLength(first), RouteLength(second));
+
+    // A new link is only seen once the cache is cleared
+    Link(network, start, end, "");
+    csList<Waypoint*> third = network.FindWaypointRoute(start, end);
+    EXPECT_FLOAT_EQ(RouteLength(first), RouteLength(third));
+    network.ClearRouteCache();
+    csList<Waypoint*> fourth = network.FindWaypointRoute(start, end);
+    EXPECT_FLOAT_EQ((end->loc.pos - start->loc.pos).Norm(), RouteLength(fourth));
+}
+
+/**
+ * Reports the cost of a route search on the shipped waypoints repeated to
+ * larger networks, against the old list based search. Disabled in normal
+ * runs, see util/benchmark.h.
+ */
+TEST(PathNetworkTest, DISABLED_RouteBenchmark)
+{
+    const int tiles[] = { 2, 5, 10 };
+    const int queries = 200;
+
+    for (size_t n = 0; n < sizeof(tiles) / sizeof(tiles[0]); n++)
+    {
+        psPathNetwork network;
+        if (!BuildNetwork(network, tiles[n]))
+        {
+            printf("Shipped waypoint data not found, skipped.\n");
+            return;
+        }
+
+        csRandomGen rng(5);
+        csArray<Waypoint*> starts, ends;
+        for (int q = 0; q < queries; q++)
+        {
+            starts.Push(network.waypoints[rng.Get((uint32)network.waypoints.GetSize())]);
+            ends.Push(network.waypoints[rng.Get((uint32)network.waypoints.GetSize())]);
+        }
+
+        csMicroTicks start = csGetMicroTicks();
+        for (int q = 0; q < queries; q++)
+            network.FindWaypointRoute(starts[q], ends[q]);
+        csMicroTicks astar = csGetMicroTicks() - start;
+
+        // The old search is quadratic, time fewer of them on big networks
+        int oldqueries = (tiles[n] > 5) ? queries / 20 : queries;
+        start = csGetMicroTicks();
+        for (int q = 0; q < oldqueries; q++)
+            ListDijkstra(network, starts[q], ends[q]);
+        csMicroTicks list = csGetMicroTicks() - start;
+
+        network.SetRouteCacheSize(queries);
+        for (int q = 0; q < queries; q++)
+            network.FindWaypointRoute(starts[q], ends[q]);
+        start = csGetMicroTicks();
+        for (int q = 0; q < queries; q++)
+            network.FindWaypointRoute(starts[q], ends[q]);
+        csMicroTicks cached = csGetMicroTicks() - start;
+
+        printf("%6zu waypoints: A* %8.2f usec, list Dijkstra %10.2f usec, cached %6.2f usec per route\n",
+            network.waypoints.GetSize(), (double)astar / queries, (double)list / oldqueries,
+            (double)cached / queries);
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * scriptvar.cpp
+ *
+ * Copyright (C) 2004 PlaneShift Team (info@planeshift.it,
+ * http://www.planeshift.it)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+#include <psconfig.h>
+
+#include <csutil/csstring.h>
+#include <csutil/hash.h>
+#include <csutil/stringarray.h>
+
+#include "util/scriptvar.h"
+
+/**
+ * Ids by lower case name and names by id. Kept in a function so classes
+ * can fill their tables during static initialization.
+ */
+struct PropertyNameTable
+{
+    csHash<PropertyID, csString> ids;
+    csStringArray names;
+};
+
+static PropertyNameTable& GetNameTable()
+{
+    static PropertyNameTable table;
+    return table;
+}
+
+PropertyID PropertyNames::Request(const char *name)
+{
+    PropertyNameTable& table = GetNameTable();
+    csString key(name);
+    key.Downcase();
+
+    PropertyID id = table.ids.Get(key, PROPERTY_UNKNOWN);
+    if (id == PROPERTY_UNKNOWN)
+    {
+        id = (PropertyID) table.names.Push(name);
+        table.ids.Put(key, id);
+    }
+    return id;
+}
+
+PropertyID PropertyNames::Find(const char *name)
+{
+    csString key(name);
+    key.Downcase();
+    return GetNameTable().ids.Get(key, PROPERTY_UNKNOWN);
+}
+
+const char *PropertyNames::GetName(PropertyID id)
+{
+    PropertyNameTable& table = GetNameTable();
+    return id < table.names.GetSize() ? table.names[id] : NULL;
+}
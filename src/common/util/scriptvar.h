@@ -19,11 +19,77 @@
 #ifndef __MATHSCRIPTVAR_H__
 #define __MATHSCRIPTVAR_H__
 
+#include <csutil/array.h>
+
+/// A number standing for a property name, the same for all classes.
+typedef unsigned int PropertyID;
+
+#define PROPERTY_UNKNOWN ((PropertyID) -1)
+
+/**
+ * The names of all properties scripts asked for. Names are matched
+ * without regard to case, like the property lookups always did.
+ *
+ * The table is not locked: names are only added while tables are built
+ * and scripts are loaded, lookups at run time must use Find().
+ */
+class PropertyNames
+{
+public:
+    /// The id of 'name', a new one if it has none yet.
+    static PropertyID Request(const char *name);
+
+    /// The id of 'name', PROPERTY_UNKNOWN if it has none.
+    static PropertyID Find(const char *name);
+
+    /// The name of 'id' as first requested, NULL if there is no such id.
+    static const char *GetName(PropertyID id);
+};
+
+/**
+ * The properties of one class, as numbers the class switches on. Filled
+ * once with the names the class knows, it turns the id of a property
+ * into its number with one array access. Classes build theirs in a
+ * static initializer, before any thread could be reading it.
+ */
+class PropertyTable
+{
+public:
+    /// Let property 'name' stand for 'value', which must not be negative.
+    void Add(const char *name, int value)
+    {
+        PropertyID id = PropertyNames::Request(name);
+        if (id >= values.GetSize())
+            values.SetSize(id + 1, -1);
+        values[id] = value;
+    }
+
+    /// The value of the property, -1 if the class does not have it.
+    int Get(PropertyID id) const
+    {
+        return id < values.GetSize() ? values[id] : -1;
+    }
+
+private:
+    csArray<int> values;
+};
 
 class iScriptableVar
 {
 public:
     virtual double GetProperty(const char *ptr)=0;
+
+    /**
+     * The property with an id from PropertyNames, as scripts ask for them.
+     * Classes with a PropertyTable answer without comparing names; the
+     * others are asked by name.
+     */
+    virtual double GetPropertyByID(PropertyID id)
+    {
+        const char *name = PropertyNames::GetName(id);
+        return GetProperty(name ? name : "");
+    }
+
     virtual double CalcFunction(const char * functionName, const double * params) = 0;
     virtual const char* ToString() = 0;
     virtual ~iScriptableVar() {};
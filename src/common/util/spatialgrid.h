@@ -0,0 +1,285 @@
+/*
+ * spatialgrid.h
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ *
+ * A uniform grid of objects per sector for radius queries.
+ *
+ */
+
+/*   Design notes:
+ *
+ *  The grid splits every sector into square cells of 'cellsize' on the
+ *  XZ plane.  Only cells holding objects exist, they live in a hash keyed
+ *  by sector and cell coordinates, so the grid is unbounded and costs
+ *  nothing for empty space.  Height is ignored for the cell but not for the
+ *  distance check, a query returns objects within 'radius' in 3D.
+ *
+ *  The grid never owns the objects and knows nothing about them except the
+ *  position last given to Update().  Callers must Update() an object when
+ *  it moves and Remove() it before destroying it.
+ *
+ *  Costs:
+ *  Update() and Remove() are O(1).  Query() visits the cells overlapping
+ *  the query square, or every cell when that is fewer, and tests each
+ *  object in them.  Pick a cell size close to the usual query radius.
+ *
+ *  THIS IS NOT THREADSAFE!  Callers must provide their own locking.
+ */
+#ifndef __SPATIALGRID_H__
+#define __SPATIALGRID_H__
+
+#include <csutil/array.h>
+#include <csutil/hash.h>
+#include <csgeom/vector3.h>
+
+struct iSector;
+
+/**
+ * Objects of type T indexed by sector and position.
+ */
+template <class T>
+class SpatialGrid
+{
+public:
+    /**
+     * @param cellsize The width of a cell, in world units.
+     */
+    SpatialGrid(float cellsize = 32.0f) : cellsize(cellsize)
+    {
+    }
+
+    ~SpatialGrid()
+    {
+        Clear();
+    }
+
+    /**
+     * Add an object or move it to a new position. An object without a
+     * sector is removed from the grid.
+     */
+    void Update(T* obj, iSector* sector, const csVector3& pos)
+    {
+        if (!sector)
+        {
+            Remove(obj);
+            return;
+        }
+
+        CellKey key(sector, CellCoord(pos.x), CellCoord(pos.z));
+        Location* loc = locations.GetElementPointer(obj);
+        if (loc)
+        {
+            if (loc->cell->key == key)
+            {
+                // Same cell, just refresh the position
+                loc->cell->entries[loc->index].pos = pos;
+                return;
+            }
+            Unlink(*loc);
+        }
+
+        Cell* cell = cells.Get(key, NULL);
+        if (!cell)
+        {
+            cell = new Cell(key);
+            cells.Put(key, cell);
+        }
+
+        Location newloc;
+        newloc.cell = cell;
+        newloc.index = cell->entries.Push(Entry(obj, pos));
+        locations.PutUnique(obj, newloc);
+    }
+
+    /// Take an object out of the grid. Does nothing if it isn't in it.
+    void Remove(T* obj)
+    {
+        Location* loc = locations.GetElementPointer(obj);
+        if (!loc)
+            return;
+
+        Unlink(*loc);
+        locations.DeleteAll(obj);
+    }
+
+    /**
+     * Append every object in 'sector' within 'radius' of 'pos' to 'result'.
+     * If 'ranges' is given the distance of each object is appended to it.
+     */
+    void Query(iSector* sector, const csVector3& pos, float radius, csArray<T*>& result,
+               csArray<float>* ranges = NULL) const
+    {
+        float radius2 = radius * radius;
+        int minx = CellCoord(pos.x - radius);
+        int maxx = CellCoord(pos.x + radius);
+        int minz = CellCoord(pos.z - radius);
+        int maxz = CellCoord(pos.z + radius);
+
+        // Huge radius, cheaper to look at the cells that exist
+        if ((double)(maxx - minx + 1) * (maxz - minz + 1) > cells.GetSize())
+        {
+            typename csHash<Cell*, CellKey>::ConstGlobalIterator it(cells.GetIterator());
+            while (it.HasNext())
+            {
+                const Cell* cell = it.Next();
+                if (cell->key.sector == sector)
+                    Collect(cell, pos, radius2, result, ranges);
+            }
+            return;
+        }
+
+        for (int x = minx; x <= maxx; x++)
+        {
+            for (int z = minz; z <= maxz; z++)
+            {
+                const Cell* cell = cells.Get(CellKey(sector, x, z), NULL);
+                if (cell)
+                    Collect(cell, pos, radius2, result, ranges);
+            }
+        }
+    }
+
+    /// True if the object is in the grid.
+    bool Contains(T* obj) const
+    {
+        return locations.Contains(obj);
+    }
+
+    /// Number of objects in the grid.
+    size_t GetSize() const
+    {
+        return locations.GetSize();
+    }
+
+    /// Number of cells holding at least one object.
+    size_t GetCellCount() const
+    {
+        return cells.GetSize();
+    }
+
+    /// Drop all objects.
+    void Clear()
+    {
+        typename csHash<Cell*, CellKey>::GlobalIterator it(cells.GetIterator());
+        while (it.HasNext())
+            delete it.Next();
+        cells.DeleteAll();
+        locations.DeleteAll();
+    }
+
+private:
+    /// Identifies a cell. No padding, the hash is computed over the bytes.
+    struct CellKey
+    {
+        iSector* sector;
+        int x;
+        int z;
+
+        CellKey() {}
+        CellKey(iSector* sector, int x, int z) : sector(sector), x(x), z(z) {}
+
+        bool operator== (const CellKey& other) const
+        {
+            return sector == other.sector && x == other.x && z == other.z;
+        }
+
+        bool operator< (const CellKey& other) const
+        {
+            if (sector != other.sector)
+                return sector < other.sector;
+            if (x != other.x)
+                return x < other.x;
+            return z < other.z;
+        }
+
+        uint GetHash() const
+        {
+            return csHashCompute((const char*)this, sizeof(CellKey));
+        }
+    };
+
+    struct Entry
+    {
+        T* obj;
+        csVector3 pos;
+
+        Entry(T* obj, const csVector3& pos) : obj(obj), pos(pos) {}
+    };
+
+    struct Cell
+    {
+        CellKey key;
+        csArray<Entry> entries;
+
+        Cell(const CellKey& key) : key(key) {}
+    };
+
+    /// Where an object is stored.
+    struct Location
+    {
+        Cell* cell;
+        size_t index;
+    };
+
+    int CellCoord(float v) const
+    {
+        return (int)floorf(v / cellsize);
+    }
+
+    /// Take the entry at 'loc' out of its cell, deleting the cell when it empties.
+    void Unlink(const Location& loc)
+    {
+        Cell* cell = loc.cell;
+        size_t index = loc.index;
+        size_t last = cell->entries.GetSize() - 1;
+        if (index != last)
+        {
+            // Move the last entry into the hole
+            cell->entries[index] = cell->entries[last];
+            locations.GetElementPointer(cell->entries[index].obj)->index = index;
+        }
+        cell->entries.Truncate(last);
+
+        if (cell->entries.IsEmpty())
+        {
+            cells.DeleteAll(cell->key);
+            delete cell;
+        }
+    }
+
+    static void Collect(const Cell* cell, const csVector3& pos, float radius2, csArray<T*>& result,
+                        csArray<float>* ranges)
+    {
+        for (size_t i = 0; i < cell->entries.GetSize(); i++)
+        {
+            const Entry& entry = cell->entries[i];
+            float dist2 = (entry.pos - pos).SquaredNorm();
+            if (dist2 <= radius2)
+            {
+                result.Push(entry.obj);
+                if (ranges)
+                    ranges->Push(sqrtf(dist2));
+            }
+        }
+    }
+
+    float cellsize;
+    csHash<Cell*, CellKey> cells;
+    csHash<Location, csPtrKey<T> > locations;
+};
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * spatialgrid_unittest.cpp
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+#include <csutil/randomgen.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/spatialgrid.h"
+#include "util/testsectors.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// Stands in for a gemObject, the grid only needs its address.
+struct TestEntity
+{
+    iSector* sector;
+    csVector3 pos;
+};
+
+static iSector* const sectorA = TestSector(0);
+static iSector* const sectorB = TestSector(1);
+
+/// Every entity within radius, the way a full scan finds them.
+static size_t BruteForce(TestEntity* entities, size_t count, iSector* sector,
+                         const csVector3& pos, float radius, csArray<TestEntity*>& result)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (entities[i].sector == sector && (entities[i].pos - pos).SquaredNorm() <= radius * radius)
+            result.Push(&entities[i]);
+    }
+    return result.GetSize();
+}
+
+TEST(SpatialGridTest, UpdateQueryRemove)
+{
+    SpatialGrid<TestEntity> grid(10.0f);
+    TestEntity a, b, c;
+
+    grid.Update(&a, sectorA, csVector3(0, 0, 0));
+    grid.Update(&b, sectorA, csVector3(12, 0, 0));
+    grid.Update(&c, sectorB, csVector3(1, 0, 0));
+    EXPECT_EQ(3u, grid.GetSize());
+
+    csArray<TestEntity*> result;
+    grid.Query(sectorA, csVector3(0, 0, 0), 5.0f, result);
+    ASSERT_EQ(1u, result.GetSize());
+    EXPECT_EQ(&a, result[0]);
+
+    // Across a cell border, and the height counts
+    result.Empty();
+    grid.Query(sectorA, csVector3(6, 0, 0), 6.5f, result);
+    EXPECT_EQ(2u, result.GetSize());
+    result.Empty();
+    grid.Query(sectorA, csVector3(6, 20, 0), 6.5f, result);
+    EXPECT_EQ(0u, result.GetSize());
+
+    // Moving into the other sector
+    grid.Update(&a, sectorB, csVector3(-1, 0, 0));
+    result.Empty();
+    grid.Query(sectorB, csVector3(0, 0, 0), 2.0f, result);
+    EXPECT_EQ(2u, result.GetSize());
+    EXPECT_EQ(3u, grid.GetSize());
+
+    // No sector takes it out
+    grid.Update(&c, NULL, csVector3(0, 0, 0));
+    EXPECT_FALSE(grid.Contains(&c));
+    grid.Remove(&a);
+    grid.Remove(&a);
+    grid.Remove(&b);
+    EXPECT_EQ(0u, grid.GetSize());
+    EXPECT_EQ(0u, grid.GetCellCount());
+}
+
+TEST(SpatialGridTest, MatchesBruteForce)
+{
+    const size_t count = 2000;
+    TestEntity entities[count];
+    SpatialGrid<TestEntity> grid(16.0f);
+    csRandomGen rng(42);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        entities[i].sector = (i % 3) ? sectorA : sectorB;
+        entities[i].pos = csVector3(rng.Get() * 400 - 200, rng.Get() * 20, rng.Get() * 400 - 200);
+        grid.Update(&entities[i], entities[i].sector, entities[i].pos);
+    }
+
+    for (int round = 0; round < 200; round++)
+    {
+        // Move some, drop some
+        for (int m = 0; m < 50; m++)
+        {
+            TestEntity& e = entities[rng.Get((uint32)count)];
+            if (rng.Get(10) == 0)
+            {
+                e.sector = NULL;
+            }
+            else
+            {
+                e.sector = rng.Get(2) ? sectorA : sectorB;
+                e.pos += csVector3(rng.Get() * 30 - 15, 0, rng.Get() * 30 - 15);
+            }
+            grid.Update(&e, e.sector, e.pos);
+        }
+
+        csVector3 pos(rng.Get() * 400 - 200, 10, rng.Get() * 400 - 200);
+        float radius = (round % 10 == 0) ? 5000.0f : rng.Get() * 60;
+        csArray<TestEntity*> found, expected;
+        grid.Query(sectorA, pos, radius, found);
+        BruteForce(entities, count, sectorA, pos, radius, expected);
+
+        ASSERT_EQ(expected.GetSize(), found.GetSize());
+        for (size_t i = 0; i < found.GetSize(); i++)
+            EXPECT_NE(csArrayItemNotFound, expected.Find(found[i]));
+    }
+}
+
+/**
+ * Spreads N entities over a square sector and reports the cost of a
+ * proximity list sized query against a full scan, at several densities.
+ * Disabled in normal runs, see util/benchmark.h.
+ */
+TEST(SpatialGridTest, DISABLED_QueryBenchmark)
+{
+    const size_t counts[] = { 1000, 10000, 50000 };
+    const float sizes[] = { 500.0f, 2000.0f };
+    const float radius = 100.0f;
+    const int queries = 500;
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            size_t count = counts[c];
+            float size = sizes[s];
+            csArray<TestEntity> entities;
+            entities.SetSize(count);
+            SpatialGrid<TestEntity> grid(50.0f);
+            csRandomGen rng(7);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                entities[i].sector = sectorA;
+                entities[i].pos = csVector3(rng.Get() * size, 0, rng.Get() * size);
+                grid.Update(&entities[i], sectorA, entities[i].pos);
+            }
+
+            csMicroTicks gridtime = 0, scantime = 0;
+            size_t found = 0;
+            csArray<TestEntity*> result;
+            for (int q = 0; q < queries; q++)
+            {
+                csVector3 pos(rng.Get() * size, 0, rng.Get() * size);
+
+                result.Empty();
+                csMicroTicks start = csGetMicroTicks();
+                grid.Query(sectorA, pos, radius, result);
+                gridtime += csGetMicroTicks() - start;
+                found += result.GetSize();
+
+                size_t gridcount = result.GetSize();
+                result.Empty();
+                start = csGetMicroTicks();
+                BruteForce(entities.GetArray(), count, sectorA, pos, radius, result);
+                scantime += csGetMicroTicks() - start;
+                EXPECT_EQ(result.GetSize(), gridcount);
+            }
+
+            printf("%6zu entities in %4.0fm square: grid %7.2f usec, scan %8.2f usec per query, %.1f found\n",
+                count, size, (double)gridtime / queries, (double)scantime / queries,
+                (double)found / queries);
+        }
+    }
+}
@@ -0,0 +1,36 @@
+/*
+ * testsectors.h
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+#ifndef __TESTSECTORS_H__
+#define __TESTSECTORS_H__
+
+struct iSector;
+
+/**
+ * Sectors for the unit tests of code that only compares and hashes sector
+ * pointers. Each index gives a distinct pointer into a small buffer, never
+ * dereference one.
+ */
+inline iSector* TestSector(size_t index)
+{
+    static char storage[8];
+    CS_ASSERT(index < sizeof(storage));
+    return (iSector*) &storage[index];
+}
+
+#endif
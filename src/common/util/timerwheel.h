@@ -0,0 +1,333 @@
+/*
+ * timerwheel.h
+ *
+ * Copyright (C) 2001 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ *
+ * A hierarchical timer wheel for scheduling intrusive timer entries.
+ *
+ */
+
+/*   Design notes:
+ *
+ *  Objects to be scheduled derive from TimerWheelNode, which holds the links
+ *  of an intrusive doubly linked list.  The wheel never owns the objects, the
+ *  caller must Remove() an entry before destroying it.
+ *
+ *  The wheel works in slots of 'resolution' ticks.  The first level has 256
+ *  slots, each higher level has 64 slots covering 64 times the span of the
+ *  level below it.  The 4 higher levels cover the full 32 bit slot range, so
+ *  any csTicks deadline can be scheduled.
+ *
+ *  Costs:
+ *  Schedule() and Remove() are O(1).  Advance() only touches entries that
+ *  are due plus the (amortised) cascading of higher levels.  Expiry is
+ *  rounded up to the resolution, so an entry never fires early but may fire
+ *  up to one slot late.
+ *
+ *  THIS IS NOT THREADSAFE!  Callers must provide their own locking.
+ */
+#ifndef __TIMERWHEEL_H__
+#define __TIMERWHEEL_H__
+
+#include <csutil/array.h>
+#include <csutil/sysfunc.h>
+
+/**
+ * Link information for an object scheduled on a TimerWheel.
+ */
+class TimerWheelNode
+{
+public:
+    TimerWheelNode() : wheelnext(NULL), wheelprev(NULL), wheelexpire(0) {}
+    ~TimerWheelNode()
+    {
+        // Destroying a scheduled node leaves a dangling pointer in the wheel.
+        CS_ASSERT(!IsScheduled());
+    }
+
+    /// True if this node is currently linked into a wheel.
+    bool IsScheduled() const { return wheelnext != NULL; }
+
+    /// The wheel slot (in resolution units) this node expires in.
+    csTicks GetWheelExpire() const { return wheelexpire; }
+
+protected:
+    template <class T> friend class TimerWheel;
+
+    void Unlink()
+    {
+        wheelprev->wheelnext = wheelnext;
+        wheelnext->wheelprev = wheelprev;
+        wheelnext = wheelprev = NULL;
+    }
+
+    void LinkBefore(TimerWheelNode* head)
+    {
+        wheelnext = head;
+        wheelprev = head->wheelprev;
+        wheelprev->wheelnext = this;
+        head->wheelprev = this;
+    }
+
+    TimerWheelNode* wheelnext;
+    TimerWheelNode* wheelprev;
+    csTicks wheelexpire;
+};
+
+/**
+ * Hierarchical timer wheel of objects derived from TimerWheelNode.
+ */
+template <class T>
+class TimerWheel
+{
+public:
+    enum
+    {
+        ROOT_BITS  = 8,
+        LEVEL_BITS = 6,
+        ROOT_SIZE  = 1 << ROOT_BITS,
+        LEVEL_SIZE = 1 << LEVEL_BITS,
+        LEVELS     = 4
+    };
+
+    /**
+     * @param resolution The number of ticks covered by a single slot.
+     * @param now The time the wheel starts at.
+     */
+    TimerWheel(csTicks resolution = 10, csTicks now = 0)
+        : resolution(resolution ? resolution : 1), count(0)
+    {
+        current = now / this->resolution;
+        for (int i = 0; i < ROOT_SIZE; i++)
+            InitHead(&root[i]);
+        for (int l = 0; l < LEVELS; l++)
+            for (int i = 0; i < LEVEL_SIZE; i++)
+                InitHead(&levels[l][i]);
+    }
+
+    ~TimerWheel()
+    {
+        Clear();
+
+        // The list heads must not look scheduled on destruction.
+        for (int i = 0; i < ROOT_SIZE; i++)
+            root[i].wheelnext = root[i].wheelprev = NULL;
+        for (int l = 0; l < LEVELS; l++)
+            for (int i = 0; i < LEVEL_SIZE; i++)
+                levels[l][i].wheelnext = levels[l][i].wheelprev = NULL;
+    }
+
+    /**
+     * Schedule an entry to expire at the given time.  An entry that is
+     * already scheduled is moved.  Times in the past expire on the next
+     * Advance().
+     */
+    void Schedule(T* entry, csTicks when)
+    {
+        TimerWheelNode* node = entry;
+        if (node->IsScheduled())
+            Remove(entry);
+
+        // Round up so we never expire early.
+        csTicks slot = (when + resolution - 1) / resolution;
+        node->wheelexpire = slot;
+        Insert(node);
+        count++;
+    }
+
+    /**
+     * Unschedule an entry. Returns false if it was not scheduled.
+     */
+    bool Remove(T* entry)
+    {
+        TimerWheelNode* node = entry;
+        if (!node->IsScheduled())
+            return false;
+
+        node->Unlink();
+        count--;
+        return true;
+    }
+
+    /**
+     * Move the wheel forward to 'now' and append every entry that expired
+     * to 'expired'.  Expired entries are unscheduled.
+     */
+    void Advance(csTicks now, csArray<T*> &expired)
+    {
+        csTicks target = now / resolution;
+
+        while ((int32)(target - current) >= 0)
+        {
+            // Nothing pending, just jump ahead.
+            if (!count)
+            {
+                current = target + 1;
+                break;
+            }
+
+            size_t index = current & (ROOT_SIZE - 1);
+            if (!index)
+                Cascade();
+
+            TimerWheelNode* head = &root[index];
+            while (head->wheelnext != head)
+            {
+                TimerWheelNode* node = head->wheelnext;
+                node->Unlink();
+                count--;
+                expired.Push(static_cast<T*>(node));
+            }
+            current++;
+        }
+    }
+
+    /**
+     * The earliest time Advance() may have something to expire, at most
+     * 'limit'.  Only the root level is searched, so this can be earlier
+     * than the real next expiry (the next cascade) but never later.
+     */
+    csTicks NextExpire(csTicks limit) const
+    {
+        if (!count)
+            return limit;
+
+        // A pending cascade may bring entries down to any root slot.
+        csTicks slot = current;
+        csTicks end = (current | (ROOT_SIZE - 1)) + 1;
+        while (slot & (ROOT_SIZE - 1) && slot != end && root[slot & (ROOT_SIZE - 1)].wheelnext == &root[slot & (ROOT_SIZE - 1)])
+            slot++;
+
+        csTicks when = slot * resolution;
+        return ((int32)(when - limit) < 0) ? when : limit;
+    }
+
+    /// Unschedule all entries and append them to 'removed'.
+    void RemoveAll(csArray<T*> &removed)
+    {
+        for (int i = 0; i < ROOT_SIZE; i++)
+            ExtractList(&root[i], removed);
+        for (int l = 0; l < LEVELS; l++)
+            for (int i = 0; i < LEVEL_SIZE; i++)
+                ExtractList(&levels[l][i], removed);
+        count = 0;
+    }
+
+    /// Unschedule all entries.
+    void Clear()
+    {
+        for (int i = 0; i < ROOT_SIZE; i++)
+            ClearList(&root[i]);
+        for (int l = 0; l < LEVELS; l++)
+            for (int i = 0; i < LEVEL_SIZE; i++)
+                ClearList(&levels[l][i]);
+        count = 0;
+    }
+
+    /// Number of scheduled entries.
+    size_t GetSize() const { return count; }
+
+    csTicks GetResolution() const { return resolution; }
+
+private:
+    void InitHead(TimerWheelNode* head)
+    {
+        head->wheelnext = head->wheelprev = head;
+    }
+
+    void ClearList(TimerWheelNode* head)
+    {
+        while (head->wheelnext != head)
+            head->wheelnext->Unlink();
+    }
+
+    void ExtractList(TimerWheelNode* head, csArray<T*> &removed)
+    {
+        while (head->wheelnext != head)
+        {
+            TimerWheelNode* node = head->wheelnext;
+            node->Unlink();
+            removed.Push(static_cast<T*>(node));
+        }
+    }
+
+    void Insert(TimerWheelNode* node)
+    {
+        csTicks expire = node->wheelexpire;
+        int32 delta = (int32)(expire - current);
+
+        if (delta < 0)
+        {
+            // Already due, fire on the next slot processed.
+            node->LinkBefore(&root[current & (ROOT_SIZE - 1)]);
+            return;
+        }
+        if (delta < ROOT_SIZE)
+        {
+            node->LinkBefore(&root[expire & (ROOT_SIZE - 1)]);
+            return;
+        }
+
+        // The last level spans the whole 32 bit range so always matches.
+        int l = 0;
+        while (l < LEVELS - 1 && (uint32)delta >= (uint32)1 << (ROOT_BITS + (l + 1) * LEVEL_BITS))
+            l++;
+
+        int lshift = ROOT_BITS + l * LEVEL_BITS;
+        node->LinkBefore(&levels[l][(expire >> lshift) & (LEVEL_SIZE - 1)]);
+    }
+
+    /// Pull the entries of the next higher level slots down a level.
+    void Cascade()
+    {
+        for (int l = 0; l < LEVELS; l++)
+        {
+            int lshift = ROOT_BITS + l * LEVEL_BITS;
+            size_t index = (current >> lshift) & (LEVEL_SIZE - 1);
+
+            TimerWheelNode list;
+            InitHead(&list);
+            TimerWheelNode* head = &levels[l][index];
+            while (head->wheelnext != head)
+            {
+                TimerWheelNode* node = head->wheelnext;
+                node->Unlink();
+                node->LinkBefore(&list);
+            }
+            while (list.wheelnext != &list)
+            {
+                TimerWheelNode* node = list.wheelnext;
+                node->Unlink();
+                Insert(node);
+            }
+            list.wheelnext = list.wheelprev = NULL;
+
+            // Only continue to the next level when this one wrapped.
+            if (index)
+                break;
+        }
+    }
+
+    csTicks resolution;
+    /// The current slot, in resolution units.
+    csTicks current;
+    size_t count;
+
+    TimerWheelNode root[ROOT_SIZE];
+    TimerWheelNode levels[LEVELS][LEVEL_SIZE];
+};
+
+#endif
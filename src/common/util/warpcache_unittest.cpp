@@ -0,0 +1,203 @@
+/*
+ * warpcache_unittest.cpp
+ *
+ * Copyright (C) 2004 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csgeom/matrix3.h>
+#include <csutil/scf.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "engine/psworld.h"
+#include "util/testsectors.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// A psWorld whose portals are given by hand instead of read from an engine.
+class PortalWorld : public psWorld
+{
+public:
+    PortalWorld(size_t count)
+    {
+        direct.SetSize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            sectors.Push(TestSector(i));
+            sectorIndex.Put(TestSector(i), i);
+        }
+    }
+
+    /// A portal in sector 'from' leading to 'to', warping by 'warp'.
+    void AddPortal(size_t from, size_t to, const csReversibleTransform& warp)
+    {
+        DirectWarp d;
+        d.to = to;
+        d.warp = warp;
+        direct[from].Push(d);
+    }
+
+    /// Portals both ways between 'a' and 'b'.
+    void AddPortals(size_t a, size_t b, const csReversibleTransform& warp)
+    {
+        AddPortal(a, b, warp);
+        AddPortal(b, a, warp.GetInverse());
+    }
+
+    void Build()
+    {
+        BuildWarpCache(direct);
+    }
+
+private:
+    csArray< csArray<DirectWarp> > direct;
+};
+
+static void ExpectNear(const csVector3& expected, const csVector3& actual)
+{
+    EXPECT_NEAR(expected.x, actual.x, 0.001f);
+    EXPECT_NEAR(expected.y, actual.y, 0.001f);
+    EXPECT_NEAR(expected.z, actual.z, 0.001f);
+}
+
+static bool HasSource(psWorld& world, size_t to, size_t from)
+{
+    const csArray<iSector*>* sources = world.GetWarpSources(TestSector(to));
+    return sources && sources->Find(TestSector(from)) != csArrayItemNotFound;
+}
+
+// Sectors 0 - 4 in a row, each turned and moved against the one before.
+static const csReversibleTransform warp01(csYRotMatrix3(HALF_PI), csVector3(-300, 0, 20));
+static const csReversibleTransform warp12(csYRotMatrix3(0.3f), csVector3(15, -4, 120));
+static const csReversibleTransform warp23(csXRotMatrix3(0.1f) * csYRotMatrix3(-1.2f), csVector3(7, 50, -60));
+static const csReversibleTransform warp34(csYRotMatrix3(2 * HALF_PI), csVector3(0, 0, 500));
+
+static void BuildRow(PortalWorld& world)
+{
+    world.AddPortals(0, 1, warp01);
+    world.AddPortals(1, 2, warp12);
+    world.AddPortals(2, 3, warp23);
+    world.AddPortals(3, 4, warp34);
+    world.Build();
+}
+
+TEST(WarpCacheTest, ChainedWarps)
+{
+    PortalWorld world(5);
+    BuildRow(world);
+
+    const csVector3 points[] = { csVector3(0, 0, 0), csVector3(12.5f, 3, -40), csVector3(-250, 17, 300) };
+    for (size_t p = 0; p < sizeof(points) / sizeof(points[0]); p++)
+    {
+        // Warping through each portal in turn
+        csVector3 in1 = warp01 * points[p];
+        csVector3 in2 = warp12 * in1;
+        csVector3 in3 = warp23 * in2;
+
+        csVector3 pos = points[p];
+        ASSERT_TRUE(world.WarpSpace(TestSector(0), TestSector(1), pos));
+        ExpectNear(in1, pos);
+
+        pos = points[p];
+        ASSERT_TRUE(world.WarpSpace(TestSector(0), TestSector(2), pos));
+        ExpectNear(in2, pos);
+
+        pos = points[p];
+        ASSERT_TRUE(world.WarpSpace(TestSector(0), TestSector(3), pos));
+        ExpectNear(in3, pos);
+
+        // And all the way back
+        pos = in3;
+        ASSERT_TRUE(world.WarpSpace(TestSector(3), TestSector(0), pos));
+        ExpectNear(points[p], pos);
+
+        pos = in2;
+        ASSERT_TRUE(world.WarpSpace(TestSector(2), TestSector(1), pos));
+        ExpectNear(in1, pos);
+    }
+}
+
+TEST(WarpCacheTest, DepthLimit)
+{
+    PortalWorld world(5);
+    BuildRow(world);
+
+    // Three portals apart is still cached, four is not
+    EXPECT_TRUE(world.GetWarp(TestSector(0), TestSector(3)) != NULL);
+    EXPECT_TRUE(world.GetWarp(TestSector(1), TestSector(4)) != NULL);
+    EXPECT_TRUE(world.GetWarp(TestSector(0), TestSector(4)) == NULL);
+    EXPECT_TRUE(world.GetWarp(TestSector(4), TestSector(0)) == NULL);
+
+    EXPECT_TRUE(HasSource(world, 3, 0));
+    EXPECT_TRUE(HasSource(world, 3, 1));
+    EXPECT_TRUE(HasSource(world, 3, 2));
+    EXPECT_TRUE(HasSource(world, 3, 4));
+    EXPECT_FALSE(HasSource(world, 4, 0));
+    EXPECT_FALSE(HasSource(world, 0, 4));
+}
+
+TEST(WarpCacheTest, FewestPortalsWin)
+{
+    // A portal straight from 0 to 2 that doesn't agree with the way
+    // through 1. The direct one must be kept, and 3 is reached through it.
+    PortalWorld world(4);
+    csReversibleTransform shortcut(csYRotMatrix3(-0.7f), csVector3(40, 0, 40));
+    world.AddPortals(0, 1, warp01);
+    world.AddPortals(1, 2, warp12);
+    world.AddPortals(2, 3, warp23);
+    world.AddPortal(0, 2, shortcut);
+    world.Build();
+
+    csVector3 start(5, 1, -8);
+    csVector3 pos = start;
+    ASSERT_TRUE(world.WarpSpace(TestSector(0), TestSector(2), pos));
+    ExpectNear(shortcut * start, pos);
+
+    pos = start;
+    ASSERT_TRUE(world.WarpSpace(TestSector(0), TestSector(3), pos));
+    ExpectNear(warp23 * (shortcut * start), pos);
+}
+
+TEST(WarpCacheTest, Mirror)
+{
+    // A mirror in 0 leads back into 0. It gives no warp and doesn't make 0
+    // a warp source of itself, neither directly nor on the way back from 1.
+    PortalWorld world(3);
+    world.AddPortal(0, 0, csReversibleTransform(csYRotMatrix3(HALF_PI), csVector3(0, 0, 2)));
+    world.AddPortals(0, 1, warp01);
+    world.AddPortals(1, 2, warp12);
+    world.Build();
+
+    EXPECT_TRUE(world.GetWarp(TestSector(0), TestSector(0)) == NULL);
+    EXPECT_FALSE(HasSource(world, 0, 0));
+    EXPECT_FALSE(HasSource(world, 1, 1));
+    EXPECT_TRUE(HasSource(world, 0, 1));
+    EXPECT_TRUE(HasSource(world, 0, 2));
+
+    csVector3 start(5, 1, -8);
+    csVector3 pos = start;
+    ASSERT_TRUE(world.WarpSpace(TestSector(0), TestSector(2), pos));
+    ExpectNear(warp12 * (warp01 * start), pos);
+}
@@ -43,6 +43,7 @@ Waypoint::Waypoint()
 {
     distance = 0.0;
     pi = NULL;
+    generation = 0;
     loc.id = -1;
 }
 
@@ -50,6 +51,7 @@ Waypoint::Waypoint(const char* name)
 {
     distance = 0.0;
     pi = NULL;
+    generation = 0;
     loc.id = -1;
     loc.name = name;
 }
@@ -60,6 +62,7 @@ Waypoint::Waypoint(csString& name,
 {
     distance = 0.0;
     pi = NULL;
+    generation = 0;
     loc.id = -1;
     loc.name = name;
     loc.pos = pos;
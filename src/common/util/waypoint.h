@@ -26,6 +26,7 @@
 #include "util/psdatabase.h"
 #include "util/location.h"
 #include "util/pspath.h"
+#include "util/heap.h"
 
 /**
  * A waypoint is a specified circle on the map with a name,
@@ -33,7 +34,7 @@
  * this class, a network of nodes can be created which will
  * allow for pathfinding and path wandering by NPCs.
  */
-class Waypoint
+class Waypoint : public IndexedHeapNode
 {
 public:
     Location                   loc;            /// Id and position
@@ -108,9 +109,10 @@ public:
     /// Set all flags based on the string.
     void SetFlags(const csString& flagStr);
 
-    /// Data used in the dijkstra's algorithm to find waypoint path
-    float distance; /// Hold current shortest distance to the start WP.
-    Waypoint * pi;  /// Predecessor WP to track shortest way back to start.
+    /// Data used in the A* search to find waypoint path
+    float distance;    /// Hold current shortest distance to the start WP.
+    Waypoint * pi;     /// Predecessor WP to track shortest way back to start.
+    uint32 generation; /// The search distance and pi belong to, older values are stale.
     
 };
 
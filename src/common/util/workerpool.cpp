@@ -0,0 +1,137 @@
+/*
+ * workerpool.cpp
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+#include <psconfig.h>
+
+#include "util/workerpool.h"
+
+WorkerPool::WorkerPool()
+{
+    task = NULL;
+    count = next = finished = 0;
+    chunk = 1;
+    generation = 0;
+    stopping = false;
+}
+
+WorkerPool::~WorkerPool()
+{
+    Stop();
+}
+
+void WorkerPool::Start(int count)
+{
+    stopping = false;
+    for (int i = 0; i < count; i++)
+    {
+        csRef<Worker> worker;
+        worker.AttachNew(new Worker(this));
+        csRef<CS::Threading::Thread> thread;
+        thread.AttachNew(new CS::Threading::Thread(worker));
+        thread->Start();
+
+        workers.Push(worker);
+        threads.Push(thread);
+    }
+}
+
+void WorkerPool::Stop()
+{
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+        stopping = true;
+        wake.NotifyAll();
+    }
+
+    for (size_t i = 0; i < threads.GetSize(); i++)
+        threads[i]->Wait();
+
+    threads.Empty();
+    workers.Empty();
+}
+
+void WorkerPool::Run(Task* task, size_t count)
+{
+    if (threads.IsEmpty() || count < 2)
+    {
+        for (size_t i = 0; i < count; i++)
+            task->Run(i);
+        return;
+    }
+
+    mutex.Lock();
+    this->task = task;
+    this->count = count;
+    next = finished = 0;
+    // A few chunks per thread, so one slow index doesn't hold up the rest
+    chunk = count / ((threads.GetSize() + 1) * 4);
+    if (chunk < 1)
+        chunk = 1;
+    generation++;
+    wake.NotifyAll();
+    mutex.Unlock();
+
+    Work();
+
+    mutex.Lock();
+    while (finished < count)
+        done.Wait(mutex);
+    this->task = NULL;
+    mutex.Unlock();
+}
+
+void WorkerPool::Work()
+{
+    mutex.Lock();
+    while (task && next < count)
+    {
+        Task* current = task;
+        size_t begin = next;
+        size_t end = (count - next > chunk) ? next + chunk : count;
+        next = end;
+        mutex.Unlock();
+
+        for (size_t i = begin; i < end; i++)
+            current->Run(i);
+
+        mutex.Lock();
+        finished += end - begin;
+        if (finished == count)
+            done.NotifyAll();
+    }
+    mutex.Unlock();
+}
+
+void WorkerPool::Worker::Run()
+{
+    pool->mutex.Lock();
+    uint32 seen = pool->generation;
+    while (true)
+    {
+        while (pool->generation == seen && !pool->stopping)
+            pool->wake.Wait(pool->mutex);
+        if (pool->stopping)
+            break;
+
+        seen = pool->generation;
+        pool->mutex.Unlock();
+        pool->Work();
+        pool->mutex.Lock();
+    }
+    pool->mutex.Unlock();
+}
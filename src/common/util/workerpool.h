@@ -0,0 +1,93 @@
+/*
+ * workerpool.h
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#ifndef __WORKERPOOL_H__
+#define __WORKERPOOL_H__
+
+#include <csutil/refarr.h>
+#include <csutil/threading/thread.h>
+#include <csutil/threading/condition.h>
+
+/**
+ * Threads sharing the iterations of a loop. Run() hands out the indexes
+ * to the workers and to the calling thread, and returns when all are
+ * done. To the caller it is an ordinary loop whose iterations may run in
+ * any order and at the same time.
+ */
+class WorkerPool
+{
+public:
+    /// The body of a loop.
+    class Task
+    {
+    public:
+        virtual ~Task() {}
+
+        /// Called once for each index, from any of the threads.
+        virtual void Run(size_t index)=0;
+    };
+
+    WorkerPool();
+    ~WorkerPool();
+
+    /// Start 'count' worker threads. With none Run() does all the work itself.
+    void Start(int count);
+
+    /// Join the workers.
+    void Stop();
+
+    size_t GetThreadCount() { return threads.GetSize(); }
+
+    /// Call task->Run() for the indexes 0 to count-1 and wait until all returned.
+    void Run(Task* task, size_t count);
+
+private:
+    class Worker : public CS::Threading::Runnable
+    {
+    public:
+        Worker(WorkerPool* pool) : pool(pool) {}
+        virtual void Run();
+    private:
+        WorkerPool* pool;
+    };
+
+    /// Run indexes of the current task until none are left to hand out.
+    void Work();
+
+    CS::Threading::Mutex mutex;
+    /// Workers wait on this for the next task.
+    CS::Threading::Condition wake;
+    /// Run() waits on this for the workers to finish theirs.
+    CS::Threading::Condition done;
+
+    Task* task;
+    size_t count;
+    size_t next;
+    size_t finished;
+    /// Indexes handed out at a time.
+    size_t chunk;
+    /// Counts the tasks, so waking workers know if there is a new one.
+    uint32 generation;
+    bool stopping;
+
+    csRefArray<Worker> workers;
+    csRefArray<CS::Threading::Thread> threads;
+};
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * workerpool_unittest.cpp
+ *
+ * Copyright (C) 2002 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/array.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/workerpool.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// Counts how often each index was run, each index only touches its own counter.
+class CountingTask : public WorkerPool::Task
+{
+public:
+    CountingTask(size_t count) { runs.SetSize(count, 0); }
+
+    virtual void Run(size_t index)
+    {
+        // Some work, so the threads overlap
+        double x = 1.0;
+        for (int i = 0; i < 1000; i++)
+            x = x * 1.0000001 + index;
+        if (x > 0)
+            runs[index]++;
+    }
+
+    csArray<int> runs;
+};
+
+static void ExpectEachOnce(const CountingTask& task)
+{
+    for (size_t i = 0; i < task.runs.GetSize(); i++)
+        EXPECT_EQ(1, task.runs[i]) << "index " << i;
+}
+
+TEST(WorkerPoolTest, WithoutThreads)
+{
+    WorkerPool pool;
+    CountingTask task(100);
+    pool.Run(&task, 100);
+    ExpectEachOnce(task);
+}
+
+TEST(WorkerPoolTest, EachIndexOnce)
+{
+    WorkerPool pool;
+    pool.Start(3);
+    EXPECT_EQ(3u, pool.GetThreadCount());
+
+    const size_t sizes[] = { 0, 1, 2, 5, 1000, 10000 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        CountingTask task(sizes[s]);
+        pool.Run(&task, sizes[s]);
+        ExpectEachOnce(task);
+    }
+}
+
+TEST(WorkerPoolTest, ManySmallRuns)
+{
+    // Workers waking late must not miss a run or work on a finished one
+    WorkerPool pool;
+    pool.Start(4);
+    for (int run = 0; run < 2000; run++)
+    {
+        CountingTask task(run % 7 + 2);
+        pool.Run(&task, task.runs.GetSize());
+        ExpectEachOnce(task);
+    }
+
+    pool.Stop();
+    EXPECT_EQ(0u, pool.GetThreadCount());
+    CountingTask task(10);
+    pool.Run(&task, 10);
+    ExpectEachOnce(task);
+}
@@ -59,7 +59,7 @@
 
 extern iDataConnection *db;
 
-NPC::NPC(psNPCClient* npcclient, NetworkManager* networkmanager, psWorld* world, iEngine* engine, iCollideSystem* cdsys): checked(false), hatelist(npcclient, engine, world), tick(NULL)
+NPC::NPC(psNPCClient* npcclient, NetworkManager* networkmanager, psWorld* world, iEngine* engine, iCollideSystem* cdsys): checked(false), hatelist(npcclient, engine, world)
 { 
     brain=NULL; 
     pid=0;
@@ -97,27 +97,26 @@ NPC::~NPC()
     }
 }
 
-void NPC::Tick()
+void NPC::PrepareTick(csTicks when)
 {
-	// Ensure NPC only has one tick at a time.
-	CS_ASSERT(tick == NULL);
-	if(npcclient->IsReady())
-	{
-		csTicks when = csGetTicks();
-		Advance(when);  // Abstract event processing function
-        csTicks timeTaken = csGetTicks() - when; // How long did it take
+    if (last_update && !disabled)
+    {
+        brain->PrepareAdvance(when-last_update,this);
+    }
+}
 
-        if (timeTaken > 200)                      // This took way to long time
-        {
-            CPrintf(CON_WARNING,"Used %u time to process tick for npc: %s(%s)\n",
-                    timeTaken, GetName(), ShowID(GetEID()));
-            Dump();
-        }
-        networkmanager->SendAllCommands(true); 
-	}
-	tick = new psNPCTick(NPC_BRAIN_TICK, this);
-	
-	tick->QueueEvent();
+void NPC::Tick(csTicks when)
+{
+    csTicks start = csGetTicks();
+    Advance(when);  // Abstract event processing function
+    csTicks timeTaken = csGetTicks() - start; // How long did it take
+
+    if (timeTaken > 200)                      // This took way to long time
+    {
+        CPrintf(CON_WARNING,"Used %u time to process tick for npc: %s(%s)\n",
+                timeTaken, GetName(), ShowID(GetEID()));
+        Dump();
+    }
 }
 
 void NPC::Dump()
@@ -287,11 +286,19 @@ void NPC::TriggerEvent(Perception *pcpt)
 {
     if (!disabled)
     {
-        Printf(15,"Got event %s",pcpt->ToString().GetData() );
+        if (IsDebugging(15))
+        {
+            Printf(15,"Got event %s",pcpt->ToString().GetData() );
+        }
         brain->FirePerception(this,pcpt);
     }
 }
 
+bool NPC::ReactsTo(Perception *pcpt)
+{
+    return !disabled && brain && brain->ReactsTo(pcpt);
+}
+
 void NPC::SetLastPerception(Perception *pcpt)
 {
     if (last_perception)
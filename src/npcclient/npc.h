@@ -47,9 +47,10 @@ class gemNPCObject;
 class gemNPCActor;
 struct RaceInfo_t;
 class LocationType;
-class psNPCTick;
 
 #define NPC_BRAIN_TICK 200
+/// The NPCs are advanced in this many batches spread over NPC_BRAIN_TICK.
+#define NPC_TICK_BATCHES 4
 
 /**
 * This object represents the entities which have attacked or 
@@ -124,8 +125,14 @@ public:
     NPC(psNPCClient* npcclient, NetworkManager* networkmanager, psWorld* world, iEngine* engine, iCollideSystem* cdsys);
     ~NPC();
 
-    
-    void Tick();
+    /**
+     * The part of Tick() that may run on a worker thread, see
+     * BehaviorSet::PrepareAdvance(). Tick() must follow with the same time.
+     */
+    void PrepareTick(csTicks when);
+
+    /// Advance the brain. psNPCClient::TickNPCs() calls this every NPC_BRAIN_TICK.
+    void Tick(csTicks when);
     
     PID                   GetPID() { return pid; }
     /**
@@ -177,6 +184,8 @@ public:
     void ResumeScript(Behavior *which);
 
     void TriggerEvent(Perception *pcpt);
+    /// False if the brain has no reaction to this perception, see NPCType::ReactsTo().
+    bool ReactsTo(Perception *pcpt);
     void SetLastPerception(Perception *pcpt);
     Perception *GetLastPerception() { return last_perception; }
 
@@ -261,29 +270,10 @@ public:
     void CheckPosition();
     
 private:
-    psNPCTick* tick;
     psNPCClient* npcclient;
     NetworkManager* networkmanager;
     psWorld* world;
     iCollideSystem* cdsys;
-    
-    friend class psNPCTick;
-};
-
-// The event that makes the NPC brain go TICK.
-class psNPCTick : public psGameEvent
-{
-protected:
-    NPC *npc;
-
-public:
-	psNPCTick(int offsetticks, NPC *npc): psGameEvent(0,offsetticks,"psNPCTick"), npc(npc) {};
-    virtual void Trigger()
-    {
-    	npc->tick = NULL;
-    	npc->Tick();
-    }
-    virtual csString ToString() const { return "psNPCTick"; } 
 };
 
 struct HateListEntry
@@ -84,6 +84,7 @@ void NPCType::DeepCopy(NPCType& other)
     {
         reactions.Push( new Reaction(*other.reactions[x],behaviors) );
     }
+    IndexReactions();
 }
 
 
@@ -188,17 +189,72 @@ bool NPCType::Load(iDocumentNode *node)
             return false;
         }
     }
+    IndexReactions();
     return true; // success
 }
 
-void NPCType::FirePerception(NPC *npc, Perception *pcpt)
+void NPCType::IndexReactions()
 {
+    reaction_index.DeleteAll();
     for (size_t x=0; x<reactions.GetSize(); x++)
     {
-        reactions[x]->React(npc,pcpt);
+        csStringID id = reactions[x]->GetEventTypeID();
+        csArray<size_t>* indexes = reaction_index.GetElementPointer(id);
+        if (!indexes)
+        {
+            reaction_index.Put(id, csArray<size_t>());
+            indexes = reaction_index.GetElementPointer(id);
+        }
+        indexes->Push(x);
     }
 }
 
+void NPCType::FirePerception(NPC *npc, Perception *pcpt)
+{
+    const csArray<csStringID>& types = pcpt->GetEventTypes();
+    if (types.GetSize() == 1)
+    {
+        const csArray<size_t>* indexes = reaction_index.GetElementPointer(types[0]);
+        if (!indexes)
+            return;
+
+        for (size_t x=0; x<indexes->GetSize(); x++)
+        {
+            reactions[indexes->Get(x)]->React(npc,pcpt);
+        }
+        return;
+    }
+
+    // Several event types, react in the order of the reactions all the same
+    csArray<size_t> matching;
+    for (size_t t=0; t<types.GetSize(); t++)
+    {
+        const csArray<size_t>* indexes = reaction_index.GetElementPointer(types[t]);
+        if (indexes)
+        {
+            for (size_t x=0; x<indexes->GetSize(); x++)
+                matching.Push(indexes->Get(x));
+        }
+    }
+    matching.Sort();
+
+    for (size_t x=0; x<matching.GetSize(); x++)
+    {
+        reactions[matching[x]]->React(npc,pcpt);
+    }
+}
+
+bool NPCType::ReactsTo(Perception *pcpt)
+{
+    const csArray<csStringID>& types = pcpt->GetEventTypes();
+    for (size_t t=0; t<types.GetSize(); t++)
+    {
+        if (reaction_index.Contains(types[t]))
+            return true;
+    }
+    return false;
+}
+
 void NPCType::DumpReactionList(NPC *npc)
 {
     CPrintf(CON_CMDOUTPUT, "%-30s %-20s %-5s\n","Reaction","Type","Range");
@@ -215,6 +271,11 @@ void NPCType::ClearState(NPC *npc)
     behaviors.ClearState(npc);
 }
 
+void NPCType::PrepareAdvance(csTicks delta, NPC *npc)
+{
+    behaviors.PrepareAdvance(delta,npc);
+}
+
 void NPCType::Advance(csTicks delta, NPC *npc)
 {
     behaviors.Advance(delta,npc);
@@ -263,6 +324,7 @@ void BehaviorSet::ClearState(NPC *npc)
 {
 	// Ensure any existing script is ended correctly.
 	Interrupt(npc);
+    prepared = false;
     for (size_t i = 0; i<behaviors.GetSize(); i++)
     {
         behaviors[i]->ResetNeed();
@@ -286,42 +348,66 @@ bool BehaviorSet::Add(Behavior *b)
     return true;
 }
 
-Behavior* BehaviorSet::Advance(csTicks delta,NPC *npc)
+bool BehaviorSet::UpdateNeeds(csTicks delta,NPC *npc)
 {
-    while (true)
-    {
-        max_need = -999;
-        bool behaviours_changed = false;
+    max_need = -999;
+    bool behaviours_changed = false;
 
-        // Go through and update needs based on time
-        for (size_t i=0; i<behaviors.GetSize(); i++)
+    // Go through and update needs based on time
+    for (size_t i=0; i<behaviors.GetSize(); i++)
+    {
+        Behavior * b = behaviors[i];
+        if (b->ApplicableToNPCState(npc))
         {
-            Behavior * b = behaviors[i];
-            if (b->ApplicableToNPCState(npc))
+            b->AdvanceNeed(delta,npc);
+
+            if (behaviors[i]->CurrentNeed() != behaviors[i]->NewNeed())
             {
-                b->Advance(delta,npc,eventmgr);
+                npc->Printf(4, "Advancing %-30s:\t%1.1f ->%1.1f",
+                            behaviors[i]->GetName(),
+                            behaviors[i]->CurrentNeed(),
+                            behaviors[i]->NewNeed() );
+            }
 
-                if (behaviors[i]->CurrentNeed() != behaviors[i]->NewNeed())
+            if (b->NewNeed() > max_need) // the advance causes re-ordering
+            {
+                if (i!=0)  // trivial swap if same element
                 {
-                    npc->Printf(4, "Advancing %-30s:\t%1.1f ->%1.1f",
-                                behaviors[i]->GetName(),
-                                behaviors[i]->CurrentNeed(),
-                                behaviors[i]->NewNeed() );
+                    behaviors[i] = behaviors[0];
+                    behaviors[0] = b;  // now highest need is elem 0
+                    behaviours_changed = true;
                 }
+                max_need = b->NewNeed();
+            }
+            b->CommitAdvance();   // Update key to correct value
+        }
+    }
+    return behaviours_changed;
+}
 
-                if (b->NewNeed() > max_need) // the advance causes re-ordering
-                {
-                    if (i!=0)  // trivial swap if same element
-                    {
-                        behaviors[i] = behaviors[0];
-                        behaviors[0] = b;  // now highest need is elem 0
-                        behaviours_changed = true;
-                    }
-                    max_need = b->NewNeed();
-                }
-                b->CommitAdvance();   // Update key to correct value
+void BehaviorSet::PrepareAdvance(csTicks delta,NPC *npc)
+{
+    prepared_changed = UpdateNeeds(delta,npc);
+    prepared = true;
+}
+
+Behavior* BehaviorSet::Advance(csTicks delta,NPC *npc)
+{
+    while (true)
+    {
+        // The first pass uses the needs from PrepareAdvance() if called
+        bool behaviours_changed = prepared ? prepared_changed : UpdateNeeds(delta,npc);
+        prepared = false;
+
+        // Then run the current operation of the active behavior
+        for (size_t i=0; i<behaviors.GetSize(); i++)
+        {
+            if (behaviors[i]->ApplicableToNPCState(npc))
+            {
+                behaviors[i]->AdvanceOperation(delta,npc,eventmgr);
             }
         }
+
         // Dump bahaviour list if changed
         if (behaviours_changed && npc->IsDebugging(3))
         {
@@ -674,7 +760,7 @@ bool Behavior::LoadScript(iDocumentNode *node,bool top_level)
     return true; // success
 }
 
-void Behavior::Advance(csTicks delta,NPC *npc,EventManager *eventmgr)
+void Behavior::AdvanceNeed(csTicks delta,NPC *npc)
 {
     if (new_need == -999)
     {
@@ -686,16 +772,6 @@ void Behavior::Advance(csTicks delta,NPC *npc,EventManager *eventmgr)
     if (is_active)
     {
         new_need = new_need - (d * need_decay_rate);
-        if (current_step < sequence.GetSize())
-        {
-            npc->Printf(10,"%s - Advance active delta: %.3f Need: %.2f Decay Rate: %.2f",
-                        name.GetData(),d,new_need,need_decay_rate);
-
-            if (!sequence[current_step]->HasCompleted())
-            {
-                sequence[current_step]->Advance(d,npc,eventmgr);
-            }
-        }
     }
     else
     {
@@ -705,6 +781,22 @@ void Behavior::Advance(csTicks delta,NPC *npc,EventManager *eventmgr)
     }
 }
 
+void Behavior::AdvanceOperation(csTicks delta,NPC *npc,EventManager *eventmgr)
+{
+    float d = .001 * delta;
+
+    if (is_active && current_step < sequence.GetSize())
+    {
+        npc->Printf(10,"%s - Advance active delta: %.3f Need: %.2f Decay Rate: %.2f",
+                    name.GetData(),d,new_need,need_decay_rate);
+
+        if (!sequence[current_step]->HasCompleted())
+        {
+            sequence[current_step]->Advance(d,npc,eventmgr);
+        }
+    }
+}
+
 bool Behavior::ApplicableToNPCState(NPC *npc)
 {
     return npc->IsAlive() || (!npc->IsAlive() && is_applicable_when_dead);
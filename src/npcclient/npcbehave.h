@@ -27,6 +27,7 @@
 //=============================================================================
 #include <csgeom/matrix3.h>
 #include <csutil/array.h>
+#include <csutil/hash.h>
 #include <iutil/document.h>
 
 struct iSector;
@@ -67,9 +68,14 @@ protected:
     Behavior *active;
     float max_need;
     EventManager *eventmgr;
+    bool prepared;          ///< PrepareAdvance() updated the needs for the next Advance()
+    bool prepared_changed;  ///< and changed the order of the behaviors
+
+    /// Advance the needs and move the neediest behavior first. Returns true if the order changed.
+    bool UpdateNeeds(csTicks delta,NPC *npc);
 
 public:
-    BehaviorSet(EventManager *eventmanager) { active=NULL; eventmgr = eventmanager; }
+    BehaviorSet(EventManager *eventmanager) { active=NULL; eventmgr = eventmanager; prepared = prepared_changed = false; }
 
     /// Returns true if the behavior didn't already exist. Otherwise returns false and removes the existing duplicate behavior.
     bool Add(Behavior *b);
@@ -79,6 +85,14 @@ public:
     void DeepCopy(BehaviorSet& other);
     void ClearState(NPC *npc);
 
+    /**
+     * The part of Advance() that only updates the needs and orders the
+     * behaviors by them. It touches nothing but this set, so the sets of
+     * different NPCs can be prepared in parallel. The next Advance() then
+     * starts from these needs instead of advancing them again.
+     */
+    void PrepareAdvance(csTicks delta,NPC *npc);
+
     /// Advances the behaviors and returns the active one.
     Behavior* Advance(csTicks delta,NPC *npc);
     void Interrupt(NPC *npc);
@@ -105,6 +119,8 @@ class NPCType
     
 protected:
     csArray<Reaction*> reactions;
+    /// Positions in reactions, by event type id.
+    csHash<csArray<size_t>,csStringID> reaction_index;
     BehaviorSet behaviors;
     csString name;
     float    ang_vel,vel;
@@ -121,10 +137,14 @@ public:
     bool Load(iDocumentNode *node);
     const char* GetName(){ return name.GetDataSafe(); }
 
+    /// See BehaviorSet::PrepareAdvance().
+    void PrepareAdvance(csTicks delta,NPC *npc);
     void Advance(csTicks delta,NPC *npc);
     void Interrupt(NPC *npc);
     void ResumeScript(NPC *npc,Behavior *which);
     void FirePerception(NPC *npc,Perception *pcpt);
+    /// True if some reaction of this type might react to the perception.
+    bool ReactsTo(Perception *pcpt);
 
     void DumpBehaviorList(NPC *npc) { behaviors.DumpBehaviorList(npc); }
     void DumpReactionList(NPC *npc);
@@ -138,6 +158,9 @@ public:
     float GetVelocity(NPC *npc);
     
 private:
+    /// Rebuild reaction_index after the reactions changed.
+    void IndexReactions();
+
     static psNPCClient* npcclient;
 };
 
@@ -182,7 +205,10 @@ public:
 
     bool LoadScript(iDocumentNode *node,bool top_level=true);
 
-    void  Advance(csTicks delta,NPC *npc,EventManager *eventmgr);
+    /// Grow or decay the need with time, touches nothing outside this behavior.
+    void  AdvanceNeed(csTicks delta,NPC *npc);
+    /// Advance the current operation if active.
+    void  AdvanceOperation(csTicks delta,NPC *npc,EventManager *eventmgr);
     float CurrentNeed()
     { return current_need; }
     float NewNeed()
@@ -89,3 +89,45 @@ TEST_F(BehaviorSetTest, Advance2Behaviors) {
     EXPECT_EQ(behavior, behaviorset.Advance(10, npc));
     EXPECT_EQ(behavior2, behaviorset.Advance(1000, npc));
 }
+
+TEST_F(BehaviorSetTest, PreparedAdvance) {
+    // A prepared set ends up where one advanced the usual way does
+    Behavior* behavior2 = new Behavior("test_behavior2");
+    behavior2->SetDecay(20)->SetGrowth(100)->SetCompletionDecay(100)->SetInitial(10);
+    behaviorset.Add(behavior2);
+
+    BehaviorSet prepared(&eventmgr);
+    Behavior* other = new Behavior("test_behavior");
+    other->SetDecay(20)->SetGrowth(50)->SetCompletionDecay(100)->SetInitial(200);
+    Behavior* other2 = new Behavior("test_behavior2");
+    other2->SetDecay(20)->SetGrowth(100)->SetCompletionDecay(100)->SetInitial(10);
+    prepared.Add(other);
+    prepared.Add(other2);
+
+    const csTicks deltas[] = { 10, 10, 1000, 500 };
+    for (size_t i = 0; i < sizeof(deltas) / sizeof(deltas[0]); i++)
+    {
+        Behavior* active = behaviorset.Advance(deltas[i], npc);
+        prepared.PrepareAdvance(deltas[i], npc);
+        Behavior* preparedActive = prepared.Advance(deltas[i], npc);
+
+        ASSERT_TRUE(active && preparedActive);
+        EXPECT_STREQ(active->GetName(), preparedActive->GetName());
+        EXPECT_EQ(behavior->CurrentNeed(), other->CurrentNeed());
+        EXPECT_EQ(behavior2->CurrentNeed(), other2->CurrentNeed());
+    }
+}
+
+TEST(PerceptionTest, EventTypes) {
+    Perception attack("attack");
+    ASSERT_EQ(1u, attack.GetEventTypes().GetSize());
+    EXPECT_EQ(Perception::GetEventTypeID("attack"), attack.GetEventTypes()[0]);
+    EXPECT_EQ(Perception::GetEventTypeID("Attack"), attack.GetEventTypes()[0]);
+    EXPECT_TRUE(Perception::GetEventTypeID("damage") != attack.GetEventTypes()[0]);
+
+    // Matched by the command, not by the name
+    NPCCmdPerception cmd("Greet", NULL);
+    ASSERT_EQ(2u, cmd.GetEventTypes().GetSize());
+    EXPECT_EQ(Perception::GetEventTypeID("npccmd:global:greet"), cmd.GetEventTypes()[0]);
+    EXPECT_EQ(Perception::GetEventTypeID("npccmd:self:greet"), cmd.GetEventTypes()[1]);
+}
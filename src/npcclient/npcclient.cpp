@@ -50,6 +50,7 @@
 #include "util/strutil.h"
 #include "util/psutil.h"
 #include "util/pspathnetwork.h"
+#include "util/locationindex.h"
 
 #include "net/connection.h"
 #include "net/clientmsghandler.h"
@@ -74,6 +75,9 @@
 #define INFINITY 999999999.0F
 #endif
 
+/// Cell size of the location indexes, about the range NPCs locate in.
+#define LOCATION_INDEX_CELL 50.0f
+
 bool running;
 extern iDataConnection *db;
 
@@ -88,7 +92,35 @@ public:
     virtual csString ToString() const;
 };
 
-psNPCClient::psNPCClient () : serverconsole(NULL)
+/// The event that makes the next batch of NPC brains go TICK.
+class psNPCBrainTick : public psGameEvent
+{
+protected:
+    psNPCClient *client;
+
+public:
+    psNPCBrainTick(int offsetticks, psNPCClient *c): psGameEvent(0,offsetticks,"psNPCBrainTick"), client(c) {};
+    virtual void Trigger()
+    {
+        if (running)
+            client->TickNPCs();
+    }
+    virtual csString ToString() const { return "psNPCBrainTick"; }
+};
+
+/// Updates the needs of a batch of NPCs, see NPC::PrepareTick().
+class psNPCPrepareTask : public WorkerPool::Task
+{
+public:
+    psNPCPrepareTask(csArray<NPC*>& npcs, csTicks when): npcs(npcs), when(when) {}
+    virtual void Run(size_t index) { npcs[index]->PrepareTick(when); }
+
+private:
+    csArray<NPC*>& npcs;
+    csTicks when;
+};
+
+psNPCClient::psNPCClient () : serverconsole(NULL), itemGrid(LONG_RANGE_PERCEPTION)
 {
     world        = NULL;
     eventmanager = NULL;
@@ -96,7 +128,8 @@ psNPCClient::psNPCClient () : serverconsole(NULL)
     database     = NULL;
     network      = NULL;
     tick_counter = 0;
-    current_long_range_perception_index = 0;
+    tick_batch   = 0;
+    brains_ticking = false;
 }
 
 psNPCClient::~psNPCClient()
@@ -104,7 +137,11 @@ psNPCClient::~psNPCClient()
 	csHash<LocationType*, csString>::GlobalIterator iter(loctypes.GetIterator());
 	while(iter.HasNext())
 		delete iter.Next();
+    csHash<LocationIndex<Location>*, csPtrKey<LocationType> >::GlobalIterator indexIter(locationIndex.GetIterator());
+    while (indexIter.HasNext())
+        delete indexIter.Next();
     running = false;
+    brainWorkers.Stop();
     delete network;
     delete serverconsole;
     delete database;
@@ -195,6 +232,8 @@ bool psNPCClient::Initialize(iObjectRegistry* object_reg,const char *_host, cons
         exit(1);
     }
 
+    brainWorkers.Start(configmanager->GetInt("PlaneShift.NPCClient.BrainThreads", 2));
+
     world = new psWorld();        
     if (!world)
     {
@@ -413,7 +452,7 @@ void psNPCClient::Add( gemNPCObject* object )
     gemNPCItem * item = dynamic_cast<gemNPCItem*>(object);
     if (item)
     {
-        all_gem_items.Push( item );
+        IndexItem( item );
     }
 
     all_gem_objects_by_eid.Put(eid, object);
@@ -450,11 +489,7 @@ void psNPCClient::Remove ( gemNPCObject * object )
     gemNPCItem * item = dynamic_cast<gemNPCItem*>(object);
     if (item)
     {
-        size_t n = all_gem_items.Find ( item );
-        if (n != csArrayItemNotFound)
-        {
-            all_gem_items.DeleteIndexFast( n );
-        }
+        itemGrid.Remove( item );
     }
 
     size_t n = all_gem_objects.Find( object );
@@ -477,7 +512,7 @@ void psNPCClient::RemoveAll()
 //    }
 
     all_gem_objects.DeleteAll();
-    all_gem_items.DeleteAll();
+    itemGrid.Clear();
     all_gem_objects_by_eid.DeleteAll();
     all_gem_objects_by_pid.DeleteAll();    
 }
@@ -504,7 +539,6 @@ NPC* psNPCClient::ReadSingleNPC(PID char_id, bool master)
     //load taking parameters works well
     if (newnpc->Load(result[0],npctypes, eventmanager, master ? char_id : 0))
     {
-    	newnpc->Tick();
         npcs.Push(newnpc);
         return newnpc;
     }
@@ -539,7 +573,6 @@ bool psNPCClient::ReadNPCsFromDatabase()
         NPC *npc = new NPC(this, network, world, engine, cdsys);
         if (npc->Load(rs[i],npctypes, eventmanager, 0))
         {
-        	npc->Tick();
             npcs.Push(npc);
 
             CheckAttachTribes(npc);
@@ -556,6 +589,7 @@ bool psNPCClient::ReadNPCsFromDatabase()
 bool psNPCClient::LoadPathNetwork()
 {
     pathNetwork = new psPathNetwork();
+    pathNetwork->SetRouteCacheSize(configmanager->GetInt("PlaneShift.NPCClient.RouteCache", 0));
     return pathNetwork->Load(engine,db,world);
 }
 
@@ -769,6 +803,9 @@ void psNPCClient::TriggerEvent(NPC *npc,Perception *pcpt,float max_range,
             if (npcs[i]==NULL)  // one of our npcs is not active right now
                 continue;
 
+            if (!npcs[i]->ReactsTo(pcpt)) // nothing to do, don't bother with the distance
+                continue;
+
             if (max_range <= 0.0)  // broadcast perceptions
             {
                 npcs[i]->TriggerEvent(pcpt);
@@ -807,6 +844,12 @@ void psNPCClient::SetEntityPos(EID eid, csVector3& pos, iSector* sector, Instanc
         }
 
         obj->SetPosition(pos,sector,&instance);
+
+        gemNPCItem * item = dynamic_cast<gemNPCItem*>(obj);
+        if (item)
+        {
+            IndexItem(item);
+        }
     }
     else
     {
@@ -827,6 +870,14 @@ void psNPCClient::LoadCompleted()
 	psNPCClientTick *tick = new psNPCClientTick(255,this);
     tick->QueueEvent();
 
+    // And the brains of the NPCs, once, the batches reschedule themselves
+    if (!brains_ticking)
+    {
+        psNPCBrainTick *brainTick = new psNPCBrainTick(NPC_BRAIN_TICK / NPC_TICK_BATCHES,this);
+        brainTick->QueueEvent();
+        brains_ticking = true;
+    }
+
 }
 
 void psNPCClient::Tick()
@@ -869,6 +920,44 @@ void psNPCClient::Tick()
 	network->SendAllCommands(true); // Final
 }
 
+void psNPCClient::TickNPCs()
+{
+    psNPCBrainTick *tick = new psNPCBrainTick(NPC_BRAIN_TICK / NPC_TICK_BATCHES,this);
+    tick->QueueEvent();
+
+    size_t batch = tick_batch;
+    tick_batch = (tick_batch + 1) % NPC_TICK_BATCHES;
+
+    if (!IsReady())
+        return;
+
+    ScopedTimer st_tick(NPC_BRAIN_TICK, "tick for npc batch %zu.", batch);
+
+    // Every NPC_TICK_BATCHES'th NPC, npcs only ever grows so they keep their batch
+    csArray<NPC*> ticked;
+    csArray<NPC*> prepared;
+    for (size_t i = batch; i < npcs.GetSize(); i += NPC_TICK_BATCHES)
+    {
+        ticked.Push(npcs[i]);
+        // Debug output of NPCs being debugged stays in order on this thread
+        if (!npcs[i]->IsDebugging())
+            prepared.Push(npcs[i]);
+    }
+
+    csTicks when = csGetTicks();
+
+    psNPCPrepareTask task(prepared, when);
+    brainWorkers.Run(&task, prepared.GetSize());
+
+    for (size_t i = 0; i < ticked.GetSize(); i++)
+    {
+        ticked[i]->Tick(when);
+    }
+
+    // One message with the commands of the whole batch
+    network->SendAllCommands(true);
+}
+
 
 
 
@@ -965,61 +1054,65 @@ Location *psNPCClient::FindNearestLocation(const char *loctype, csVector3& pos,
     LocationType *found = loctypes.Get(loctype, NULL);
     if (found)
     {
-        float min_range = range;    
-
-        int   min_i = -1;
-
-        for (size_t i=0; i<found->locs.GetSize(); i++)
-        {
-            float dist2 = world->Distance(pos,sector,found->locs[i]->pos,found->locs[i]->GetSector(engine));
+        Location *loc = GetLocationIndex(found)->FindNearest(world, sector, pos, range, found_range);
 
-            if (min_range < 0 || dist2 < min_range)
-            {
-                min_range = dist2;
-                min_i = (int)i;
-            }
-        }
-        if (min_i > -1)  // found closest one
+        if (!loc && range < 0 && found->locs.GetSize())
         {
-            if (found_range) *found_range = min_range;
-
-            return found->locs[(size_t)min_i];
+            // None within reach, they are all equally far away
+            loc = found->locs[0];
+            if (found_range) *found_range = world->Distance(pos,sector,loc->pos,loc->GetSector(engine));
         }
+        return loc;
     }
     return NULL;
 }
 
 Location *psNPCClient::FindRandomLocation(const char *loctype, csVector3& pos, iSector* sector, float range, float *found_range)
 {
-    csArray<Location*> nearby;
-    csArray<float> dist;
-
     LocationType *found = loctypes.Get(loctype, NULL);
     if (found)
     {
-        for (size_t i=0; i<found->locs.GetSize(); i++)
+        if (range < 0)
         {
-            float dist2 = world->Distance(pos,sector,found->locs[i]->pos,found->locs[i]->GetSector(engine));
+            // Any location will do, no need to measure them all
+            if (found->locs.GetSize() == 0)
+                return NULL;
 
-            if (range < 0 || dist2 < range)
-            {
-                nearby.Push(found->locs[i]);
-                dist.Push(dist2);
-            }
+            Location *loc = found->locs[psGetRandom((uint32)found->locs.GetSize())];
+            if (found_range) *found_range = sqrt(world->Distance(pos,sector,loc->pos,loc->GetSector(engine)));
+            return loc;
         }
 
+        csArray<LocationIndex<Location>::Found> nearby;
+        GetLocationIndex(found)->FindInRange(world, sector, pos, range, nearby);
+
         if (nearby.GetSize()>0)  // found one or more closer than range
         {
             size_t pick = psGetRandom((uint32)nearby.GetSize());
             
-            if (found_range) *found_range = sqrt(dist[pick]);
+            if (found_range) *found_range = sqrt(nearby[pick].range);
 
-            return nearby[pick];
+            return nearby[pick].obj;
         }
     }
     return NULL;
 }
 
+LocationIndex<Location>* psNPCClient::GetLocationIndex(LocationType* type)
+{
+    LocationIndex<Location>* index = locationIndex.Get(type, NULL);
+    if (!index)
+    {
+        index = new LocationIndex<Location>(LOCATION_INDEX_CELL);
+        for (size_t i=0; i<type->locs.GetSize(); i++)
+        {
+            index->Add(type->locs[i], type->locs[i]->GetSector(engine), type->locs[i]->pos);
+        }
+        locationIndex.Put(type, index);
+    }
+    return index;
+}
+
 Waypoint *psNPCClient::FindNearestWaypoint(csVector3& v,iSector *sector, float range, float * found_range)
 {
     return pathNetwork->FindNearestWaypoint(v, sector, range, found_range);
@@ -1327,12 +1420,10 @@ void psNPCClient::HandleDeath(NPC *who)
 
 void psNPCClient::PerceptProximityItems()
 {
-    int size = (int)all_gem_items.GetSize();
-
-    if (!size) return; // Nothing to do if no items
+    if (!itemGrid.GetSize()) return; // Nothing to do if no items
 
+    csArray<gemNPCItem*> nearby;
 
-    
     for (size_t i=0; i<npcs.GetSize(); i++)
     {
         if (npcs[i]==NULL || npcs[i]->GetActor() == NULL) // Can't do anyting unless we have both
@@ -1342,64 +1433,58 @@ void psNPCClient::PerceptProximityItems()
         csVector3 npc_pos;
         float yrot; // Used later for items as well
         psGameObject::GetPosition(npcs[i]->GetActor(),npc_pos,yrot,npc_sector);
-        
-        //
-        // Note: The follwing method could skeep checking a item for
-        // an iteraction. This because fast delete is used to remove  
-        // items from list and than a item on the end might be moved right
-        // into the space just checked.
-        //
-        
-        int size = (int)all_gem_items.GetSize();
-        
-        int check_count = 50; // We only check 50 items each time. This number has to be tuned
-        if (check_count > size)
-        {
-            // If not more than check_count items don't check them more than once :)
-            check_count = size;
-        }
-        
-        while (check_count--)
+
+        nearby.Empty();
+        FindNearbyItems(npc_sector,npc_pos,LONG_RANGE_PERCEPTION,nearby);
+
+        for (size_t j=0; j<nearby.GetSize(); j++)
         {
-            current_long_range_perception_index++;
-            if (current_long_range_perception_index >= (int)all_gem_items.GetSize())
-            {
-                current_long_range_perception_index = 0;
-            }
-            
-            gemNPCItem * item = all_gem_items[current_long_range_perception_index];
-            
+            gemNPCItem * item = nearby[j];
+            if (!item->IsPickable())
+                continue;
+
             iSector *item_sector;
             csVector3 item_pos;
             psGameObject::GetPosition(item,item_pos,yrot,item_sector);
-                         
-            if (item && item->IsPickable())
+
+            float dist = world->Distance(npc_pos,npc_sector,item_pos,item_sector);
+
+            if (dist <= LONG_RANGE_PERCEPTION)
             {
-                float dist = world->Distance(npc_pos,npc_sector,item_pos,item_sector);
-                
-                if (dist <= LONG_RANGE_PERCEPTION)
+                if (dist <= SHORT_RANGE_PERCEPTION)
                 {
-                    if (dist <= SHORT_RANGE_PERCEPTION)
+                    if (dist <= PERSONAL_RANGE_PERCEPTION)
                     {
-                        if (dist <= PERSONAL_RANGE_PERCEPTION)
-                        {
-                            ItemPerception pcpt_nearby("item nearby", item);
-                            TriggerEvent(npcs[i],&pcpt_nearby);
-                            continue;
-                        }
-                        ItemPerception pcpt_adjacent("item adjacent", item);
-                        TriggerEvent(npcs[i],&pcpt_adjacent);
+                        ItemPerception pcpt_nearby("item nearby", item);
+                        TriggerEvent(npcs[i],&pcpt_nearby);
                         continue;
                     }
-                    ItemPerception pcpt_sensed("item sensed", item);
-                    TriggerEvent(npcs[i],&pcpt_sensed);
+                    ItemPerception pcpt_adjacent("item adjacent", item);
+                    TriggerEvent(npcs[i],&pcpt_adjacent);
                     continue;
                 }
+                ItemPerception pcpt_sensed("item sensed", item);
+                TriggerEvent(npcs[i],&pcpt_sensed);
             }
         }
     }
 }
 
+void psNPCClient::FindNearbyItems(iSector* sector, const csVector3& pos, float radius, csArray<gemNPCItem*>& items)
+{
+    QueryInReach(itemGrid,world,sector,pos,radius,items);
+}
+
+void psNPCClient::IndexItem(gemNPCItem* item)
+{
+    iSector *sector;
+    csVector3 pos;
+    float yrot;
+    psGameObject::GetPosition(item,pos,yrot,sector);
+
+    itemGrid.Update(item,sector,pos);
+}
+
 void psNPCClient::PerceptProximityLocations()
 {
     csHash<LocationType*, csString>::GlobalIterator iter(loctypes.GetIterator());
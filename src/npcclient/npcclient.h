@@ -39,6 +39,8 @@ struct iCollideSystem;
 #include "util/psconst.h"
 #include "util/serverconsole.h"
 #include "util/pspath.h"
+#include "util/workerpool.h"
+#include "util/spatialgrid.h"
 
 class  psDatabase;
 class  MsgHandler;
@@ -60,6 +62,7 @@ class  psPFMaps;
 class  psTribe;
 class  psPath;
 class  psPathNetwork;
+template <class T> class LocationIndex;
 
 struct RaceInfo_t
 {
@@ -135,6 +138,15 @@ public:
     * This does 1 AI calc per Tribe then returns.
     */
     void Tick();
+
+    /**
+     * Advance the brains of the next of the NPC_TICK_BATCHES batches of
+     * NPCs, so each NPC is advanced every NPC_BRAIN_TICK. The needs are
+     * updated on the brain workers, nothing else runs meanwhile. Then the
+     * behaviors run in order on this thread and the commands of the whole
+     * batch go to the server in one message.
+     */
+    void TickNPCs();
    
     /**
      * Load a map into a region.  This is a copy of code
@@ -173,26 +185,22 @@ public:
     Location *FindRandomLocation(const char *loctype, csVector3& pos, iSector* sector, float range = -1, float *found_range = NULL);
 
     /**
-     * This iterates over all waypoints and finds the nearest one.
-     * There is probably a more efficient structure to accomplish this.
+     * Finds the nearest waypoint, using the waypoint index of the path network.
      */
     Waypoint *FindNearestWaypoint(csVector3& v, iSector* sector, float range = -1, float * found_range = NULL);
 
     /**
-     * This iterates over all waypoints and finds the nearest one.
-     * There is probably a more efficient structure to accomplish this.
+     * Finds a random waypoint within range, using the waypoint index of the path network.
      */
     Waypoint *FindRandomWaypoint(csVector3& v, iSector* sector, float range = -1, float * found_range = NULL);
     
     /**
-     * This iterates over all waypoints and finds the nearest one with the given group.
-     * There is probably a more efficient structure to accomplish this.
+     * Finds the nearest waypoint of the given group, using the waypoint index of the path network.
      */
     Waypoint *FindNearestWaypoint(const char *group, csVector3& v, iSector* sector, float range = -1, float * found_range = NULL);
 
     /**
-     * This iterates over all waypoints and finds the nearest one with the given group.
-     * There is probably a more efficient structure to accomplish this.
+     * Finds a random waypoint of the given group within range, using the waypoint index of the path network.
      */
     Waypoint *FindRandomWaypoint(const char *group, csVector3& v, iSector* sector, float range = -1, float * found_range = NULL);
     
@@ -424,6 +432,9 @@ protected:
 
 protected:
     bool LoadLocations();
+    
+    /// Index of the locations of a type, built on first use.
+    LocationIndex<Location>* GetLocationIndex(LocationType* type);
     bool LoadPathNetwork();
     
     /** Load Tribes from db */
@@ -436,6 +447,15 @@ protected:
      * NPC.
      */
     void PerceptProximityItems();
+
+    /**
+     * Append the items within 'radius' of a position to 'items', including
+     * the ones in sectors psWorld::Distance() warps from.
+     */
+    void FindNearbyItems(iSector* sector, const csVector3& pos, float radius, csArray<gemNPCItem*>& items);
+
+    /// Put an item into itemGrid at its current position.
+    void IndexItem(gemNPCItem* item);
     
     /**
      * Find all locations that are close to NPC's and percept the
@@ -456,6 +476,7 @@ protected:
 
     csHash<NPCType*, const char*> npctypes;
     csHash<LocationType*, csString> loctypes;
+    csHash<LocationIndex<Location>*, csPtrKey<LocationType> > locationIndex;
     psPathNetwork             *pathNetwork;
     csArray<NPC*>              npcs;
     csArray<DeferredNPC>       npcsDeferred;
@@ -463,7 +484,8 @@ protected:
     csHash<gemNPCObject*, EID> all_gem_objects_by_eid;
     csHash<gemNPCObject*, PID> all_gem_objects_by_pid;
     csArray<gemNPCObject*>     all_gem_objects;
-    csArray<gemNPCItem*>       all_gem_items;
+    /// All items, by position
+    SpatialGrid<gemNPCItem>    itemGrid;
     csHash<RaceInfo_t,csString> raceInfos;
 
     csRef<iCollideSystem>      cdsys;
@@ -475,7 +497,10 @@ protected:
     /// Counter used to start events at every nth client tick
     unsigned int               tick_counter;
 
-    int                        current_long_range_perception_index;
+    /// The batch of NPCs TickNPCs() advances next
+    size_t                     tick_batch;
+    bool                       brains_ticking;
+    WorkerPool                 brainWorkers;
 
     // Game Time
     int     gameMinute;
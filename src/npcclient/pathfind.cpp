@@ -57,20 +57,20 @@
 *
 * A* OPEN list
 * ------------
-* Some suggest to use priority queues instead of simple linked lists because
-* they have O(log(n)) retrieval of the most promising node. 
-* The cons is that they have O(log(n)) for all operations, and linked list
-* has small O(1) times on insertion and deletion. Overall priority queues
-* are O(log(n)) and lists O(n) so queues scale better with number of A* nodes,
-* but linked lists are more efficient up to some unknown value of n. 
-* Our scalability is solved by hierarchical A* so A* should be running on fairly
-* small graphs, so we don't need queues, I guess. I thought I learned about this idea 
-* in a gamasutra article but I can't find it now.
-* The linked list could be optimized by splitting it to several lists
-* grouping nodes by quality, we would search in the best list only.
+* The OPEN list is a 4-ary indexed heap keyed by the total estimate. Each
+* node remembers its place in the heap, so a better cost found for an open
+* node is an O(log(n)) key decrease instead of a search. The old linked list
+* needed a full scan for the most promising node on every expansion, which
+* made a search quadratic in the number of expanded nodes; the hierarchy that
+* was meant to keep searches small is not built yet, so long searches on the
+* basic graph must be cheap on their own.
+* A 4-ary heap is shallower than a binary one, key decreases are the most
+* frequent operation and get cheaper, DeleteMin compares a few more keys.
 *
-* Fibonacci heaps have O(1) insert and delete and O(log(n)) search,
-* but with big constants.
+* The heap is kept in psAMap and reused by every run, and the rest of the
+* A* state lives in the nodes themselves, so a run allocates nothing once the
+* heap has grown to the size of the largest OPEN list seen. maxExpands bounds
+* both the time and the size of the OPEN list of a run.
 *
 * Nonadmissible heuristic
 * -----------------------
@@ -145,12 +145,16 @@ psAMap::psAMap()
 {
     objReg = NULL;
     vfs = NULL;
+    nodeCount = 0;
+    lastExpands = 0;
 }
 
 psAMap::psAMap(iObjectRegistry * objReg)
 {
     this->objReg = objReg;
     vfs =  csQueryRegistry<iVFS> (objReg);
+    nodeCount = 0;
+    lastExpands = 0;
 }
 
 psANode::~psANode()
@@ -166,40 +170,26 @@ psANode::~psANode()
 
 void psAMap::PruneSuperfluous()
 {
-    csList<psANode*>::Iterator it, next;
     bool prunedSomething;
     
-    //super ugly
-    
-    //na posledni node se vykasle
+    //the first node is never pruned
+    size_t first = 0;
+    while (first < nodes.GetSize()  &&  nodes[first] == NULL)
+        first++;
     
     do
     {
         prunedSomething = false;
-        it = nodes;
-        if (it.HasNext()) 
-            it.Next();
-        
-        while (it.HasCurrent())
+        for (size_t i = first+1; i < nodes.GetSize(); i++)
         {
-            psANode * node = *it;
-            
-            if (it.HasNext())
-            {
-                next = it;
-                next.Next();
-            }
-            else
-                next = csList<psANode*>::Iterator();
-            
-            if (node->ShouldBePruned(*this))
+            psANode * node = nodes[i];
+            if (node != NULL  &&  node->ShouldBePruned(*this))
             {
                 delete node;
-                nodes.Delete(it);
+                nodes[i] = NULL;
+                nodeCount--;
                 prunedSomething = true;
             }
-            
-            it = next;
         }
     } while (prunedSomething);
 }
@@ -311,10 +301,13 @@ void psANode::RestoreConnectionsFromNeighbours()
 void psANode::LoadBasicsFromXML(csRef<iDocumentNode> node, psWalkPolyMap * wpMap, csRef<iEngine> engine)
 {
     id = node->GetAttributeValueAsInt("id");
+    // nodes created after loading must not reuse the loaded ids
+    if (id >= nextID)
+        nextID = id+1;
     point.x = node->GetAttributeValueAsFloat("x");
     point.y = node->GetAttributeValueAsFloat("y");
     point.z = node->GetAttributeValueAsFloat("z");
-    sector = engine->FindSector(node->GetAttributeValue("sector"));
+    sector = engine ? engine->FindSector(node->GetAttributeValue("sector")) : NULL;
     
     if (wpMap != NULL)
     {
@@ -341,7 +334,10 @@ void psANode::LoadEdgesFromXML(csRef<iDocumentNode> node, psAMap & map)
 
 bool psAMap::LoadFromString(const csString & str, psWalkPolyMap * wpMap)
 {
-    csRef<iEngine> engine =  csQueryRegistry<iEngine> (objReg);
+    //without an object registry the nodes are loaded without sectors
+    csRef<iEngine> engine;
+    if (objReg != NULL)
+        engine =  csQueryRegistry<iEngine> (objReg);
     
     csRef<iDocument> doc = ParseString(str);
     if (doc == NULL)
@@ -397,7 +393,7 @@ void psANode::SaveToString(csString & str)
     str += csString().Format("<node id='%i' x='%f' y='%f' z='%f' poly1='%i' poly2='%i' sector='%s'>",
                              id, point.x, point.y, point.z, 
                              poly1?poly1->GetID():0, poly2?poly2->GetID():0,
-                             sector->QueryObject()->GetName());
+                             sector?sector->QueryObject()->GetName():"");
     for (size_t levelNum=0; levelNum < edges.GetSize(); levelNum++)
     {
         csArray<psAEdge> & levEdges = edges[levelNum];
@@ -410,13 +406,11 @@ void psANode::SaveToString(csString & str)
 
 void psAMap::SaveToString(csString & str)
 {
-    csList<psANode*>::Iterator it(nodes);
-    
     str += "<map>\n";
-    while (it.HasNext())
+    for (size_t i = 0; i < nodes.GetSize(); i++)
     {
-        psANode * node = it.Next();
-        node->SaveToString(str);
+        if (nodes[i] != NULL)
+            nodes[i]->SaveToString(str);
     }
     str += "</map>\n";
 }
@@ -443,11 +437,10 @@ void psANode::DumpJS()
 
 void psAMap::DumpJS()
 {
-    csList <psANode*>::Iterator it(nodes);
-    while (it.HasNext())
+    for (size_t i = 0; i < nodes.GetSize(); i++)
     {
-        psANode * node = it.Next();
-        node->DumpJS();
+        if (nodes[i] != NULL)
+            nodes[i]->DumpJS();
     }
 }
 
@@ -457,7 +450,14 @@ void psAMap::DumpJS()
 
 void psAMap::AddNode(psANode * node)
 {
-    nodes.PushBack(node);
+    CS_ASSERT(node->id >= 0);
+    if ((size_t)node->id >= nodes.GetSize())
+        nodes.SetSize(node->id+1, NULL);
+    
+    CS_ASSERT(nodes[node->id] == NULL);
+    if (nodes[node->id] == NULL)
+        nodeCount++;
+    nodes[node->id] = node;
 }
 
 void psWalkPolyMap::BuildBasicAMap(psAMap & AMap)
@@ -780,23 +780,6 @@ void psANode::SetBestPrev(psANode * bestPrev, float cost)
     this->bestCost = cost;
 }
 
-psANode * FindMostPromising(psANode * firstOpen)
-{
-    psANode * bestSoFar, * current;
-    
-    bestSoFar = firstOpen;
-    current = firstOpen;
-    while (current != NULL)
-    {
-        if (current->total < bestSoFar->total)
-        {
-            bestSoFar = current;
-        }
-        current = current->nextInOpen;
-    }
-    return bestSoFar;
-}
-
 void psANode::EnsureNodeIsInited(int currARunNum)
 {
     if (ARunNum == currARunNum)
@@ -804,38 +787,12 @@ void psANode::EnsureNodeIsInited(int currARunNum)
     
     ARunNum = currARunNum;
     state = AState_unknown;
-    prevInOpen = nextInOpen = NULL;
     bestPrev = NULL;
     bestCost = 0;
     heur = 0;
     total = 0;
 }
 
-psANode * InsertIntoOpen(psANode * firstOpen, psANode * node)
-{
-    node->state = AState_open;
-    
-    node->prevInOpen = NULL;
-    node->nextInOpen = firstOpen;
-    if (firstOpen != NULL)
-        firstOpen->prevInOpen = node;
-    return node;
-}
-
-psANode * RemoveFromOpen(psANode * firstOpen, psANode * node)
-{
-    node->state = AState_closed;
-    
-    if (node->prevInOpen == NULL)
-        firstOpen = node->nextInOpen;
-    else
-        node->prevInOpen->nextInOpen = node->nextInOpen;
-    if (node->nextInOpen != NULL)
-        node->nextInOpen->prevInOpen = node->prevInOpen;
-    node->prevInOpen = node->nextInOpen = NULL;
-    return firstOpen;
-}
-
 void ConstructPath(psANode * goal, psAPath & path)
 {
     psANode * node;
@@ -858,7 +815,6 @@ void psANode::CalcHeur(psANode * goal)
 bool psAMap::RunA(psANode * start, psANode * goal, int level, int maxExpands, psAPath & path)
 {
     static int ARunNum = 0;
-    psANode * firstOpen = NULL;
     psANode * expanded = NULL;
     psAEdge * edge;
     int numExpands;
@@ -871,23 +827,32 @@ bool psAMap::RunA(psANode * start, psANode * goal, int level, int maxExpands, ps
     if (dbg)CShift();
     
     start->EnsureNodeIsInited(ARunNum);
-    firstOpen = InsertIntoOpen(firstOpen, start);
+    start->state = AState_open;
     start->CalcHeur(goal);
+    open.Update(start, start->total);
     
-    while (firstOpen != NULL)
+    while (!open.IsEmpty())
     {
-        expanded = FindMostPromising(firstOpen);
+        expanded = open.FindMin();
         numExpands ++;
         if (dbg)CPrintf(CON_DEBUG, "expanding=%i\n", expanded->id);
         if (expanded == goal   ||   numExpands == maxExpands)
             break;
 
         if (dbg)CShift();
-        firstOpen = RemoveFromOpen(firstOpen, expanded);
+        open.DeleteMin();
+        expanded->state = AState_closed;
+        
+        if ((size_t)level >= expanded->edges.GetSize())
+        {
+            if (dbg)CUnshift();
+            continue;
+        }
         
-        for (size_t edgeNum = 0; edgeNum < expanded->edges[level].GetSize(); edgeNum++)
+        csArray<psAEdge> & levEdges = expanded->edges[level];
+        for (size_t edgeNum = 0; edgeNum < levEdges.GetSize(); edgeNum++)
         {
-            edge = &expanded->edges[level][edgeNum];
+            edge = &levEdges[edgeNum];
             psANode * neighbour = edge->neighbour;
             
             // existuje skoro nulova pst ze nedojde k initu a stane se buhvi co
@@ -897,9 +862,10 @@ bool psAMap::RunA(psANode * start, psANode * goal, int level, int maxExpands, ps
             if (neighbour->state == AState_unknown)
             {
                 if (dbg)CPrintf(CON_DEBUG, "unknown=%i\n", neighbour->id);
-                firstOpen = InsertIntoOpen(firstOpen, neighbour);
+                neighbour->state = AState_open;
                 neighbour->SetBestPrev(expanded, newCost);
                 neighbour->CalcHeur(goal);
+                open.Update(neighbour, neighbour->total);
             }
             else if (neighbour->state == AState_open)
             {
@@ -909,12 +875,17 @@ bool psAMap::RunA(psANode * start, psANode * goal, int level, int maxExpands, ps
                     if (dbg)CPrintf(CON_DEBUG, "updating\n");
                     neighbour->total -= neighbour->bestCost - newCost;
                     neighbour->SetBestPrev(expanded, newCost);
+                    open.Update(neighbour, neighbour->total);
                 }
             }
         }
         if (dbg)CUnshift();
     }
     
+    // leave no node linked to the heap, they may be deleted before the next run
+    open.Clear();
+    lastExpands = numExpands;
+    
     if (expanded == goal)
     {
         ConstructPath(goal, path);
@@ -930,15 +901,9 @@ bool psAMap::RunA(psANode * start, psANode * goal, int level, int maxExpands, ps
 
 psANode * psAMap::FindNode(int id)
 {
-    csList <psANode*>::Iterator it(nodes);
-    
-    while (it.HasNext())
-    {
-        psANode * node = it.Next();
-        if (node->id == id)
-            return node;
-    }
-    return NULL;
+    if (id < 0  ||  (size_t)id >= nodes.GetSize())
+        return NULL;
+    return nodes[id];
 }
 
 /***********************************************************************************
@@ -30,6 +30,10 @@
 #include <csutil/csstring.h>
 #include <csutil/list.h>
 
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/heap.h"
 
 class psANode;
 class psWalkPoly;
@@ -133,7 +137,7 @@ enum psAState {AState_open, AState_closed, AState_unknown};
 * if its state is valid for the current A* run - if not, THEN we clear it.
 ****************************************************************************/
 
-class psANode
+class psANode : public IndexedHeapNode
 {
 public:
     psANode();
@@ -183,7 +187,6 @@ public:
     /* The following variables are temporary A* state valid for one A* run only */
     int ARunNum;          /**< number of the A* run */
     psAState state;
-    psANode * prevInOpen, * nextInOpen;  /**  */
     psANode * bestPrev;
     float bestCost;
     float heur;
@@ -250,6 +253,9 @@ public:
         Returns true when path was found */
     bool RunA(psANode * start, psANode * goal, int level, int maxExpands, psAPath & path);
     
+    /// Number of nodes the last RunA() expanded.
+    int GetLastExpands() { return lastExpands; }
+    
     void DumpJS();
     
     bool LoadFromString(const csString & str, psWalkPolyMap * wpMap);
@@ -258,12 +264,21 @@ public:
     bool SaveToFile(const csString & path);
     
     psANode* FindNode(int id);
+    
+    /// Number of nodes in the map.
+    size_t GetNodeCount() { return nodeCount; }
 
 protected:
-    csList <psANode*> nodes;
+    /// Nodes indexed by their id, NULL where there is none.
+    csArray <psANode*> nodes;
+    size_t nodeCount;
     csList <psACluster*> clusters;
     iObjectRegistry * objReg;
     csRef<iVFS> vfs;
+    
+    /// A* open list, kept between runs to reuse its memory.
+    IndexedHeap<psANode, 4> open;
+    int lastExpands;
 };
 
 
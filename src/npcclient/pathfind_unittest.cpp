@@ -0,0 +1,292 @@
+/*
+ * pathfind_unittest.cpp
+ *
+ * Copyright (C) 2005 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+#include <csutil/randomgen.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "pathfind.h"
+#include "util/benchmark.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/**
+ * Writes an A* map in the format psAMap::SaveToFile() uses: a 'size' by
+ * 'size' grid of nodes 4 units apart with a share of them missing, each
+ * connected to its 8 neighbours. Edges cost their length times a terrain
+ * factor of 1 to 1.5, the same in both directions.
+ */
+static csString MakeGridMap(int size, int holes, uint32 seed)
+{
+    csRandomGen rng(seed);
+    csArray<bool> present;
+    for (int i = 0; i < size * size; i++)
+        present.Push((int)rng.Get(100) >= holes);
+
+    csArray<float> terrain;
+    for (int i = 0; i < size * size * 8; i++)
+        terrain.Push(1.0f + rng.Get() * 0.5f);
+
+    const int dx[] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+    const int dz[] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+    csString str("<map>\n");
+    for (int z = 0; z < size; z++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            int id = z * size + x;
+            if (!present[id])
+                continue;
+            str.AppendFmt("<node id='%d' x='%f' y='0' z='%f' poly1='0' poly2='0' sector=''>",
+                id, x * 4.0f, z * 4.0f);
+            for (int d = 0; d < 8; d++)
+            {
+                int nx = x + dx[d];
+                int nz = z + dz[d];
+                if (nx < 0 || nz < 0 || nx >= size || nz >= size || !present[nz * size + nx])
+                    continue;
+                // Use the factor of the lower id for both directions
+                int other = nz * size + nx;
+                float factor = (id < other) ? terrain[id * 8 + d] : terrain[other * 8 + (d + 4) % 8];
+                float length = 4.0f * ((dx[d] && dz[d]) ? 1.41421356f : 1.0f);
+                str.AppendFmt("<edge level='0' id='%d' cost='%f'/>", other, length * factor);
+            }
+            str += "</node>";
+        }
+    }
+    str += "</map>\n";
+    return str;
+}
+
+/**
+ * A* as RunA did it before: the OPEN list as a linked list, scanned for the
+ * most promising node on every expansion. Returns the path cost, or -1.
+ */
+static float ListAStar(psAMap& map, int maxid, psANode* start, psANode* goal)
+{
+    csArray<float> cost, total;
+    csArray<int> state;     // 0 unknown, 1 open, 2 closed
+    cost.SetSize(maxid, 0.0f);
+    total.SetSize(maxid, 0.0f);
+    state.SetSize(maxid, 0);
+    csList<psANode*> open;
+
+    open.PushBack(start);
+    state[start->id] = 1;
+    total[start->id] = (goal->point - start->point).Norm();
+
+    while (!open.IsEmpty())
+    {
+        csList<psANode*>::Iterator it(open), best;
+        while (it.HasNext())
+        {
+            psANode* node = it.Next();
+            if (!best.HasCurrent() || total[node->id] < total[(*best)->id])
+                best = it;
+        }
+        psANode* expanded = *best;
+        if (expanded == goal)
+            return cost[goal->id];
+        open.Delete(best);
+        state[expanded->id] = 2;
+        if (expanded->edges.IsEmpty())
+            continue;
+
+        csArray<psAEdge>& edges = expanded->edges[0];
+        for (size_t e = 0; e < edges.GetSize(); e++)
+        {
+            psANode* neighbour = edges[e].neighbour;
+            float newCost = cost[expanded->id] + edges[e].cost;
+            if (state[neighbour->id] == 0)
+            {
+                state[neighbour->id] = 1;
+                open.PushBack(neighbour);
+            }
+            else if (state[neighbour->id] == 2 || newCost >= cost[neighbour->id])
+                continue;
+            cost[neighbour->id] = newCost;
+            total[neighbour->id] = newCost + (goal->point - neighbour->point).Norm();
+        }
+    }
+    return -1.0f;
+}
+
+/// One more than the highest node id in the map.
+static int MaxID(psAMap& map)
+{
+    int maxid = 0;
+    for (size_t found = 0; found < map.GetNodeCount(); maxid++)
+    {
+        if (map.FindNode(maxid))
+            found++;
+    }
+    return maxid;
+}
+
+/// Some random existing node of the map.
+static psANode* PickNode(psAMap& map, int maxid, csRandomGen& rng)
+{
+    psANode* node = NULL;
+    while (!node)
+        node = map.FindNode((int)rng.Get((uint32)maxid));
+    return node;
+}
+
+TEST(PathFindTest, LoadAndFindNode)
+{
+    psAMap map;
+    ASSERT_TRUE(map.LoadFromString(MakeGridMap(10, 20, 1), NULL));
+
+    size_t count = 0;
+    for (int id = 0; id < 100; id++)
+    {
+        psANode* node = map.FindNode(id);
+        if (node)
+        {
+            EXPECT_EQ(id, node->id);
+            count++;
+        }
+    }
+    EXPECT_EQ(count, map.GetNodeCount());
+    EXPECT_TRUE(map.FindNode(-1) == NULL);
+    EXPECT_TRUE(map.FindNode(100) == NULL);
+
+    // New nodes don't collide with the loaded ones
+    psANode* extra = new psANode(csVector3(0, 0, 0));
+    EXPECT_TRUE(map.FindNode(extra->id) == NULL);
+    map.AddNode(extra);
+    EXPECT_EQ(extra, map.FindNode(extra->id));
+}
+
+TEST(PathFindTest, ShortestPaths)
+{
+    const int size = 30;
+    psAMap map;
+    ASSERT_TRUE(map.LoadFromString(MakeGridMap(size, 30, 2), NULL));
+
+    csRandomGen rng(3);
+    for (int i = 0; i < 200; i++)
+    {
+        psANode* start = PickNode(map, size * size, rng);
+        psANode* goal = PickNode(map, size * size, rng);
+
+        psAPath path;
+        bool found = map.RunA(start, goal, 0, size * size + 1, path);
+        float expected = ListAStar(map, size * size, start, goal);
+        ASSERT_EQ(expected >= 0, found);
+        if (found)
+            EXPECT_NEAR(expected, path.CalcCost(), 0.01f);
+    }
+
+    // Running out of expansions fails the search
+    psAMap full;
+    ASSERT_TRUE(full.LoadFromString(MakeGridMap(size, 0, 2), NULL));
+    psAPath path;
+    EXPECT_FALSE(full.RunA(full.FindNode(0), full.FindNode(size * size - 1), 0, 3, path));
+    EXPECT_EQ(3, full.GetLastExpands());
+    EXPECT_TRUE(full.RunA(full.FindNode(0), full.FindNode(size * size - 1), 0, size * size, path));
+}
+
+/**
+ * Reports expansions per second and search latency on grid maps of
+ * growing size, against the old list based search. Set PS_AMAP_FILE to
+ * the path of a saved map to benchmark that map as well.
+ */
+TEST(PathFindTest, DISABLED_SearchBenchmark)
+{
+    const int sizes[] = { 30, 100, 300 };
+    const int queries = 200;
+
+    csArray<csString> maps;
+    csArray<csString> names;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        maps.Push(MakeGridMap(sizes[s], 25, 4));
+        names.Push(csString().Format("%dx%d grid", sizes[s], sizes[s]));
+    }
+
+    const char* file = getenv("PS_AMAP_FILE");
+    if (file)
+    {
+        FILE* f = fopen(file, "r");
+        if (f)
+        {
+            csString str;
+            char buf[4096];
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+                str.Append(buf, n);
+            fclose(f);
+            maps.Push(str);
+            names.Push(file);
+        }
+    }
+
+    for (size_t m = 0; m < maps.GetSize(); m++)
+    {
+        psAMap map;
+        ASSERT_TRUE(map.LoadFromString(maps[m], NULL));
+        int maxid = MaxID(map);
+
+        csRandomGen rng(5);
+        csArray<psANode*> starts, goals;
+        for (int q = 0; q < queries; q++)
+        {
+            starts.Push(PickNode(map, maxid, rng));
+            goals.Push(PickNode(map, maxid, rng));
+        }
+
+        csArray<float> latency;
+        double expands = 0;
+        csMicroTicks heaptime = 0;
+        for (int q = 0; q < queries; q++)
+        {
+            psAPath path;
+            csMicroTicks start = csGetMicroTicks();
+            map.RunA(starts[q], goals[q], 0, maxid + 1, path);
+            csMicroTicks elapsed = csGetMicroTicks() - start;
+            heaptime += elapsed;
+            latency.Push((float)elapsed);
+            expands += map.GetLastExpands();
+        }
+
+        // The old search is quadratic, time fewer of them on big maps
+        int oldqueries = (map.GetNodeCount() > 10000) ? queries / 20 : queries;
+        csMicroTicks start = csGetMicroTicks();
+        for (int q = 0; q < oldqueries; q++)
+            ListAStar(map, maxid, starts[q], goals[q]);
+        csMicroTicks listtime = csGetMicroTicks() - start;
+
+        printf("%s, %zu nodes: %.0f expansions/s, %.1f expansions per search, list %.2f usec per search\n",
+            names[m].GetData(), map.GetNodeCount(), expands * 1000000.0 / MAX(heaptime, 1),
+            expands / queries, (double)listtime / oldqueries);
+        PrintPercentiles("  heap A* latency", latency, "usec");
+    }
+}
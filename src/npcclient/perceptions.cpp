@@ -55,6 +55,7 @@
 
 Reaction::Reaction()
 {
+    event_type_id = csInvalidStringID;
     desireValue   = 0.0f;
     desireType    = DESIRE_GUARANTIED;
     range         = 0;
@@ -115,6 +116,7 @@ bool Reaction::Load(iDocumentNode *node,BehaviorSet& behaviors)
 
     // Handle hooking up to the perception
     event_type             = node->GetAttributeValue("event");
+    event_type_id          = Perception::GetEventTypeID(event_type);
     range                  = node->GetAttributeValueAsFloat("range");
     weight                 = node->GetAttributeValueAsFloat("weight");
     faction_diff           = node->GetAttributeValueAsInt("faction_diff");
@@ -176,6 +178,7 @@ void Reaction::DeepCopy(Reaction& other,BehaviorSet& behaviors)
         affected.Push(behavior);
     }
     event_type             = other.event_type;
+    event_type_id          = other.event_type_id;
     range                  = other.range;
     faction_diff           = other.faction_diff;
     oper                   = other.oper;
@@ -249,7 +252,10 @@ void Reaction::React(NPC *who, Perception *pcpt)
             break;
 
 
-        who->Printf(2, "Reaction '%s' reacting to perception %s", GetEventType(), pcpt->ToString().GetDataSafe());
+        if (who->IsDebugging(2))
+        {
+            who->Printf(2, "Reaction '%s' reacting to perception %s", GetEventType(), pcpt->ToString().GetDataSafe());
+        }
         switch (desireType)
         {
         case DESIRE_NONE:
@@ -346,6 +352,15 @@ bool Reaction::GetRandomValid(int i)
 
 /*----------------------------------------------------------------------------*/
 
+csStringSet Perception::event_type_ids;
+
+csStringID Perception::GetEventTypeID(const char *event_type)
+{
+    csString folded(event_type);
+    folded.Downcase();
+    return event_type_ids.Request(folded);
+}
+
 bool Perception::ShouldReact(Reaction *reaction, NPC *npc)
 {
     if (name == reaction->GetEventType())
@@ -565,6 +580,17 @@ SpellPerception::SpellPerception(const char *name,
     this->target = (gemNPCActor*) target;
     this->spell_severity = severity;
     this->type = type;
+
+    // Which one depends on the NPC, see ShouldReact()
+    static const char* const towards[] = { "target", "self", "unknown" };
+    event_types.Empty();
+    for (size_t i = 0; i < sizeof(towards)/sizeof(towards[0]); i++)
+    {
+        csString event(type);
+        event.Append(':');
+        event.Append(towards[i]);
+        event_types.Push(GetEventTypeID(event));
+    }
 }
 
 bool SpellPerception::ShouldReact(Reaction *reaction,NPC *npc)
@@ -843,11 +869,8 @@ OwnerActionPerception::OwnerActionPerception( const char *name  ,
     this->action = action;
     this->owner = owner;
     this->pet = pet;
-}
 
-bool OwnerActionPerception::ShouldReact( Reaction *reaction, NPC *npc )
-{
-    csString event("ownercmd");
+    event = "ownercmd";
     event.Append(':');
 
     switch ( this->action )
@@ -869,6 +892,12 @@ bool OwnerActionPerception::ShouldReact( Reaction *reaction, NPC *npc )
         break;
     }
 
+    event_types.Empty();
+    event_types.Push(GetEventTypeID(event));
+}
+
+bool OwnerActionPerception::ShouldReact( Reaction *reaction, NPC *npc )
+{
     if (event == reaction->GetEventType())
     {
         return true;
@@ -903,13 +932,19 @@ NPCCmdPerception::NPCCmdPerception( const char *command, NPC * self ) : Percepti
 {
     this->cmd = command;
     this->self = self;
+
+    global_event = "npccmd:global:";
+    global_event.Append(cmd);
+    self_event = "npccmd:self:";
+    self_event.Append(cmd);
+
+    event_types.Empty();
+    event_types.Push(GetEventTypeID(global_event));
+    event_types.Push(GetEventTypeID(self_event));
 }
 
 bool NPCCmdPerception::ShouldReact( Reaction *reaction, NPC *npc )
 {
-    csString global_event("npccmd:global:");
-    global_event.Append(cmd);
-
     if (strcasecmp(global_event,reaction->GetEventType()) == 0)
     {
         npc->Printf(15,"Matched reaction '%s' to perception '%s'.",reaction->GetEventType(), global_event.GetData() );
@@ -921,9 +956,6 @@ bool NPCCmdPerception::ShouldReact( Reaction *reaction, NPC *npc )
     }
     
 
-    csString self_event("npccmd:self:");
-    self_event.Append(cmd);
-
     if (strcasecmp(self_event,reaction->GetEventType())==0 && npc == self)
     {
         npc->Printf(15,"Matched reaction '%s' to perception '%s'.",reaction->GetEventType(), self_event.GetData() );
@@ -30,6 +30,7 @@
 #include <csutil/weakref.h>
 #include <iutil/document.h>
 #include <csutil/array.h>
+#include <csutil/strset.h>
 
 //=============================================================================
 // Library Includes
@@ -59,6 +60,7 @@ class Reaction
 protected:
     // members making up the "if statement"
     csString  event_type;
+    csStringID event_type_id;  // See Perception::GetEventTypeID()
     float     range;
     int       faction_diff;
     csString  oper;
@@ -104,6 +106,7 @@ public:
     bool ShouldReact(gemNPCObject* entity, Perception *pcpt);
 
     const char     *GetEventType()      { return event_type;   }
+    csStringID      GetEventTypeID()    { return event_type_id; }
     float           GetRange()          { return range;        }
     int             GetFactionDiff()    { return faction_diff; }
     bool            GetValueValid(int i);
@@ -133,11 +136,24 @@ protected:
     /// Values used by perseptions. Usally they correspond to the same value in a reaction.  
     csString  type;
 
+    /// The event types of the reactions ShouldReact() can accept, the name unless a subclass knows better.
+    csArray<csStringID> event_types;
+
 public:
-    Perception(const char *n) { name = n; }
-    Perception(const char *n, const char *t) { name = n; type = t; }
+    Perception(const char *n) { name = n; event_types.Push(GetEventTypeID(n)); }
+    Perception(const char *n, const char *t) { name = n; type = t; event_types.Push(GetEventTypeID(n)); }
     virtual ~Perception() {}
 
+    /**
+     * Intern an event type. Case is folded, so reactions that are matched
+     * ignoring case get the same id. Two equal ids only make a reaction
+     * a candidate, ShouldReact() has the final word.
+     */
+    static csStringID GetEventTypeID(const char *event_type);
+
+    /// The reactions NPCType asks ShouldReact() are those with one of these ids.
+    const csArray<csStringID>& GetEventTypes() { return event_types; }
+
 
     virtual bool ShouldReact(Reaction *reaction,NPC *npc);
     virtual Perception *MakeCopy();
@@ -152,6 +168,9 @@ public:
     virtual float GetRadius() const { return 0.0; }
 
     virtual csString ToString();
+
+private:
+    static csStringSet event_type_ids;
 };
 
 //-----------------------------------------------------------------------------
@@ -434,6 +453,7 @@ class OwnerActionPerception : public Perception
 {
 protected:
     int action;
+    csString event;
     csWeakRef<gemNPCObject> owner;
     csWeakRef<gemNPCObject> pet;
 
@@ -458,6 +478,8 @@ class NPCCmdPerception : public Perception
 {
 protected:
     csString cmd;
+    csString global_event;
+    csString self_event;
     NPC * self;
 
 public:
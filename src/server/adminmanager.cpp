@@ -39,6 +39,7 @@
 #include "util/serverconsole.h"
 #include "util/strutil.h"
 #include "util/eventmanager.h"
+#include "util/asyncquery.h"
 #include "util/pspathnetwork.h"
 #include "util/waypoint.h"
 #include "util/pspath.h"
@@ -2548,6 +2549,10 @@ void AdminManager::Teleport(MsgEntry* me, psAdminCmdMessage& msg, AdminCmdData&
         csString escapedName;
         db->Escape( escapedName, data.player.GetDataSafe() );
 
+        // The character may have been saved on logout moments ago
+        PID offlinePID = psserver->CharacterLoader.FindCharacterID(data.player.GetDataSafe(), false);
+        if (offlinePID.IsValid())
+            db->FlushDelayed("characters", offlinePID.Unbox());
         sql.AppendFmt("update characters set loc_x=%10.2f, loc_y=%10.2f, loc_z=%10.2f, loc_yrot=%10.2f, loc_sector_id=%u, loc_instance=%u where name=\"%s\"",
             myPoint.x, myPoint.y, myPoint.z, yRot, mysectorinfo->uid, client->GetActor()->GetInstance(), escapedName.GetDataSafe());
 
@@ -3012,6 +3017,8 @@ void AdminManager::HandlePath(MsgEntry* me, psAdminCmdMessage& msg, AdminCmdData
         {
             if (wp->Adjust(db,myPos,mySectorName))
             {
+                pathNetwork->ClearWaypointIndex();
+
                 if (client->WaypointIsDisplaying())
                 {
                     psEffectMessage msg(me->clientnum,"admin_waypoint",myPos,0,0,client->PathGetEffectID());
@@ -4587,6 +4594,7 @@ void AdminManager::ChangeLock(MsgEntry *me, psAdminCmdMessage& msg, AdminCmdData
                     lstr.Append(word);
 
                     // write back to database
+                    db->FlushDelayed("item_instances", keyID);
                     int result = db->CommandPump("UPDATE item_instances SET openable_locks='%s' WHERE id=%d",
                         lstr.GetData(), keyID);
                     if (result == -1)
@@ -4865,62 +4873,101 @@ bool AdminManager::GetPetitionsArray(csArray<psPetitionInfo> &petitions, Client
             
     if(rs)
     {
-        psPetitionInfo info;
-        for (unsigned int i=0; i<rs->Count(); i++)
-        {
-            // Set info
-            info.id = atoi((*rs)[i][0]);
-            info.petition = (*rs)[i][1];
-            info.status = (*rs)[i][2];
-            info.created = csString((*rs)[i][3]).Slice(0, 16);
-            info.assignedgm = (*rs)[i][4];
-            if (!IsGMrequest) //this is special handling for player petition requests
+        ReadPetitions(rs, petitions, IsGMrequest);
+        rs->Release();
+        return true;
+    }
+
+    return false;
+}
+
+void AdminManager::ReadPetitions(iResultSet *rs, csArray<psPetitionInfo> &petitions, bool IsGMrequest)
+{
+    psPetitionInfo info;
+    for (unsigned int i=0; i<rs->Count(); i++)
+    {
+        // Set info
+        info.id = atoi((*rs)[i][0]);
+        info.petition = (*rs)[i][1];
+        info.status = (*rs)[i][2];
+        info.created = csString((*rs)[i][3]).Slice(0, 16);
+        info.assignedgm = (*rs)[i][4];
+        if (!IsGMrequest) //this is special handling for player petition requests
+        {
+            if(info.assignedgm.Length() == 0)
             {
-                if(info.assignedgm.Length() == 0)
-                {
-                    info.assignedgm = "No GM Assigned";
-                }
-                info.resolution = (*rs)[i][5];
-                if (info.resolution.Length() == 0)
-                {
-                    info.resolution = "No Resolution";
-                }
+                info.assignedgm = "No GM Assigned";
             }
-            else //this is special handling for gm petitions requests
+            info.resolution = (*rs)[i][5];
+            if (info.resolution.Length() == 0)
             {
-                info.player = (*rs)[i][5];
-                info.escalation = atoi((*rs)[i][6]);
-                info.online = (clients->Find(info.player) ? true : false);
-
+                info.resolution = "No Resolution";
             }
+        }
+        else //this is special handling for gm petitions requests
+        {
+            info.player = (*rs)[i][5];
+            info.escalation = atoi((*rs)[i][6]);
+            info.online = (clients->Find(info.player) ? true : false);
 
-            // Append to the message:
-            petitions.Push(info);
         }
-        rs->Release();
-        return true;
-    }
 
-    return false;
+        // Append to the message:
+        petitions.Push(info);
+    }
 }
 
-void AdminManager::ListPetitions(MsgEntry *me, psPetitionRequestMessage& msg,Client *client)
+/**
+ * Sends a petition list once its query is done. The client may have left
+ * in the meantime, so it is looked up again.
+ */
+class psPetitionListEvent : public psDBQueryEvent
 {
-    csArray<psPetitionInfo> petitions;
-    // Try and grab the result set from the database
-    if(GetPetitionsArray(petitions, client))
+public:
+    psPetitionListEvent(AdminManager* admin, uint32_t clientnum, bool IsGMrequest)
+        : psDBQueryEvent("psPetitionListEvent"), admin(admin), clientnum(clientnum), IsGMrequest(IsGMrequest)
     {
-        psPetitionMessage message(me->clientnum, &petitions, "List retrieved successfully.", true, PETITION_LIST);
-        message.SendMessage();
     }
-    else
+
+protected:
+    virtual void Done(iResultSet* result, unsigned long affected, const char* error)
     {
-        // Return no succeed message to client
-        csString error;
-        error.Format("SQL Error: %s", db->GetLastError());
-        psPetitionMessage message(me->clientnum, NULL, error, false, PETITION_LIST);
-        message.SendMessage();
+        if (!admin->clients->Find(clientnum))
+            return;
+
+        if (result)
+        {
+            csArray<psPetitionInfo> petitions;
+            admin->ReadPetitions(result, petitions, IsGMrequest);
+            psPetitionMessage message(clientnum, &petitions, "List retrieved successfully.", true, PETITION_LIST, IsGMrequest);
+            message.SendMessage();
+        }
+        else
+        {
+            // Return no succeed message to client
+            csString errormsg;
+            errormsg.Format("SQL Error: %s", error);
+            psPetitionMessage message(clientnum, NULL, errormsg, false, PETITION_LIST, IsGMrequest);
+            message.SendMessage();
+        }
     }
+
+private:
+    AdminManager* admin;
+    uint32_t clientnum;
+    bool IsGMrequest;
+};
+
+void AdminManager::SendPetitionsAsync(Client *client, bool IsGMrequest)
+{
+    csString query = GetPetitionsQuery(IsGMrequest ? PETITION_GM : client->GetPID(),
+                                       IsGMrequest ? client->GetPID() : PETITION_GM);
+    db->SelectAsync(new psPetitionListEvent(this, client->GetClientNum(), IsGMrequest), "%s", query.GetData());
+}
+
+void AdminManager::ListPetitions(MsgEntry *me, psPetitionRequestMessage& msg,Client *client)
+{
+    SendPetitionsAsync(client, false);
 }
 
 void AdminManager::CancelPetition(MsgEntry *me, psPetitionRequestMessage& msg,Client *client)
@@ -4972,23 +5019,8 @@ void AdminManager::GMListPetitions(MsgEntry *me, psPetitionRequestMessage& msg,C
         return;
     }
 
-    // Try and grab the result set from the database
-
     // Show the player all petitions.
-    csArray<psPetitionInfo> petitions;
-    if(GetPetitionsArray(petitions, client, true))
-    {
-        psPetitionMessage message(me->clientnum, &petitions, "List retrieved successfully.", true, PETITION_LIST, true);
-        message.SendMessage();
-    }
-    else
-    {
-        // Return no succeed message to GM
-        csString error;
-        error.Format("SQL Error: %s", db->GetLastError());
-        psPetitionMessage message(me->clientnum, NULL, error, false, PETITION_LIST, true);
-        message.SendMessage();
-    }
+    SendPetitionsAsync(client, true);
 }
 
 void AdminManager::GMHandlePetition(MsgEntry *me, psPetitionRequestMessage& msg,Client *client)
@@ -5161,19 +5193,31 @@ bool AdminManager::AddPetition(PID playerID, const char* petition)
 
 iResultSet *AdminManager::GetPetitions(PID playerID, PID gmID)
 {
-    iResultSet *rs;
+    iResultSet *rs = db->Select("%s", GetPetitionsQuery(playerID, gmID).GetData());
+
+    if (!rs)
+    {
+        lasterror = GetLastSQLError();
+    }
+
+    return rs;
+}
+
+csString AdminManager::GetPetitionsQuery(PID playerID, PID gmID)
+{
+    csString query;
 
     // Check player ID, if ID is PETITION_GM (0xFFFFFFFF), get a complete list for the GM:
     if (playerID == PETITION_GM)
     {
-            rs = db->Select("SELECT pet.id,pet.petition,pet.status,pet.created_date,gm.name as gmname,pl.name,pet.escalation_level FROM petitions pet "
+            query.Format("SELECT pet.id,pet.petition,pet.status,pet.created_date,gm.name as gmname,pl.name,pet.escalation_level FROM petitions pet "
                     "LEFT JOIN characters gm ON pet.assigned_gm=gm.id, characters pl WHERE pet.player!=%d AND (pet.status=\"Open\" OR pet.status=\"In Progress\") "
                     "AND pet.player=pl.id "
                     "ORDER BY pet.status ASC,pet.escalation_level DESC,pet.created_date ASC", gmID.Unbox());
     }
     else
     {
-        rs = db->Select("SELECT pet.id,pet.petition,pet.status,pet.created_date,pl.name,pet.resolution "
+        query.Format("SELECT pet.id,pet.petition,pet.status,pet.created_date,pl.name,pet.resolution "
                     "FROM petitions pet LEFT JOIN characters pl "
                     "ON pet.assigned_gm=pl.id "
                     "WHERE pet.player=%d "
@@ -5181,12 +5225,7 @@ iResultSet *AdminManager::GetPetitions(PID playerID, PID gmID)
                     "ORDER BY pet.status ASC,pet.escalation_level DESC", playerID.Unbox());
     }
 
-    if (!rs)
-    {
-        lasterror = GetLastSQLError();
-    }
-
-    return rs;
+    return query;
 }
 
 bool AdminManager::CancelPetition(PID playerID, int petitionID, bool isGMrequest)
@@ -5639,6 +5678,7 @@ void AdminManager::ChangeName(MsgEntry* me, psAdminCmdMessage& msg, AdminCmdData
     }
 
     // Need instant DB update if we should be able to change the same persons name twice
+    db->FlushDelayed("characters", pid.Unbox());
     db->CommandPump("UPDATE characters SET name='%s', lastname='%s' WHERE id='%u'",data.newName.GetData(),data.newLastName.GetDataSafe(), pid.Unbox());
 
     // Resend group list
@@ -79,6 +79,8 @@ enum GM_LEVEL
  */
 class AdminManager : public MessageManager
 {
+    friend class psPetitionListEvent;
+
 public:
     AdminManager();
     virtual ~AdminManager();
@@ -289,6 +291,19 @@ protected:
      */
     bool GetPetitionsArray(csArray<psPetitionInfo> &petitions, Client *client, bool IsGMrequest = false);
 
+    /** @brief Parses the petitions selected by the query of GetPetitionsQuery().
+     *  @param rs The rows of the petitions.
+     *  @param petitions The array the parsed petitions are appended to.
+     *  @param IsGMrequest manages if the list should be formated for gm or players. True is for gm.
+     */
+    void ReadPetitions(iResultSet *rs, csArray<psPetitionInfo> &petitions, bool IsGMrequest);
+
+    /** @brief Sends the petition list to a client without waiting for the database.
+     *  @param client The client which requested the list.
+     *  @param IsGMrequest true to send the list of all petitions to a GM.
+     */
+    void SendPetitionsAsync(Client *client, bool IsGMrequest);
+
     /// Handles queries sent by the client to the server for information or actions
     void ListPetitions(MsgEntry* me, psPetitionRequestMessage& msg, Client *client);
     void CancelPetition(MsgEntry* me, psPetitionRequestMessage& msg, Client *client);
@@ -464,6 +479,9 @@ protected:
      */
     iResultSet *GetPetitions(PID playerID, PID gmID = PETITION_GM);
 
+    /// The query of GetPetitions(), for running it asynchronously
+    csString GetPetitionsQuery(PID playerID, PID gmID = PETITION_GM);
+
     /** @brief Cancels the specified petition if the player was its creator
      *  @param playerID: Is the ID of the player who is requesting the change.
      *  @param petitionID: The petition id
@@ -39,6 +39,7 @@
 #include "util/psdatabase.h"
 #include "util/log.h"
 #include "util/eventmanager.h"
+#include "util/asyncquery.h"
 
 //=============================================================================
 // Local Includes
@@ -103,6 +104,70 @@ AuthenticationServer::~AuthenticationServer()
 }
 
 
+/**
+ * Logs a client in once its account has been read. The client may have
+ * left in the meantime, so it is looked up again.
+ */
+class psAccountLoadEvent : public psDBQueryEvent
+{
+public:
+    psAccountLoadEvent(AuthenticationServer* auth, const AuthenticationServer::AuthRequest& request)
+        : psDBQueryEvent("psAccountLoadEvent"), auth(auth), request(request)
+    {
+    }
+
+protected:
+    virtual void Done(iResultSet* result, unsigned long affected, const char* error)
+    {
+        if (!auth->clients->FindAny(request.clientnum))
+            return;
+
+        psAccountInfo* acctinfo = NULL;
+        if (result)
+            acctinfo = CacheManager::GetSingleton().ReadAccountInfo(result);
+        else
+            Warning3(LOG_CONNECTIONS,"Could not find account for login %s.  Error: %s",request.user.GetData(),error);
+
+        auth->Authenticate(request, acctinfo);
+    }
+
+private:
+    AuthenticationServer* auth;
+    AuthenticationServer::AuthRequest request;
+};
+
+/**
+ * Picks the character once the list of the account has been read.
+ */
+class psCharacterListEvent : public psDBQueryEvent
+{
+public:
+    psCharacterListEvent(AuthenticationServer* auth, uint32_t clientnum, const csString& name)
+        : psDBQueryEvent("psCharacterListEvent"), auth(auth), clientnum(clientnum), name(name)
+    {
+    }
+
+protected:
+    virtual void Done(iResultSet* result, unsigned long affected, const char* error)
+    {
+        Client* client = auth->clients->FindAny(clientnum);
+        if (!client)
+            return;
+
+        psCharacterList* charlist = NULL;
+        if (result)
+            charlist = psserver->CharacterLoader.ReadCharacterList(result);
+
+        auth->PickCharacter(client, name, charlist);
+    }
+
+private:
+    AuthenticationServer* auth;
+    uint32_t clientnum;
+    csString name;
+};
+
+
 void AuthenticationServer::HandleAuthCharacter( MsgEntry* me, Client *client )
 {
     psCharacterPickerMessage charpick( me );
@@ -112,31 +177,44 @@ void AuthenticationServer::HandleAuthCharacter( MsgEntry* me, Client *client )
         return;
     } 
 
-    psCharacterList *charlist = psserver->CharacterLoader.LoadCharacterList( client->GetAccountID());
-    
+    psCharacterList *charlist = psserver->CharacterLoader.GetCachedCharacterList( client->GetAccountID());
+    if (charlist)
+    {
+        PickCharacter(client, charpick.characterName, charlist);
+        return;
+    }
+
+    psserver->CharacterLoader.LoadCharacterListAsync(client->GetAccountID(),
+        new psCharacterListEvent(this, client->GetClientNum(), charpick.characterName));
+}
+
+void AuthenticationServer::PickCharacter(Client* client, const csString& name, psCharacterList* charlist)
+{
     if (!charlist)
     {
         Error1("Could not load Character List for account! Rejecting client!\n");
-        psserver->RemovePlayer( me->clientnum, "Could not load the list of characters for your account.  Please contact a PS Admin for help.");        
+        psserver->RemovePlayer( client->GetClientNum(), "Could not load the list of characters for your account.  Please contact a PS Admin for help.");        
         return;
     } 
 
+    // Trim out whitespaces from name
+    csString characterName(name);
+    characterName.Trim();
+
     int i;
     for (i=0;i<MAX_CHARACTERS_IN_LIST;i++)
     {
         if (charlist->GetEntryValid(i))
         {
-            // Trim out whitespaces from name
-            charpick.characterName.Trim();
             csString listName( charlist->GetCharacterFullName(i) );
             listName.Trim();
                                             
-            if ( charpick.characterName == listName )
+            if ( characterName == listName )
             {
                  client->SetPID(charlist->GetCharacterID(i));
                  // Set client name in code to just firstname as other code depends on it
                  client->SetName(charlist->GetCharacterName(i));
-                 psCharacterApprovedMessage out( me->clientnum );
+                 psCharacterApprovedMessage out( client->GetClientNum() );
                  out.SendMessage();
                  break;
             }                     
@@ -232,33 +310,56 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
         return;                
     }
     
+    AuthRequest request;
+    request.clientnum = me->clientnum;
+    request.user = msg.sUser;
+    request.password = msg.sPassword;
+    request.os = msg.os_;
+    request.gfxcard = msg.gfxcard_;
+    request.gfxversion = msg.gfxversion_;
+    request.compression = msg.compression;
+    request.start = start;
+
     // Check if login was correct
     Notify2(LOG_CONNECTIONS,"Check Login for: '%s'\n", (const char*)msg.sUser);
-    psAccountInfo *acctinfo=CacheManager::GetSingleton().GetAccountInfoByUsername((const char *)msg.sUser);
+    psAccountInfo *acctinfo = CacheManager::GetSingleton().GetCachedAccountInfo(msg.sUser);
+    if (acctinfo)
+    {
+        Authenticate(request, acctinfo);
+        return;
+    }
+
+    // The account is read without holding up the game
+    CacheManager::GetSingleton().LoadAccountInfoAsync(msg.sUser, new psAccountLoadEvent(this, request));
+}
+
+void AuthenticationServer::Authenticate(const AuthRequest& request, psAccountInfo* acctinfo)
+{
+    csString status;
 
     if ( !acctinfo )
     {
         // invalid
-        psserver->RemovePlayer(me->clientnum,"Incorrect password or username.");
+        psserver->RemovePlayer(request.clientnum,"Incorrect password or username.");
 
         Notify2(LOG_CONNECTIONS,"User '%s' authentication request rejected: No account found with that name.\n",
-                (const char *)msg.sUser);            
+                (const char *)request.user);            
         return;                
     }
 
     // Add account to cache to optimize repeated login attempts
-    CacheManager::GetSingleton().AddToCache(acctinfo,msg.sUser,120);
+    CacheManager::GetSingleton().AddToCache(acctinfo,request.user,120);
     
     // Check if password was correct
     csString passwordhashandclientnum (acctinfo->password);
     passwordhashandclientnum.Append(":");
-    passwordhashandclientnum.Append(me->clientnum);
+    passwordhashandclientnum.Append(request.clientnum);
     
     csString encoded_hash = csMD5::Encode(passwordhashandclientnum).HexString();
-    if (strcmp( encoded_hash.GetData() , msg.sPassword.GetData())) // authentication error
+    if (strcmp( encoded_hash.GetData() , request.password.GetData())) // authentication error
     {
-        psserver->RemovePlayer(me->clientnum, "Incorrect password or username.");
-        Notify2(LOG_CONNECTIONS,"User '%s' authentication request rejected (Bad password).",(const char *)msg.sUser);
+        psserver->RemovePlayer(request.clientnum, "Incorrect password or username.");
+        Notify2(LOG_CONNECTIONS,"User '%s' authentication request rejected (Bad password).",(const char *)request.user);
         // No delete necessary because AddToCache will auto-delete
         // delete acctinfo;
         return;
@@ -267,7 +368,7 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
     /**
      * Check if the client is already logged in
      */
-    Client* existingClient = clients->FindAccount(acctinfo->accountid, me->clientnum);
+    Client* existingClient = clients->FindAccount(acctinfo->accountid, request.clientnum);
     if (existingClient)  // account already logged in
     {
         // invalid authent message from a different client
@@ -285,33 +386,34 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
 
         psserver->RemovePlayer(existingClient->GetClientNum(), reason);
         Notify2(LOG_CONNECTIONS,"User '%s' authentication request overrides an existing logged in user.\n",
-            (const char *)msg.sUser);
+            (const char *)request.user);
 
         // No delete necessary because AddToCache will auto-delete
         // delete acctinfo;
     }
 
 
-    if(csGetTicks() - start > 500)
+    if(csGetTicks() - request.start > 500)
     {
         csString status;
         status.Format("Warning: Spent %u time authenticating account ID %u, After password check", 
-            csGetTicks() - start, acctinfo->accountid);
+            csGetTicks() - request.start, acctinfo->accountid);
         psserver->GetLogCSV()->Write(CSV_STATUS, status);
     }
 
 
-    Client *client = clients->FindAny(me->clientnum);
+    Client *client = clients->FindAny(request.clientnum);
     if (!client)
     {
-        Bug2("Couldn't find client %d?!?",me->clientnum);
+        Bug2("Couldn't find client %d?!?",request.clientnum);
         // No delete necessary because AddToCache will auto-delete
         // delete acctinfo;
         return;
     }
 
-    client->SetName(msg.sUser);
+    client->SetName(request.user);
     client->SetAccountID( acctinfo->accountid );
+    client->SetCompression(request.compression);
     
 
     // Check to see if the client is banned
@@ -346,20 +448,20 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
                           timeinfo->tm_min,
                           ban->reason.GetData() );
     
-            psserver->RemovePlayer(me->clientnum, banmsg);
+            psserver->RemovePlayer(request.clientnum, banmsg);
     
-            Notify2(LOG_CONNECTIONS,"User '%s' authentication request rejected (Banned).",(const char *)msg.sUser);
+            Notify2(LOG_CONNECTIONS,"User '%s' authentication request rejected (Banned).",(const char *)request.user);
             // No delete necessary because AddToCache will auto-delete
             // delete acctinfo;
             return;
         }
     }
 
-    if(csGetTicks() - start > 500)
+    if(csGetTicks() - request.start > 500)
     {
         csString status;
         status.Format("Warning: Spent %u time authenticating account ID %u, After ban check", 
-            csGetTicks() - start, acctinfo->accountid);
+            csGetTicks() - request.start, acctinfo->accountid);
         psserver->GetLogCSV()->Write(CSV_STATUS, status);
     }
 
@@ -370,8 +472,8 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
 
     if (!charlist)
     {
-        Error2("Could not load Character List for account! Rejecting client %s!\n",(const char *)msg.sUser);
-        psserver->RemovePlayer( me->clientnum, "Could not load the list of characters for your account.  Please contact a PS Admin for help.");
+        Error2("Could not load Character List for account! Rejecting client %s!\n",(const char *)request.user);
+        psserver->RemovePlayer( request.clientnum, "Could not load the list of characters for your account.  Please contact a PS Admin for help.");
         delete acctinfo;
         return;
     }
@@ -389,9 +491,9 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
     if (psserver->IsFull(clients->Count(),client)) 
     {
         // invalid
-        psserver->RemovePlayer(me->clientnum, "The server is full right now.  Please try again in a few minutes.");
+        psserver->RemovePlayer(request.clientnum, "The server is full right now.  Please try again in a few minutes.");
 
-        Notify2(LOG_CONNECTIONS, "User '%s' authentication request rejected: Too many connections.\n", (const char *)msg.sUser );
+        Notify2(LOG_CONNECTIONS, "User '%s' authentication request rejected: Too many connections.\n", (const char *)request.user );
         // No delete necessary because AddToCache will auto-delete
         // delete acctinfo;
         status = "User limit hit!";
@@ -399,7 +501,7 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
         return;
     }
 
-    Notify3(LOG_CONNECTIONS,"User '%s' (%d) added to active client list\n",(const char*) msg.sUser, me->clientnum);
+    Notify3(LOG_CONNECTIONS,"User '%s' (%d) added to active client list\n",(const char*) request.user, request.clientnum);
 
     // Get the struct to refresh
     // Update last login ip and time
@@ -418,9 +520,9 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
         gmtm->tm_sec);
 
     acctinfo->lastlogintime = timeStr;
-    acctinfo->os = msg.os_;
-    acctinfo->gfxcard = msg.gfxcard_;
-    acctinfo->gfxversion = msg.gfxversion_;
+    acctinfo->os = request.os;
+    acctinfo->gfxcard = request.gfxcard;
+    acctinfo->gfxversion = request.gfxversion;
     CacheManager::GetSingleton().UpdateAccountInfo(acctinfo);
 
     iCachedObject *obj = CacheManager::GetSingleton().RemoveFromCache(CacheManager::GetSingleton().MakeCacheName("auth",acctinfo->accountid));
@@ -429,13 +531,13 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
     if (!obj)
     {
         // Send approval message
-        psAuthApprovedMessage *message = new psAuthApprovedMessage(me->clientnum,client->GetPID(), charlist->GetValidCount() );    
+        psAuthApprovedMessage *message = new psAuthApprovedMessage(request.clientnum,client->GetPID(), charlist->GetValidCount() );    
 
-        if(csGetTicks() - start > 500)
+        if(csGetTicks() - request.start > 500)
         {
             csString status;
             status.Format("Warning: Spent %u time authenticating account ID %u, After approval", 
-                csGetTicks() - start, acctinfo->accountid);
+                csGetTicks() - request.start, acctinfo->accountid);
             psserver->GetLogCSV()->Write(CSV_STATUS, status);
         }
 
@@ -452,7 +554,7 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
                     continue;
                 }
 
-                Notify3(LOG_CHARACTER, "Sending %s to client %d\n", character->name.GetData(), me->clientnum );
+                Notify3(LOG_CHARACTER, "Sending %s to client %d\n", character->name.GetData(), request.clientnum );
                 character->AppendCharacterSelectData(*message);
 
                 delete character;
@@ -466,13 +568,13 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
         // recover underlying object
         cam = (CachedAuthMessage *)obj->RecoverObject();
         // update client id since new connection here
-        cam->msg->msg->clientnum = me->clientnum;
+        cam->msg->msg->clientnum = request.clientnum;
     }
     // Send auth approved and char list in one message now
     cam->msg->SendMessage();
     CacheManager::GetSingleton().AddToCache(cam, CacheManager::GetSingleton().MakeCacheName("auth",acctinfo->accountid), 10);
 
-    SendMsgStrings(me->clientnum, true); 
+    SendMsgStrings(request.clientnum, true); 
     
     client->SetSpamPoints(acctinfo->spamPoints);
     client->SetAdvisorPoints(acctinfo->advisorPoints);
@@ -480,7 +582,7 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
 
     if (acctinfo->securitylevel >= GM_TESTER)
     {
-        psserver->GetAdminManager()->Admin(me->clientnum, client);
+        psserver->GetAdminManager()->Admin(request.clientnum, client);
     }
     
     if (CacheManager::GetSingletonPtr()->GetCommandManager()->Validate(client->GetSecurityLevel(), "default advisor"))
@@ -489,17 +591,17 @@ void AuthenticationServer::HandleAuthent(MsgEntry *me, Client *notused)
     if (CacheManager::GetSingletonPtr()->GetCommandManager()->Validate(client->GetSecurityLevel(), "default buddylisthide"))
         client->SetBuddyListHide(true);
 
-    psserver->GetWeatherManager()->SendClientGameTime(me->clientnum);
+    psserver->GetWeatherManager()->SendClientGameTime(request.clientnum);
 
-    if(csGetTicks() - start > 500)
+    if(csGetTicks() - request.start > 500)
     {
         csString status;
         status.Format("Warning: Spent %u time authenticating account ID %u, After load", 
-            csGetTicks() - start, acctinfo->accountid);
+            csGetTicks() - request.start, acctinfo->accountid);
         psserver->GetLogCSV()->Write(CSV_STATUS, status);
     }
 
-    status.Format("%s - %s, %u, Logged in", addr, (const char*) msg.sUser, me->clientnum);
+    status.Format("%s - %s, %u, Logged in", addr, (const char*) request.user, request.clientnum);
     psserver->GetLogCSV()->Write(CSV_AUTHENT, status);
 }
 
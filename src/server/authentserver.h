@@ -35,6 +35,8 @@ class ClientConnectionSet;
 class UserManager;
 class GuildManager;
 class Client;
+class psAccountInfo;
+class psCharacterList;
 
 struct BanEntry
 {
@@ -164,7 +166,8 @@ protected:
      * HandleMessage() method. uses the following steps to atuthenticate a
      * client. Sends a psAuthMessageApproved message back to the client if it
      * was successfully authenticated and adds the client to the current
-     * client list.
+     * client list. An account that is not cached is read on the async
+     * query pool and the rest is done by Authenticate().
      *
      * @param me: Is a message entry that contains the authenticate message.
      * @see psAuthMessageApproved 
@@ -192,6 +195,37 @@ protected:
      *  Can remove the player using psServer::RemovePlayer if invalid.
      */
     void HandleAuthCharacter(MsgEntry* me, Client *notused);    
+
+    /// What is kept of an authenticate message while its account is read.
+    struct AuthRequest
+    {
+        uint32_t clientnum;
+        csString user;
+        csString password;
+        csString os;
+        csString gfxcard;
+        csString gfxversion;
+        bool compression;
+        csTicks start;
+    };
+
+    /** Checks the password and bans and logs the client in.
+     * Called by HandleAuthent() when the account is cached, else when the
+     * account has been read from the database.
+     *
+     * @param request: The authenticate message.
+     * @param acctinfo: The account, NULL if there is none of that name.
+     */
+    void Authenticate(const AuthRequest& request, psAccountInfo* acctinfo);
+
+    /** Approves the character named 'name' if it is in the account's list.
+     * Called by HandleAuthCharacter() when the list is cached, else when it
+     * has been read from the database. The list is cached afterwards.
+     */
+    void PickCharacter(Client* client, const csString& name, psCharacterList* charlist);
+
+    friend class psAccountLoadEvent;
+    friend class psCharacterListEvent;
 };
 
 #endif
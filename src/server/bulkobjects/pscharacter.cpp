@@ -798,6 +798,7 @@ void psCharacter::SetLastLoginTime(const char *last_login, bool save )
     if ( save )
     {
         //Store in database
+        db->FlushDelayed("characters", pid.Unbox());
         if (!db->CommandPump("UPDATE characters SET last_login='%s' WHERE id='%d'", timeStr.GetData(), pid.Unbox()))
         {
              Error2( "Last login storage: DB Error: %s\n", db->GetLastError() );
@@ -1010,6 +1011,7 @@ void psCharacter::UpdateRespawn(csVector3 pos, float yrot, psSectorInfo *sector,
     st_location & l = spawn_loc;
     psString sql;
 
+    db->FlushDelayed("characters", pid.Unbox());
     sql.AppendFmt("update characters set loc_x=%10.2f, loc_y=%10.2f, loc_z=%10.2f, loc_yrot=%10.2f, loc_sector_id=%u, loc_instance=%u where id=%u",
                      l.loc.x, l.loc.y, l.loc.z, l.loc_yrot, l.loc_sector->uid, l.worldInstance, pid.Unbox());
     if (db->CommandPump(sql) != 1)
@@ -1148,6 +1150,7 @@ void psCharacter::SetProgressionPoints(unsigned int X,bool save)
         Debug3(LOG_SKILLXP, pid.Unbox(), "Updating PP points and Exp to %u and %u\n", X, exp);
         // Update the DB
         csString sql;
+        db->FlushDelayed("characters", pid.Unbox());
         sql.Format("UPDATE characters SET progression_points = '%u', experience_points = '%u' WHERE id ='%u'", X, exp, pid.Unbox());
         if(!db->CommandPump(sql))
         {
@@ -1520,6 +1523,7 @@ void psCharacter::SaveMoney(bool bank)
                       money.GetCircles(), money.GetTrias(), money.GetHexas(), money.GetOctas(), pid.Unbox());
     }
 
+    db->FlushDelayed("characters", pid.Unbox());
     if (db->CommandPump(sql) != 1)
     {
         Error3 ("Couldn't save character's money to database.\nCommand was "
@@ -1544,14 +1548,18 @@ void psCharacter::CombatDrain(int slot)
     if(weapon)//shouldn't happen
         return;
 
+    static const size_t varActor    = MathEnvironment::GetSlot("Actor");
+    static const size_t varWeapon   = MathEnvironment::GetSlot("Weapon");
+    static const size_t varPhyDrain = MathEnvironment::GetSlot("PhyDrain");
+    static const size_t varMntDrain = MathEnvironment::GetSlot("MntDrain");
     MathEnvironment env;
-    env.Define("Actor", this);
-    env.Define("Weapon", weapon);
+    env.DefineSlot(varActor, this);
+    env.DefineSlot(varWeapon, weapon);
 
     script->Evaluate(&env);
 
-    MathVar *phyDrain = env.Lookup("PhyDrain");
-    MathVar *mntDrain = env.Lookup("MntDrain");
+    MathVar *phyDrain = env.LookupSlot(varPhyDrain);
+    MathVar *mntDrain = env.LookupSlot(varMntDrain);
     if (!phyDrain || !mntDrain)
     {
         Error1("Failed to evaluate MathScript >StaminaCombat<.");
@@ -1669,15 +1677,20 @@ void psCharacter::SetStaminaRegenerationNone(bool physical,bool mental)
 
 void psCharacter::SetStaminaRegenerationWalk(bool physical,bool mental)
 {
+    static const size_t varActor             = MathEnvironment::GetSlot("Actor");
+    static const size_t varBaseRegenPhysical = MathEnvironment::GetSlot("BaseRegenPhysical");
+    static const size_t varBaseRegenMental   = MathEnvironment::GetSlot("BaseRegenMental");
+    static const size_t varPStaminaRate      = MathEnvironment::GetSlot("PStaminaRate");
+    static const size_t varMStaminaRate      = MathEnvironment::GetSlot("MStaminaRate");
     MathEnvironment env;
-    env.Define("Actor", this);
-    env.Define("BaseRegenPhysical", GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_PHYSICAL_WALK]);
-    env.Define("BaseRegenMental",   GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_MENTAL_WALK]);
+    env.DefineSlot(varActor, this);
+    env.DefineSlot(varBaseRegenPhysical, GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_PHYSICAL_WALK]);
+    env.DefineSlot(varBaseRegenMental,   GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_MENTAL_WALK]);
     
     staminaRatioWalk->Evaluate(&env);
     
-    MathVar *ratePhy = env.Lookup("PStaminaRate");
-    MathVar *rateMen = env.Lookup("MStaminaRate");
+    MathVar *ratePhy = env.LookupSlot(varPStaminaRate);
+    MathVar *rateMen = env.LookupSlot(varMStaminaRate);
     
     if(physical && ratePhy) GetPStaminaRate().SetBase(ratePhy->GetValue());
     if(mental   && rateMen) GetMStaminaRate().SetBase(rateMen->GetValue());
@@ -1688,15 +1701,20 @@ void psCharacter::SetStaminaRegenerationWalk(bool physical,bool mental)
 
 void psCharacter::SetStaminaRegenerationSitting()
 {
+    static const size_t varActor             = MathEnvironment::GetSlot("Actor");
+    static const size_t varBaseRegenPhysical = MathEnvironment::GetSlot("BaseRegenPhysical");
+    static const size_t varBaseRegenMental   = MathEnvironment::GetSlot("BaseRegenMental");
+    static const size_t varPStaminaRate      = MathEnvironment::GetSlot("PStaminaRate");
+    static const size_t varMStaminaRate      = MathEnvironment::GetSlot("MStaminaRate");
     MathEnvironment env;
-    env.Define("Actor", this);
-    env.Define("BaseRegenPhysical", GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_PHYSICAL_STILL]);
-    env.Define("BaseRegenMental",   GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_MENTAL_STILL]);
+    env.DefineSlot(varActor, this);
+    env.DefineSlot(varBaseRegenPhysical, GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_PHYSICAL_STILL]);
+    env.DefineSlot(varBaseRegenMental,   GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_MENTAL_STILL]);
     
     staminaRatioSit->Evaluate(&env);
     
-    MathVar *ratePhy = env.Lookup("PStaminaRate");
-    MathVar *rateMen = env.Lookup("MStaminaRate");
+    MathVar *ratePhy = env.LookupSlot(varPStaminaRate);
+    MathVar *rateMen = env.LookupSlot(varMStaminaRate);
     
     if(ratePhy) GetPStaminaRate().SetBase(ratePhy->GetValue());
     if(rateMen) GetMStaminaRate().SetBase(rateMen->GetValue());
@@ -1708,15 +1726,20 @@ void psCharacter::SetStaminaRegenerationSitting()
 void psCharacter::SetStaminaRegenerationStill(bool physical,bool mental)
 {
     
+    static const size_t varActor             = MathEnvironment::GetSlot("Actor");
+    static const size_t varBaseRegenPhysical = MathEnvironment::GetSlot("BaseRegenPhysical");
+    static const size_t varBaseRegenMental   = MathEnvironment::GetSlot("BaseRegenMental");
+    static const size_t varPStaminaRate      = MathEnvironment::GetSlot("PStaminaRate");
+    static const size_t varMStaminaRate      = MathEnvironment::GetSlot("MStaminaRate");
     MathEnvironment env;
-    env.Define("Actor", this);
-    env.Define("BaseRegenPhysical", GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_PHYSICAL_STILL]);
-    env.Define("BaseRegenMental",   GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_MENTAL_STILL]);
+    env.DefineSlot(varActor, this);
+    env.DefineSlot(varBaseRegenPhysical, GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_PHYSICAL_STILL]);
+    env.DefineSlot(varBaseRegenMental,   GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_MENTAL_STILL]);
     
     staminaRatioStill->Evaluate(&env);
     
-    MathVar *ratePhy = env.Lookup("PStaminaRate");
-    MathVar *rateMen = env.Lookup("MStaminaRate");
+    MathVar *ratePhy = env.LookupSlot(varPStaminaRate);
+    MathVar *rateMen = env.LookupSlot(varMStaminaRate);
     
     if(physical && ratePhy) GetPStaminaRate().SetBase(ratePhy->GetValue());
     if(mental   && rateMen) GetMStaminaRate().SetBase(rateMen->GetValue());
@@ -1731,10 +1754,16 @@ void psCharacter::SetStaminaRegenerationWork(int skill)
     if (actor->nevertired)
         return;
 
+    static const size_t varActor             = MathEnvironment::GetSlot("Actor");
+    static const size_t varBaseRegenPhysical = MathEnvironment::GetSlot("BaseRegenPhysical");
+    static const size_t varBaseRegenMental   = MathEnvironment::GetSlot("BaseRegenMental");
+    static const size_t varSkillMentalFactor = MathEnvironment::GetSlot("SkillMentalFactor");
+    static const size_t varPStaminaRate      = MathEnvironment::GetSlot("PStaminaRate");
+    static const size_t varMStaminaRate      = MathEnvironment::GetSlot("MStaminaRate");
     MathEnvironment env;
-    env.Define("Actor", this);
-    env.Define("BaseRegenPhysical", GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_PHYSICAL_STILL]);
-    env.Define("BaseRegenMental",   GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_MENTAL_STILL]);
+    env.DefineSlot(varActor, this);
+    env.DefineSlot(varBaseRegenPhysical, GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_PHYSICAL_STILL]);
+    env.DefineSlot(varBaseRegenMental,   GetRaceInfo()->baseRegen[PSRACEINFO_STAMINA_MENTAL_STILL]);
     
     // Need real formula for this. Shouldn't be hard coded anyway.
     // Stamina drain needs to be set depending on the complexity of the task.
@@ -1742,12 +1771,12 @@ void psCharacter::SetStaminaRegenerationWork(int skill)
     //if skill is none (-1) we set zero here
     int factor = skillInfo? skillInfo->mental_factor : 100;
 
-    env.Define("SkillMentalFactor",  factor);
+    env.DefineSlot(varSkillMentalFactor,  factor);
     
     staminaRatioWork->Evaluate(&env);
     
-    MathVar *ratePhy = env.Lookup("PStaminaRate");
-    MathVar *rateMen = env.Lookup("MStaminaRate");
+    MathVar *ratePhy = env.LookupSlot(varPStaminaRate);
+    MathVar *rateMen = env.LookupSlot(varMStaminaRate);
     
     if(ratePhy) GetPStaminaRate().SetBase(ratePhy->GetValue());
     if(rateMen) GetMStaminaRate().SetBase(rateMen->GetValue());
@@ -1758,20 +1787,28 @@ void psCharacter::SetStaminaRegenerationWork(int skill)
 
 void psCharacter::CalculateMaxStamina()
 {
+    static const size_t varSTR     = MathEnvironment::GetSlot("STR");
+    static const size_t varEND     = MathEnvironment::GetSlot("END");
+    static const size_t varAGI     = MathEnvironment::GetSlot("AGI");
+    static const size_t varINT     = MathEnvironment::GetSlot("INT");
+    static const size_t varWILL    = MathEnvironment::GetSlot("WILL");
+    static const size_t varCHA     = MathEnvironment::GetSlot("CHA");
+    static const size_t varBasePhy = MathEnvironment::GetSlot("BasePhy");
+    static const size_t varBaseMen = MathEnvironment::GetSlot("BaseMen");
     MathEnvironment env;
     // Set all the skills vars
-    env.Define("STR",  attributes[PSITEMSTATS_STAT_STRENGTH].Current());
-    env.Define("END",  attributes[PSITEMSTATS_STAT_ENDURANCE].Current());
-    env.Define("AGI",  attributes[PSITEMSTATS_STAT_AGILITY].Current());
-    env.Define("INT",  attributes[PSITEMSTATS_STAT_INTELLIGENCE].Current());
-    env.Define("WILL", attributes[PSITEMSTATS_STAT_WILL].Current());
-    env.Define("CHA",  attributes[PSITEMSTATS_STAT_CHARISMA].Current());
+    env.DefineSlot(varSTR,  attributes[PSITEMSTATS_STAT_STRENGTH].Current());
+    env.DefineSlot(varEND,  attributes[PSITEMSTATS_STAT_ENDURANCE].Current());
+    env.DefineSlot(varAGI,  attributes[PSITEMSTATS_STAT_AGILITY].Current());
+    env.DefineSlot(varINT,  attributes[PSITEMSTATS_STAT_INTELLIGENCE].Current());
+    env.DefineSlot(varWILL, attributes[PSITEMSTATS_STAT_WILL].Current());
+    env.DefineSlot(varCHA,  attributes[PSITEMSTATS_STAT_CHARISMA].Current());
 
     // Calculate
     staminaCalc->Evaluate(&env);
 
-    MathVar *basePhy = env.Lookup("BasePhy");
-    MathVar *baseMen = env.Lookup("BaseMen");
+    MathVar *basePhy = env.LookupSlot(varBasePhy);
+    MathVar *baseMen = env.LookupSlot(varBaseMen);
     if (!basePhy || !baseMen)
     {
         Error1("Failed to evaluate MathScript >StaminaBase<.");
@@ -2046,6 +2083,7 @@ void psCharacter::SaveLocationInWorld()
     st_location & l = location;
     psString sql;
 
+    db->FlushDelayed("characters", pid.Unbox());
     sql.AppendFmt("update characters set loc_x=%10.2f, loc_y=%10.2f, loc_z=%10.2f, loc_yrot=%10.2f, loc_sector_id=%u, loc_instance=%u where id=%u",
                      l.loc.x, l.loc.y, l.loc.z, l.loc_yrot, l.loc_sector->uid, l.worldInstance, pid.Unbox());
     if (db->CommandPump(sql) != 1)
@@ -2812,167 +2850,193 @@ bool psCharacter::HasExploredArea(PID explored)
     return false;
 }
 
+/// Numbers of the properties psCharacter::GetPropertyByID() switches on
+enum
+{
+    CHARPROP_ATTACKERTARGETED,
+    CHARPROP_TOTALTARGETEDBLOCKVALUE,
+    CHARPROP_TOTALUNTARGETEDBLOCKVALUE,
+    CHARPROP_DODGEVALUE,
+    CHARPROP_KILLEXP,
+    CHARPROP_GETATTACKVALUEMODIFIER,
+    CHARPROP_GETDEFENSEVALUEMODIFIER,
+    CHARPROP_HP,
+    CHARPROP_MAXHP,
+    CHARPROP_BASEHP,
+    CHARPROP_MANA,
+    CHARPROP_MAXMANA,
+    CHARPROP_BASEMANA,
+    CHARPROP_PSTAMINA,
+    CHARPROP_MSTAMINA,
+    CHARPROP_MAXPSTAMINA,
+    CHARPROP_MAXMSTAMINA,
+    CHARPROP_BASEPSTAMINA,
+    CHARPROP_BASEMSTAMINA,
+    CHARPROP_STRENGTH,
+    CHARPROP_AGILITY,
+    CHARPROP_ENDURANCE,
+    CHARPROP_INTELLIGENCE,
+    CHARPROP_WILL,
+    CHARPROP_CHARISMA,
+    CHARPROP_BASESTRENGTH,
+    CHARPROP_BASEAGILITY,
+    CHARPROP_BASEENDURANCE,
+    CHARPROP_BASEINTELLIGENCE,
+    CHARPROP_BASEWILL,
+    CHARPROP_BASECHARISMA,
+    CHARPROP_ALLARMORSTRMALUS,
+    CHARPROP_ALLARMORAGIMALUS,
+    CHARPROP_PID,
+    CHARPROP_LOC_X,
+    CHARPROP_LOC_Y,
+    CHARPROP_LOC_Z,
+    CHARPROP_SECTOR,
+    CHARPROP_OWNER
+};
+
+static PropertyTable BuildCharacterProperties()
+{
+    PropertyTable table;
+    table.Add("AttackerTargeted", CHARPROP_ATTACKERTARGETED);
+    table.Add("TotalTargetedBlockValue", CHARPROP_TOTALTARGETEDBLOCKVALUE);
+    table.Add("TotalUntargetedBlockValue", CHARPROP_TOTALUNTARGETEDBLOCKVALUE);
+    table.Add("DodgeValue", CHARPROP_DODGEVALUE);
+    table.Add("KillExp", CHARPROP_KILLEXP);
+    table.Add("getAttackValueModifier", CHARPROP_GETATTACKVALUEMODIFIER);
+    table.Add("getDefenseValueModifier", CHARPROP_GETDEFENSEVALUEMODIFIER);
+    table.Add("HP", CHARPROP_HP);
+    table.Add("MaxHP", CHARPROP_MAXHP);
+    table.Add("BaseHP", CHARPROP_BASEHP);
+    table.Add("Mana", CHARPROP_MANA);
+    table.Add("MaxMana", CHARPROP_MAXMANA);
+    table.Add("BaseMana", CHARPROP_BASEMANA);
+    table.Add("PStamina", CHARPROP_PSTAMINA);
+    table.Add("MStamina", CHARPROP_MSTAMINA);
+    table.Add("MaxPStamina", CHARPROP_MAXPSTAMINA);
+    table.Add("MaxMStamina", CHARPROP_MAXMSTAMINA);
+    table.Add("BasePStamina", CHARPROP_BASEPSTAMINA);
+    table.Add("BaseMStamina", CHARPROP_BASEMSTAMINA);
+    table.Add("Strength", CHARPROP_STRENGTH);
+    table.Add("Agility", CHARPROP_AGILITY);
+    table.Add("Endurance", CHARPROP_ENDURANCE);
+    table.Add("Intelligence", CHARPROP_INTELLIGENCE);
+    table.Add("Will", CHARPROP_WILL);
+    table.Add("Charisma", CHARPROP_CHARISMA);
+    table.Add("BaseStrength", CHARPROP_BASESTRENGTH);
+    table.Add("BaseAgility", CHARPROP_BASEAGILITY);
+    table.Add("BaseEndurance", CHARPROP_BASEENDURANCE);
+    table.Add("BaseIntelligence", CHARPROP_BASEINTELLIGENCE);
+    table.Add("BaseWill", CHARPROP_BASEWILL);
+    table.Add("BaseCharisma", CHARPROP_BASECHARISMA);
+    table.Add("AllArmorStrMalus", CHARPROP_ALLARMORSTRMALUS);
+    table.Add("AllArmorAgiMalus", CHARPROP_ALLARMORAGIMALUS);
+    table.Add("PID", CHARPROP_PID);
+    table.Add("loc_x", CHARPROP_LOC_X);
+    table.Add("loc_y", CHARPROP_LOC_Y);
+    table.Add("loc_z", CHARPROP_LOC_Z);
+    table.Add("sector", CHARPROP_SECTOR);
+    table.Add("owner", CHARPROP_OWNER);
+    return table;
+}
+
+static const PropertyTable characterProperties = BuildCharacterProperties();
+
 double psCharacter::GetProperty(const char *ptr)
 {
-    if (!strcasecmp(ptr,"AttackerTargeted"))
-    {
-        return true;
-        // return (attacker_targeted) ? 1 : 0;
-    }
-    else if (!strcasecmp(ptr,"TotalTargetedBlockValue"))
-    {
-        return GetTotalTargetedBlockValue();
-    }
-    else if (!strcasecmp(ptr,"TotalUntargetedBlockValue"))
-    {
-        return GetTotalUntargetedBlockValue();
-    }
-    else if (!strcasecmp(ptr,"DodgeValue"))
-    {
-        return GetDodgeValue();
-    }
-    else if (!strcasecmp(ptr,"KillExp"))
-    {
-        return kill_exp;
-    }
-    else if (!strcasecmp(ptr,"getAttackValueModifier"))
-    {
-        return attackModifier.Value();
-    }
-    else if (!strcasecmp(ptr,"getDefenseValueModifier"))
-    {
-        return defenseModifier.Value();
-    }
-    else if (!strcasecmp(ptr,"HP"))
-    {
-        return GetHP();
-    }
-    else if (!strcasecmp(ptr,"MaxHP"))
-    {
-        return GetMaxHP().Current();
-    }
-    else if (!strcasecmp(ptr,"BaseHP"))
-    {
-        return GetMaxHP().Base();
-    }
-    else if (!strcasecmp(ptr,"Mana"))
-    {
-        return GetMana();
-    }
-    else if (!strcasecmp(ptr,"MaxMana"))
-    {
-        return GetMaxMana().Current();
-    }
-    else if (!strcasecmp(ptr,"BaseMana"))
-    {
-        return GetMaxMana().Base();
-    }
-    else if (!strcasecmp(ptr,"PStamina"))
-    {
-        return GetStamina(true);
-    }
-    else if (!strcasecmp(ptr,"MStamina"))
-    {
-        return GetStamina(false);
-    }
-    else if (!strcasecmp(ptr,"MaxPStamina"))
-    {
-        return GetMaxPStamina().Current();
-    }
-    else if (!strcasecmp(ptr,"MaxMStamina"))
-    {
-        return GetMaxMStamina().Current();
-    }
-    else if (!strcasecmp(ptr,"BasePStamina"))
-    {
-        return GetMaxPStamina().Base();
-    }
-    else if (!strcasecmp(ptr,"BaseMStamina"))
-    {
-        return GetMaxMStamina().Base();
-    }
-    else if (!strcasecmp(ptr,"Strength"))
-    {
-        return attributes[PSITEMSTATS_STAT_STRENGTH].Current();
-    }
-    else if (!strcasecmp(ptr,"Agility"))
-    {
-        return attributes[PSITEMSTATS_STAT_AGILITY].Current();
-    }
-    else if (!strcasecmp(ptr,"Endurance"))
-    {
-        return attributes[PSITEMSTATS_STAT_ENDURANCE].Current();
-    }
-    else if (!strcasecmp(ptr,"Intelligence"))
-    {
-        return attributes[PSITEMSTATS_STAT_INTELLIGENCE].Current();
-    }
-    else if (!strcasecmp(ptr,"Will"))
-    {
-        return attributes[PSITEMSTATS_STAT_WILL].Current();
-    }
-    else if (!strcasecmp(ptr,"Charisma"))
-    {
-        return attributes[PSITEMSTATS_STAT_CHARISMA].Current();
-    }
-    else if (!strcasecmp(ptr,"BaseStrength"))
-    {
-        return attributes[PSITEMSTATS_STAT_STRENGTH].Base();
-    }
-    else if (!strcasecmp(ptr,"BaseAgility"))
-    {
-        return attributes[PSITEMSTATS_STAT_AGILITY].Base();
-    }
-    else if (!strcasecmp(ptr,"BaseEndurance"))
-    {
-        return attributes[PSITEMSTATS_STAT_ENDURANCE].Base();
-    }
-    else if (!strcasecmp(ptr,"BaseIntelligence"))
-    {
-        return attributes[PSITEMSTATS_STAT_INTELLIGENCE].Base();
-    }
-    else if (!strcasecmp(ptr,"BaseWill"))
+    PropertyID id = PropertyNames::Find(ptr);
+    if (id == PROPERTY_UNKNOWN)
     {
-        return attributes[PSITEMSTATS_STAT_WILL].Base();
-    }
-    else if (!strcasecmp(ptr,"BaseCharisma"))
-    {
-        return attributes[PSITEMSTATS_STAT_CHARISMA].Base();
-    }
-    else if (!strcasecmp(ptr,"AllArmorStrMalus"))
-    {
-        return modifiers[PSITEMSTATS_STAT_STRENGTH].Current();
-    }
-    else if (!strcasecmp(ptr,"AllArmorAgiMalus"))
-    {
-        return modifiers[PSITEMSTATS_STAT_AGILITY].Current();
-    }
-    else if (!strcasecmp(ptr,"PID"))
-    {
-        return (double) pid.Unbox();
-    }
-    else if (!strcasecmp(ptr,"loc_x"))
-    {
-        return location.loc.x;
-    }
-    else if (!strcasecmp(ptr,"loc_y"))
-    {
-        return location.loc.y;
-    }
-    else if (!strcasecmp(ptr,"loc_z"))
-    {
-        return location.loc.z;
-    }
-    else if (!strcasecmp(ptr,"sector"))
-    {
-        return location.loc_sector->uid;
-    }
-    else if (!strcasecmp(ptr,"owner"))
-    {
-        return (double) owner_id.Unbox();
+        Error2("Requested psCharacter property not found '%s'", ptr);
+        return 0;
     }
-
-    Error2("Requested psCharacter property not found '%s'", ptr);
+    return GetPropertyByID(id);
+}
+
+double psCharacter::GetPropertyByID(PropertyID id)
+{
+    switch (characterProperties.Get(id))
+    {
+        case CHARPROP_ATTACKERTARGETED:
+            return true; // return (attacker_targeted) ? 1 : 0;
+        case CHARPROP_TOTALTARGETEDBLOCKVALUE:
+            return GetTotalTargetedBlockValue();
+        case CHARPROP_TOTALUNTARGETEDBLOCKVALUE:
+            return GetTotalUntargetedBlockValue();
+        case CHARPROP_DODGEVALUE:
+            return GetDodgeValue();
+        case CHARPROP_KILLEXP:
+            return kill_exp;
+        case CHARPROP_GETATTACKVALUEMODIFIER:
+            return attackModifier.Value();
+        case CHARPROP_GETDEFENSEVALUEMODIFIER:
+            return defenseModifier.Value();
+        case CHARPROP_HP:
+            return GetHP();
+        case CHARPROP_MAXHP:
+            return GetMaxHP().Current();
+        case CHARPROP_BASEHP:
+            return GetMaxHP().Base();
+        case CHARPROP_MANA:
+            return GetMana();
+        case CHARPROP_MAXMANA:
+            return GetMaxMana().Current();
+        case CHARPROP_BASEMANA:
+            return GetMaxMana().Base();
+        case CHARPROP_PSTAMINA:
+            return GetStamina(true);
+        case CHARPROP_MSTAMINA:
+            return GetStamina(false);
+        case CHARPROP_MAXPSTAMINA:
+            return GetMaxPStamina().Current();
+        case CHARPROP_MAXMSTAMINA:
+            return GetMaxMStamina().Current();
+        case CHARPROP_BASEPSTAMINA:
+            return GetMaxPStamina().Base();
+        case CHARPROP_BASEMSTAMINA:
+            return GetMaxMStamina().Base();
+        case CHARPROP_STRENGTH:
+            return attributes[PSITEMSTATS_STAT_STRENGTH].Current();
+        case CHARPROP_AGILITY:
+            return attributes[PSITEMSTATS_STAT_AGILITY].Current();
+        case CHARPROP_ENDURANCE:
+            return attributes[PSITEMSTATS_STAT_ENDURANCE].Current();
+        case CHARPROP_INTELLIGENCE:
+            return attributes[PSITEMSTATS_STAT_INTELLIGENCE].Current();
+        case CHARPROP_WILL:
+            return attributes[PSITEMSTATS_STAT_WILL].Current();
+        case CHARPROP_CHARISMA:
+            return attributes[PSITEMSTATS_STAT_CHARISMA].Current();
+        case CHARPROP_BASESTRENGTH:
+            return attributes[PSITEMSTATS_STAT_STRENGTH].Base();
+        case CHARPROP_BASEAGILITY:
+            return attributes[PSITEMSTATS_STAT_AGILITY].Base();
+        case CHARPROP_BASEENDURANCE:
+            return attributes[PSITEMSTATS_STAT_ENDURANCE].Base();
+        case CHARPROP_BASEINTELLIGENCE:
+            return attributes[PSITEMSTATS_STAT_INTELLIGENCE].Base();
+        case CHARPROP_BASEWILL:
+            return attributes[PSITEMSTATS_STAT_WILL].Base();
+        case CHARPROP_BASECHARISMA:
+            return attributes[PSITEMSTATS_STAT_CHARISMA].Base();
+        case CHARPROP_ALLARMORSTRMALUS:
+            return modifiers[PSITEMSTATS_STAT_STRENGTH].Current();
+        case CHARPROP_ALLARMORAGIMALUS:
+            return modifiers[PSITEMSTATS_STAT_AGILITY].Current();
+        case CHARPROP_PID:
+            return (double) pid.Unbox();
+        case CHARPROP_LOC_X:
+            return location.loc.x;
+        case CHARPROP_LOC_Y:
+            return location.loc.y;
+        case CHARPROP_LOC_Z:
+            return location.loc.z;
+        case CHARPROP_SECTOR:
+            return location.loc_sector->uid;
+        case CHARPROP_OWNER:
+            return (double) owner_id.Unbox();
+    }
+
+    Error2("Requested psCharacter property not found '%s'", PropertyNames::GetName(id));
     return 0;
 }
 
@@ -3125,6 +3189,7 @@ void psCharacter::Train( PSSKILL skill, int yIncrease )
 
                 csString id((size_t) pid.Unbox());
 
+                db->FlushDelayed("characters", pid.Unbox());
                 if(!db->GenericUpdateWithID("characters","id",id,fieldnames,fieldvalues))
                 {
                     Error2("Couldn't save stats for character %u!\n", pid.Unbox());
@@ -3298,8 +3363,11 @@ unsigned int psCharacter::GetCharLevel(bool physical)
 //This function recalculates Hp, Mana, and Stamina when needed (char creation, combats, training sessions)
 void psCharacter::RecalculateStats()
 {
+    static const size_t varActor   = MathEnvironment::GetSlot("Actor");
+    static const size_t varMaxMana = MathEnvironment::GetSlot("MaxMana");
+    static const size_t varMaxHP   = MathEnvironment::GetSlot("MaxHP");
     MathEnvironment env; // safe enough to reuse...and faster...
-    env.Define("Actor", this);
+    env.DefineSlot(varActor, this);
 
     // Calculate current Max Mana level:
     static MathScript *maxManaScript;
@@ -3317,7 +3385,7 @@ void psCharacter::RecalculateStats()
     else if (maxManaScript)
     {
         maxManaScript->Evaluate(&env);
-        MathVar* maxMana = env.Lookup("MaxMana");
+        MathVar* maxMana = env.LookupSlot(varMaxMana);
         if (maxMana)
         {
             GetMaxMana().SetBase(maxMana->GetValue());
@@ -3344,7 +3412,7 @@ void psCharacter::RecalculateStats()
     else if (maxHPScript)
     {
         maxHPScript->Evaluate(&env);
-        MathVar* maxHP = env.Lookup("MaxHP");
+        MathVar* maxHP = env.LookupSlot(varMaxHP);
         GetMaxHP().SetBase(maxHP->GetValue());
     }
 
@@ -1074,6 +1074,7 @@ public:
 
     /// This is used by the math scripting engine to get various values.
     double GetProperty(const char *ptr);
+    double GetPropertyByID(PropertyID id);
     double CalcFunction(const char * functionName, const double * params);
     const char* ToString() { return fullname.GetData(); }
 
@@ -78,6 +78,9 @@ bool psCharacterLoader::Initialize()
     return true;
 }
 
+/// The characters of an account, as listed on the charpick screen
+#define CHARACTER_LIST_QUERY "SELECT id,name,lastname FROM characters WHERE account_id=%u ORDER BY id"
+
 bool psCharacterLoader::AccountOwner(const char* characterName, AccountID accountID)
 {
     csString escape;
@@ -89,28 +92,47 @@ bool psCharacterLoader::AccountOwner(const char* characterName, AccountID accoun
 psCharacterList *psCharacterLoader::LoadCharacterList(AccountID accountid)
 {
     // Check the generic cache first
-    iCachedObject *obj = CacheManager::GetSingleton().RemoveFromCache(CacheManager::GetSingleton().MakeCacheName("list",accountid.Unbox()));
-    if (obj)
-    {
-        Notify2(LOG_CACHE,"Returning char object %p from cache.",obj->RecoverObject());
-        return (psCharacterList *)obj->RecoverObject();
-    }
+    psCharacterList *charlist = GetCachedCharacterList(accountid);
+    if (charlist)
+        return charlist;
 
     Notify1(LOG_CACHE,"******LOADING CHARACTER LIST*******");
     // Load if not in cache
-    Result result(db->Select("SELECT id,name,lastname FROM characters WHERE account_id=%u ORDER BY id", accountid.Unbox()));
+    Result result(db->Select(CHARACTER_LIST_QUERY, accountid.Unbox()));
 
     if (!result.IsValid())
         return NULL;
 
+    return ReadCharacterList(result.rs);
+}
+
+psCharacterList *psCharacterLoader::GetCachedCharacterList(AccountID accountid)
+{
+    iCachedObject *obj = CacheManager::GetSingleton().RemoveFromCache(CacheManager::GetSingleton().MakeCacheName("list",accountid.Unbox()));
+    if (!obj)
+        return NULL;
+
+    Notify2(LOG_CACHE,"Returning char object %p from cache.",obj->RecoverObject());
+    return (psCharacterList *)obj->RecoverObject();
+}
+
+void psCharacterLoader::LoadCharacterListAsync(AccountID accountid, iQueryCallback *callback)
+{
+    Notify1(LOG_CACHE,"******LOADING CHARACTER LIST*******");
+    db->SelectAsync(callback, CHARACTER_LIST_QUERY, accountid.Unbox());
+}
+
+psCharacterList *psCharacterLoader::ReadCharacterList(iResultSet *result)
+{
     psCharacterList *charlist = new psCharacterList;
 
-    charlist->SetValidCount( result.Count() );
-    for (unsigned int i=0;i<result.Count();i++)
+    charlist->SetValidCount( result->Count() );
+    for (unsigned int i=0;i<result->Count();i++)
     {
+        iResultRow& row = (*result)[i];
         charlist->SetEntryValid(i,true);
-        charlist->SetCharacterID(i,result[i].GetInt("id"));
-        charlist->SetCharacterFullName(i,result[i]["name"],result[i]["lastname"]);
+        charlist->SetCharacterID(i,row.GetInt("id"));
+        charlist->SetCharacterFullName(i,row["name"],row["lastname"]);
     }
     return charlist;
 }
@@ -192,6 +214,9 @@ psCharacter *psCharacterLoader::LoadCharacterData(PID pid, bool forceReload)
     // Now load from the database if not found in cache
     csTicks start = csGetTicks();
 
+    // The last save of this character may still wait in the write behind queue
+    db->FlushDelayed("characters", pid.Unbox());
+
     Result result(db->Select("SELECT * FROM characters WHERE id=%u", pid.Unbox()));
 
     if (!result.IsValid())
@@ -641,9 +666,9 @@ bool psCharacterLoader::SaveCharacterData(psCharacter *chardata,gemActor *actor,
     static iRecord* updatePlayer;
     static iRecord* updateNpc;
     if(playerORpet && updatePlayer == NULL)
-        updatePlayer = db->NewUpdatePreparedStatement("characters", "id", 42, __FILE__, __LINE__); // 41 fields + 1 id field
+        updatePlayer = db->NewDelayedUpdateStatement("characters", "id", 42, __FILE__, __LINE__); // 41 fields + 1 id field
     if(!playerORpet && updateNpc == NULL)
-        updateNpc = db->NewUpdatePreparedStatement("characters", "id", 35, __FILE__, __LINE__); // 34 fields + 1 id field
+        updateNpc = db->NewDelayedUpdateStatement("characters", "id", 35, __FILE__, __LINE__); // 34 fields + 1 id field
 
     // Give 100% hp if the char is dead
     if(!actor->IsAlive())
@@ -907,7 +932,7 @@ void psSaveCharEvent::DeleteObjectCallback(iDeleteNotificationObject * object)
         this->actor->UnregisterCallback(this);
 
     this->actor = NULL;
-    SetValid(false);
+    CancelEvent();
 }
 
 
@@ -89,6 +89,15 @@ public:
 
     /// Loads the names of characters for a given account for charpick screen on login
     psCharacterList *LoadCharacterList(AccountID accountid);
+
+    /// Takes the character list of an account out of the cache, NULL if it isn't there
+    psCharacterList *GetCachedCharacterList(AccountID accountid);
+
+    /// Reads the character list of an account on the async query pool, see ReadCharacterList()
+    void LoadCharacterListAsync(AccountID accountid, iQueryCallback *callback);
+
+    /// Makes the character list of the rows read by LoadCharacterListAsync()
+    psCharacterList *ReadCharacterList(iResultSet *result);
     
 
     psCharacter **LoadAllNPCCharacterData(psSectorInfo *sector,int &count);
@@ -233,6 +233,23 @@ psItem *psCharacterInventory::GetItemFactory(psItemStats *stats)
 }
 
 
+/**
+ * Write the queued saves of the selected items. Items moved to the
+ * character were written before the select, so a row still queued is one
+ * moving away or changing otherwise. Returns true if any was, then the
+ * rows must be selected again.
+ */
+static bool FlushQueuedItems(Result& items)
+{
+    bool queued = false;
+    for (unsigned long i = 0; i < items.Count(); i++)
+    {
+        if (db->FlushDelayed("item_instances", items[i].GetUInt32("id")))
+            queued = true;
+    }
+    return queued;
+}
+
 bool psCharacterInventory::Load(PID use_id)
 {
     doRestrictions = (owner->GetCharType() == PSCHARACTER_TYPE_PLAYER);
@@ -243,7 +260,13 @@ bool psCharacterInventory::Load(PID use_id)
         doRestrictions = false;
     }
 
+    // Items moved to this character may still wait in the write behind queue
+    db->FlushDelayed("item_instances", "char_id_owner", use_id.Unbox());
+
     Result items(db->Select("SELECT * FROM item_instances WHERE char_id_owner=%u AND location_in_parent!=-1", use_id.Unbox()));
+    if (items.IsValid() && FlushQueuedItems(items))
+        items = db->Select("SELECT * FROM item_instances WHERE char_id_owner=%u AND location_in_parent!=-1", use_id.Unbox());
+
     if ( items.IsValid() )
     {
         for (size_t x = 0; x < items.Count(); x++ )
@@ -300,7 +323,10 @@ bool psCharacterInventory::Load(PID use_id)
 
 bool psCharacterInventory::QuickLoad(PID use_id)
 {
+    db->FlushDelayed("item_instances", "char_id_owner", use_id.Unbox());
     Result items(db->Select("SELECT id, item_stats_id_standard, location_in_parent FROM item_instances WHERE char_id_owner = %u AND location_in_parent > -1 AND location_in_parent < %d AND (parent_item_id IS NULL OR parent_item_id = 0)" , use_id.Unbox(), PSCHARACTER_SLOT_BULK1));
+    if (items.IsValid() && FlushQueuedItems(items))
+        items = db->Select("SELECT id, item_stats_id_standard, location_in_parent FROM item_instances WHERE char_id_owner = %u AND location_in_parent > -1 AND location_in_parent < %d AND (parent_item_id IS NULL OR parent_item_id = 0)" , use_id.Unbox(), PSCHARACTER_SLOT_BULK1);
 
     if ( items.IsValid() )
     {
@@ -306,6 +306,7 @@ bool psGuildInfo::AddNewMember(psCharacter *player, int level)
     }
 
     // Set player's guild
+    db->FlushDelayed("characters", player->GetPID().Unbox());
     if (db->Command("update characters "
         "   set guild_member_of=%d, "
         "       guild_level=%d,"
@@ -354,6 +355,7 @@ bool psGuildInfo::RemoveMember(psGuildMember *target)
     if (i==csArrayItemNotFound)
         return false;
 
+    db->FlushDelayed("characters", target->char_id.Unbox());
     if (db->Command("update characters"
                     "   set guild_member_of=0,"
                     "       guild_level=0,"
@@ -407,6 +409,8 @@ bool psGuildInfo::RemoveGuild()
         return false;
     }
 
+    for (size_t i = 0; i < members.GetSize(); i++)
+        db->FlushDelayed("characters", members[i]->char_id.Unbox());
     if (db->Command("update characters "
         "   set guild_member_of=0,"
         "       guild_level=0,"
@@ -553,6 +557,7 @@ bool psGuildInfo::SetMemberPrivilege(psGuildMember *member, GUILD_PRIVILEGE priv
             }
         }
 
+        db->FlushDelayed("characters", member->char_id.Unbox());
         unsigned long res = db->Command("update characters"
             "   set guild_additional_privileges='%d' guild_denied_privileges='%d'"
             " where id = '%d'",
@@ -577,6 +582,7 @@ bool psGuildInfo::UpdateMemberLevel(psGuildMember *target,int level)
     {
         target->guildlevel = lev;
 
+        db->FlushDelayed("characters", target->char_id.Unbox());
         unsigned long res = db->Command("UPDATE characters SET guild_level=%d WHERE id=%u", level, target->char_id.Unbox());
 
         if (res == QUERY_FAILED)
@@ -619,6 +625,7 @@ bool psGuildInfo::SetMemberPoints(psGuildMember * member, int points)
 
     member->guild_points = points;
 
+    db->FlushDelayed("characters", member->char_id.Unbox());
     unsigned long res = db->Command("UPDATE characters SET guild_points=%d WHERE id=%u", points, member->char_id.Unbox());
     if (res != 1)
     {
@@ -661,6 +668,7 @@ bool psGuildInfo::SetMemberNotes(psGuildMember * member, const csString & notes,
 
     csString escNotes;
     db->Escape( escNotes, notes );
+    db->FlushDelayed("characters", member->char_id.Unbox());
     unsigned long res = db->Command("UPDATE characters SET %s='%s' WHERE id=%u", dbName, escNotes.GetData(), member->char_id.Unbox());
     if (res != 1)
     {
@@ -229,6 +229,7 @@ void psItem::UpdateItemQuality(uint32 id, float qual)
         return;
 
     Debug3(LOG_USER,id,"UpdateItemQuality(%u,%1.2f)\n",id, qual);
+    db->FlushDelayed("item_instances", id);
     int ret = db->CommandPump("update item_instances set item_quality=%1.2f where id=%u",qual, id);
     if (ret == 0 && strlen(db->GetLastError())) // 0 updates could mean the value was the same, not an error
     {
@@ -528,7 +529,7 @@ void psItem::Commit(bool children)
     else
     {
         if(updateQuery == NULL)
-            updateQuery = db->NewUpdatePreparedStatement("item_instances", "id", 27, __FILE__, __LINE__); // 26 fields + 1 id field
+            updateQuery = db->NewDelayedUpdateStatement("item_instances", "id", 27, __FILE__, __LINE__); // 26 fields + 1 id field
         targetQuery = updateQuery;
     }
 
@@ -1912,129 +1913,158 @@ int psItem::GetMaxCharges() const
     return base_stats->GetMaxCharges();
 }
 
+/// Numbers of the properties psItem::GetPropertyByID() switches on
+enum
+{
+    ITEMPROP_SKILL1,
+    ITEMPROP_SKILL2,
+    ITEMPROP_SKILL3,
+    ITEMPROP_QUALITY,
+    ITEMPROP_ARMQUALITY,
+    ITEMPROP_MAXQUALITY,
+    ITEMPROP_WEAPONCBV,
+    ITEMPROP_HARDNESS,
+    ITEMPROP_PENETRATION,
+    ITEMPROP_DAMAGESLASH,
+    ITEMPROP_PROTECTSLASH,
+    ITEMPROP_EXTRADAMAGEPCTSLASH,
+    ITEMPROP_DAMAGEBLUNT,
+    ITEMPROP_PROTECTBLUNT,
+    ITEMPROP_EXTRADAMAGEPCTBLUNT,
+    ITEMPROP_DAMAGEPIERCE,
+    ITEMPROP_PROTECTPIERCE,
+    ITEMPROP_EXTRADAMAGEPCTPIERCE,
+    ITEMPROP_STRMALUS,
+    ITEMPROP_AGIMALUS,
+    ITEMPROP_WEIGHT,
+    ITEMPROP_MENTALFACTOR,
+    ITEMPROP_REQUIREDREPAIRSKILL,
+    ITEMPROP_REPAIRDIFFICULTYPCT,
+    ITEMPROP_SALEPRICE,
+    ITEMPROP_CHARGES,
+    ITEMPROP_MAXCHARGES,
+    ITEMPROP_RANGE
+};
+
+static PropertyTable BuildItemProperties()
+{
+    PropertyTable table;
+    table.Add("Skill1", ITEMPROP_SKILL1);
+    table.Add("Skill2", ITEMPROP_SKILL2);
+    table.Add("Skill3", ITEMPROP_SKILL3);
+    table.Add("Quality", ITEMPROP_QUALITY);
+    table.Add("ArmQuality", ITEMPROP_ARMQUALITY);
+    table.Add("MaxQuality", ITEMPROP_MAXQUALITY);
+    table.Add("WeaponCBV", ITEMPROP_WEAPONCBV);
+    table.Add("Hardness", ITEMPROP_HARDNESS);
+    table.Add("Penetration", ITEMPROP_PENETRATION);
+    table.Add("DamageSlash", ITEMPROP_DAMAGESLASH);
+    table.Add("ProtectSlash", ITEMPROP_PROTECTSLASH);
+    table.Add("ExtraDamagePctSlash", ITEMPROP_EXTRADAMAGEPCTSLASH);
+    table.Add("DamageBlunt", ITEMPROP_DAMAGEBLUNT);
+    table.Add("ProtectBlunt", ITEMPROP_PROTECTBLUNT);
+    table.Add("ExtraDamagePctBlunt", ITEMPROP_EXTRADAMAGEPCTBLUNT);
+    table.Add("DamagePierce", ITEMPROP_DAMAGEPIERCE);
+    table.Add("ProtectPierce", ITEMPROP_PROTECTPIERCE);
+    table.Add("ExtraDamagePctPierce", ITEMPROP_EXTRADAMAGEPCTPIERCE);
+    table.Add("StrMalus", ITEMPROP_STRMALUS);
+    table.Add("AgiMalus", ITEMPROP_AGIMALUS);
+    table.Add("Weight", ITEMPROP_WEIGHT);
+    table.Add("MentalFactor", ITEMPROP_MENTALFACTOR);
+    table.Add("RequiredRepairSkill", ITEMPROP_REQUIREDREPAIRSKILL);
+    table.Add("RepairDifficultyPct", ITEMPROP_REPAIRDIFFICULTYPCT);
+    table.Add("SalePrice", ITEMPROP_SALEPRICE);
+    table.Add("Charges", ITEMPROP_CHARGES);
+    table.Add("MaxCharges", ITEMPROP_MAXCHARGES);
+    table.Add("Range", ITEMPROP_RANGE);
+    return table;
+}
+
+static const PropertyTable itemProperties = BuildItemProperties();
+
 double psItem::GetProperty(const char *ptr)
 {
-    if (!strcasecmp(ptr,"Skill1"))
-    {
-        return GetWeaponSkill((PSITEMSTATS_WEAPONSKILL_INDEX)0);
-    }
-    else if (!strcasecmp(ptr,"Skill2"))
-    {
-        return GetWeaponSkill((PSITEMSTATS_WEAPONSKILL_INDEX)1);
-    }
-    else if (!strcasecmp(ptr,"Skill3"))
-    {
-        return GetWeaponSkill((PSITEMSTATS_WEAPONSKILL_INDEX)2);
-    }
-    else if (!strcasecmp(ptr,"Quality"))
-    {
-        return GetItemQuality();
-    }
-    else if (!strcasecmp(ptr,"ArmQuality"))
-    {
-        // For natural armour quality
-        if(useNat)
-            return CacheManager::GetSingleton().GetBasicItemStatsByID(owning_character->raceinfo->natural_armor_id)->GetQuality();
-        return GetItemQuality();
-    }
-    else if (!strcasecmp(ptr,"MaxQuality"))
-    {
-        return GetMaxItemQuality();
-    }
-    else if (!strcasecmp(ptr,"WeaponCBV"))
-    {
-        return GetCounterBlockValue();
-    }
-    else if (!strcasecmp(ptr,"Hardness"))
-    {
-        return GetHardness();
-    }
-    else if (!strcasecmp(ptr,"Penetration"))
-    {
-        return GetPenetration();
-    }
-    else if (!strcasecmp(ptr,"DamageSlash"))
-    {
-        return GetDamage(PSITEMSTATS_DAMAGETYPE_SLASH);
-    }
-    else if (!strcasecmp(ptr,"ProtectSlash"))
-    {
-        return GetDamageProtection(PSITEMSTATS_DAMAGETYPE_SLASH);
-    }
-    else if (!strcasecmp(ptr,"ExtraDamagePctSlash"))
-    {
-        return 0; // in the future, this should be read from weapon/armor XML
-    }
-    else if (!strcasecmp(ptr,"DamageBlunt"))
-    {
-        return GetDamage(PSITEMSTATS_DAMAGETYPE_BLUNT);
-    }
-    else if (!strcasecmp(ptr,"ProtectBlunt"))
-    {
-        return GetDamageProtection(PSITEMSTATS_DAMAGETYPE_BLUNT);
-    }
-    else if (!strcasecmp(ptr,"ExtraDamagePctBlunt"))
-    {
-        return 0; // in the future, this should be read from weapon/armor XML
-    }
-    else if (!strcasecmp(ptr,"DamagePierce"))
-    {
-        return GetDamage(PSITEMSTATS_DAMAGETYPE_PIERCE);
-    }
-    else if (!strcasecmp(ptr,"ProtectPierce"))
+    PropertyID id = PropertyNames::Find(ptr);
+    if (id == PROPERTY_UNKNOWN)
     {
-        return GetDamageProtection(PSITEMSTATS_DAMAGETYPE_PIERCE);
-    }
-    else if (!strcasecmp(ptr,"ExtraDamagePctPierce"))
-    {
-        return 0; // in the future, this should be read from weapon/armor XML
-    }
-    else if (!strcasecmp(ptr,"StrMalus"))
-    {
-        return GetWeaponAttributeBonus(PSITEMSTATS_STAT_STRENGTH);
-    }
-    else if (!strcasecmp(ptr,"AgiMalus"))
-    {
-        return GetWeaponAttributeBonus(PSITEMSTATS_STAT_AGILITY);
-    }
-    else if (!strcasecmp(ptr,"Weight"))
-    {
-        return GetWeight();
-    }
-    else if (!strcasecmp(ptr,"MentalFactor"))
-    {
-        int temp = GetWeaponSkill((PSITEMSTATS_WEAPONSKILL_INDEX)0);
-        return ( (double)CacheManager::GetSingleton().GetSkillByID((temp<0)?0:temp)->mental_factor / 100.0 );
-    }
-    else if (!strcasecmp(ptr,"RequiredRepairSkill"))
-    {
-        return base_stats->GetCategory()->repairSkillId;
-    }
-    else if (!strcasecmp(ptr,"RepairDifficultyPct"))
-    {
-        return base_stats->GetCategory()->repairDifficultyPct;
-    }
-    else if (!strcasecmp(ptr,"SalePrice"))
-    {
-        return base_stats->GetPrice().GetTotal();
-    }
-    else if (!strcasecmp(ptr,"Charges"))
-    {
-        return (double)GetCharges();
-    }
-    else if (!strcasecmp(ptr,"MaxCharges"))
-    {
-        return (double)GetMaxCharges();
-    }
-    else if (!strcasecmp(ptr,"Range"))
-    {
-        return (double)GetRange();
-    }
-    else
-    {
-        CPrintf(CON_ERROR, "psItem::GetProperty(%s) failed\n",ptr);
+        CPrintf(CON_ERROR, "psItem::GetProperty(%s) failed\n", ptr);
         return 0;
     }
+    return GetPropertyByID(id);
+}
+
+double psItem::GetPropertyByID(PropertyID id)
+{
+    switch (itemProperties.Get(id))
+    {
+        case ITEMPROP_SKILL1:
+            return GetWeaponSkill((PSITEMSTATS_WEAPONSKILL_INDEX)0);
+        case ITEMPROP_SKILL2:
+            return GetWeaponSkill((PSITEMSTATS_WEAPONSKILL_INDEX)1);
+        case ITEMPROP_SKILL3:
+            return GetWeaponSkill((PSITEMSTATS_WEAPONSKILL_INDEX)2);
+        case ITEMPROP_QUALITY:
+            return GetItemQuality();
+        case ITEMPROP_ARMQUALITY:
+        {
+            // For natural armour quality
+            if(useNat)
+                return CacheManager::GetSingleton().GetBasicItemStatsByID(owning_character->raceinfo->natural_armor_id)->GetQuality();
+            return GetItemQuality();
+        }
+        case ITEMPROP_MAXQUALITY:
+            return GetMaxItemQuality();
+        case ITEMPROP_WEAPONCBV:
+            return GetCounterBlockValue();
+        case ITEMPROP_HARDNESS:
+            return GetHardness();
+        case ITEMPROP_PENETRATION:
+            return GetPenetration();
+        case ITEMPROP_DAMAGESLASH:
+            return GetDamage(PSITEMSTATS_DAMAGETYPE_SLASH);
+        case ITEMPROP_PROTECTSLASH:
+            return GetDamageProtection(PSITEMSTATS_DAMAGETYPE_SLASH);
+        case ITEMPROP_EXTRADAMAGEPCTSLASH:
+            return 0; // in the future, this should be read from weapon/armor XML
+        case ITEMPROP_DAMAGEBLUNT:
+            return GetDamage(PSITEMSTATS_DAMAGETYPE_BLUNT);
+        case ITEMPROP_PROTECTBLUNT:
+            return GetDamageProtection(PSITEMSTATS_DAMAGETYPE_BLUNT);
+        case ITEMPROP_EXTRADAMAGEPCTBLUNT:
+            return 0; // in the future, this should be read from weapon/armor XML
+        case ITEMPROP_DAMAGEPIERCE:
+            return GetDamage(PSITEMSTATS_DAMAGETYPE_PIERCE);
+        case ITEMPROP_PROTECTPIERCE:
+            return GetDamageProtection(PSITEMSTATS_DAMAGETYPE_PIERCE);
+        case ITEMPROP_EXTRADAMAGEPCTPIERCE:
+            return 0; // in the future, this should be read from weapon/armor XML
+        case ITEMPROP_STRMALUS:
+            return GetWeaponAttributeBonus(PSITEMSTATS_STAT_STRENGTH);
+        case ITEMPROP_AGIMALUS:
+            return GetWeaponAttributeBonus(PSITEMSTATS_STAT_AGILITY);
+        case ITEMPROP_WEIGHT:
+            return GetWeight();
+        case ITEMPROP_MENTALFACTOR:
+        {
+            int temp = GetWeaponSkill((PSITEMSTATS_WEAPONSKILL_INDEX)0);
+            return ( (double)CacheManager::GetSingleton().GetSkillByID((temp<0)?0:temp)->mental_factor / 100.0 );
+        }
+        case ITEMPROP_REQUIREDREPAIRSKILL:
+            return base_stats->GetCategory()->repairSkillId;
+        case ITEMPROP_REPAIRDIFFICULTYPCT:
+            return base_stats->GetCategory()->repairDifficultyPct;
+        case ITEMPROP_SALEPRICE:
+            return base_stats->GetPrice().GetTotal();
+        case ITEMPROP_CHARGES:
+            return (double)GetCharges();
+        case ITEMPROP_MAXCHARGES:
+            return (double)GetMaxCharges();
+        case ITEMPROP_RANGE:
+            return (double)GetRange();
+    }
+
+    CPrintf(CON_ERROR, "psItem::GetProperty(%s) failed\n", PropertyNames::GetName(id));
+    return 0;
 }
 
 double psItem::CalcFunction(const char * functionName, const double * params)
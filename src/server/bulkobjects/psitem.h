@@ -810,6 +810,7 @@ public:
 
     /// This is used by the math scripting engine to get various values.
     double GetProperty(const char *ptr);
+    double GetPropertyByID(PropertyID id);
     double CalcFunction(const char * functionName, const double * params);
     const char *ToString() { return item_name.GetDataSafe(); }
 
@@ -773,6 +773,8 @@ bool psNPCLoader::WriteToDatabase()
     csString invulnerable = (npc->GetImperviousToAttack() & ALWAYS_IMPERVIOUS) ? "Y" : "N";
     int kill_exp  = npc->GetKillExperience();
 
+    db->FlushDelayed("characters", pid.Unbox());
+
     // add a spawn rule for the npc
     db->Command("UPDATE characters c SET c.npc_spawn_rule=1 WHERE c.id=%u;", pid.Unbox());
 
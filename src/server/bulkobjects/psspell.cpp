@@ -532,17 +532,45 @@ bool psSpell::AffectTarget(gemActor* caster, gemObject* origTarget, gemObject* t
 ///
 /// iScriptableVar Interface Implementation
 ///
+/// Numbers of the properties psSpell::GetPropertyByID() switches on
+enum
+{
+    SPELLPROP_REALM,
+    SPELLPROP_WAY
+};
+
+static PropertyTable BuildSpellProperties()
+{
+    PropertyTable table;
+    table.Add("Realm", SPELLPROP_REALM);
+    table.Add("Way", SPELLPROP_WAY);
+    return table;
+}
+
+static const PropertyTable spellProperties = BuildSpellProperties();
+
 double psSpell::GetProperty(const char *ptr)
 {
-    if (!strcasecmp(ptr,"Realm"))
+    PropertyID id = PropertyNames::Find(ptr);
+    if (id == PROPERTY_UNKNOWN)
     {
-        return realm;
+        Error2("Requested psSpell property not found '%s'", ptr);
+        return 0;
     }
-    else if (!strcasecmp(ptr,"Way"))
+    return GetPropertyByID(id);
+}
+
+double psSpell::GetPropertyByID(PropertyID id)
+{
+    switch (spellProperties.Get(id))
     {
-        return way->id;
+        case SPELLPROP_REALM:
+            return realm;
+        case SPELLPROP_WAY:
+            return way->id;
     }
-    Error2("Requested psSpell property not found '%s'", ptr);
+
+    Error2("Requested psSpell property not found '%s'", PropertyNames::GetName(id));
     return 0;
 }
 
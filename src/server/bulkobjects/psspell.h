@@ -109,6 +109,7 @@ class psSpell : public iScriptableVar
     /// iScriptableVar Implementation
     /// This is used by the math scripting engine to get various values.
     double GetProperty(const char *ptr);
+    double GetPropertyByID(PropertyID id);
     double CalcFunction(const char * functionName, const double * params);
     const char* ToString() { return name.GetDataSafe(); }
 
@@ -22,6 +22,7 @@
 // Crystal Space Includes
 //=============================================================================
 #include <zlib.h>
+#include <iutil/cfgmgr.h>
 
 //=============================================================================
 // Project Space Includes
@@ -31,6 +32,8 @@
 #include "util/serverconsole.h"
 #include "util/eventmanager.h"
 #include "util/psdatabase.h"
+#include "util/preloadquery.h"
+#include "util/psprofile.h"
 
 #include "net/message.h"
 
@@ -137,6 +140,7 @@ CacheManager::CacheManager()
     effectID = 0;
 
     commandManager = NULL;
+    preloadQueries = NULL;
 
     // Init common string data.
     compressed_msg_strings = 0;
@@ -150,62 +154,123 @@ CacheManager::~CacheManager()
     UnloadAll();
 }
 
+/// The bulk selects of the preload steps, sent all at once by PreloadAll()
+static const char* const preloadSelects[][2] =
+{
+    // table                    query, as the step sends it
+    { "sectors",                "SELECT * from sectors" },
+    { "skills",                 "SELECT * from skills" },
+    { "character_limitations",  "SELECT * from character_limitations" },
+    { "race_info",              "SELECT * from race_info" },
+    { "traits",                 "SELECT * from traits order by id" },
+    { "item_categories",        "SELECT * from item_categories" },
+    { "item_animations",        "SELECT * from item_animations order by id, min_use_level" },
+    { "ways",                   "SELECT * from ways" },
+    { "factions",               "SELECT * from factions" },
+    { "progression_events",     "SELECT * from progression_events" },
+    { "spells",                 "SELECT * from spells" },
+    { "quests",                 "select * from quests order by id" },
+    { "trade_combinations",     "select * from trade_combinations order by pattern_id, result_id, item_id" },
+    { "trade_transformations",  "select * from trade_transformations order by pattern_id, item_id" },
+    { "trade_patterns",         "select id from trade_patterns order by id" },
+    { "trade_processes",        "select * from trade_processes order by process_id, subprocess_number" },
+    { "trade_patterns",         "select * from trade_patterns order by designitem_id" },
+    { "trade_patterns",         "SELECT * from trade_patterns order by designitem_id" },
+    { "tips",                   "select tip from tips where id<1000" },
+    { "bad_names",              "SELECT * from bad_names" },
+    { "armor_vs_weapon",        "select * from armor_vs_weapon" },
+    { "movement_modes",         "SELECT * FROM movement_modes" },
+    { "movement_types",         "SELECT * FROM movement_types" },
+    { "stances",                "select * from stances order by id" }
+};
+
+/// A step of PreloadAll()
+struct PreloadStep
+{
+    const char* name;
+    bool (CacheManager::*load)();
+};
+
 bool CacheManager::PreloadAll()
 {
-    if (!PreloadSectors())
-        return false;
-    if (!PreloadSkills())
-        return false;
-    if (!PreloadLimitations())
-        return false;
-    if (!PreloadRaceInfo())
-        return false;
-    if (!PreloadTraits())
-        return false; // Need RaceInfo
-    if (!PreloadItemCategories())
-        return false;
-    if (!PreloadItemAnimList())
-        return false;
-    if (!PreloadItemStatsDatabase())
-        return false;
-    if (!PreloadWays())
-        return false;
-    if (!PreloadFactions())
-        return false;
-    if (!PreloadScripts())
-        return false;
-    if (!PreloadSpells())
-        return false;
-    if (!PreloadQuests())
-        return false;
-    if (!PreloadTradeCombinations())
-        return false;
-    if (!PreloadTradeTransformations())
-        return false;
-    if (!PreloadUniqueTradeTransformations())
-        return false;
-    if (!PreloadTradeProcesses())
-        return false;
-    if (!PreloadTradePatterns())
-        return false;
-    if (!PreloadCraftMessages())
-        return false;
-    if (!PreloadTips())
-        return false;
-    if (!PreloadBadNames())
-        return false;
-    if (!PreloadArmorVsWeapon())
-        return false;
-    if (!PreloadMovement())
-        return false;
-    if (!PreloadStances())
+    // In order, later steps look up what earlier ones loaded
+    static const PreloadStep steps[] =
+    {
+        { "sectors",                    &CacheManager::PreloadSectors },
+        { "skills",                     &CacheManager::PreloadSkills },
+        { "limitations",                &CacheManager::PreloadLimitations },
+        { "race info",                  &CacheManager::PreloadRaceInfo },
+        { "traits",                     &CacheManager::PreloadTraits }, // Need RaceInfo
+        { "item categories",            &CacheManager::PreloadItemCategories },
+        { "item animations",            &CacheManager::PreloadItemAnimList },
+        { "item stats",                 &CacheManager::PreloadItemStatsDatabase },
+        { "ways",                       &CacheManager::PreloadWays },
+        { "factions",                   &CacheManager::PreloadFactions },
+        { "scripts",                    &CacheManager::PreloadScripts },
+        { "spells",                     &CacheManager::PreloadSpells },
+        { "quests",                     &CacheManager::PreloadQuests },
+        { "trade combinations",         &CacheManager::PreloadTradeCombinations },
+        { "trade transformations",      &CacheManager::PreloadTradeTransformations },
+        { "unique trade transformations", &CacheManager::PreloadUniqueTradeTransformations },
+        { "trade processes",            &CacheManager::PreloadTradeProcesses },
+        { "trade patterns",             &CacheManager::PreloadTradePatterns },
+        { "craft messages",             &CacheManager::PreloadCraftMessages },
+        { "tips",                       &CacheManager::PreloadTips },
+        { "bad names",                  &CacheManager::PreloadBadNames },
+        { "armor vs weapon",            &CacheManager::PreloadArmorVsWeapon },
+        { "movement",                   &CacheManager::PreloadMovement },
+        { "stances",                    &CacheManager::PreloadStances }
+    };
+    const size_t stepcount = sizeof(steps) / sizeof(steps[0]);
+
+    psStopWatch total;
+    total.Start();
+
+    // Send the queries of all steps ahead, the steps mostly find their rows waiting
+    PreloadQuerySet queries;
+    for (size_t i = 0; i < sizeof(preloadSelects) / sizeof(preloadSelects[0]); i++)
+        queries.Add(preloadSelects[i][0], preloadSelects[i][1]);
+
+    csString snapshot = psserver->GetConfig()->GetStr("PlaneShift.Server.PreloadSnapshot", "");
+    queries.Start(db, psserver->vfs, snapshot);
+    preloadQueries = &queries;
+
+    csArray<csTicks> times;
+    bool ok = true;
+    for (size_t i = 0; i < stepcount && ok; i++)
+    {
+        psStopWatch watch;
+        watch.Start();
+        ok = (this->*steps[i].load)();
+        times.Push(watch.Stop());
+
+        if (!ok)
+            CPrintf(CON_ERROR, "Preloading %s failed.\n", steps[i].name);
+    }
+
+    preloadQueries = NULL;
+    if (!ok)
         return false;
+    queries.Finish();
 
     PreloadCommandGroups();
 
+    CPrintf(CON_CMDOUTPUT, "Preloaded database cache in %u ms%s.\n", total.Stop(),
+        queries.IsFromSnapshot() ? " from snapshot" : "");
+    for (size_t i = 0; i < stepcount; i++)
+        CPrintf(CON_NOTIFY, "    %-30s %6u ms\n", steps[i].name, times[i]);
+
     return true;
 }
 
+iResultSet* CacheManager::PreloadSelect(const char* sql)
+{
+    if (preloadQueries)
+        return preloadQueries->Select(sql);
+
+    return db->Select("%s", sql);
+}
+
 void CacheManager::PreloadCommandGroups()
 {
     commandManager = new psCommandManager;
@@ -421,7 +486,7 @@ bool CacheManager::PreloadSkills()
 {
     unsigned int currentrow;
     psSkillInfo *newskill;
-    Result result(db->Select("SELECT * from skills") );
+    Result result(PreloadSelect("SELECT * from skills") );
 
     if (!result.IsValid())
     {
@@ -469,7 +534,7 @@ bool CacheManager::PreloadLimitations()
 {
     psCharacterLimitation *limit;
     unsigned int currentrow;
-    Result result(db->Select("SELECT * from character_limitations") );
+    Result result(PreloadSelect("SELECT * from character_limitations") );
 
     if (!result.IsValid())
     {
@@ -506,7 +571,7 @@ bool CacheManager::PreloadSectors()
 {
     unsigned int currentrow;
     psSectorInfo *newsector;
-    Result result(db->Select("SELECT * from sectors") );
+    Result result(PreloadSelect("SELECT * from sectors") );
 
     if (!result.IsValid())
     {
@@ -564,7 +629,7 @@ bool CacheManager::PreloadSectors()
 
 bool CacheManager::PreloadMovement()
 {
-    Result modes(db->Select("SELECT * FROM movement_modes"));
+    Result modes(PreloadSelect("SELECT * FROM movement_modes"));
     if ( !modes.IsValid() )
     {
         return false;
@@ -601,7 +666,7 @@ bool CacheManager::PreloadMovement()
     }
     Notify2( LOG_STARTUP, "%lu Movement Modes Loaded", modes.Count() );
 
-    Result types(db->Select("SELECT * FROM movement_types"));
+    Result types(PreloadSelect("SELECT * FROM movement_types"));
     if ( !types.IsValid() )
     {
         return false;
@@ -669,7 +734,7 @@ uint8_t CacheManager::GetMovementID(const char* name)
 bool CacheManager::PreloadArmorVsWeapon()
 {
     unsigned int currentrow;
-    Result result(db->Select("select * from armor_vs_weapon"));
+    Result result(PreloadSelect("select * from armor_vs_weapon"));
 
     if (!result.IsValid())
     {
@@ -710,7 +775,7 @@ bool CacheManager::PreloadArmorVsWeapon()
 
 bool CacheManager::PreloadStances()
 {
-    Result result(db->Select("select * from stances order by id"));
+    Result result(PreloadSelect("select * from stances order by id"));
 
     if(!result.IsValid())
     {
@@ -742,7 +807,7 @@ bool CacheManager::PreloadQuests()
     psQuest *quest;
     csArray<psQuest *> failed;
 
-    Result result(db->Select("select * from quests order by id"));
+    Result result(PreloadSelect("select * from quests order by id"));
 
     if (!result.IsValid())
     {
@@ -861,7 +926,7 @@ bool CacheManager::PreloadTradeCombinations()
     CombinationConstruction *ctr;
     csPDelArray<CombinationConstruction> *newArray = NULL;
 
-    Result result(db->Select("select * from trade_combinations order by pattern_id, result_id, item_id"));
+    Result result(PreloadSelect("select * from trade_combinations order by pattern_id, result_id, item_id"));
     if (!result.IsValid())
     {
         Error1("No data in trade_combinations could be found");
@@ -920,7 +985,7 @@ bool CacheManager::PreloadTradeTransformations()
     csHash<csPDelArray<psTradeTransformations> *,uint32>* transHash = NULL;
     csPDelArray<psTradeTransformations>* newArray = NULL;
 
-    Result result(db->Select("select * from trade_transformations order by pattern_id, item_id"));
+    Result result(PreloadSelect("select * from trade_transformations order by pattern_id, item_id"));
     if (!result.IsValid())
     {
         Error1("No data in trade_transformations could be found");
@@ -983,7 +1048,7 @@ bool CacheManager::PreloadUniqueTradeTransformations()
     csArray<uint32>* newArray;
 
     // Get a list of the trade patterns ids
-    Result result(db->Select("select id from trade_patterns order by id"));
+    Result result(PreloadSelect("select id from trade_patterns order by id"));
     if (!result.IsValid())
     {
         Error1("No data in trade_patterns could be found");
@@ -1050,7 +1115,7 @@ bool CacheManager::PreloadTradeProcesses()
     csArray<psTradeProcesses*>* newArray = NULL;
 
     // Get a list of the trade processes
-    Result result(db->Select("select * from trade_processes order by process_id, subprocess_number"));
+    Result result(PreloadSelect("select * from trade_processes order by process_id, subprocess_number"));
     if (!result.IsValid())
     {
         Error1("No data in trade_processes could be found");
@@ -1097,7 +1162,7 @@ bool CacheManager::PreloadTradePatterns()
     psTradePatterns* newPattern;
 
     // Get a list of the trade patterns ignoring the dummy ones
-    Result result(db->Select("select * from trade_patterns order by designitem_id"));
+    Result result(PreloadSelect("select * from trade_patterns order by designitem_id"));
     if (!result.IsValid())
     {
         Error1("Invalid select from trade patterns.");
@@ -1146,7 +1211,7 @@ bool CacheManager::PreloadCraftMessages()
     csArray<CraftComboInfo*>* newComboArray = NULL;
 
     // Get a list of all the trade patterns in the database ordered by design item ID
-    Result result(db->Select("SELECT * from trade_patterns order by designitem_id") );
+    Result result(PreloadSelect("SELECT * from trade_patterns order by designitem_id") );
     for (int currentPattern=0; currentPattern<(int)result.Count(); currentPattern++)
     {
         // Get the design item that goes with the pattern
@@ -1507,7 +1572,7 @@ bool CacheManager::PreloadTips()
     unsigned int currentrow;
 
     // Id<1000 means we are excluding Tutorial tips
-    Result result(db->Select("select tip from tips where id<1000"));
+    Result result(PreloadSelect("select tip from tips where id<1000"));
     if (!result.IsValid())
     {
         return false;
@@ -1712,7 +1777,7 @@ bool CacheManager::PreloadTraits()
 {
     unsigned int currentrow;
     psTrait *newtrait;
-    Result result(db->Select("SELECT * from traits order by id"));
+    Result result(PreloadSelect("SELECT * from traits order by id"));
 
     if (!result.IsValid())
     {
@@ -1757,6 +1822,7 @@ bool CacheManager::PreloadTraits()
         newtrait->location = loc;
 
         traitlist.Push(newtrait);
+        traits_by_id.Add(newtrait->uid, newtrait);
     }
     // Update cross ref to next_trait
     for (size_t i = 0; i < traitlist.GetSize(); i++)
@@ -1770,21 +1836,9 @@ bool CacheManager::PreloadTraits()
     return true;
 }
 
-// TODO: This should be done faster, probably not with an array
 psTrait *CacheManager::GetTraitByID(unsigned int id)
 {
-    size_t i;
-    psTrait *currenttrait;
-
-    for (i=0;i<traitlist.GetSize();i++)
-    {
-        currenttrait=traitlist.Get(i);
-        if (currenttrait!=NULL && currenttrait->uid==id)
-        {
-            return currenttrait;
-        }
-    }
-    return NULL;
+    return traits_by_id.Get(id);
 }
 
 // TODO: This should be done faster, probably not with an array
@@ -1836,7 +1890,7 @@ bool CacheManager::PreloadRaceInfo()
 {
     unsigned int currentrow;
     psRaceInfo *newraceinfo;
-    Result result(db->Select("SELECT * from race_info"));
+    Result result(PreloadSelect("SELECT * from race_info"));
 
     if (!result.IsValid())
     {
@@ -1852,6 +1906,7 @@ bool CacheManager::PreloadRaceInfo()
         {
             newraceinfo->LoadBaseSpeeds(psserver->GetObjectReg());
             raceinfolist.Push(newraceinfo);
+            IndexRaceInfo(newraceinfo);
         }
         else
         {
@@ -1879,141 +1934,78 @@ psRaceInfo *CacheManager::GetRaceInfoByIndex(int idx)
 }
 
 
-// TODO: This should be done faster, probably not with an array
-psRaceInfo *CacheManager::GetRaceInfoByID(unsigned int id)
+/// Key of raceinfo_by_race_gender
+static inline uint32 RaceGenderKey(unsigned int race, PSCHARACTER_GENDER gender)
+{
+    return (race << 2) | (uint32) gender;
+}
+
+void CacheManager::IndexRaceInfo(psRaceInfo *raceinfo)
 {
-    size_t i;
-    psRaceInfo *currentri;
+    raceinfo_by_id.Add(raceinfo->uid, raceinfo);
+    raceinfo_by_name.Add(raceinfo->name, raceinfo);
+    raceinfo_by_mesh.Add(raceinfo->mesh_name, raceinfo);
 
-    for (i=0;i<raceinfolist.GetSize();i++)
+    // A race without gender stands in for every gender of its race
+    if (raceinfo->gender == PSCHARACTER_GENDER_NONE)
     {
-        currentri=raceinfolist.Get(i);
-        if (currentri && currentri->uid==id)
-        {
-            return currentri;
-        }
+        for (int gender = 0; gender < PSCHARACTER_GENDER_COUNT; gender++)
+            raceinfo_by_race_gender.Add(RaceGenderKey(raceinfo->race, (PSCHARACTER_GENDER) gender), raceinfo);
+    }
+    else
+    {
+        raceinfo_by_race_gender.Add(RaceGenderKey(raceinfo->race, raceinfo->gender), raceinfo);
     }
-    return NULL;
 }
 
-// TODO: This should be done faster, probably not with an array
+psRaceInfo *CacheManager::GetRaceInfoByID(unsigned int id)
+{
+    return raceinfo_by_id.Get(id);
+}
+
 psRaceInfo *CacheManager::GetRaceInfoByNameGender(const char *name,PSCHARACTER_GENDER gender)
 {
-    size_t i;
-    psRaceInfo *currentri;
-    csString raceName(name);
+    const csArray<psRaceInfo*>* races = raceinfo_by_name.GetAll(name);
+    if (!races)
+        return NULL;
 
-    for (i=0;i<raceinfolist.GetSize();i++)
+    for (size_t i = 0; i < races->GetSize(); i++)
     {
-        currentri=raceinfolist.Get(i);
-        if (currentri!=NULL && currentri->gender==gender && raceName.CompareNoCase(currentri->name))
-        {
-            return currentri;
-        }
+        if (races->Get(i)->gender == gender)
+            return races->Get(i);
     }
     return NULL;
 }
 
-// TODO: This should be done faster, probably not with an array
 psRaceInfo *CacheManager::GetRaceInfoByNameGender( unsigned int id, PSCHARACTER_GENDER gender)
 {
-    size_t i;
-    psRaceInfo *currentri;
-
-    for (i=0;i<raceinfolist.GetSize();i++)
-    {
-        currentri=raceinfolist.Get(i);
-        // If the current race matches the race we're looking for, and only has the 'none' gender,
-        // it's the race we need.
-        if (currentri!=NULL &&
-            currentri->race==id &&
-            (currentri->gender == PSCHARACTER_GENDER_NONE || currentri->gender==gender))
-        {
-            return currentri;
-        }
-    }
-    return NULL;
+    return raceinfo_by_race_gender.Get(RaceGenderKey(id, gender));
 }
 
 
 psRaceInfo *CacheManager::GetRaceInfoByMeshName(const csString & meshname)
 {
-    size_t i;
-    psRaceInfo *currentri;
-
-    for (i=0;i<raceinfolist.GetSize();i++)
-    {
-        currentri=raceinfolist.Get(i);
-        if (currentri!=NULL && currentri->mesh_name==meshname)
-        {
-            return currentri;
-        }
-    }
-    return NULL;
+    return raceinfo_by_mesh.Get(meshname);
 }
 
 psItemCategory *CacheManager::GetItemCategoryByID(unsigned int id)
 {
-    size_t i;
-    for (i=0;i<itemCategoryList.GetSize();i++)
-    {
-        psItemCategory *currentCategory;
-        currentCategory=itemCategoryList.Get(i);
-        if (currentCategory && id==currentCategory->id)
-        {
-             return currentCategory;
-        }
-    }
-    return NULL;
-
+    return itemcategory_by_id.Get(id);
 }
 
 psItemCategory *CacheManager::GetItemCategoryByName(const csString & name)
 {
-    size_t i;
-    for (i=0;i<itemCategoryList.GetSize();i++)
-    {
-        psItemCategory *currentCategory;
-        currentCategory=itemCategoryList.Get(i);
-        if (currentCategory && name==currentCategory->name)
-        {
-            return currentCategory;
-        }
-    }
-    return NULL;
-
+    return itemcategory_by_name.Get(name);
 }
 
-// TODO:  This function needs to be implemented in a fast fashion
 psWay *CacheManager::GetWayByID(unsigned int id)
 {
-    size_t i;
-    for (i=0;i<wayList.GetSize();i++)
-    {
-        psWay *currentWay;
-        currentWay=wayList.Get(i);
-        if (currentWay && id==currentWay->id)
-        {
-            return currentWay;
-        }
-    }
-    return NULL;
+    return ways_by_id.Get(id);
 }
 
-// TODO:  This function needs to be implemented in a fast fashion
 psWay *CacheManager::GetWayByName(const csString & name)
 {
-    size_t i;
-    for (i=0;i<wayList.GetSize();i++)
-    {
-        psWay *currentWay;
-        currentWay=wayList.Get(i);
-        if (currentWay && name==currentWay->name)
-        {
-            return currentWay;
-        }
-    }
-    return NULL;
+    return ways_by_name.Get(name);
 }
 
 Faction *CacheManager::GetFaction(const char *name)
@@ -2048,32 +2040,14 @@ ProgressionScript *CacheManager::GetProgressionScript(const char *name)
     return scripts.Get(name, NULL);
 }
 
-// TODO:  This function needs to be implemented in a fast fashion
 psSpell *CacheManager::GetSpellByID(unsigned int id)
 {
-    size_t i;
-    for (i=0;i<spellList.GetSize();i++)
-    {
-        psSpell *currentSpell;
-        currentSpell=spellList.Get(i);
-        if (currentSpell && id==(unsigned int)currentSpell->GetID())
-            return currentSpell;
-    }
-    return NULL;
+    return spells_by_id.Get(id);
 }
 
-// TODO:  This function needs to be implemented in a fast fashion
 psSpell *CacheManager::GetSpellByName(const csString & name)
 {
-    size_t i;
-    for (i=0;i<spellList.GetSize();i++)
-    {
-        psSpell *currentSpell;
-        currentSpell=spellList.Get(i);
-        if (currentSpell && name.CompareNoCase(currentSpell->GetName()))
-            return currentSpell;
-    }
-    return NULL;
+    return spells_by_name.Get(name);
 }
 
 CacheManager::SpellIterator CacheManager::GetSpellIterator()
@@ -2284,7 +2258,7 @@ PSSKILL CacheManager::ConvertSkill(int skill_id)
 
 bool CacheManager::PreloadItemCategories()
 {
-    Result categories(db->Select("SELECT * from item_categories"));
+    Result categories(PreloadSelect("SELECT * from item_categories"));
 
     if (categories.IsValid())
     {
@@ -2305,6 +2279,8 @@ bool CacheManager::PreloadItemCategories()
             category->identifyMinSkill     = categories[i].GetInt("identify_min_skill");
 
             itemCategoryList.Push(category);
+            itemcategory_by_id.Add(category->id, category);
+            itemcategory_by_name.Add(category->name, category);
          }
     }
     Notify2( LOG_STARTUP, "%lu Item Categories Loaded", categories.Count() );
@@ -2313,7 +2289,7 @@ bool CacheManager::PreloadItemCategories()
 
 bool CacheManager::PreloadWays()
 {
-    Result ways(db->Select("SELECT * from ways"));
+    Result ways(PreloadSelect("SELECT * from ways"));
     if (ways.IsValid())
     {
         int i,count=ways.Count();
@@ -2364,6 +2340,8 @@ bool CacheManager::PreloadWays()
             }
 
             wayList.Push(way);
+            ways_by_id.Add(way->id, way);
+            ways_by_name.Add(way->name, way);
         }
     }
 
@@ -2409,7 +2387,7 @@ void CacheManager::PreloadFactionCharacterEvents(const char* script, Faction* fa
 
 bool CacheManager::PreloadFactions()
 {
-    Result result_factions(db->Select("SELECT * from factions"));
+    Result result_factions(PreloadSelect("SELECT * from factions"));
 
     unsigned int x = 0;
 
@@ -2439,7 +2417,7 @@ bool CacheManager::PreloadFactions()
 
 bool CacheManager::PreloadScripts()
 {
-    Result result(db->Select("SELECT * from progression_events"));
+    Result result(PreloadSelect("SELECT * from progression_events"));
 
     if (result.IsValid())
     {
@@ -2459,7 +2437,7 @@ bool CacheManager::PreloadScripts()
 
 bool CacheManager::PreloadSpells()
 {
-    Result spells(db->Select("SELECT * from spells"));
+    Result spells(PreloadSelect("SELECT * from spells"));
     if (spells.IsValid())
     {
         int i,count=spells.Count();
@@ -2470,6 +2448,8 @@ bool CacheManager::PreloadSpells()
             if (spell->Load(spells[i]))
             {
                 spellList.Push(spell);
+                spells_by_id.Add(spell->GetID(), spell);
+                spells_by_name.Add(spell->GetName(), spell);
             }
             else
             {
@@ -2499,7 +2479,7 @@ bool CacheManager::PreloadItemAnimList()
     psItemAnimation *newitem;
     csPDelArray<psItemAnimation> *newarray;
 
-    Result result(db->Select("SELECT * from item_animations order by id, min_use_level"));
+    Result result(PreloadSelect("SELECT * from item_animations order by id, min_use_level"));
 
     if (!result.IsValid())
     {
@@ -2551,7 +2531,7 @@ bool CacheManager::LoadWorldItems(psSectorInfo *sector, csArray<psItem*> & items
         db->Select("SELECT * from item_instances where loc_sector_id='%u'",sector->uid) :
         // it's an object on the ground, not held by players
         // or the parent container is an object on the ground, not held by players
-        db->Select("SELECT * from item_instances"
+        db->SelectStream("SELECT * from item_instances"
                    " where ifnull(loc_sector_id,0)!=0"
                    " or parent_item_id IN (select id "
                                            " from item_instances "
@@ -2564,16 +2544,17 @@ bool CacheManager::LoadWorldItems(psSectorInfo *sector, csArray<psItem*> & items
         return false;
     }
 
-    for (unsigned long i = 0; i < result.Count(); i++)
+    iResultRow *row;
+    while ((row = result.Next()))
     {
         psItem *item;
-        unsigned int stats_id=result[i].GetUInt32("item_stats_id_standard");
+        unsigned int stats_id=row->GetUInt32("item_stats_id_standard");
         psItemStats *stats= GetBasicItemStatsByID(stats_id);
 
         if (!stats)
         {
             Error3("Error in LoadWorldItems! Item instance %lu could not load base stats %lu. Check the item_stats_id_standard value for this item. Skipping.\n",
-                result[i].GetUInt32("id"), result[i].GetUInt32("item_stats_id_standard"));
+                row->GetUInt32("id"), row->GetUInt32("item_stats_id_standard"));
             continue;
         }
 
@@ -2586,9 +2567,9 @@ bool CacheManager::LoadWorldItems(psSectorInfo *sector, csArray<psItem*> & items
             item = new psItem();
         }
 
-        if (!item->Load(result[i]))
+        if (!item->Load(*row))
         {
-            Error2("Error in LoadWorldItems! Item instance %lu could not be loaded. Skipping.\n",result[i].GetUInt32("id"));
+            Error2("Error in LoadWorldItems! Item instance %lu could not be loaded. Skipping.\n",row->GetUInt32("id"));
             delete item;
             continue;
         }
@@ -2596,6 +2577,16 @@ bool CacheManager::LoadWorldItems(psSectorInfo *sector, csArray<psItem*> & items
         items.Push(item);
     }
 
+    // The streamed rows can fail half way, don't spawn part of the world
+    if (result.GetError())
+    {
+        Error2("Error loading world items: %s", result.GetError());
+        for (size_t i=0; i < items.GetSize(); i++)
+            delete items[i];
+        items.Empty();
+        return false;
+    }
+
     for (size_t i=0; i < items.GetSize(); i++)
     {
         items[i]->SetLoaded();
@@ -2611,19 +2602,20 @@ void CacheManager::AddItemStatsToHashTable(psItemStats* newitem)
 
 bool CacheManager::PreloadItemStatsDatabase()
 {
-    uint32 currentrow;
     psItemStats *newitem;
-    Result result(db->Select("SELECT * from item_stats where stat_type in ('B','U','R') "));
+    iResultRow *row;
+    // Streamed, the table is large
+    Result result(db->SelectStream("SELECT * from item_stats where stat_type in ('B','U','R') "));
 
     if (!result.IsValid())
     {
         return false;
     }
 
-    for (currentrow=0; currentrow<result.Count(); currentrow++)
+    while ((row = result.Next()))
     {
         newitem = new psItemStats;
-        bool loaded = newitem->ReadItemStats(result[currentrow]);
+        bool loaded = newitem->ReadItemStats(*row);
         // Prevent name conflicts
         if (!loaded || itemStats_NameHash.Get(newitem->GetDownCaseName(), NULL))
         {
@@ -2634,7 +2626,7 @@ bool CacheManager::PreloadItemStatsDatabase()
             else
             {
                 CPrintf(CON_ERROR, "Failed to load item_stats with id='%s' and name='%s'\n",
-                        result[currentrow]["id"],result[currentrow]["name"]);
+                        (*row)["id"],(*row)["name"]);
             }
 
             delete newitem;
@@ -2646,6 +2638,12 @@ bool CacheManager::PreloadItemStatsDatabase()
             AddItemStatsToHashTable(newitem);
         }
     }
+
+    if (result.GetError())
+    {
+        CPrintf(CON_ERROR, "Reading item_stats failed after %lu rows: %s\n", result.Count(), result.GetError());
+        return false;
+    }
     Notify2( LOG_STARTUP, "%lu Item Stats Loaded", result.Count() );
     return true;
 }
@@ -2700,7 +2698,7 @@ psItemStats* CacheManager::CopyItemStats(uint32 id, csString newName)
 
 bool CacheManager::PreloadBadNames()
 {
-    Result result(db->Select("SELECT * from bad_names"));
+    Result result(PreloadSelect("SELECT * from bad_names"));
 
     if (!result.IsValid())
     {
@@ -2783,12 +2781,9 @@ psAccountInfo *CacheManager::GetAccountInfoByCharID(PID charid)
 
 psAccountInfo *CacheManager::GetAccountInfoByUsername(const char *username)
 {
-    iCachedObject *obj = RemoveFromCache(username);
-    if (obj)
-    {
-        Notify2(LOG_CACHE, "Found account for %s in cache!", username);
-        return (psAccountInfo *)obj->RecoverObject();
-    }
+    psAccountInfo *accountinfo = GetCachedAccountInfo(username);
+    if (accountinfo)
+        return accountinfo;
 
     csString escape;
     db->Escape( escape, username );
@@ -2798,8 +2793,33 @@ psAccountInfo *CacheManager::GetAccountInfoByUsername(const char *username)
         Warning3(LOG_CONNECTIONS,"Could not find account for login %s.  Error: %s",username,db->GetLastError());
         return NULL;
     }
+    return ReadAccountInfo(result.rs);
+}
+
+psAccountInfo *CacheManager::GetCachedAccountInfo(const char *username)
+{
+    iCachedObject *obj = RemoveFromCache(username);
+    if (!obj)
+        return NULL;
+
+    Notify2(LOG_CACHE, "Found account for %s in cache!", username);
+    return (psAccountInfo *)obj->RecoverObject();
+}
+
+void CacheManager::LoadAccountInfoAsync(const char *username, iQueryCallback *callback)
+{
+    csString escape;
+    db->Escape( escape, username );
+    db->SelectAsync(callback, "SELECT * from accounts where username='%s'", escape.GetData());
+}
+
+psAccountInfo *CacheManager::ReadAccountInfo(iResultSet *result)
+{
+    if (result->Count()<1)
+        return NULL;
+
     psAccountInfo *accountinfo=new psAccountInfo;
-    if (accountinfo->Load(result[0]))
+    if (accountinfo->Load((*result)[0]))
     {
         return accountinfo;
     }
@@ -3090,7 +3110,6 @@ iCachedObject *CacheManager::RemoveFromCache(const char *name)
 CacheManager::psCacheExpireEvent::psCacheExpireEvent(int delayticks,CachedObject *object)
 : psGameEvent(0,delayticks,"psCacheExpireEvent")
 {
-    valid = true;
     myObject = object;
 }
 
@@ -32,6 +32,7 @@
 //=============================================================================
 #include "util/slots.h"
 #include "util/gameevent.h"
+#include "util/cacheindex.h"
 
 #include "bulkobjects/pscharacter.h"
 #include "bulkobjects/psitemstats.h"
@@ -55,6 +56,9 @@ class psTradeTransformations;
 class psTradeAutoContainers;
 class psItemSet;
 class psCommandManager;
+class PreloadQuerySet;
+class iResultSet;
+class iQueryCallback;
 class psSpell;
 class psItemStats;
 class psItem;
@@ -272,6 +276,25 @@ public:
      */
     psAccountInfo *GetAccountInfoByUsername(const char *username);
 
+    /** Takes the account of a username out of the cache, if it is there.
+     *
+     *  @return NULL if the account is not cached.
+     */
+    psAccountInfo *GetCachedAccountInfo(const char *username);
+
+    /** Reads the account of a username on the async query pool.
+     *
+     *  'callback' gets the rows, which ReadAccountInfo() turns into the
+     *  account. The cache is not looked at, see GetCachedAccountInfo().
+     */
+    void LoadAccountInfoAsync(const char *username, iQueryCallback *callback);
+
+    /** Makes the account of the rows read by LoadAccountInfoAsync().
+     *
+     *  @return NULL if no account was found.  The returned pointer must be deleted when no longer needed.
+     */
+    psAccountInfo *ReadAccountInfo(iResultSet *result);
+
     /** Call to store modified account information back to the database. Updates IP, security level, last login time, os, graphics card and graphics driver version.
      *
      * @param ainfo - A pointer to account data to store.
@@ -287,7 +310,11 @@ public:
     unsigned int NewAccountInfo(psAccountInfo *ainfo);
     //@}
 
-    /// Convenience function to preload all of the above in an appropriate order
+    /**
+     * Convenience function to preload all of the above in an appropriate order.
+     * The bulk selects of all steps are sent ahead, and read from the
+     * snapshot set by PlaneShift.Server.PreloadSnapshot if there is one.
+     */
     bool PreloadAll();
     void UnloadAll();
 
@@ -451,6 +478,12 @@ protected:
     bool PreloadMovement();
     bool PreloadStances();
     void PreloadCommandGroups();
+
+    /// Add a race to the race lookups.
+    void IndexRaceInfo(psRaceInfo *raceinfo);
+
+    /// The rows of a preload step, sent ahead while PreloadAll() runs.
+    iResultSet* PreloadSelect(const char* sql);
     
     /// Cache in the crafting messages.        
     bool PreloadCraftMessages();
@@ -486,12 +519,10 @@ protected:
     class psCacheExpireEvent : public psGameEvent
     {
     protected:
-        bool valid;
         CachedObject *myObject;
 
     public:
         psCacheExpireEvent(int delayticks,CachedObject *object);
-        void CancelEvent() { valid = false;}
         virtual void Trigger();  ///< Abstract event processing function
     };
 
@@ -511,18 +542,30 @@ protected:
     csHash<psSectorInfo *> sectorinfo_by_id;   ///< Sector info list hashed by sector id
     csHash<psSectorInfo *> sectorinfo_by_name; ///< Sector info list hashed by sector name
     csPDelArray<psTrait > traitlist;
+    CacheIndex<psTrait> traits_by_id;
     csPDelArray<psRaceInfo > raceinfolist;
+    CacheIndex<psRaceInfo> raceinfo_by_id;
+    NameIndex<psRaceInfo> raceinfo_by_name;
+    CacheIndex<psRaceInfo, csString> raceinfo_by_mesh;
+    /// Races by race and gender, races without gender under every gender
+    CacheIndex<psRaceInfo> raceinfo_by_race_gender;
 
     csHash<psSkillInfo*, int> skillinfo_IDHash;
     csHash<psSkillInfo *, csString> skillinfo_NameHash;
     csHash<psSkillInfo *, int> skillinfo_CategoryHash;
 
     csPDelArray<psItemCategory > itemCategoryList;
+    CacheIndex<psItemCategory> itemcategory_by_id;
+    CacheIndex<psItemCategory, csString> itemcategory_by_name;
     csPDelArray<psWay > wayList;
+    CacheIndex<psWay> ways_by_id;
+    CacheIndex<psWay, csString> ways_by_name;
     csHash<Faction*, int> factions_by_id;
     csHash<Faction*, csString> factions;
     csHash<ProgressionScript*,csString> scripts;
     csPDelArray<psSpell > spellList;
+    CacheIndex<psSpell> spells_by_id;
+    NameIndex<psSpell> spells_by_name;
     //csArray<psItemStats *> basicitemstatslist;
     csHash<psItemStats *,uint32> itemStats_IDHash;
     csHash<psItemStats *,csString> itemStats_NameHash;
@@ -545,6 +588,9 @@ protected:
     csPDelArray<psMovement> movements;
     csPDelArray<psCharacterLimitation> limits;  ///< All the limitations based on scores for characters.
     psCommandManager* commandManager;
+
+    /// The queries PreloadAll() sent ahead, NULL once it is done
+    PreloadQuerySet* preloadQueries;
 };
 
 
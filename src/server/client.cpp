@@ -41,6 +41,7 @@
 //=============================================================================
 #include "usermanager.h"
 #include "client.h"
+#include "clients.h"
 #include "psserver.h"
 #include "playergroup.h"
 #include "globals.h"
@@ -59,6 +60,7 @@ Client::Client ()
       pathEffectID(0), pathPath(NULL), pathIsDisplaying(false),
       locationEffectID(0), locationIsDisplaying(false),cheatMask(NO_CHEAT)
 {
+    connections     = NULL;
     actor           = 0;
     target          = 0;
     exchangeID      = 0;
@@ -104,6 +106,30 @@ bool Client::Initialize(LPSOCKADDR_IN addr, uint32_t clientnum)
     return true;
 }
 
+void Client::SetName(const char* n)
+{
+    if (connections)
+        connections->UpdateIndexes(this, n, playerID, accountID);
+    else
+        name = n;
+}
+
+void Client::SetPID(PID id)
+{
+    if (connections)
+        connections->UpdateIndexes(this, name, id, accountID);
+    else
+        playerID = id;
+}
+
+void Client::SetAccountID(AccountID id)
+{
+    if (connections)
+        connections->UpdateIndexes(this, name, playerID, id);
+    else
+        accountID = id;
+}
+
 bool Client::Disconnect()
 {
     // Make sure the advisor system knows this client is gone.
@@ -42,6 +42,7 @@ class gemObject;
 class gemActor;
 class gemNPC;
 class psPath;
+class ClientConnectionSet;
 
 class FloodBuffRow
 {
@@ -112,7 +113,8 @@ public:
     void SetMute(bool flag) { mute = flag; }
     bool IsMute() { return mute; }
 
-    void SetName(const char* n) { name = n; }
+    /// Changes the name, keeping the name index of the ClientConnectionSet up to date.
+    void SetName(const char* n);
     const char* GetName() { return name; }
 
     // Additional Entity information
@@ -165,11 +167,11 @@ public:
 
     /// The account number for this client.
     AccountID GetAccountID() { return accountID; }
-    void SetAccountID(AccountID id) { accountID = id; }
+    void SetAccountID(AccountID id);
 
     /// The player number for this client.
     PID GetPID() { return playerID; }
-    void SetPID(PID id) { playerID = id; }
+    void SetPID(PID id);
 
     int GetExchangeID() { return exchangeID; }
     void SetExchangeID(int ID) { exchangeID = ID; }
@@ -237,6 +239,10 @@ public:
     bool IsSuperClient() { return superclient; }
     void SetSuperClient(bool flag) { superclient = flag; }
 
+    /// Did the client say it can inflate compressed messages when authenticating?
+    bool WantsCompression() { return compression; }
+    void SetCompression(bool flag) { compression = flag; }
+
     long GetIPAddress(char *addr)
     {
         unsigned int a1,a2,a3,a4;
@@ -376,6 +382,10 @@ public:
     bool GetBuddyListHide() { return isBuddyListHiding; }
 	
 protected:
+    friend class ClientConnectionSet;
+
+    /// The set indexing this client by name, PID and account, NULL until it is added.
+    ClientConnectionSet* connections;
 
     /**
      * A zombie client is a client where the player has disconnected, but
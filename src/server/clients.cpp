@@ -28,7 +28,7 @@
 
 //static int compareClientsByName(Client * const &, Client * const &);
 
-ClientConnectionSet::ClientConnectionSet():addrHash(307),hash(307)
+ClientConnectionSet::ClientConnectionSet():addrHash(307),hash(307),nameHash(307),pidHash(307),accountHash(307)
 {
 }
 
@@ -70,11 +70,54 @@ Client *ClientConnectionSet::Add(LPSOCKADDR_IN addr)
     }
 
     CS::Threading::RecursiveMutexScopedLock lock(mutex);
+    CS::Threading::ScopedWriteLock writelock(lookupLock);
     addrHash.PutUnique(SockAddress(client->GetAddress()), client);
     hash.Put(client->GetClientNum(), client);
+    client->connections = this;
+    Index(client);
     return client;
 }
 
+void ClientConnectionSet::Index(Client* client)
+{
+    if (!client->name.IsEmpty())
+    {
+        csString key(client->name);
+        nameHash.Put(key.Downcase(), client);
+    }
+    if (client->playerID.IsValid())
+        pidHash.Put(client->playerID, client);
+    if (client->accountID.IsValid())
+        accountHash.Put(client->accountID, client);
+}
+
+void ClientConnectionSet::Unindex(Client* client)
+{
+    if (!client->name.IsEmpty())
+    {
+        csString key(client->name);
+        nameHash.Delete(key.Downcase(), client);
+    }
+    if (client->playerID.IsValid())
+        pidHash.Delete(client->playerID, client);
+    if (client->accountID.IsValid())
+        accountHash.Delete(client->accountID, client);
+}
+
+void ClientConnectionSet::UpdateIndexes(Client* client, const char* name, PID playerID, AccountID accountID)
+{
+    // name may point into the client itself
+    csString newName(name);
+
+    CS::Threading::RecursiveMutexScopedLock lock(mutex);
+    CS::Threading::ScopedWriteLock writelock(lookupLock);
+    Unindex(client);
+    client->name = newName;
+    client->playerID = playerID;
+    client->accountID = accountID;
+    Index(client);
+}
+
 /*
 static int compareClientsByName(Client * const &a, Client * const &b)
 {
@@ -85,12 +128,15 @@ static int compareClientsByName(Client * const &a, Client * const &b)
 void ClientConnectionSet::MarkDelete(Client *client)
 {
 	CS::Threading::RecursiveMutexScopedLock lock (mutex);
+    CS::Threading::ScopedWriteLock writelock(lookupLock);
     
     uint32_t clientid = client->GetClientNum();
     if (!addrHash.DeleteAll(client->GetAddress()))
         Bug2("Couldn't delete client %d, it was never added!", clientid);
 
     hash.DeleteAll(clientid);
+    Unindex(client);
+    client->connections = NULL;
     toDelete.Push(client);
 }
 
@@ -111,7 +157,7 @@ Client *ClientConnectionSet::FindAny(uint32_t clientnum)
     if (clientnum==0)
         return NULL;
 
-    CS::Threading::RecursiveMutexScopedLock lock(mutex);
+    CS::Threading::ScopedReadLock lock(lookupLock);
     return hash.Get(clientnum, 0);
 }
 
@@ -120,7 +166,7 @@ Client *ClientConnectionSet::Find(uint32_t clientnum)
     if (clientnum==0)
         return NULL;
 
-    CS::Threading::RecursiveMutexScopedLock lock(mutex);
+    CS::Threading::ScopedReadLock lock(lookupLock);
     Client* temp = hash.Get(clientnum, 0);
 
     if (temp && temp->IsReady())
@@ -137,50 +183,35 @@ Client *ClientConnectionSet::Find(const char* name)
         return NULL;
     }
 
-    CS::Threading::RecursiveMutexScopedLock lock(mutex);
-    AddressHash::GlobalIterator it (addrHash.GetIterator ());
-    Client *p = NULL;
-    while(it.HasNext())
-    {
-        p = it.Next();
-        if (!p->GetName())
-            continue;
-
-        if (!strcasecmp(p->GetName(), name))
-            break;
-        p = NULL;
-    }
-
-    if (p && p->IsReady())
-        return p;
-    else
-        return NULL;
-}
-
-Client *ClientConnectionSet::FindPlayer(PID playerID)
-{
-    CS::Threading::RecursiveMutexScopedLock lock(mutex);
-    AddressHash::GlobalIterator it (addrHash.GetIterator ());
+    csString key(name);
+    key.Downcase();
 
+    CS::Threading::ScopedReadLock lock(lookupLock);
+    csHash<Client*, csString>::Iterator it(nameHash.GetIterator(key));
     while (it.HasNext())
     {
         Client *p = it.Next();
-        if (p->GetPID() == playerID)
+        if (p->IsReady())
             return p;
     }
 
     return NULL;
 }
 
-Client *ClientConnectionSet::FindAccount(AccountID accountID, uint32_t excludeClient)
+Client *ClientConnectionSet::FindPlayer(PID playerID)
 {
-    CS::Threading::RecursiveMutexScopedLock lock(mutex);
-    AddressHash::GlobalIterator it (addrHash.GetIterator ());
+    CS::Threading::ScopedReadLock lock(lookupLock);
+    return pidHash.Get(playerID, NULL);
+}
 
+Client *ClientConnectionSet::FindAccount(AccountID accountID, uint32_t excludeClient)
+{
+    CS::Threading::ScopedReadLock lock(lookupLock);
+    csHash<Client*, AccountID>::Iterator it(accountHash.GetIterator(accountID));
     while (it.HasNext())
     {
         Client *p = it.Next();
-        if (p->GetAccountID() == accountID && p->GetClientNum() != excludeClient)
+        if (p->GetClientNum() != excludeClient)
             return p;
     }
 
@@ -189,7 +220,7 @@ Client *ClientConnectionSet::FindAccount(AccountID accountID, uint32_t excludeCl
 
 Client *ClientConnectionSet::Find(LPSOCKADDR_IN addr)
 {
-    CS::Threading::RecursiveMutexScopedLock lock(mutex);
+    CS::Threading::ScopedReadLock lock(lookupLock);
 
     return addrHash.Get(SockAddress(*addr), NULL);
 }
@@ -199,7 +230,7 @@ csRef<NetPacketQueueRefCount> ClientConnectionSet::FindQueueAny(uint32_t clientn
     if (clientnum==0)
         return NULL;
     
-    CS::Threading::RecursiveMutexScopedLock lock(mutex);
+    CS::Threading::ScopedReadLock lock(lookupLock);
     Client *client = hash.Get(clientnum, 0);
     if(client)
         return client->outqueue;
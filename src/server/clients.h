@@ -21,6 +21,7 @@
 
 #include <csutil/hash.h>
 #include <csutil/threading/thread.h>
+#include <csutil/threading/rwmutex.h>
 
 #include "client.h"
 
@@ -51,8 +52,17 @@ public csHashComputerStruct<SockAddress> {};
 
 /**
  * This class is a list of several CLient objects, it's designed for finding
- * clients very fast based on their clientnum or their IP address.
- * This class is also threadsafe now
+ * clients very fast based on their clientnum, IP address, name, player id or
+ * account id.
+ *
+ * This class is also threadsafe now. Two locks are used:
+ * - mutex serializes all changes and is held by ClientIterator for the
+ *   whole iteration, so the game thread can keep calling into the set
+ *   (and even remove clients) while iterating.
+ * - lookupLock guards the hashes themselves. Lookups only take it for
+ *   reading, and changes take it for writing just around the hash updates,
+ *   so the network thread's FindAny() doesn't wait for an iteration in the
+ *   game thread to finish.
  */
 class ClientConnectionSet
 {
@@ -60,11 +70,25 @@ public:
     typedef csHash<Client*, SockAddress> AddressHash;
 protected:
     friend class ClientIterator;
+    friend class Client;
     
     AddressHash addrHash;
     csHash<Client*> hash;
+    /// Index by lower case name, names aren't unique before character selection.
+    csHash<Client*, csString> nameHash;
+    csHash<Client*, PID> pidHash;
+    /// Index by account, one account may have several clients while relogging.
+    csHash<Client*, AccountID> accountHash;
     csPDelArray<Client> toDelete;
     CS::Threading::RecursiveMutex mutex;
+    CS::Threading::ReadWriteMutex lookupLock;
+
+    /// Add or remove the client from the name, PID and account indexes. Needs lookupLock for writing.
+    void Index(Client* client);
+    void Unindex(Client* client);
+
+    /// Called by the Client setters to change the indexed values of a client in the set.
+    void UpdateIndexes(Client* client, const char* name, PID playerID, AccountID accountID);
 
 public:
     ClientConnectionSet();
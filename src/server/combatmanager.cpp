@@ -160,6 +160,22 @@ CombatManager::CombatManager() : pvp_region(NULL)
 
     staminacombat = psserver->GetMathScriptEngine()->FindScript("StaminaCombat");
 
+    varAttacker              = MathEnvironment::GetSlot("Attacker");
+    varTarget                = MathEnvironment::GetSlot("Target");
+    varAttackWeapon          = MathEnvironment::GetSlot("AttackWeapon");
+    varAttackWeaponSecondary = MathEnvironment::GetSlot("AttackWeaponSecondary");
+    varTargetAttackWeapon    = MathEnvironment::GetSlot("TargetAttackWeapon");
+    varAttackLocationItem    = MathEnvironment::GetSlot("AttackLocationItem");
+    varIAH                   = MathEnvironment::GetSlot("IAH");
+    varAHR                   = MathEnvironment::GetSlot("AHR");
+    varQOH                   = MathEnvironment::GetSlot("QOH");
+    varBlocked               = MathEnvironment::GetSlot("Blocked");
+    varFinalDamage           = MathEnvironment::GetSlot("FinalDamage");
+    varActor                 = MathEnvironment::GetSlot("Actor");
+    varWeapon                = MathEnvironment::GetSlot("Weapon");
+    varPhyDrain              = MathEnvironment::GetSlot("PhyDrain");
+    varMntDrain              = MathEnvironment::GetSlot("MntDrain");
+
     psserver->GetEventManager()->Subscribe(this,new NetMessageCallback<CombatManager>(this,&CombatManager::HandleDeathEvent),MSGTYPE_DEATH_EVENT,NO_VALIDATION);
 }
 
@@ -458,15 +474,15 @@ int CombatManager::CalculateAttack(psCombatGameEvent *event, psItem* subWeapon)
     event->AttackLocation = (INVENTORY_SLOT_NUMBER) targetLocations[randomgen->Get((int) targetLocations.GetSize())];
 
     MathEnvironment env;
-    env.Define("Attacker",              event->GetAttacker());
-    env.Define("Target",                event->GetTarget());
-    env.Define("AttackWeapon",          event->GetAttackerData()->Inventory().GetEffectiveWeaponInSlot(event->GetWeaponSlot()));
-    env.Define("AttackWeaponSecondary", subWeapon);
+    env.DefineSlot(varAttacker,              event->GetAttacker());
+    env.DefineSlot(varTarget,                event->GetTarget());
+    env.DefineSlot(varAttackWeapon,          event->GetAttackerData()->Inventory().GetEffectiveWeaponInSlot(event->GetWeaponSlot()));
+    env.DefineSlot(varAttackWeaponSecondary, subWeapon);
     // FIXME: The original code defined and redefined TargetAttackWeapon, which can't be right.
     //        Maybe this was supposed to be DefenseWeaponSecondary.  Probably not.  This needs cleaning.
-    env.Define("TargetAttackWeapon",    event->GetTargetData()->Inventory().GetEffectiveWeaponInSlot(event->GetWeaponSlot()));
-    env.Define("TargetAttackWeapon",    event->GetTargetData()->Inventory().GetEffectiveWeaponInSlot(otherHand));
-    env.Define("AttackLocationItem",    event->GetTargetData()->Inventory().GetEffectiveArmorInSlot(event->AttackLocation));
+    env.DefineSlot(varTargetAttackWeapon,    event->GetTargetData()->Inventory().GetEffectiveWeaponInSlot(event->GetWeaponSlot()));
+    env.DefineSlot(varTargetAttackWeapon,    event->GetTargetData()->Inventory().GetEffectiveWeaponInSlot(otherHand));
+    env.DefineSlot(varAttackLocationItem,    event->GetTargetData()->Inventory().GetEffectiveArmorInSlot(event->AttackLocation));
 
     calc_damage->Evaluate(&env);
 
@@ -476,10 +492,10 @@ int CombatManager::CalculateAttack(psCombatGameEvent *event, psItem* subWeapon)
         env.DumpAllVars();
     }
 
-    MathVar *IAH      = env.Lookup("IAH");         // IAH = If Attack Hit
-    MathVar *AHR      = env.Lookup("AHR");         // AHR = Attack Hit Roll
-    MathVar *blocked  = env.Lookup("Blocked");     // Blocked = Blocked by weapon
-    MathVar *damage   = env.Lookup("FinalDamage"); // Actual damage done, if any
+    MathVar *IAH      = env.LookupSlot(varIAH);         // IAH = If Attack Hit
+    MathVar *AHR      = env.LookupSlot(varAHR);         // AHR = Attack Hit Roll
+    MathVar *blocked  = env.LookupSlot(varBlocked);     // Blocked = Blocked by weapon
+    MathVar *damage   = env.LookupSlot(varFinalDamage); // Actual damage done, if any
     // QOH ("Quality of Hit") is also an output variable, supposedly, but isn't used by the code...
     if (IAH->GetValue() < 0.0)
         return ATTACK_MISSED;
@@ -769,11 +785,11 @@ void CombatManager::HandleCombatEvent(psCombatGameEvent *event)
     {
         // Input the stamina data
         MathEnvironment env;
-        env.Define("Actor",  gemAttacker);
-        env.Define("Weapon", weapon);
+        env.DefineSlot(varActor,  gemAttacker);
+        env.DefineSlot(varWeapon, weapon);
         staminacombat->Evaluate(&env);
-        MathVar *PhyDrain = env.Lookup("PhyDrain");
-        MathVar *MntDrain = env.Lookup("MntDrain");
+        MathVar *PhyDrain = env.LookupSlot(varPhyDrain);
+        MathVar *MntDrain = env.LookupSlot(varMntDrain);
 
         if ( (attacker_client->GetCharacterData()->GetStamina(true) < PhyDrain->GetValue())
             || (attacker_client->GetCharacterData()->GetStamina(false) < MntDrain->GetValue()) )
@@ -919,11 +935,11 @@ void CombatManager::HandleCombatEvent(psCombatGameEvent *event)
 
 void CombatManager::DebugOutput(psCombatGameEvent *event, const MathEnvironment & env)
 {
-    MathVar *IAH      = env.Lookup("IAH");         // IAH = If Attack Hit
-    MathVar *AHR      = env.Lookup("AHR");         // AHR = Attack Hit Roll
-    MathVar *QOH      = env.Lookup("QOH");         // QOH = Quality of Hit
-    MathVar *blocked  = env.Lookup("Blocked");     // Blocked = Blocked by weapon
-    MathVar *damage   = env.Lookup("FinalDamage"); // Actual damage done, if any
+    MathVar *IAH      = env.LookupSlot(varIAH);         // IAH = If Attack Hit
+    MathVar *AHR      = env.LookupSlot(varAHR);         // AHR = Attack Hit Roll
+    MathVar *QOH      = env.LookupSlot(varQOH);         // QOH = Quality of Hit
+    MathVar *blocked  = env.LookupSlot(varBlocked);     // Blocked = Blocked by weapon
+    MathVar *damage   = env.LookupSlot(varFinalDamage); // Actual damage done, if any
 
     psItem* item = event->GetAttackerData()->Inventory().GetEffectiveWeaponInSlot(event->GetWeaponSlot() );
 
@@ -92,6 +92,12 @@ private:
     /// if the player is too tired, stop fighting. We stop if we don't have enough stamina to make an attack with the current stance.
     MathScript* staminacombat;
 
+    /// The variables the combat scripts take and give, by MathEnvironment slot.
+    size_t varAttacker, varTarget, varAttackWeapon, varAttackWeaponSecondary;
+    size_t varTargetAttackWeapon, varAttackLocationItem;
+    size_t varIAH, varAHR, varQOH, varBlocked, varFinalDamage;
+    size_t varActor, varWeapon, varPhyDrain, varMntDrain;
+
     void HandleDeathEvent(MsgEntry *me,Client *client);
 
     bool ValidDistance(gemObject *attacker, gemObject *target, psItem *Weapon);
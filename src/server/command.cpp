@@ -321,6 +321,11 @@ int com_status(char *)
         hasBeenReady ? "loaded and running." : "not loaded.");
     CPrintf (CON_CMDOUTPUT ,"Connection Count : " COL_CYAN "%d\n" COL_NORMAL,
         psserver->GetNetManager()->GetConnections()->Count());
+
+    psDelayedWriteStats dbstats;
+    db->GetDelayedWriteStats(dbstats);
+    CPrintf (CON_CMDOUTPUT ,"DB write queue   : " COL_CYAN "%zu rows, last flush %u ms, slowest %u ms, %zu failed\n" COL_NORMAL,
+        dbstats.queueDepth, dbstats.lastFlushTime, dbstats.maxFlushTime, dbstats.rowsFailed);
     CPrintf (CON_CMDOUTPUT ,COL_GREEN "%-5s %-7s %-25s %14s %10s %9s %s %s %s %s\n" COL_NORMAL,"EID","PID","Name","CNum","Ready","Time con.", "RTT", "Window filled", "Est. packet loss", "Packets sent");
 
     ClientConnectionSet* clients = psserver->GetNetManager()->GetConnections();
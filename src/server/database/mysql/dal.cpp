@@ -19,12 +19,21 @@
 
 #include <psconfig.h>
 #include <csutil/stringarray.h>
+#include <iutil/cfgmgr.h>
+#include <iutil/objreg.h>
 
 #include "util/log.h"
 #include "util/consoleout.h"
 
 #include "dal.h"
 
+/// Default milliseconds between flushes of the delayed updates, 0 disables them
+#define DELAYED_WRITE_INTERVAL   2000
+/// Default number of rows combined into one statement
+#define DELAYED_WRITE_BATCH      100
+/// Default number of connections running SelectAsync() and CommandAsync()
+#define ASYNC_QUERY_CONNECTIONS  2
+
 // SCF definitions
 
 SCF_IMPLEMENT_FACTORY(psMysqlConnection)
@@ -36,10 +45,19 @@ SCF_IMPLEMENT_FACTORY(psMysqlConnection)
 psMysqlConnection::psMysqlConnection(iBase *iParent) : scfImplementationType(this, iParent)
 {
     conn = NULL;
+    objectReg = NULL;
+    logcsv = NULL;
+    streamconn = NULL;
+    streamBusy = false;
+    port = 0;
 }
 
 psMysqlConnection::~psMysqlConnection()
 {
+    StopDelayedWriter();
+    asyncPool.Stop();
+    if (streamconn)
+        mysql_close(streamconn);
     mysql_close(conn);
     conn = NULL;
 }
@@ -57,6 +75,12 @@ bool psMysqlConnection::Initialize(const char *host, unsigned int port, const ch
                               const char *user, const char *pwd, LogCSV* logcsv)
 {
     this->logcsv = logcsv;
+    this->host = host;
+    this->port = port;
+    this->database = database;
+    this->user = user;
+    this->pwd = pwd;
+
     // Create a mydb
     mysql_library_init(0, NULL, NULL);
     mysql_thread_init();
@@ -79,11 +103,76 @@ bool psMysqlConnection::Initialize(const char *host, unsigned int port, const ch
     dqmThread->SetPriority(THREAD_PRIO_HIGH);
 #endif
 
+    csTicks interval = DELAYED_WRITE_INTERVAL;
+    size_t batchsize = DELAYED_WRITE_BATCH;
+    int asyncconnections = ASYNC_QUERY_CONNECTIONS;
+    csRef<iConfigManager> configmanager = objectReg ? csQueryRegistry<iConfigManager>(objectReg) : 0;
+    if (configmanager)
+    {
+        interval = configmanager->GetInt("PlaneShift.Database.WriteBehind.Interval", DELAYED_WRITE_INTERVAL);
+        batchsize = configmanager->GetInt("PlaneShift.Database.WriteBehind.BatchSize", DELAYED_WRITE_BATCH);
+        asyncconnections = configmanager->GetInt("PlaneShift.Database.AsyncConnections", ASYNC_QUERY_CONNECTIONS);
+    }
+
+    // Without a pool the async queries run on this connection
+    csArray<AsyncQueryPool::Connection*> pool;
+    for (int i = 0; i < asyncconnections; i++)
+    {
+        MYSQL *poolconn = mysql_init(NULL);
+        if (!mysql_real_connect(poolconn,host,user,pwd,database,port,NULL,CLIENT_FOUND_ROWS))
+        {
+            printf("Failed to open async query connection: %s\n", mysql_error(poolconn));
+            mysql_close(poolconn);
+            break;
+        }
+        pool.Push(new dbAsyncConnection(poolconn));
+    }
+    asyncPool.Start(pool);
+
+    if (interval > 0)
+    {
+        MYSQL *writerconn = mysql_init(NULL);
+        if (mysql_real_connect(writerconn,host,user,pwd,database,port,NULL,CLIENT_FOUND_ROWS))
+        {
+#if MYSQL_VERSION_ID >= 50000
+            mysql_options(writerconn, MYSQL_OPT_RECONNECT, &my_true);
+#endif
+            writer.AttachNew(new DelayedWriteManager(new dbAsyncConnection(writerconn), interval, MAX(batchsize, 1)));
+            writerThread.AttachNew(new Thread(writer));
+            writerThread->Start();
+        }
+        else
+        {
+            // Without the second connection updates are written at once
+            printf("Failed to open the write behind connection, writing updates directly: %s\n", mysql_error(writerconn));
+            mysql_close(writerconn);
+        }
+    }
+
     return (conn == conn_check);
 }
 
+void psMysqlConnection::StopDelayedWriter()
+{
+    if (!writer)
+        return;
+
+    writer->Stop();
+    writerThread->Wait();
+    writerThread.Invalidate();
+    writer.Invalidate();
+}
+
 bool psMysqlConnection::Close()
 {
+    // The writer flushes its rows before the library goes away
+    StopDelayedWriter();
+    asyncPool.Stop();
+
+    if (streamconn)
+        mysql_close(streamconn);
+    streamconn = NULL;
+
     mysql_close(conn);
     conn = NULL;
 
@@ -166,6 +255,74 @@ unsigned long psMysqlConnection::CommandPump(const char *sql,...)
 #endif
 }
 
+void psMysqlConnection::SelectAsync(iQueryCallback* callback, const char *sql,...)
+{
+    csString querystr;
+    va_list args;
+
+    va_start(args, sql);
+    querystr.FormatV(sql, args);
+    va_end(args);
+
+    if (asyncPool.IsRunning())
+    {
+        asyncPool.Select(callback, querystr);
+        return;
+    }
+
+    iResultSet *rs = Select("%s", querystr.GetData());
+    if (!callback)
+    {
+        if (rs)
+            rs->Release();
+    }
+    else if (rs)
+        callback->QueryDone(rs, rs->Count(), NULL);
+    else
+        callback->QueryDone(NULL, QUERY_FAILED, GetLastError());
+}
+
+void psMysqlConnection::CommandAsync(iQueryCallback* callback, const char *sql,...)
+{
+    csString querystr;
+    va_list args;
+
+    va_start(args, sql);
+    querystr.FormatV(sql, args);
+    va_end(args);
+
+    if (asyncPool.IsRunning())
+    {
+        asyncPool.Command(callback, querystr);
+        return;
+    }
+
+    unsigned long affected = Command("%s", querystr.GetData());
+    if (callback)
+        callback->QueryDone(NULL, affected, (affected == QUERY_FAILED) ? GetLastError() : NULL);
+}
+
+size_t psMysqlConnection::GetAsyncQueueDepth()
+{
+    return asyncPool.GetQueueDepth();
+}
+
+iResultSet* dbAsyncConnection::Select(const char* sql)
+{
+    if (mysql_query(conn, sql))
+        return NULL;
+
+    return new psResultSet(conn);
+}
+
+unsigned long dbAsyncConnection::Command(const char* sql)
+{
+    if (mysql_query(conn, sql))
+        return QUERY_FAILED;
+
+    return (unsigned long) mysql_affected_rows(conn);
+}
+
 unsigned long psMysqlConnection::Command(const char *sql,...)
 {
     psStopWatch timer;
@@ -225,6 +382,45 @@ iResultSet *psMysqlConnection::Select(const char *sql, ...)
         return NULL;
 }
 
+iResultSet *psMysqlConnection::SelectStream(const char *sql, ...)
+{
+    psStopWatch timer;
+    csString querystr;
+    va_list args;
+
+    va_start(args, sql);
+    querystr.FormatV(sql, args);
+    va_end(args);
+
+    lastquery = querystr;
+
+    if (!streamconn)
+    {
+        MYSQL *newconn = mysql_init(NULL);
+        streamconn = mysql_real_connect(newconn,host,user,pwd,database,port,NULL,CLIENT_FOUND_ROWS);
+        if (!streamconn)
+        {
+            printf("Failed to open the streaming connection: %s\n", mysql_error(newconn));
+            mysql_close(newconn);
+        }
+    }
+
+    // Another stream is still open, or no connection for it
+    if (!streamconn || streamBusy)
+        return Select("%s", querystr.GetData());
+
+    timer.Start();
+    if (!mysql_query(streamconn, querystr))
+    {
+        // Only the time to the first row, the rest is read on the way
+        profs.AddSQLTime(querystr, timer.Stop());
+        streamBusy = true;
+        return new psStreamResultSet(streamconn, &streamBusy);
+    }
+    else
+        return NULL;
+}
+
 int psMysqlConnection::SelectSingleNumber(const char *sql, ...)
 {
     psStopWatch timer;
@@ -428,6 +624,39 @@ iRecord* psMysqlConnection::NewInsertPreparedStatement(const char* table, unsign
     return new dbInsert(conn, table, count, logcsv, file, line);
 }
 
+iRecord* psMysqlConnection::NewDelayedUpdateStatement(const char* table, const char* idfield, unsigned int count, const char* file, unsigned int line)
+{
+    if (!writer)
+        return new dbUpdate(conn, table, idfield, count, logcsv, file, line);
+
+    return new dbDelayedUpdate(conn, writer, table, idfield, count, file, line);
+}
+
+void psMysqlConnection::FlushDelayed()
+{
+    if (writer)
+        writer->Flush();
+}
+
+bool psMysqlConnection::FlushDelayed(const char* table, uint32 id)
+{
+    return writer ? writer->Flush(table, id) : false;
+}
+
+void psMysqlConnection::FlushDelayed(const char* table, const char* field, uint32 value)
+{
+    if (writer)
+        writer->Flush(table, field, value);
+}
+
+void psMysqlConnection::GetDelayedWriteStats(psDelayedWriteStats& stats)
+{
+    if (writer)
+        writer->GetStats(stats);
+    else
+        memset(&stats, 0, sizeof(stats));
+}
+
 psResultSet::psResultSet(MYSQL *conn)
 {
     rs = mysql_store_result(conn);
@@ -459,9 +688,99 @@ iResultRow& psResultSet::operator[](unsigned long whichrow)
     return row;
 }
 
+iResultRow* psResultSet::Next()
+{
+    unsigned long next = current + 1; // current starts at -1
+    if (next >= rows)
+        return NULL;
+
+    return &(*this)[next];
+}
+
+psStreamResultSet::psStreamResultSet(MYSQL *conn, bool *busy)
+{
+    this->conn = conn;
+    this->busy = busy;
+    rows = 0;
+    current = (unsigned long) -1;
+
+    rs = mysql_use_result(conn);
+    if (rs)
+    {
+        row.SetMaxFields(mysql_num_fields(rs));
+        row.SetResultSet(rs);
+    }
+    else
+        error = mysql_error(conn);
+}
+
+psStreamResultSet::~psStreamResultSet()
+{
+    // Reads whatever is left, the connection is free after that
+    if (rs)
+        mysql_free_result(rs);
+    *busy = false;
+}
+
+iResultRow& psStreamResultSet::operator[](unsigned long whichrow)
+{
+    CS_ASSERT_MSG("Streamed results can't go back", whichrow + 1 >= current + 1);
+    while (rs && current != whichrow && Next())
+        ;
+    return row;
+}
+
+iResultRow* psStreamResultSet::Next()
+{
+    if (!rs || !error.IsEmpty())
+        return NULL;
+
+    if (row.FetchNext())
+    {
+        // The end of the rows, or the connection failed on the way
+        if (mysql_errno(conn))
+            error = mysql_error(conn);
+        return NULL;
+    }
+
+    current++;
+    rows++;
+    return &row;
+}
+
+unsigned int psResultRow::HashName(const char *name)
+{
+    unsigned int hash = 5381;
+    for (; *name; name++)
+        hash = hash * 33 + (unsigned char) tolower(*name);
+    return hash;
+}
+
 void psResultRow::SetResultSet(void * resultsettoken)
 {
     rs = (MYSQL_RES *)resultsettoken;
+
+    // Index the column names once, instead of scanning them on every access
+    fieldcount = mysql_num_fields(rs);
+    fieldinfo = mysql_fetch_fields(rs);
+
+    size_t size = 8;
+    while (size < (size_t) fieldcount * 2)
+        size *= 2;
+    nameTable.SetSize(size, -1);
+
+    for (int i = 0; i < fieldcount; i++)
+    {
+        if (!fieldinfo[i].name)
+            continue;
+
+        // The first of several columns with the same name wins
+        size_t slot = HashName(fieldinfo[i].name) & (size - 1);
+        while (nameTable[slot] >= 0 && strcasecmp(fieldinfo[nameTable[slot]].name, fieldinfo[i].name))
+            slot = (slot + 1) & (size - 1);
+        if (nameTable[slot] < 0)
+            nameTable[slot] = i;
+    }
 }
 
 int psResultRow::Fetch(int row)
@@ -479,6 +798,19 @@ int psResultRow::Fetch(int row)
     }
 }
 
+int psResultRow::FetchNext()
+{
+    rr = mysql_fetch_row(rs);
+
+    if (rr)
+        return 0;   // success
+    else
+    {
+        max = 0;    // no fields will make operator[]'s safe
+        return 1;
+    }
+}
+
 const char *psResultRow::operator[](int whichfield)
 {
     if (whichfield >= 0 && whichfield < max)
@@ -487,58 +819,95 @@ const char *psResultRow::operator[](int whichfield)
         return "";
 }
 
-const char *psResultRow::operator[](const char *fieldname)
+int psResultRow::GetFieldIndex(const char *fieldname)
 {
-  MYSQL_FIELD *field;
-  CS_ASSERT(fieldname);
-  CS_ASSERT(max); // trying to access when no fields returned in row! probably empty resultset.
+    CS_ASSERT(fieldname);
 
-  int i;
-
-  for ( i=last_index; (field=mysql_fetch_field(rs)); i++)
-  {
-    if (field->name && !strcasecmp(field->name,fieldname))
+    // Fields are often read in the order of the columns
+    if (last_index < fieldcount && fieldinfo[last_index].name &&
+        !strcasecmp(fieldinfo[last_index].name, fieldname))
     {
-      last_index = i+1;
-      return rr[i];
+        return last_index++;
     }
-  }
-  mysql_field_seek(rs, 0);
-  for (i=0; (i<last_index) && (field=mysql_fetch_field(rs)); i++)
-  {
-    if (field->name && !strcasecmp(field->name,fieldname))
+
+    if (nameTable.IsEmpty())
+        return -1;
+
+    size_t mask = nameTable.GetSize() - 1;
+    for (size_t slot = HashName(fieldname) & mask; nameTable[slot] >= 0; slot = (slot + 1) & mask)
     {
-      last_index = i+1;
-      return rr[i];
+        int i = nameTable[slot];
+        if (!strcasecmp(fieldinfo[i].name, fieldname))
+        {
+            last_index = i + 1;
+            return i;
+        }
     }
-  }
+    return -1;
+}
+
+const char *psResultRow::operator[](const char *fieldname)
+{
+  CS_ASSERT(fieldname);
+  CS_ASSERT(max); // trying to access when no fields returned in row! probably empty resultset.
+
+  int i = GetFieldIndex(fieldname);
+  if (i >= 0)
+      return operator[](i);
+
   CPrintf(CON_BUG, "Could not find field %s!. Exiting.\n",fieldname);
   CS_ASSERT(false);
   return ""; // Illegal name.
 }
 
+/// atoi() for the plain decimals MySQL sends, without the locale and errno work.
+static inline int ParseInt(const char *ptr)
+{
+    const char *p = (*ptr == '-') ? ptr + 1 : ptr;
+    if (*p < '0' || *p > '9')
+        return atoi(ptr);
+
+    unsigned int value = 0;
+    for (; *p >= '0' && *p <= '9'; p++)
+        value = value * 10 + (*p - '0');
+    return (*ptr == '-') ? -(int)value : (int)value;
+}
+
+/// strtoul() the same way, negative values are left to strtoul().
+static inline unsigned long ParseUInt(const char *ptr)
+{
+    const char *p = ptr;
+    if (*p < '0' || *p > '9')
+        return strtoul(ptr,NULL,10);
+
+    unsigned long value = 0;
+    for (; *p >= '0' && *p <= '9'; p++)
+        value = value * 10 + (*p - '0');
+    return value;
+}
+
 int psResultRow::GetInt(int whichfield)
 {
     const char *ptr = this->operator [](whichfield);
-    return (ptr)?atoi(ptr):0;
+    return (ptr)?ParseInt(ptr):0;
 }
 
 int psResultRow::GetInt(const char *fieldname)
 {
     const char *ptr = this->operator [](fieldname);
-    return (ptr)?atoi(ptr):0;
+    return (ptr)?ParseInt(ptr):0;
 }
 
 unsigned long psResultRow::GetUInt32(int whichfield)
 {
     const char *ptr = this->operator [](whichfield);
-    return (ptr)?strtoul(ptr,NULL,10):0;
+    return (ptr)?ParseUInt(ptr):0;
 }
 
 unsigned long psResultRow::GetUInt32(const char *fieldname)
 {
     const char *ptr = this->operator [](fieldname);
-    return (ptr)?strtoul(ptr,NULL,10):0;
+    return (ptr)?ParseUInt(ptr):0;
 }
 
 float psResultRow::GetFloat(int whichfield)
@@ -731,6 +1100,87 @@ bool dbUpdate::Prepare()
 }
 
 
+dbDelayedUpdate::dbDelayedUpdate(MYSQL* db, DelayedWriteManager* writer, const char* Table, const char* Idfield, unsigned int count, const char* file, unsigned int line)
+{
+    conn = db;
+    this->writer = writer;
+    table = Table;
+    idfield = Idfield;
+    index = 0;
+    this->count = count;
+    this->file = file;
+    this->line = line;
+
+    // count includes the id field, like dbUpdate
+    fields.SetSize(count);
+    values.SetSize(count);
+}
+
+void dbDelayedUpdate::AddValue(const char* fname, const char* value)
+{
+    CS_ASSERT_MSG("Error: too many fields", index + 1 < count);
+    fields[index] = fname;
+    values[index] = value;
+    index++;
+}
+
+void dbDelayedUpdate::AddField(const char* fname, float fValue)
+{
+    csString value;
+    value.Format("%.9g", fValue);
+    AddValue(fname, value);
+}
+
+void dbDelayedUpdate::AddField(const char* fname, int iValue)
+{
+    csString value;
+    value.Format("%d", iValue);
+    AddValue(fname, value);
+}
+
+void dbDelayedUpdate::AddField(const char* fname, unsigned int uiValue)
+{
+    csString value;
+    value.Format("%u", uiValue);
+    AddValue(fname, value);
+}
+
+void dbDelayedUpdate::AddField(const char* fname, unsigned short usValue)
+{
+    csString value;
+    value.Format("%u", (unsigned int) usValue);
+    AddValue(fname, value);
+}
+
+void dbDelayedUpdate::AddField(const char* fname, const char* sValue)
+{
+    size_t len = strlen(sValue);
+    char* buff = new char[len*2+1];
+    mysql_real_escape_string(conn, buff, sValue, (unsigned long)len);
+
+    csString value;
+    value.Format("'%s'", buff);
+    delete[] buff;
+    AddValue(fname, value);
+}
+
+void dbDelayedUpdate::AddFieldNull(const char* fname)
+{
+    AddValue(fname, "NULL");
+}
+
+bool dbDelayedUpdate::Execute(uint32 uid)
+{
+    CS_ASSERT_MSG("Error: wrong number of expected fields", index + 1 == count);
+
+    if (!writer->Queue(table, idfield, uid, fields, values, index))
+    {
+        printf("Delayed update of %s %u from %s:%u after the writer stopped\n", table.GetData(), uid, file, line);
+        return false;
+    }
+    return true;
+}
+
 #ifdef USE_DELAY_QUERY
 
 DelayedQueryManager::DelayedQueryManager(const char *host, unsigned int port, const char *database,
@@ -12,6 +12,9 @@
 #include <csutil/scf.h>
 #include <csutil/scf_implementation.h>
 #include <csutil/threading/thread.h>
+#include <csutil/threading/condition.h>
+#include <csutil/hash.h>
+#include <csutil/set.h>
 
 #include "iutil/comp.h"
 
@@ -22,6 +25,8 @@
 #include <csutil/csstring.h>
 #include "util/stringarray.h"
 #include "util/dbprofile.h"
+#include "util/asyncquery.h"
+#include "util/delayedwrite.h"
 
 using namespace CS::Threading;
 
@@ -55,6 +60,24 @@ private:
 };
 #endif
 
+/// A connection of the async query pool.
+class dbAsyncConnection : public AsyncQueryPool::Connection
+{
+public:
+    dbAsyncConnection(MYSQL* conn) : conn(conn) {}
+    virtual ~dbAsyncConnection() { mysql_close(conn); }
+
+    virtual void ThreadInit() { mysql_thread_init(); }
+    virtual void ThreadEnd() { mysql_thread_end(); }
+
+    virtual iResultSet* Select(const char* sql);
+    virtual unsigned long Command(const char* sql);
+    virtual const char* GetLastError() { return mysql_error(conn); }
+
+private:
+    MYSQL* conn;
+};
+
 class psMysqlConnection : public scfImplementation2<psMysqlConnection, iComponent, iDataConnection>
 {
 protected:
@@ -66,6 +89,22 @@ protected:
     csString profileDump;
     LogCSV* logcsv;
 
+    /// Writes the rows of delayed updates, NULL if write behind is disabled
+    csRef<DelayedWriteManager> writer;
+    csRef<Thread> writerThread;
+
+    /// Stop the delayed update writer after it wrote all queued rows.
+    void StopDelayedWriter();
+
+    /// Runs SelectAsync() and CommandAsync(), not running if disabled
+    AsyncQueryPool asyncPool;
+
+    /// Connection of SelectStream(), opened when first needed
+    MYSQL *streamconn;
+    bool streamBusy;
+    csString host, database, user, pwd;
+    unsigned int port;
+
 public:
     psMysqlConnection(iBase *iParent);
     virtual ~psMysqlConnection();
@@ -84,10 +123,15 @@ public:
     void Escape(csString& to, const char *from);
     
     iResultSet *Select(const char *sql,...);
+    iResultSet *SelectStream(const char *sql,...);
     int SelectSingleNumber(const char *sql, ...);
     unsigned long Command(const char *sql,...);
     unsigned long CommandPump(const char *sql,...);
 
+    void SelectAsync(iQueryCallback* callback, const char *sql,...);
+    void CommandAsync(iQueryCallback* callback, const char *sql,...);
+    size_t GetAsyncQueueDepth();
+
     uint64 GenericInsertWithID(const char *table,const char **fieldnames,psStringArray& fieldvalues);
     bool GenericUpdateWithID(const char *table,const char *idfield,const char *id,const char **fieldnames,psStringArray& fieldvalues);
     bool GenericUpdateWithID(const char *table,const char *idfield,const char *id,psStringArray& fields);
@@ -106,6 +150,12 @@ public:
     
     iRecord* NewUpdatePreparedStatement(const char* table, const char* idfield, unsigned int count, const char* file, unsigned int line);
     iRecord* NewInsertPreparedStatement(const char* table, unsigned int count, const char* file, unsigned int line);
+    iRecord* NewDelayedUpdateStatement(const char* table, const char* idfield, unsigned int count, const char* file, unsigned int line);
+
+    void FlushDelayed();
+    bool FlushDelayed(const char* table, uint32 id);
+    void FlushDelayed(const char* table, const char* field, uint32 value);
+    void GetDelayedWriteStats(psDelayedWriteStats& stats);
 
 #ifdef USE_DELAY_QUERY    
     csRef<DelayedQueryManager> dqm;
@@ -122,12 +172,22 @@ protected:
     int max;
     int last_index;
 
+    /// The columns, and their indexes hashed by lower case name
+    MYSQL_FIELD *fieldinfo;
+    int fieldcount;
+    csArray<int> nameTable;
+
+    static unsigned int HashName(const char *name);
+
 public:
     psResultRow()
     {
         rr = NULL;
         rs = NULL;
-    last_index=0;
+        max = 0;
+        last_index=0;
+        fieldinfo = NULL;
+        fieldcount = 0;
     };
 
     void SetMaxFields(int fields)  {    max = fields;   };
@@ -135,9 +195,19 @@ public:
 
     int Fetch(int row);
 
+    /// Fetch the row after the current one, for results that can't seek.
+    int FetchNext();
+
     const char *operator[](int whichfield);
     const char *operator[](const char *fieldname);
 
+    int GetFieldIndex(const char *fieldname);
+    int GetFieldCount() { return fieldcount; }
+    const char *GetFieldName(int whichfield)
+    {
+        return (whichfield >= 0 && whichfield < fieldcount) ? fieldinfo[whichfield].name : NULL;
+    }
+
     int GetInt(int whichfield);
     int GetInt(const char *fieldname);
 
@@ -170,6 +240,41 @@ public:
     iResultRow& operator[](unsigned long whichrow);
 
     unsigned long Count(void) { return rows; };
+
+    iResultRow* Next();
+};
+
+/**
+ * A result read from the server row by row with mysql_use_result().
+ * The connection can't run other queries until it is released.
+ */
+class psStreamResultSet : public iResultSet
+{
+protected:
+    MYSQL *conn;
+    MYSQL_RES *rs;
+    unsigned long rows, current;
+    psResultRow  row;
+    bool *busy;
+    csString error;
+
+public:
+    /// 'busy' is cleared when the result is released and the connection free again.
+    psStreamResultSet(MYSQL *conn, bool *busy);
+    virtual ~psStreamResultSet();
+
+    void Release(void) { delete this; };
+
+    /// Only rows at or after the current one can be reached.
+    iResultRow& operator[](unsigned long whichrow);
+
+    /// The number of rows read so far.
+    unsigned long Count(void) { return rows; };
+
+    iResultRow* Next();
+
+    /// Set if reading a row failed, the rows returned so far are not all of them then.
+    const char* GetError() { return error.IsEmpty() ? NULL : error.GetData(); }
 };
 
 class dbRecord : public iRecord
@@ -303,6 +408,52 @@ public:
     virtual bool Prepare();
 
 };
+
+/**
+ * An update that DelayedWriteManager writes later. The values are turned
+ * into SQL literals as they are added, Execute() hands them to the writer.
+ */
+class dbDelayedUpdate : public iRecord
+{
+protected:
+    MYSQL* conn;
+    csRef<DelayedWriteManager> writer;
+    csString table;
+    csString idfield;
+
+    csArray<csString> fields;
+    csArray<csString> values;
+    unsigned int index;
+    unsigned int count;
+
+    // Useful for debugging
+    const char* file;
+    unsigned int line;
+
+    void AddValue(const char* fname, const char* value);
+
+public:
+    dbDelayedUpdate(MYSQL* db, DelayedWriteManager* writer, const char* Table, const char* Idfield, unsigned int count, const char* file, unsigned int line);
+
+    void Reset()
+    {
+        index = 0;
+    }
+
+    void AddField(const char* fname, float fValue);
+
+    void AddField(const char* fname, int iValue);
+
+    void AddField(const char* fname, unsigned int uiValue);
+
+    void AddField(const char* fname, unsigned short usValue);
+
+    void AddField(const char* fname, const char* sValue);
+
+    void AddFieldNull(const char* fname);
+
+    virtual bool Execute(uint32 uid);
+};
     
 #endif
 
@@ -684,6 +684,7 @@ PID EntityManager::CopyNPCFromDatabase(PID master_id, float x, float y, float z,
     if (psServer::CharacterLoader.NewNPCCharacterData(0, npc))
     {
         new_id = npc->GetPID();
+        db->FlushDelayed("characters", new_id.Unbox());
         db->Command("UPDATE characters SET npc_master_id=%d WHERE id=%d", master_id.Unbox(), new_id.Unbox());
     }
 
@@ -25,6 +25,8 @@
 #include <iengine/campos.h>
 #include <iengine/mesh.h>
 #include <iengine/movable.h>
+#include <iengine/portal.h>
+#include <iengine/portalcontainer.h>
 #include <ivideo/txtmgr.h>
 #include <ivideo/texture.h>
 #include <iutil/objreg.h>
@@ -36,6 +38,7 @@
 #include <csgeom/transfrm.h>
 #include <csutil/snprintf.h>
 #include <csutil/hash.h>
+#include <csutil/set.h>
 #include <imesh/object.h>
 #include <imesh/spritecal3d.h>
 #include <imesh/nullmesh.h>
@@ -113,6 +116,9 @@
 /// Lifetime of a chat history line, in ticks
 #define CHAT_HISTORY_LIFETIME 300000 // 5 minutes
 
+/// Cell width of the entity grid, close to the proximity list range
+#define ENTITY_GRID_CELL 50.0f
+
 //-----------------------------------------------------------------------------
 
 psGemServerMeshAttach::psGemServerMeshAttach(gemObject* objectToAttach) : scfImplementationType(this)
@@ -126,7 +132,7 @@ psGemServerMeshAttach::psGemServerMeshAttach(gemObject* objectToAttach) : scfImp
 GEMSupervisor *gemObject::cel = NULL;
 
 GEMSupervisor::GEMSupervisor(iObjectRegistry *objreg,
-                             psDatabase *db)
+                             psDatabase *db) : entityGrid(ENTITY_GRID_CELL)
 {
     object_reg = objreg;
     database = db;
@@ -166,6 +172,10 @@ GEMSupervisor::~GEMSupervisor()
         psserver->GetEventManager()->Unsubscribe(this,MSGTYPE_STATDRUPDATE);
         psserver->GetEventManager()->Unsubscribe(this,MSGTYPE_STATS);
     }
+
+    csHash<csArray<PortalLink>*, csPtrKey<iSector> >::GlobalIterator it(portalLinks.GetIterator());
+    while (it.HasNext())
+        delete it.Next();
 }
 
 void GEMSupervisor::HandleMessage(MsgEntry *me,Client *client)
@@ -228,6 +238,7 @@ void GEMSupervisor::AddEntity(gemObject *obj, EID objEid)
 {
     CS_ASSERT(!entities_by_eid.Contains(objEid));
     entities_by_eid.Put(objEid, obj);
+    UpdateEntityPosition(obj);
     Debug3(LOG_CELPERSIST,0,"Entity <%s> added to supervisor as %s\n", obj->GetName(), ShowID(objEid));
 }
 
@@ -261,6 +272,7 @@ void GEMSupervisor::RemoveEntity(gemObject *which)
         return;
 
     entities_by_eid.Delete(which->GetEID(), which);
+    entityGrid.Remove(which);
     Debug3(LOG_CELPERSIST,0,"Entity <%s, %s> removed from supervisor.\n", which->GetName(), ShowID(which->GetEID()));
 
 }
@@ -531,26 +543,94 @@ gemObject* GEMSupervisor::FindAttachedObject( iObject* object )
     return found;
 }
 
+struct GEMSupervisor::PortalLink
+{
+    iSector* target;               ///< The sector on the other side
+    csBox3 bbox;                   ///< World space bounds of the portal polygon
+    csReversibleTransform warp;    ///< Takes positions from this sector to the target
+};
+
+const csArray<GEMSupervisor::PortalLink>* GEMSupervisor::GetPortalLinks(iSector* sector)
+{
+    csArray<PortalLink>* links = portalLinks.Get(sector, NULL);
+    if (links)
+        return links;
+
+    links = new csArray<PortalLink>;
+    const csSet<csPtrKey<iMeshWrapper> >& portals = sector->GetPortalMeshes();
+    csSet<csPtrKey<iMeshWrapper> >::GlobalIterator it = portals.GetIterator();
+    while (it.HasNext())
+    {
+        iPortalContainer* pc = it.Next()->GetPortalContainer();
+        for (int j = 0; j < pc->GetPortalCount(); j++)
+        {
+            iPortal* portal = pc->GetPortal(j);
+            if (!portal->CompleteSector(0) || portal->GetSector() == sector)
+                continue;
+
+            PortalLink link;
+            link.target = portal->GetSector();
+            const csVector3* vertices = portal->GetWorldVertices();
+            const int* indices = portal->GetVertexIndices();
+            for (int v = 0; v < portal->GetVertexIndicesCount(); v++)
+                link.bbox.AddBoundingVertex(vertices[indices[v]]);
+            if (portal->GetFlags().Check(CS_PORTAL_WARP))
+                link.warp = portal->GetWarp();
+            links->Push(link);
+        }
+    }
+
+    portalLinks.Put(sector, links);
+    return links;
+}
+
+void GEMSupervisor::UpdateEntityPosition(gemObject* obj)
+{
+    entityGrid.Update(obj, obj->GetSector(), obj->GetPosition());
+}
+
 csArray<gemObject*> GEMSupervisor::FindNearbyEntities( iSector* sector, const csVector3& pos, float radius, bool doInvisible )
 {
     csArray<gemObject*> list;
+    if (!sector)
+        return list;
+
+    // Look in this sector and in every sector seen through a portal within
+    // the radius, the way the engine looks for nearby meshes.
+    csArray<iSector*> visited;
+    csArray<iSector*> sectors;
+    csArray<csVector3> positions;
+    visited.Push(sector);
+    sectors.Push(sector);
+    positions.Push(pos);
 
-    csRef<iMeshWrapperIterator> obj_it =  engine->GetNearbyMeshes( sector, pos, radius );
-    while (obj_it->HasNext())
+    for (size_t s = 0; s < sectors.GetSize(); s++)
     {
-        iMeshWrapper* m = obj_it->Next();
-        if (!doInvisible)
+        iSector* current = sectors[s];
+        csVector3 center = positions[s];
+        entityGrid.Query(current, center, radius, list);
+
+        const csArray<PortalLink>* links = GetPortalLinks(current);
+        for (size_t i = 0; i < links->GetSize(); i++)
         {
-            bool invisible = m->GetFlags().Check(CS_ENTITY_INVISIBLE);
-            if (invisible)
+            const PortalLink& link = links->Get(i);
+            if (visited.Find(link.target) != csArrayItemNotFound)
+                continue;
+            if (link.bbox.SquaredPosDist(center) > radius * radius)
                 continue;
-        }
 
-        gemObject* object = FindAttachedObject(m->QueryObject());
+            visited.Push(link.target);
+            sectors.Push(link.target);
+            positions.Push(link.warp * center);
+        }
+    }
 
-        if (object)
+    if (!doInvisible)
+    {
+        for (size_t i = list.GetSize(); i-- > 0; )
         {
-            list.Push( object );
+            if (list[i]->GetMeshWrapper()->GetFlags().Check(CS_ENTITY_INVISIBLE))
+                list.DeleteIndexFast(i);
         }
     }
 
@@ -739,6 +819,7 @@ iMeshWrapper *gemObject::GetMeshWrapper()
 void gemObject::Move(const csVector3& pos,float rotangle, iSector* room)
 {
     pcmesh->MoveMesh(room, rotangle, pos);
+    cel->UpdateEntityPosition(this);
 }
 
 bool gemObject::IsNear(gemObject *obj, float radius, bool ignoreY)
@@ -1208,6 +1289,12 @@ double gemItem::GetProperty(const char *prop)
     return itemdata->GetProperty(prop);
 }
 
+double gemItem::GetPropertyByID(PropertyID id)
+{
+    CS_ASSERT(itemdata);
+    return itemdata->GetPropertyByID(id);
+}
+
 double gemItem::CalcFunction(const char *f, const double *params)
 {
     CS_ASSERT(itemdata);
@@ -2006,26 +2093,51 @@ gemActor::~gemActor()
     delete pcmove;
 }
 
-double gemActor::GetProperty(const char *prop)
+/// Numbers of the properties gemActor::GetPropertyByID() switches on
+enum
 {
-    csString property(prop);
+    ACTORPROP_COMBATSTANCE,
+    ACTORPROP_ISADVISORBANNED,
+    ACTORPROP_ADVISORPOINTS
+};
 
-    if (property == "CombatStance")
-    {
-        // Backwards compatibility.
-        return GetCombatStance().stance_id;
-    }
-    else if (property == "IsAdvisorBanned")
+static PropertyTable BuildActorProperties()
+{
+    PropertyTable table;
+    table.Add("CombatStance", ACTORPROP_COMBATSTANCE);
+    table.Add("IsAdvisorBanned", ACTORPROP_ISADVISORBANNED);
+    table.Add("AdvisorPoints", ACTORPROP_ADVISORPOINTS);
+    return table;
+}
+
+static const PropertyTable actorProperties = BuildActorProperties();
+
+double gemActor::GetProperty(const char *prop)
+{
+    PropertyID id = PropertyNames::Find(prop);
+    if (id == PROPERTY_UNKNOWN)
     {
-        return (double) (GetClient() ? GetClient()->IsAdvisorBanned() : true);
+        CS_ASSERT(psChar);
+        return psChar->GetProperty(prop);
     }
-    else if (property == "AdvisorPoints")
+    return GetPropertyByID(id);
+}
+
+double gemActor::GetPropertyByID(PropertyID id)
+{
+    switch (actorProperties.Get(id))
     {
-        return (double) (GetClient() ? GetClient()->GetAdvisorPoints() : 0);
+        case ACTORPROP_COMBATSTANCE:
+            // Backwards compatibility.
+            return GetCombatStance().stance_id;
+        case ACTORPROP_ISADVISORBANNED:
+            return (double) (GetClient() ? GetClient()->IsAdvisorBanned() : true);
+        case ACTORPROP_ADVISORPOINTS:
+            return (double) (GetClient() ? GetClient()->GetAdvisorPoints() : 0);
     }
 
     CS_ASSERT(psChar);
-    return psChar->GetProperty(prop);
+    return psChar->GetPropertyByID(id);
 }
 
 double gemActor::CalcFunction(const char *f, const double *params)
@@ -2309,10 +2421,13 @@ void gemActor::Resurrect()
 
 void gemActor::InvokeAttackScripts(gemActor *defender, psItem *weapon)
 {
+    static const size_t varAttacker = MathEnvironment::GetSlot("Attacker");
+    static const size_t varDefender = MathEnvironment::GetSlot("Defender");
+    static const size_t varWeapon   = MathEnvironment::GetSlot("Weapon");
     MathEnvironment env;
-    env.Define("Attacker", this);
-    env.Define("Defender", defender);
-    env.Define("Weapon",   weapon);
+    env.DefineSlot(varAttacker, this);
+    env.DefineSlot(varDefender, defender);
+    env.DefineSlot(varWeapon,   weapon);
 
     for (size_t i = 0; i < onAttackScripts.GetSize(); i++)
     {
@@ -2322,10 +2437,13 @@ void gemActor::InvokeAttackScripts(gemActor *defender, psItem *weapon)
 
 void gemActor::InvokeDefenseScripts(gemActor *attacker, psItem *weapon)
 {
+    static const size_t varAttacker = MathEnvironment::GetSlot("Attacker");
+    static const size_t varDefender = MathEnvironment::GetSlot("Defender");
+    static const size_t varWeapon   = MathEnvironment::GetSlot("Weapon");
     MathEnvironment env;
-    env.Define("Attacker", attacker);
-    env.Define("Defender", this);
-    env.Define("Weapon",   weapon);
+    env.DefineSlot(varAttacker, attacker);
+    env.DefineSlot(varDefender, this);
+    env.DefineSlot(varWeapon,   weapon);
 
     for (size_t i = 0; i < onDefenseScripts.GetSize(); i++)
     {
@@ -3284,18 +3402,24 @@ void gemActor::ApplyStaminaCalculations(const csVector3& v, float times)
         #endif
 
         // Stuff goes in
+        static const size_t varSpeed       = MathEnvironment::GetSlot("Speed");
+        static const size_t varAscentAngle = MathEnvironment::GetSlot("AscentAngle");
+        static const size_t varWeight      = MathEnvironment::GetSlot("Weight");
+        static const size_t varMaxWeight   = MathEnvironment::GetSlot("MaxWeight");
+        static const size_t varMaxStamina  = MathEnvironment::GetSlot("MaxStamina");
+        static const size_t varDrain       = MathEnvironment::GetSlot("Drain");
         MathEnvironment env;
-        env.Define("Speed",       Speed);                                       // How fast you're moving
-        env.Define("AscentAngle", Angle);                                       // How steep your climb is
-        env.Define("Weight",      psChar->Inventory().GetCurrentTotalWeight()); // How much you're carrying
-        env.Define("MaxWeight",   psChar->Inventory().MaxWeight());             // How much you can carry
-        env.Define("MaxStamina",  psChar->GetMaxPStamina().Current());          // Max stamina of the character
+        env.DefineSlot(varSpeed,       Speed);                                       // How fast you're moving
+        env.DefineSlot(varAscentAngle, Angle);                                       // How steep your climb is
+        env.DefineSlot(varWeight,      psChar->Inventory().GetCurrentTotalWeight()); // How much you're carrying
+        env.DefineSlot(varMaxWeight,   psChar->Inventory().MaxWeight());             // How much you can carry
+        env.DefineSlot(varMaxStamina,  psChar->GetMaxPStamina().Current());          // Max stamina of the character
 
         // Do stuff with stuff
         script->Evaluate(&env);
 
         // Stuff comes out
-        MathVar* drain = env.Lookup("Drain");
+        MathVar* drain = env.LookupSlot(varDrain);
         float value = drain->GetValue();
         //value *= times;
 
@@ -3350,6 +3474,7 @@ bool gemActor::SetDRData(psDRMessage& drmsg)
     }
 	pcmove->SetDRData(drmsg.on_ground,1.0f,drmsg.pos,drmsg.yrot,drmsg.sector,drmsg.vel,drmsg.worldVel,drmsg.ang_vel);
 	DRcounter = drmsg.counter;
+    cel->UpdateEntityPosition(this);
 
 
     // Apply stamina only on PCs
@@ -3453,6 +3578,7 @@ bool gemActor::UpdateDR()
     pcmove->SetOnGround(true);
     pcmove->UpdateDR();
     pcmove->SetOnGround(on_ground);
+    cel->UpdateEntityPosition(this);
     return true;
 }
 
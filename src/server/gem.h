@@ -40,6 +40,7 @@
 
 #include "util/gameevent.h"
 #include "util/consoleout.h"
+#include "util/spatialgrid.h"
 
 #include "net/npcmessages.h"  // required for psNPCCommandsMessage::PerceptionType
 
@@ -251,6 +252,15 @@ public:
       */
     csArray<gemObject*> FindNearbyEntities (iSector* sector, const csVector3& pos, float radius, bool doInvisible = false);
 
+    /** @brief Refresh the position of an entity in the spatial grid.
+      *
+      * Must be called whenever the mesh of the entity is moved, or
+      * FindNearbyEntities() will find it at its old position.
+      *
+      * @param obj The entity that moved.
+      */
+    void UpdateEntityPosition(gemObject* obj);
+
 protected:
     /** @brief Get the next ID for an object.
       *
@@ -268,6 +278,16 @@ protected:
 
     /// Stored here to save expensive csQueryRegistry calls
     csRef<iEngine> engine;
+
+    struct PortalLink;
+    /** @brief Get the portals leading out of a sector.
+      *
+      * Built on first use, the portals of the server world never move.
+      */
+    const csArray<PortalLink>* GetPortalLinks(iSector* sector);
+
+    SpatialGrid<gemObject> entityGrid;                            ///< All entities in the world by position.
+    csHash<csArray<PortalLink>*, csPtrKey<iSector> > portalLinks; ///< The portals out of each sector.
 };
 
 //-----------------------------------------------------------------------------
@@ -501,6 +521,7 @@ public:
 
     /// iScriptableVar implementation
     virtual double GetProperty(const char *ptr);
+    virtual double GetPropertyByID(PropertyID id);
     virtual double CalcFunction(const char *functionName, const double *params);
 
     virtual float GetBaseAdvertiseRange();
@@ -801,6 +822,7 @@ public:
 
     /// iScriptableVar implementation
     virtual double GetProperty(const char *ptr);
+    virtual double GetPropertyByID(PropertyID id);
     virtual double CalcFunction(const char *functionName, const double *params);
 
     bool SetupCharData();
@@ -1236,7 +1258,7 @@ public:
 
     virtual void DeleteObjectCallback(iDeleteNotificationObject * object)
     {
-        SetValid(false); // Prevent the Trigger from beeing called.
+        CancelEvent(); // Prevent the Trigger from beeing called.
 
         if (dependency.IsValid())
         {
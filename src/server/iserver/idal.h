@@ -24,6 +24,40 @@ class iRecord;
 class psDBProfiles;
 class LogCSV;
 
+/// Counters of the background writer behind iDataConnection::NewDelayedUpdateStatement().
+struct psDelayedWriteStats
+{
+    size_t queueDepth;      ///< Rows waiting to be written
+    size_t rowsQueued;      ///< Rows handed to Execute() so far
+    size_t rowsCoalesced;   ///< Of those, merged into a row that was still waiting
+    size_t rowsWritten;     ///< Rows the database accepted
+    size_t rowsFailed;      ///< Rows the database refused
+    size_t flushes;         ///< Batches of rows written
+    csTicks lastFlushTime;  ///< Milliseconds the last flush took
+    csTicks maxFlushTime;   ///< Milliseconds the slowest flush took
+    csTicks totalFlushTime; ///< Milliseconds spent flushing so far
+};
+
+/**
+ * Receives the outcome of iDataConnection::SelectAsync() and CommandAsync().
+ * QueryDone() is called on a database thread, implementations hand the
+ * outcome over to the game thread. psDBQueryEvent does that.
+ */
+class iQueryCallback
+{
+public:
+    /**
+     * @param result The rows of a select, NULL for commands and failed
+     *               selects. The callback owns it and must Release() it.
+     * @param affected Rows changed by a command or found by a select,
+     *                 QUERY_FAILED if the query failed.
+     * @param error The database error if the query failed, else NULL.
+     */
+    virtual void QueryDone(iResultSet* result, unsigned long affected, const char* error)=0;
+
+    virtual ~iQueryCallback() {}
+};
+
 struct iDataConnection : public virtual iBase
 {
 public:
@@ -49,6 +83,16 @@ public:
      */
     virtual iResultSet *Select(const char *sql,...)=0;
 
+    /**
+     * Like Select(), but the rows are read from the server as they are
+     * walked with iResultSet::Next() instead of all at once, so a large
+     * result takes little memory. Use it for big preload queries. The rows
+     * can only be walked forward, and Count() is the number of rows read so
+     * far. The query runs on a connection of its own, other queries may be
+     * run while the result is open.
+     */
+    virtual iResultSet *SelectStream(const char *sql,...)=0;
+
     /**
      * Special function for handling database selects which result in a single
      * value returned, since this behavior is so common.
@@ -63,6 +107,22 @@ public:
     virtual unsigned long Command(const char *sql,...)=0;
     virtual unsigned long CommandPump(const char *sql,...) = 0;
 
+    /**
+     * Run a select on one of the connections of the async pool and hand
+     * the rows to 'callback' when done. Returns at once.
+     */
+    virtual void SelectAsync(iQueryCallback* callback, const char *sql,...)=0;
+
+    /**
+     * Run a command on the async pool, like SelectAsync(). 'callback' may
+     * be NULL if nobody cares about the outcome. Commands of the pool are
+     * not ordered with those run by Command() or with each other.
+     */
+    virtual void CommandAsync(iQueryCallback* callback, const char *sql,...)=0;
+
+    /// Number of async queries waiting for a connection of the pool.
+    virtual size_t GetAsyncQueueDepth()=0;
+
     /**
      * This dynamically builds an insert sql statement
      * from the supplied table name, field name array,
@@ -106,6 +166,40 @@ public:
     
     virtual iRecord* NewUpdatePreparedStatement(const char* table, const char* idfield, unsigned int count, const char* file, unsigned int line) =0;
     virtual iRecord* NewInsertPreparedStatement(const char* table, unsigned int count, const char* file, unsigned int line) = 0;
+
+    /**
+     * Like NewUpdatePreparedStatement(), but Execute() only queues the row
+     * for a background writer and returns at once. Rows queued again before
+     * they are written are merged, the newest value of each field wins.
+     * Queued rows are written in batches every few seconds, on FlushDelayed()
+     * and on Close(). If write behind is disabled this is a plain prepared
+     * update.
+     */
+    virtual iRecord* NewDelayedUpdateStatement(const char* table, const char* idfield, unsigned int count, const char* file, unsigned int line) = 0;
+
+    /**
+     * Wait until every row queued by a delayed update is written. Call it
+     * before reading rows that may still be waiting.
+     */
+    virtual void FlushDelayed() = 0;
+
+    /**
+     * Wait until the queued delayed update of this row, if there is one, is
+     * written. Call it before updating the row directly, or the queued row
+     * overwrites that update when it is written later. Returns true if the
+     * row was queued.
+     */
+    virtual bool FlushDelayed(const char* table, uint32 id) = 0;
+
+    /**
+     * Wait until the queued delayed updates of 'table' that set 'field' to
+     * 'value' are written, such as the rows of one owner. Rows that are
+     * queued with another value are not waited for.
+     */
+    virtual void FlushDelayed(const char* table, const char* field, uint32 value) = 0;
+
+    /// Fill in the counters of the delayed update writer, all 0 if it is disabled.
+    virtual void GetDelayedWriteStats(psDelayedWriteStats& stats) = 0;
 };
 
 
@@ -146,6 +240,19 @@ public:
      */
     virtual const char *operator[](const char *fieldname)=0;
 
+    /**
+     * The zero-based index of the column with the given name, or -1 if
+     * there is none. Resolve names once with this and read the fields of
+     * many rows by index.
+     */
+    virtual int GetFieldIndex(const char *fieldname)=0;
+
+    /// The number of columns of the result.
+    virtual int GetFieldCount()=0;
+
+    /// The name of a column, NULL if there is no such column.
+    virtual const char *GetFieldName(int whichfield)=0;
+
     virtual int GetInt(int whichfield)=0;
     virtual int GetInt(const char *fieldname)=0;
 
@@ -180,6 +287,19 @@ public:
      */
     virtual unsigned long Count(void)=0;
 
+    /**
+     * Moves to the row after the last one returned, starting with the
+     * first. Returns NULL after the last row.
+     */
+    virtual iResultRow* Next()=0;
+
+    /**
+     * The error that ended the rows early, NULL if Next() returned NULL
+     * after the last row. Only a streamed result can fail while its rows
+     * are read, stored results fail in the Select() itself.
+     */
+    virtual const char* GetError() { return NULL; }
+
     /**
      * Deletes itself.  This must be a member of the plugin class rather
      * than letting the caller delete it due to a Windows assertion error
@@ -484,6 +484,7 @@ void psMarriageManager::DeleteMarriageInfo(  psCharacter* charData )
             iResultRow& row = result[0];
             unsigned int id = row.GetUInt32("id");
             
+            db->FlushDelayed("characters", id);
             query.Format("UPDATE characters SET lastname=old_lastname, old_lastname='' WHERE id=%d", id);
             
             if(!db->Command( query.GetData()))
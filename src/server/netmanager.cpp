@@ -32,6 +32,7 @@
 #include "net/message.h"
 #include "net/messages.h"
 #include "net/netpacket.h"
+#include "net/netcompress.h"
 
 #include "bulkobjects/psaccountinfo.h"
 
@@ -59,17 +60,14 @@
 class DelayedMessageSendEvent : public psGameEvent
 {
 protected:
-	bool valid;
 	csRef<MsgEntry> myMsg;
 
 public:
 	DelayedMessageSendEvent(int delayticks,MsgEntry *msg)
 		: psGameEvent(0, delayticks, "DelayedMessageSendEvent")
 	{
-		valid = true;
 		myMsg = msg;
 	}
-	void CancelEvent() { valid = false;}
 	virtual void Trigger()
 	{
 		if (valid)
@@ -109,6 +107,20 @@ bool NetManager::Initialize(int client_firstmsg, int npcclient_firstmsg, int tim
 
     SetMsgStrings(CacheManager::GetSingleton().GetMsgStrings(), 0);
 
+    // Large lists and entity dumps are worth compressing, see SetCompressionThreshold().
+    SetCompressedType(MSGTYPE_GUIINVENTORY, true);
+    SetCompressedType(MSGTYPE_GUIMERCHANT, true);
+    SetCompressedType(MSGTYPE_GUISTORAGE, true);
+    SetCompressedType(MSGTYPE_GUIGUILD, true);
+    SetCompressedType(MSGTYPE_GUISKILL, true);
+    SetCompressedType(MSGTYPE_SPELL_BOOK, true);
+    SetCompressedType(MSGTYPE_QUESTLIST, true);
+    SetCompressedType(MSGTYPE_CHARACTERDETAILS, true);
+    SetCompressedType(MSGTYPE_PETITION, true);
+    SetCompressedType(MSGTYPE_CRAFT_INFO, true);
+    SetCompressedType(MSGTYPE_ALLENTITYPOS, true);
+    SetCompressedType(MSGTYPE_PERSIST_ALL_ENTITIES, true);
+
     return true;
 }
 
@@ -227,8 +239,6 @@ bool NetManager::HandleUnknownClient (LPSOCKADDR_IN addr, MsgEntry* me)
 
 void NetManager::CheckResendPkts()
 {	
-	// NOTE: Globaliterators on csHash do not retrieve keys contiguously.
-    csHash<csRef<psNetPacketEntry>, PacketKey>::GlobalIterator it (awaitingack.GetIterator());
     csRef<psNetPacketEntry> pkt;
     csArray<csRef<psNetPacketEntry> > pkts;
     csArray<Connection*> resentConnections;
@@ -239,13 +249,9 @@ void NetManager::CheckResendPkts()
     csTicks currenttime = csGetTicks();
     unsigned int resentCount = 0;
 
-    while(it.HasNext())
-    {
-        pkt = it.Next();
-        // Check the connection packet timeout
-        if (pkt->timestamp + MIN(PKTMAXRTO, pkt->RTO) < currenttime)
-            pkts.Push(pkt);
-    }
+    // Only the packets whose RTO expired are returned, no need to scan the pool.
+    GetExpiredPkts(currenttime, pkts);
+
     for (size_t i = 0; i < pkts.GetSize(); i++)
     {
 #ifdef PACKETDEBUG
@@ -257,7 +263,7 @@ void NetManager::CheckResendPkts()
         csRef<NetPacketQueueRefCount> outqueue = clients.FindQueueAny(pkt->clientnum);
         if (!outqueue)
         {
-            awaitingack.Delete(PacketKey(pkt->clientnum, pkt->packet->pktid), pkt);
+            RemoveAwaitingAck(pkt);
             continue;
         }
         
@@ -267,7 +273,11 @@ void NetManager::CheckResendPkts()
         	if (resentConnections.Find(connection) == csArrayItemNotFound)
         		resentConnections.Push(connection);
         	if (fullConnections.Find(connection) != csArrayItemNotFound)
+        	{
+        		// Retry on the next check
+        		ScheduleResend(pkt, currenttime);
         		continue;
+        	}
         	// This indicates a bug in the netcode.
         	if (pkt->RTO == 0)
         	{
@@ -298,11 +308,13 @@ void NetManager::CheckResendPkts()
 
             if (packet->offset == 0) 
             {
-                psMessageBytes* msg = (psMessageBytes*) packet->data;
+                psMessageBytes* msg = (psMessageBytes*) pkt->GetPacketData();
                 type = msg->type;
             }
             Error4("Queue full. Could not add packet with clientnum %d type %s ID %d.\n", pkt->clientnum, type == 0 ? "Fragment" : (const char *)  GetMsgTypeName(type), pkt->packet->pktid);
             fullConnections.Push(connection);
+            // Still awaiting ack, try again when the new RTO expires.
+            ScheduleResend(pkt, pkt->timestamp + MIN(PKTMAXRTO, pkt->RTO));
             continue;
         }
 
@@ -318,7 +330,7 @@ void NetManager::CheckResendPkts()
         //printf("pkt=%p, pkt->packet=%p\n",pkt,pkt->packet);
         // take out of awaiting ack pool.
         // This does NOT delete the pkt mem block itself.
-        if (!awaitingack.Delete(PacketKey(pkt->clientnum, pkt->packet->pktid), pkt))
+        if (!RemoveAwaitingAck(pkt))
         {
 #ifdef PACKETDEBUG
             Debug2(LOG_NET,"No packet in ack queue :%d\n", pkt->packet->pktid);
@@ -394,7 +406,72 @@ bool NetManager::SendMessageDelayed(MsgEntry *me, csTicks delay)
 	}
 }
 
+/**
+ * The shared payload of a message going to many clients, and its compressed
+ * form for clients that asked for compression, are each built only once
+ * and only when the first client needs them.
+ */
+class NetManager::FanOut
+{
+public:
+    FanOut(NetManager* netmanager, MsgEntry* me)
+        : netmanager(netmanager), msg(me)
+    {
+        compress = netmanager->ShouldCompress(me);
+    }
+
+    void SendTo(Client* client)
+    {
+        if (compress && client->WantsCompression())
+        {
+            if (!compressed)
+            {
+                compressed = psNetCompression::Compress(msg);
+                if (compressed)
+                    compressedpayload.AttachNew(new psNetSharedPayload(compressed->bytes));
+                else
+                    compress = false;  // Doesn't get any smaller
+            }
+            if (compressed)
+            {
+                compressed->clientnum = client->GetClientNum();
+                netmanager->SendMessage(compressed, compressedpayload);
+                return;
+            }
+        }
+
+        if (!payload)
+            payload.AttachNew(new psNetSharedPayload(msg->bytes));
+
+        msg->clientnum = client->GetClientNum();
+        netmanager->SendMessage(msg, payload);
+    }
+
+private:
+    NetManager* netmanager;
+    MsgEntry* msg;
+    bool compress;
+    csRef<psNetSharedPayload> payload;
+    csRef<MsgEntry> compressed;
+    csRef<psNetSharedPayload> compressedpayload;
+};
+
 bool NetManager::SendMessage(MsgEntry* me)
+{
+    if (ShouldCompress(me))
+    {
+        Client* client = clients.FindAny(me->clientnum);
+        if (client && client->WantsCompression())
+        {
+            csRef<MsgEntry> compressed = psNetCompression::Compress(me);
+            if (compressed)
+                return SendMessage(compressed, NULL);
+        }
+    }
+    return SendMessage(me, NULL);
+}
+
+bool NetManager::SendMessage(MsgEntry* me, psNetSharedPayload* payload)
 {
     bool sendresult;
     csRef<NetPacketQueueRefCount> outqueue = clients.FindQueueAny(me->clientnum);
@@ -410,7 +487,7 @@ bool NetManager::SendMessage(MsgEntry* me)
      *  In actuality a false response does not actually mean no data was added to the queue, just that
      *  not all of the data could be added.
      */
-    sendresult=NetBase::SendMessage(me,outqueue);
+    sendresult=NetBase::SendMessage(me,outqueue,payload);
 
     /**
      * The senders list is a list of busy queues.  The SendOut() function
@@ -549,7 +626,8 @@ void NetManager::Broadcast(MsgEntry *me, int scope, int guildID)
             newmsg.AttachNew(new MsgEntry(me));
             newmsg->msgid = GetRandomID();
 
-            // Message is copied again into packet sections, so we can reuse same one.
+            // The message is copied once and shared by the packets of all clients.
+            FanOut fanout(this, newmsg);
             ClientIterator i(clients);
 
             while(i.HasNext())
@@ -571,8 +649,7 @@ void NetManager::Broadcast(MsgEntry *me, int scope, int guildID)
                 if (!p->IsReady())
                     continue;
 
-                newmsg->clientnum = p->GetClientNum();
-                SendMessage (newmsg);
+                fanout.SendTo(p);
             }
 
             CHECK_FINAL_DECREF(newmsg, "BroadcastMsg");
@@ -592,7 +669,8 @@ void NetManager::Broadcast(MsgEntry *me, int scope, int guildID)
             newmsg.AttachNew(new MsgEntry(me));
             newmsg->msgid = GetRandomID();
 
-            // Message is copied again into packet sections, so we can reuse same one.
+            // The message is copied once and shared by the packets of all clients.
+            FanOut fanout(this, newmsg);
             ClientIterator i(clients);
 
             while(i.HasNext())
@@ -600,8 +678,7 @@ void NetManager::Broadcast(MsgEntry *me, int scope, int guildID)
                 Client *p = i.Next();
                 if (p->GetGuildID() == guildID)
                 {
-                    newmsg->clientnum = p->GetClientNum();
-                    SendMessage (newmsg);
+                    fanout.SendTo(p);
                 }
             }
 
@@ -624,7 +701,7 @@ void NetManager::Broadcast(MsgEntry *me, int scope, int guildID)
             0, 0, (uint32_t) newmsg->bytes->GetTotalSize(),
             (uint16_t) newmsg->bytes->GetTotalSize(), newmsg->bytes));
         // this will also delete the pkt
-        SendFinalPacket(pkt);
+        SendFinalPacketNow(pkt);
 
         CHECK_FINAL_DECREF(newmsg, "FinalPacket");
         break;
@@ -648,6 +725,9 @@ Client *NetManager::GetAnyClient(int cnum)
 
 void NetManager::Multicast (MsgEntry* me, const csArray<PublishDestination>& multi, int except, float range)
 {
+    // Copied on the first recipient, then shared by the packets of all of them.
+    FanOut fanout(this, me);
+
     for (size_t i=0; i<multi.GetSize(); i++)
     {
          if (multi[i].client==except)  // skip the exception client to avoid circularity
@@ -658,8 +738,7 @@ void NetManager::Multicast (MsgEntry* me, const csArray<PublishDestination>& mul
         {
             if (range == 0 || multi[i].dist < range)
             {
-                me->clientnum = multi[i].client;
-                SendMessage(me);      // This copies the mem block, so we can reuse.
+                fanout.SendTo(c);
             }
         }
     }
@@ -133,6 +133,15 @@ public:
      * @return Returns success or faliure.
      */
     virtual bool SendMessage (MsgEntry* me);
+
+    /** Sends the given message to the client listed in the message using
+     * a payload built once for all recipients, see Broadcast and Multicast.
+     *
+     * @param me: The message, its client number is the destination.
+     * @param payload: The serialized message shared by all recipients.
+     * @return Returns success or faliure.
+     */
+    bool SendMessage (MsgEntry* me, psNetSharedPayload* payload);
     /**
      * Queues the message for sending later, so the calling classes don't have 
      * to all manage this themselves.
@@ -182,6 +191,11 @@ protected:
     virtual bool HandleUnknownClient (LPSOCKADDR_IN addr, MsgEntry* msg);
 
 private:
+    /**
+     * A message going out to many clients, see Broadcast and Multicast.
+     */
+    class FanOut;
+
     /**
      * This cycles through set of pkts awaiting ack and resends old ones.
      */
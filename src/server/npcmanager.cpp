@@ -575,6 +575,7 @@ void NPCManager::HandleAuthentRequest(MsgEntry *me,Client *notused)
     client->SetName(msg.sUser);
     client->SetAccountID( acctinfo->accountid );
     client->SetSuperClient( true );
+    client->SetCompression(msg.compression);
 
     char addr[30];
     client->GetIPAddress(addr);
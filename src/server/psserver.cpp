@@ -386,6 +386,8 @@ bool psServer::Initialize(iObjectRegistry* object_reg)
     configmanager->GetInt("PlaneShift.Server.Port", 1243);
     Debug3(LOG_STARTUP,0,COL_BLUE "Listening on '%s' Port %d." COL_NORMAL,
             (const char*) serveraddr, port);
+    netmanager->SetBatchedIO(configmanager->GetBool("PlaneShift.Server.BatchedIO", true));
+    netmanager->SetCompressionThreshold(configmanager->GetInt("PlaneShift.Server.CompressThreshold", 512));
     if (!netmanager->Bind(serveraddr, port))
     {
         delete netmanager;
@@ -111,6 +111,14 @@ void psServerStatusRunEvent::Trigger ()
         if(!obj->GetClient() && obj->GetCharacterData())
             ReportNPC(obj->GetCharacterData(), reportString);
     }
+    // Write behind queue of the database
+    psDelayedWriteStats dbstats;
+    db->GetDelayedWriteStats(dbstats);
+    reportString.AppendFmt("<database write_queue=\"%zu\" rows_queued=\"%zu\" rows_coalesced=\"%zu\" rows_written=\"%zu\" rows_failed=\"%zu\" flushes=\"%zu\" last_flush_ms=\"%u\" max_flush_ms=\"%u\" avg_flush_ms=\"%u\" />\n",
+        dbstats.queueDepth, dbstats.rowsQueued, dbstats.rowsCoalesced, dbstats.rowsWritten, dbstats.rowsFailed,
+        dbstats.flushes, dbstats.lastFlushTime, dbstats.maxFlushTime,
+        dbstats.flushes ? (unsigned int)(dbstats.totalFlushTime / dbstats.flushes) : 0);
+
     reportString.Append( "</server_report>" );
     
     csRef<iFile> logFile = psserver->vfs->Open( ServerStatus::reportFile, VFS_FILE_WRITE );            
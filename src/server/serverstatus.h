@@ -58,6 +58,8 @@ class psServer;
  *             title="guild rank" 
  *             security="security level"  
  *             secret="yes|no" /&gt;
+ *  &lt;database write_queue="rows waiting to be written"
+ *             last_flush_ms="time the last write took" ... /&gt;
  *  &lt;server_report&gt; 
  */
 
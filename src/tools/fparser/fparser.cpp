@@ -245,7 +245,8 @@ template<typename Value_t>
 FunctionParserBase<Value_t>::Data::Data():
     referenceCounter(1),
     numVariables(0),
-    StackSize(0)
+    StackSize(0),
+    CompiledResult(0)
 {}
 
 template<typename Value_t>
@@ -261,7 +262,10 @@ FunctionParserBase<Value_t>::Data::Data(const Data& rhs):
 #ifndef FP_USE_THREAD_SAFE_EVAL
     Stack(rhs.StackSize),
 #endif
-    StackSize(rhs.StackSize)
+    StackSize(rhs.StackSize),
+    Compiled(rhs.Compiled),
+    CompiledFrame(rhs.CompiledFrame),
+    CompiledResult(rhs.CompiledResult)
 {
     for(typename namePtrsType<Value_t>::const_iterator i =
             rhs.namePtrs.begin();
@@ -803,6 +807,7 @@ int FunctionParserBase<Value_t>::ParseFunction(const char* function,
     data->ByteCode.clear(); data->ByteCode.reserve(128);
     data->Immed.clear(); data->Immed.reserve(128);
     data->StackSize = StackPtr = 0;
+    data->Compiled.clear(); data->CompiledFrame.clear();
 
     const char* ptr = CompileExpression(function);
     if(parseErrorType != FP_NO_ERROR) return int(errorLocation - function);
@@ -56,6 +56,13 @@ public:
     Value_t Eval(const Value_t* Vars);
     int EvalError() const;
 
+    // Compiled evaluation (fpcompiled.cpp). Compile() turns the bytecode
+    // into register operations EvalCompiled() runs without a stack
+    // machine. If a function can't be compiled, or was parsed again since,
+    // EvalCompiled() is the same as Eval().
+    bool Compile();
+    Value_t EvalCompiled(const Value_t* Vars);
+
     bool AddConstant(const std::string& name, Value_t value);
     bool AddUnit(const std::string& name, Value_t value);
 
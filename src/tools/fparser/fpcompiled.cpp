@@ -0,0 +1,524 @@
+/***************************************************************************\
+|* Function Parser for C++ v4.0.5                                          *|
+|*-------------------------------------------------------------------------*|
+|* Copyright: Juha Nieminen, Joel Yliluoma                                 *|
+|*                                                                         *|
+|* This library is distributed under the terms of the                      *|
+|* GNU Lesser General Public License version 3.                            *|
+|* (See lgpl.txt and gpl.txt for the license text.)                        *|
+\***************************************************************************/
+
+/* Compiled evaluation.
+
+   Eval() runs the bytecode on a stack: every variable and constant is
+   pushed before it is used, and every opcode goes through one big switch.
+   Compile() runs the bytecode once on a stack of frame locations instead
+   of values, and emits an operation wherever a value is computed:
+
+       x*2+y   (push x, push 2, mul, push y, add)
+
+   becomes
+
+       r0 = v0 * i0
+       r0 = r0 + v1
+
+   Variables and constants are read where they are, so only the
+   computations remain. EvalCompiled() runs the operations through the
+   handler pointers they carry, each handler returning the next one.
+
+   The frame holds the immediates, then the variables, then one register
+   for each stack position. Registers are only ever referred to from the
+   same or a higher stack position, so a register can be written as soon
+   as its stack position is, and both branches of an if() leave their
+   value in the same register.
+*/
+
+#include "fpconfig.h"
+#include "fparser.h"
+
+#include <map>
+#include <vector>
+#include <cmath>
+using namespace std;
+
+#include "fptypes.h"
+using namespace FUNCTIONPARSERTYPES;
+
+#ifdef FP_USE_THREAD_SAFE_EVAL_WITH_ALLOCA
+#ifndef FP_USE_THREAD_SAFE_EVAL
+#define FP_USE_THREAD_SAFE_EVAL
+#endif
+#endif
+
+namespace
+{
+    template<typename Value_t>
+    struct Handlers
+    {
+        typedef CompiledOp<Value_t> Op;
+
+#define FP_UNARY(name, expr) \
+        static const Op* name(const Op* op, Value_t* f, int&) \
+        { const Value_t& x = f[op->a]; f[op->dst] = (expr); return op + 1; }
+
+#define FP_UNARY_CHECKED(name, fail, error, expr) \
+        static const Op* name(const Op* op, Value_t* f, int& err) \
+        { \
+            const Value_t& x = f[op->a]; \
+            if(fail) { err = error; return 0; } \
+            f[op->dst] = (expr); return op + 1; \
+        }
+
+#define FP_BINARY(name, expr) \
+        static const Op* name(const Op* op, Value_t* f, int&) \
+        { \
+            const Value_t& x = f[op->a]; const Value_t& y = f[op->b]; \
+            f[op->dst] = (expr); return op + 1; \
+        }
+
+#define FP_BINARY_CHECKED(name, fail, error, expr) \
+        static const Op* name(const Op* op, Value_t* f, int& err) \
+        { \
+            const Value_t& x = f[op->a]; const Value_t& y = f[op->b]; \
+            if(fail) { err = error; return 0; } \
+            f[op->dst] = (expr); return op + 1; \
+        }
+
+#ifndef FP_NO_EVALUATION_CHECKS
+# define FP_CHECK(cond) (cond)
+#else
+# define FP_CHECK(cond) false
+#endif
+
+        FP_UNARY(Abs, fp_abs(x))
+        FP_UNARY_CHECKED(Acos, FP_CHECK(x < Value_t(-1) || x > Value_t(1)), 4, fp_acos(x))
+        FP_UNARY_CHECKED(Acosh, FP_CHECK(x < Value_t(1)), 4, fp_acosh(x))
+        FP_UNARY_CHECKED(Asin, FP_CHECK(x < Value_t(-1) || x > Value_t(1)), 4, fp_asin(x))
+        FP_UNARY(Asinh, fp_asinh(x))
+        FP_UNARY(Atan, fp_atan(x))
+        FP_BINARY(Atan2, fp_atan2(x, y))
+        FP_UNARY_CHECKED(Atanh, FP_CHECK(x <= Value_t(-1) || x >= Value_t(1)), 4, fp_atanh(x))
+        FP_UNARY(Cbrt, fp_cbrt(x))
+        FP_UNARY(Ceil, fp_ceil(x))
+        FP_UNARY(Cos, fp_cos(x))
+        FP_UNARY(Cosh, fp_cosh(x))
+        FP_UNARY_CHECKED(Cot, FP_CHECK(fp_tan(x) == Value_t(0)), 1, Value_t(1) / fp_tan(x))
+        FP_UNARY_CHECKED(Csc, FP_CHECK(fp_sin(x) == Value_t(0)), 1, Value_t(1) / fp_sin(x))
+        FP_UNARY(Exp, fp_exp(x))
+        FP_UNARY(Exp2, fp_exp2(x))
+        FP_UNARY(Floor, fp_floor(x))
+        FP_BINARY(Hypot, fp_hypot(x, y))
+        FP_UNARY(Int, fp_int(x))
+        FP_UNARY_CHECKED(Log, FP_CHECK(!(x > Value_t(0))), 3, fp_log(x))
+        FP_UNARY_CHECKED(Log10, FP_CHECK(!(x > Value_t(0))), 3, fp_log10(x))
+        FP_UNARY_CHECKED(Log2, FP_CHECK(!(x > Value_t(0))), 3, fp_log2(x))
+        FP_BINARY(Max, fp_max(x, y))
+        FP_BINARY(Min, fp_min(x, y))
+        FP_BINARY_CHECKED(Pow, FP_CHECK(x == Value_t(0) && y < Value_t(0)), 3, fp_pow(x, y))
+        FP_UNARY(Trunc, fp_trunc(x))
+        FP_UNARY_CHECKED(Sec, FP_CHECK(fp_cos(x) == Value_t(0)), 1, Value_t(1) / fp_cos(x))
+        FP_UNARY(Sin, fp_sin(x))
+        FP_UNARY(Sinh, fp_sinh(x))
+        FP_UNARY_CHECKED(Sqrt, FP_CHECK(x < Value_t(0)), 2, fp_sqrt(x))
+        FP_UNARY(Tan, fp_tan(x))
+        FP_UNARY(Tanh, fp_tanh(x))
+
+        FP_UNARY(Neg, -x)
+        FP_BINARY(Add, x + y)
+        FP_BINARY(Sub, x - y)
+        FP_BINARY(Mul, x * y)
+        FP_BINARY_CHECKED(Div, (FP_CHECK(true) || IsIntType<Value_t>::result) && y == Value_t(0), 1, x / y)
+        FP_BINARY_CHECKED(Mod, y == Value_t(0), 1, fp_mod(x, y))
+        FP_BINARY(Equal, fp_equal(x, y))
+        FP_BINARY(NEqual, fp_nequal(x, y))
+        FP_BINARY(Less, fp_less(x, y))
+        FP_BINARY(LessOrEq, fp_lessOrEq(x, y))
+        FP_UNARY(Not, fp_not(x))
+        FP_UNARY(NotNot, fp_notNot(x))
+        FP_BINARY(And, fp_and(x, y))
+        FP_BINARY(Or, fp_or(x, y))
+        FP_BINARY_CHECKED(Log2by, FP_CHECK(x <= Value_t(0)), 3, fp_log2(x) * y)
+        FP_UNARY(AbsNot, fp_absNot(x))
+        FP_UNARY(AbsNotNot, fp_absNotNot(x))
+        FP_BINARY(AbsAnd, fp_absAnd(x, y))
+        FP_BINARY(AbsOr, fp_absOr(x, y))
+        FP_UNARY_CHECKED(Inv, (FP_CHECK(true) || IsIntType<Value_t>::result) && x == Value_t(0), 1, Value_t(1) / x)
+        FP_UNARY(Sqr, x * x)
+        FP_UNARY_CHECKED(RSqrt, FP_CHECK(x == Value_t(0)), 1, Value_t(1) / fp_sqrt(x))
+        FP_UNARY(Move, x)
+
+#undef FP_UNARY
+#undef FP_UNARY_CHECKED
+#undef FP_BINARY
+#undef FP_BINARY_CHECKED
+#undef FP_CHECK
+
+        // dst gets sin(a), dst+1 cos(a)
+        static const Op* SinCos(const Op* op, Value_t* f, int&)
+        {
+            Value_t s, c;
+            fp_sinCos(s, c, f[op->a]);
+            f[op->dst] = s;
+            f[op->dst + 1] = c;
+            return op + 1;
+        }
+
+        // The parameters are in the registers from a on
+        static const Op* FCall(const Op* op, Value_t* f, int&)
+        {
+            f[op->dst] = op->func(&f[op->a]);
+            return op + 1;
+        }
+
+        static const Op* If(const Op* op, Value_t* f, int&)
+        {
+            return fp_truth(f[op->a]) ? op + 1 : op + op->jump;
+        }
+
+        static const Op* AbsIf(const Op* op, Value_t* f, int&)
+        {
+            return fp_absTruth(f[op->a]) ? op + 1 : op + op->jump;
+        }
+
+        static const Op* Jump(const Op* op, Value_t*, int&)
+        {
+            return op + op->jump;
+        }
+    };
+
+    /* Where a jump lands: the stack of locations there, and the
+       operations jumping to it, to be pointed at it once it is emitted.
+     */
+    struct JumpTarget
+    {
+        std::vector<unsigned> stack;
+        unsigned DP;
+        std::vector<size_t> jumps;
+    };
+
+    template<typename Value_t>
+    class Compiler
+    {
+    public:
+        typedef CompiledOp<Value_t> Op;
+        typedef typename Op::Handler Handler;
+
+        Compiler(std::vector<Op>& ops, unsigned regBase)
+            : ops(ops), regBase(regBase) { }
+
+        unsigned Reg(size_t pos) const { return regBase + unsigned(pos); }
+        bool IsReg(unsigned loc) const { return loc >= regBase; }
+
+        size_t Emit(Handler handler, unsigned dst, unsigned a = 0, unsigned b = 0)
+        {
+            Op op;
+            op.handler = handler;
+            op.dst = dst;
+            op.a = a;
+            op.b = b;
+            op.jump = 0;
+            op.func = 0;
+            ops.push_back(op);
+            return ops.size() - 1;
+        }
+
+        // Make the value at stack position pos live in its own register
+        void Materialize(size_t pos)
+        {
+            if(stack[pos] != Reg(pos))
+            {
+                Emit(Handlers<Value_t>::Move, Reg(pos), stack[pos]);
+                stack[pos] = Reg(pos);
+            }
+        }
+
+        void Unary(Handler handler)
+        {
+            const size_t pos = stack.size() - 1;
+            Emit(handler, Reg(pos), stack[pos]);
+            stack[pos] = Reg(pos);
+        }
+
+        void Binary(Handler handler, bool reversed = false)
+        {
+            const unsigned y = stack.back();
+            stack.pop_back();
+            const size_t pos = stack.size() - 1;
+            if(reversed)
+                Emit(handler, Reg(pos), y, stack[pos]);
+            else
+                Emit(handler, Reg(pos), stack[pos], y);
+            stack[pos] = Reg(pos);
+        }
+
+        // Jump from the op just emitted to the bytecode at IP
+        bool AddJump(unsigned IP, unsigned DP)
+        {
+            std::map<unsigned, JumpTarget>::iterator it = targets.find(IP);
+            if(it == targets.end())
+            {
+                JumpTarget& target = targets[IP];
+                target.stack = stack;
+                target.DP = DP;
+                target.jumps.push_back(ops.size() - 1);
+                return true;
+            }
+            if(it->second.stack != stack || it->second.DP != DP)
+                return false;
+            it->second.jumps.push_back(ops.size() - 1);
+            return true;
+        }
+
+        // Called before the bytecode at IP, tells if jumps land there
+        bool ArriveAt(unsigned IP, bool reachable, unsigned& DP)
+        {
+            std::map<unsigned, JumpTarget>::iterator it = targets.find(IP);
+            if(it == targets.end())
+                return reachable;
+
+            JumpTarget& target = it->second;
+            if(reachable)
+            {
+                // Both ways must leave the value in the same register
+                if(!stack.empty())
+                    Materialize(stack.size() - 1);
+                if(stack != target.stack || DP != target.DP)
+                    return false;
+            }
+            else
+            {
+                stack = target.stack;
+                DP = target.DP;
+            }
+
+            for(size_t i = 0; i < target.jumps.size(); ++i)
+                ops[target.jumps[i]].jump = int(ops.size() - target.jumps[i]);
+            targets.erase(it);
+            return true;
+        }
+
+        std::vector<unsigned> stack;
+        std::map<unsigned, JumpTarget> targets;
+
+    private:
+        std::vector<Op>& ops;
+        unsigned regBase;
+    };
+}
+
+template<typename Value_t>
+bool FunctionParserBase<Value_t>::Compile()
+{
+    typedef Handlers<Value_t> H;
+
+    CopyOnWrite();
+    data->Compiled.clear();
+    data->CompiledFrame.clear();
+    if(parseErrorType != FP_NO_ERROR) return false;
+
+    const std::vector<unsigned>& ByteCode = data->ByteCode;
+    const unsigned ByteCodeSize = unsigned(ByteCode.size());
+    const unsigned varBase = unsigned(data->Immed.size());
+    const unsigned regBase = varBase + data->numVariables;
+
+    std::vector<CompiledOp<Value_t> > ops;
+    Compiler<Value_t> c(ops, regBase);
+    std::vector<unsigned>& stack = c.stack;
+    unsigned DP = 0;
+    bool reachable = true;
+
+    for(unsigned IP = 0; IP < ByteCodeSize; ++IP)
+    {
+        // Gives up on code nothing leads to, and on jumps arriving with
+        // the values elsewhere than where the code falling through has them
+        if(!c.ArriveAt(IP, reachable, DP)) return false;
+        reachable = true;
+
+        const unsigned opcode = ByteCode[IP];
+        if(opcode >= VarBegin)
+        {
+            stack.push_back(varBase + (opcode - VarBegin));
+            continue;
+        }
+
+        switch(opcode)
+        {
+          case cImmed: stack.push_back(DP++); break;
+          case cDup: stack.push_back(stack.back()); break;
+          case cNop: break;
+
+          case cAbs: c.Unary(H::Abs); break;
+          case cAcos: c.Unary(H::Acos); break;
+          case cAcosh: c.Unary(H::Acosh); break;
+          case cAsin: c.Unary(H::Asin); break;
+          case cAsinh: c.Unary(H::Asinh); break;
+          case cAtan: c.Unary(H::Atan); break;
+          case cAtan2: c.Binary(H::Atan2); break;
+          case cAtanh: c.Unary(H::Atanh); break;
+          case cCbrt: c.Unary(H::Cbrt); break;
+          case cCeil: c.Unary(H::Ceil); break;
+          case cCos: c.Unary(H::Cos); break;
+          case cCosh: c.Unary(H::Cosh); break;
+          case cCot: c.Unary(H::Cot); break;
+          case cCsc: c.Unary(H::Csc); break;
+          case cExp: c.Unary(H::Exp); break;
+          case cExp2: c.Unary(H::Exp2); break;
+          case cFloor: c.Unary(H::Floor); break;
+          case cHypot: c.Binary(H::Hypot); break;
+          case cInt: c.Unary(H::Int); break;
+          case cLog: c.Unary(H::Log); break;
+          case cLog10: c.Unary(H::Log10); break;
+          case cLog2: c.Unary(H::Log2); break;
+          case cMax: c.Binary(H::Max); break;
+          case cMin: c.Binary(H::Min); break;
+          case cPow: c.Binary(H::Pow); break;
+          case cTrunc: c.Unary(H::Trunc); break;
+          case cSec: c.Unary(H::Sec); break;
+          case cSin: c.Unary(H::Sin); break;
+          case cSinh: c.Unary(H::Sinh); break;
+          case cSqrt: c.Unary(H::Sqrt); break;
+          case cTan: c.Unary(H::Tan); break;
+          case cTanh: c.Unary(H::Tanh); break;
+
+          case cNeg: c.Unary(H::Neg); break;
+          case cAdd: c.Binary(H::Add); break;
+          case cSub: c.Binary(H::Sub); break;
+          case cRSub: c.Binary(H::Sub, true); break;
+          case cMul: c.Binary(H::Mul); break;
+          case cDiv: c.Binary(H::Div); break;
+          case cRDiv: c.Binary(H::Div, true); break;
+          case cMod: c.Binary(H::Mod); break;
+          case cEqual: c.Binary(H::Equal); break;
+          case cNEqual: c.Binary(H::NEqual); break;
+          case cLess: c.Binary(H::Less); break;
+          case cLessOrEq: c.Binary(H::LessOrEq); break;
+          case cGreater: c.Binary(H::Less, true); break;
+          case cGreaterOrEq: c.Binary(H::LessOrEq, true); break;
+          case cNot: c.Unary(H::Not); break;
+          case cNotNot: c.Unary(H::NotNot); break;
+          case cAnd: c.Binary(H::And); break;
+          case cOr: c.Binary(H::Or); break;
+          case cAbsNot: c.Unary(H::AbsNot); break;
+          case cAbsNotNot: c.Unary(H::AbsNotNot); break;
+          case cAbsAnd: c.Binary(H::AbsAnd); break;
+          case cAbsOr: c.Binary(H::AbsOr); break;
+          case cInv: c.Unary(H::Inv); break;
+          case cSqr: c.Unary(H::Sqr); break;
+          case cRSqrt: c.Unary(H::RSqrt); break;
+
+          case cIf:
+          case cAbsIf:
+              {
+                  const unsigned cond = stack.back();
+                  stack.pop_back();
+                  c.Emit(opcode == cIf ? H::If : H::AbsIf, 0, cond);
+                  if(!c.AddJump(ByteCode[IP+1] + 1, ByteCode[IP+2]))
+                      return false;
+                  IP += 2;
+                  break;
+              }
+
+          case cJump:
+              if(!stack.empty())
+                  c.Materialize(stack.size() - 1);
+              c.Emit(H::Jump, 0);
+              if(!c.AddJump(ByteCode[IP+1] + 1, ByteCode[IP+2]))
+                  return false;
+              IP += 2;
+              reachable = false;
+              break;
+
+          case cFCall:
+              {
+                  const unsigned index = ByteCode[++IP];
+                  const unsigned params = data->FuncPtrs[index].params;
+                  const size_t first = stack.size() - params;
+                  for(size_t i = first; i < stack.size(); ++i)
+                      c.Materialize(i);
+                  const size_t op = c.Emit(H::FCall, c.Reg(first), c.Reg(first));
+                  ops[op].func = data->FuncPtrs[index].funcPtr;
+                  stack.resize(first + 1);
+                  stack[first] = c.Reg(first);
+                  break;
+              }
+
+#ifdef FP_SUPPORT_OPTIMIZER
+          case cFetch:
+              stack.push_back(stack[ByteCode[++IP]]);
+              break;
+
+          case cPopNMov:
+              {
+                  const unsigned target = ByteCode[++IP];
+                  const unsigned source = ByteCode[++IP];
+                  const unsigned loc = stack[source];
+                  stack.resize(target + 1);
+                  stack[target] = loc;
+                  // A register above the target will be written again
+                  if(c.IsReg(loc) && loc > c.Reg(target))
+                      c.Materialize(target);
+                  break;
+              }
+
+          case cLog2by: c.Binary(H::Log2by); break;
+
+          case cSinCos:
+              {
+                  const size_t pos = stack.size() - 1;
+                  c.Emit(H::SinCos, c.Reg(pos), stack[pos]);
+                  stack[pos] = c.Reg(pos);
+                  stack.push_back(c.Reg(pos + 1));
+                  break;
+              }
+#endif
+
+          default:
+              // eval(), calls to other parsers and degree conversion
+              // are left to Eval()
+              return false;
+        }
+    }
+
+    // Like Eval(), the result is what is on top, the optimizer may leave
+    // values it fetched from underneath
+    if(!c.ArriveAt(ByteCodeSize, reachable, DP) || !c.targets.empty()
+       || stack.empty())
+        return false;
+
+    data->CompiledFrame.assign(regBase + data->StackSize + 1, Value_t(0));
+    for(unsigned i = 0; i < varBase; ++i)
+        data->CompiledFrame[i] = data->Immed[i];
+    data->CompiledResult = stack.back();
+    data->Compiled.swap(ops);
+    return true;
+}
+
+template<typename Value_t>
+Value_t FunctionParserBase<Value_t>::EvalCompiled(const Value_t* Vars)
+{
+    if(data->CompiledFrame.empty()) return Eval(Vars);
+
+#ifdef FP_USE_THREAD_SAFE_EVAL
+    std::vector<Value_t> Frame(data->CompiledFrame);
+#else
+    std::vector<Value_t>& Frame = data->CompiledFrame;
+#endif
+
+    Value_t* const frame = &Frame[0];
+    const unsigned varBase = unsigned(data->Immed.size());
+    for(unsigned i = 0; i < data->numVariables; ++i)
+        frame[varBase + i] = Vars[i];
+
+    // Jumps past the last op land on end, errors return 0
+    const std::vector<CompiledOp<Value_t> >& Ops = data->Compiled;
+    const CompiledOp<Value_t>* op = Ops.empty() ? 0 : &Ops[0];
+    const CompiledOp<Value_t>* const end = op + Ops.size();
+    int error = 0;
+    while(op != end && (op = op->handler(op, frame, error)))
+        ;
+
+    evalErrorType = error;
+    return error ? Value_t(0) : frame[data->CompiledResult];
+}
+
+FUNCTIONPARSER_INSTANTIATE_TYPES
@@ -11253,6 +11253,8 @@ void FunctionParserBase<double>::Optimize()
 
     data->ByteCode.swap(byteCode);
     data->Immed.swap(immed);
+    data->Compiled.clear();
+    data->CompiledFrame.clear();
 
     //PrintByteCode(std::cout);
 }
@@ -225,6 +225,23 @@ namespace FUNCTIONPARSERTYPES
     };
 
     const unsigned FUNC_AMOUNT = sizeof(Functions)/sizeof(Functions[0]);
+
+    /* One operation of the compiled form of a function, see fpcompiled.cpp.
+       Operands are indices into a frame holding the immediates, the
+       variables and the stack. The handler runs the operation and returns
+       the next one, or 0 on an evaluation error.
+     */
+    template<typename Value_t>
+    struct CompiledOp
+    {
+        typedef const CompiledOp* (*Handler)(const CompiledOp*, Value_t*, int&);
+        typedef Value_t (*FunctionPtr)(const Value_t*);
+
+        Handler handler;
+        unsigned dst, a, b;
+        int jump;          // ops to advance by when jumping
+        FunctionPtr func;  // user defined function
+    };
 #endif // ONCE_FPARSER_H_
 }
 
@@ -262,6 +279,11 @@ struct FunctionParserBase<Value_t>::Data
 #endif
     unsigned StackSize;
 
+    // Compiled form, the frame is empty unless Compile() succeeded
+    std::vector<FUNCTIONPARSERTYPES::CompiledOp<Value_t> > Compiled;
+    std::vector<Value_t> CompiledFrame;
+    unsigned CompiledResult;
+
     Data();
     Data(const Data&);
     Data& operator=(const Data&); // not implemented on purpose